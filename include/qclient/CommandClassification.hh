@@ -0,0 +1,203 @@
+//------------------------------------------------------------------------------
+// File: CommandClassification.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_COMMAND_CLASSIFICATION_HH
+#define QCLIENT_COMMAND_CLASSIFICATION_HH
+
+#include <string_view>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+//! Does a command only read data, or may it also modify it?
+//------------------------------------------------------------------------------
+enum class CommandType {
+  kRead,
+  kWrite,
+  kUnknown   // not in the table - to be on the safe side, treat as a write
+};
+
+struct CommandClassification {
+  std::string_view name;
+  CommandType type;
+};
+
+//------------------------------------------------------------------------------
+//! Every command we know about, redis and QuarkDB-specific, in uppercase.
+//! Must stay sorted - it's binary searched, and checked at compile time.
+//------------------------------------------------------------------------------
+inline constexpr CommandClassification kCommandTable[] = {
+  { "APPEND",             CommandType::kWrite },
+  { "BITCOUNT",           CommandType::kRead  },
+  { "BITPOS",             CommandType::kRead  },
+  { "CONFIG-GET",         CommandType::kRead  },
+  { "CONFIG-GETALL",      CommandType::kRead  },
+  { "CONFIG-SET",         CommandType::kWrite },
+  { "DECR",               CommandType::kWrite },
+  { "DECRBY",             CommandType::kWrite },
+  { "DEL",                CommandType::kWrite },
+  { "DEQUE-CLEAR",        CommandType::kWrite },
+  { "DEQUE-LEN",          CommandType::kRead  },
+  { "DEQUE-POP-BACK",     CommandType::kWrite },
+  { "DEQUE-POP-FRONT",    CommandType::kWrite },
+  { "DEQUE-PUSH-BACK",    CommandType::kWrite },
+  { "DEQUE-PUSH-FRONT",   CommandType::kWrite },
+  { "DEQUE-SCAN-BACK",    CommandType::kRead  },
+  { "DEQUE-TRIM-FRONT",   CommandType::kWrite },
+  { "EXISTS",             CommandType::kRead  },
+  { "EXPIRE",             CommandType::kWrite },
+  { "GET",                CommandType::kRead  },
+  { "GETBIT",             CommandType::kRead  },
+  { "GETRANGE",           CommandType::kRead  },
+  { "GETSET",             CommandType::kWrite },
+  { "HCLONE",             CommandType::kWrite },
+  { "HDEL",               CommandType::kWrite },
+  { "HEXISTS",            CommandType::kRead  },
+  { "HGET",               CommandType::kRead  },
+  { "HGETALL",            CommandType::kRead  },
+  { "HINCRBY",            CommandType::kWrite },
+  { "HINCRBYFLOAT",       CommandType::kWrite },
+  { "HINCRBYMULTI",       CommandType::kWrite },
+  { "HKEYS",              CommandType::kRead  },
+  { "HLEN",               CommandType::kRead  },
+  { "HMGET",              CommandType::kRead  },
+  { "HMSET",              CommandType::kWrite },
+  { "HSCAN",              CommandType::kRead  },
+  { "HSET",               CommandType::kWrite },
+  { "HSETNX",             CommandType::kWrite },
+  { "HSTRLEN",            CommandType::kRead  },
+  { "HVALS",              CommandType::kRead  },
+  { "INCR",               CommandType::kWrite },
+  { "INCRBY",             CommandType::kWrite },
+  { "KEYS",               CommandType::kRead  },
+  { "LHDEL",              CommandType::kWrite },
+  { "LHGET",              CommandType::kRead  },
+  { "LHLEN",              CommandType::kRead  },
+  { "LHSCAN",             CommandType::kRead  },
+  { "LHSET",              CommandType::kWrite },
+  { "LINDEX",             CommandType::kRead  },
+  { "LLEN",               CommandType::kRead  },
+  { "LPOP",               CommandType::kWrite },
+  { "LPUSH",              CommandType::kWrite },
+  { "LRANGE",             CommandType::kRead  },
+  { "MGET",               CommandType::kRead  },
+  { "MSET",               CommandType::kWrite },
+  { "PERSIST",            CommandType::kWrite },
+  { "PEXPIRE",            CommandType::kWrite },
+  { "PTTL",               CommandType::kRead  },
+  { "RPOP",               CommandType::kWrite },
+  { "RPUSH",              CommandType::kWrite },
+  { "SADD",               CommandType::kWrite },
+  { "SCAN",               CommandType::kRead  },
+  { "SCARD",              CommandType::kRead  },
+  { "SET",                CommandType::kWrite },
+  { "SETBIT",             CommandType::kWrite },
+  { "SETEX",              CommandType::kWrite },
+  { "SETNX",              CommandType::kWrite },
+  { "SISMEMBER",          CommandType::kRead  },
+  { "SMEMBERS",           CommandType::kRead  },
+  { "SMISMEMBER",         CommandType::kRead  },
+  { "SMOVE",              CommandType::kWrite },
+  { "SPOP",               CommandType::kWrite },
+  { "SRANDMEMBER",        CommandType::kRead  },
+  { "SREM",               CommandType::kWrite },
+  { "SSCAN",              CommandType::kRead  },
+  { "STRLEN",             CommandType::kRead  },
+  { "TTL",                CommandType::kRead  },
+  { "TYPE",               CommandType::kRead  },
+  { "VHDEL",              CommandType::kWrite },
+  { "VHGETALL",           CommandType::kRead  },
+  { "VHLEN",              CommandType::kRead  },
+  { "VHSET",              CommandType::kWrite },
+  { "ZADD",               CommandType::kWrite },
+  { "ZCARD",              CommandType::kRead  },
+  { "ZCOUNT",             CommandType::kRead  },
+  { "ZINCRBY",            CommandType::kWrite },
+  { "ZRANGE",             CommandType::kRead  },
+  { "ZRANGEBYSCORE",      CommandType::kRead  },
+  { "ZRANK",              CommandType::kRead  },
+  { "ZREM",               CommandType::kWrite },
+  { "ZREVRANGE",          CommandType::kRead  },
+  { "ZREVRANK",           CommandType::kRead  },
+  { "ZSCAN",              CommandType::kRead  },
+  { "ZSCORE",             CommandType::kRead  }
+};
+
+//------------------------------------------------------------------------------
+//! Compare two command names, ignoring the case of the first - the second
+//! comes from the table, and is always uppercase.
+//------------------------------------------------------------------------------
+constexpr int compareCommandNames(std::string_view name, std::string_view upper) {
+  size_t len = name.size() < upper.size() ? name.size() : upper.size();
+
+  for(size_t i = 0; i < len; i++) {
+    char c = name[i];
+    if(c >= 'a' && c <= 'z') c = c - 'a' + 'A';
+
+    if(c != upper[i]) {
+      return c < upper[i] ? -1 : 1;
+    }
+  }
+
+  if(name.size() == upper.size()) return 0;
+  return name.size() < upper.size() ? -1 : 1;
+}
+
+constexpr bool isCommandTableSorted() {
+  for(size_t i = 1; i < sizeof(kCommandTable) / sizeof(kCommandTable[0]); i++) {
+    if(compareCommandNames(kCommandTable[i-1].name, kCommandTable[i].name) >= 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static_assert(isCommandTableSorted(), "kCommandTable must be sorted, without duplicates");
+
+//------------------------------------------------------------------------------
+//! Look up a command, case-insensitive.
+//------------------------------------------------------------------------------
+constexpr CommandType classifyCommand(std::string_view name) {
+  size_t low = 0;
+  size_t high = sizeof(kCommandTable) / sizeof(kCommandTable[0]);
+
+  while(low < high) {
+    size_t mid = low + (high - low) / 2;
+    int cmp = compareCommandNames(name, kCommandTable[mid].name);
+
+    if(cmp == 0) return kCommandTable[mid].type;
+    if(cmp < 0) high = mid;
+    else low = mid + 1;
+  }
+
+  return CommandType::kUnknown;
+}
+
+static_assert(classifyCommand("hget") == CommandType::kRead, "");
+static_assert(classifyCommand("HSET") == CommandType::kWrite, "");
+static_assert(classifyCommand("FLUSHALL") == CommandType::kUnknown, "");
+
+}
+
+#endif
@@ -24,11 +24,14 @@
 #ifndef QCLIENT_ENCODED_REQUEST_HH
 #define QCLIENT_ENCODED_REQUEST_HH
 
+#include "qclient/RequestBufferAllocator.hh"
 #include <memory>
 #include <vector>
 #include <deque>
 #include <string>
 #include <cstdint>
+#include <algorithm>
+#include <cstring>
 
 namespace qclient {
 
@@ -50,16 +53,88 @@ inline size_t toSize(const T& param) {
   return param.size();
 }
 
+//------------------------------------------------------------------------------
+// A ref-counted, immutable payload - an EncodedRequest can reference one
+// instead of copying it.
+//------------------------------------------------------------------------------
+using RequestPayload = std::shared_ptr<const std::string>;
+
+//------------------------------------------------------------------------------
+// A single argument of a zero-copy request: Either plain bytes which will be
+// copied, or a payload which may be referenced.
+//------------------------------------------------------------------------------
+struct RequestChunk {
+  const char *data;
+  size_t size;
+  const RequestPayload *payload;
+};
+
+inline RequestChunk toRequestChunk(const char *param) {
+  return RequestChunk { param, strlen(param), nullptr };
+}
+
+inline RequestChunk toRequestChunk(const std::string &param) {
+  return RequestChunk { param.data(), param.size(), nullptr };
+}
+
+inline RequestChunk toRequestChunk(const RequestPayload &param) {
+  return RequestChunk { param->data(), param->size(), &param };
+}
+
 //------------------------------------------------------------------------------
 // A class to represent an encoded redis request. Move-only type, it is not
 // possible to copy it, as there's no need to. This prevents accidental
 // inefficiencies.
+//
+// Small requests are stored inline, and never touch the heap. Larger ones
+// get their buffer from RequestBufferAllocator::getDefault(), and give it
+// back once destroyed - typically when the request has been acknowledged.
+//
+// A request can also be made of several segments: Encoded headers stored in
+// our buffer, interleaved with caller-provided payloads we hold a reference
+// to, see makeZeroCopy(). Such requests are written out with writev(),
+// without ever being materialised as one contiguous buffer.
+//
+// Note that moving an inline request changes the address of its buffer.
 //------------------------------------------------------------------------------
 class EncodedRequest {
 public:
+  static constexpr size_t kInlineCapacity = 128;
+
+  //----------------------------------------------------------------------------
+  // Payloads smaller than this are copied even by makeZeroCopy(), an extra
+  // iovec is not worth it.
+  //----------------------------------------------------------------------------
+  static constexpr size_t kZeroCopyThreshold = 4096;
+
+  //----------------------------------------------------------------------------
+  // Take ownership of a buffer allocated with malloc.
+  //----------------------------------------------------------------------------
   EncodedRequest(char* buff, size_t len) {
-    buffer.reset(buff);
+    buffer = buff;
     length = len;
+    bufferLength = len;
+    allocator = MallocBufferAllocator::instance();
+  }
+
+  EncodedRequest(EncodedRequest&& other) noexcept {
+    moveFrom(other);
+  }
+
+  EncodedRequest& operator=(EncodedRequest&& other) noexcept {
+    if(this != &other) {
+      release();
+      moveFrom(other);
+    }
+
+    return *this;
+  }
+
+  EncodedRequest(const EncodedRequest& other) = delete;
+  EncodedRequest& operator=(const EncodedRequest& other) = delete;
+
+  ~EncodedRequest() {
+    release();
   }
 
   EncodedRequest(size_t nchunks, const char** chunks, const size_t* sizes);
@@ -90,24 +165,95 @@ public:
     return EncodedRequest(size, cstr, sizes);
   }
 
+  //----------------------------------------------------------------------------
+  // Same as make(), but arguments given as RequestPayload are referenced
+  // instead of copied - they stay alive for as long as this request, or any
+  // request fused from it, does.
+  //----------------------------------------------------------------------------
+  template<typename... Args>
+  static EncodedRequest makeZeroCopy(const Args&... args) {
+    const RequestChunk chunks[] { toRequestChunk(args)... };
+
+    EncodedRequest retval;
+    retval.initFromRequestChunks(sizeof...(Args), chunks);
+    return retval;
+  }
+
+  //----------------------------------------------------------------------------
+  // Contiguous requests only - for segmented ones, this returns the encoded
+  // headers without the referenced payloads.
+  //----------------------------------------------------------------------------
   char* getBuffer() {
-    return buffer.get();
+    return buffer;
   }
 
   const char* getBuffer() const {
-    return buffer.get();
+    return buffer;
+  }
+
+  //----------------------------------------------------------------------------
+  // Is the entire request stored in a single buffer?
+  //----------------------------------------------------------------------------
+  bool isContiguous() const {
+    return segments.empty();
+  }
+
+  //----------------------------------------------------------------------------
+  // Access the request as a sequence of segments, to be written out
+  // back-to-back. A contiguous request has a single segment.
+  //----------------------------------------------------------------------------
+  size_t getSegmentCount() const {
+    return segments.empty() ? 1u : segments.size();
+  }
+
+  const char* getSegmentData(size_t i) const {
+    if(segments.empty()) return buffer;
+
+    const Segment &segment = segments[i];
+    if(segment.payload < 0) return buffer + segment.offset;
+    return payloads[segment.payload]->data() + segment.offset;
+  }
+
+  size_t getSegmentLength(size_t i) const {
+    if(segments.empty()) return length;
+    return segments[i].length;
+  }
+
+  //----------------------------------------------------------------------------
+  // Materialise the full request contents - for tests and debugging.
+  //----------------------------------------------------------------------------
+  std::string toString() const;
+
+  //----------------------------------------------------------------------------
+  // Is the buffer stored inside this object?
+  //----------------------------------------------------------------------------
+  bool isInline() const {
+    return buffer == inlineStorage;
   }
 
   size_t getLen() const {
     return length;
   }
 
+  //----------------------------------------------------------------------------
+  // Never send this request to a follower, even if it's a read eligible for
+  // follower routing - see Options::readRouting. For reads which must
+  // observe a write issued just before.
+  //----------------------------------------------------------------------------
+  void requireLeader() {
+    leaderOnly = true;
+  }
+
+  bool requiresLeader() const {
+    return leaderOnly;
+  }
+
   static EncodedRequest fuseIntoBlock(const std::deque<EncodedRequest> &block);
   static EncodedRequest fuseIntoBlockAndSurround(std::deque<EncodedRequest> &&block);
 
   bool operator==(const EncodedRequest &other) const {
     if(length != other.length) return false;
-    if(std::string(buffer.get(), length) != std::string(other.buffer.get(), other.length)) {
+    if(toString() != other.toString()) {
       return false;
     }
 
@@ -117,14 +263,89 @@ public:
   std::string toPrintableString() const;
 
 private:
+  EncodedRequest() {}
+
+  friend class PreparedCommand;
+
   void initFromChunks(size_t nchunks, const char** chunks, const size_t* sizes);
 
-  struct Deleter {
-    void operator()(char* b) { if(b) { free(b); } }
+  //----------------------------------------------------------------------------
+  // Copy the given, already encoded prefix, then append the chunks. The
+  // prefix must include the array header.
+  //----------------------------------------------------------------------------
+  void initFromPrefix(const char* prefix, size_t prefixLen, size_t nchunks,
+    const char** chunks, const size_t* sizes);
+  void initFromRequestChunks(size_t nchunks, const RequestChunk* chunks);
+
+  //----------------------------------------------------------------------------
+  // A range inside our buffer if payload is negative, or inside the given
+  // entry of payloads otherwise.
+  //----------------------------------------------------------------------------
+  struct Segment {
+    int64_t payload;
+    size_t offset;
+    size_t length;
   };
 
-  std::unique_ptr<char, Deleter> buffer;
-  size_t length;
+  //----------------------------------------------------------------------------
+  // Append a segment, merging consecutive buffer ranges.
+  //----------------------------------------------------------------------------
+  void addBufferSegment(size_t offset, size_t len);
+  void addPayloadSegment(const RequestPayload &payload, size_t offset, size_t len);
+
+  //----------------------------------------------------------------------------
+  // Point buffer to storage of at least len bytes, inline if possible.
+  //----------------------------------------------------------------------------
+  char* allocateBuffer(size_t len);
+
+  void release() {
+    if(allocator) {
+      allocator->deallocate(buffer, bufferLength);
+    }
+
+    buffer = nullptr;
+    allocator = nullptr;
+    length = 0;
+    bufferLength = 0;
+    segments.clear();
+    payloads.clear();
+  }
+
+  void moveFrom(EncodedRequest &other) {
+    length = other.length;
+    bufferLength = other.bufferLength;
+    allocator = other.allocator;
+
+    if(other.isInline()) {
+      std::copy(other.inlineStorage, other.inlineStorage + bufferLength, inlineStorage);
+      buffer = inlineStorage;
+    }
+    else {
+      buffer = other.buffer;
+    }
+
+    // Segments store offsets, not pointers - no fixup needed.
+    segments = std::move(other.segments);
+    payloads = std::move(other.payloads);
+    leaderOnly = other.leaderOnly;
+
+    other.buffer = nullptr;
+    other.allocator = nullptr;
+    other.length = 0;
+    other.bufferLength = 0;
+    other.segments.clear();
+    other.payloads.clear();
+    other.leaderOnly = false;
+  }
+
+  char* buffer = nullptr;
+  size_t length = 0;
+  size_t bufferLength = 0;
+  RequestBufferAllocator *allocator = nullptr;
+  std::vector<Segment> segments;
+  std::vector<RequestPayload> payloads;
+  bool leaderOnly = false;
+  char inlineStorage[kInlineCapacity];
 };
 
 }
@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// File: EventLoopGroup.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_EVENT_LOOP_GROUP_HH
+#define QCLIENT_EVENT_LOOP_GROUP_HH
+
+#include "qclient/Executor.hh"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace qclient {
+
+class EventLoop;
+
+//------------------------------------------------------------------------------
+//! A fixed number of epoll-based threads, shared between many QClient
+//! objects - see Options::eventLoopGroup. Each attached QClient is pinned to
+//! one of the threads, which then takes care of its socket, reconnections and
+//! writing out staged requests. No per-QClient reader and writer threads.
+//!
+//! DNS lookups may block for seconds, so they run on separate resolver
+//! threads instead: A slow resolver only holds up other lookups, never the
+//! sockets of the connections sharing a loop thread. With zero resolver
+//! threads, lookups run on the loop threads - fine if only a single QClient
+//! is attached.
+//!
+//! Must outlive all QClient objects attached to it.
+//------------------------------------------------------------------------------
+class EventLoopGroup {
+public:
+  EventLoopGroup(size_t threads, size_t resolverThreads = 1);
+  ~EventLoopGroup();
+
+  EventLoopGroup(const EventLoopGroup&) = delete;
+  void operator=(const EventLoopGroup&) = delete;
+
+  size_t getThreadCount() const {
+    return loops.size();
+  }
+
+  //----------------------------------------------------------------------------
+  //! Total number of times the threads woke up so far.
+  //----------------------------------------------------------------------------
+  uint64_t getIterations() const;
+
+  //----------------------------------------------------------------------------
+  //! Pick the thread to pin a new connection to - round-robin.
+  //----------------------------------------------------------------------------
+  EventLoop* pick();
+
+  //----------------------------------------------------------------------------
+  //! Where to run DNS lookups - nullptr means on the loop threads.
+  //----------------------------------------------------------------------------
+  Executor* getResolver() {
+    return resolver.get();
+  }
+
+private:
+  std::vector<std::unique_ptr<EventLoop>> loops;
+  std::atomic<size_t> nextLoop {0};
+  std::unique_ptr<WorkStealingExecutor> resolver;
+};
+
+}
+
+#endif
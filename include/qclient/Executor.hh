@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+// File: Executor.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_EXECUTOR_HH
+#define QCLIENT_EXECUTOR_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace qclient {
+
+class AssistedThread;
+class ThreadAssistant;
+
+//------------------------------------------------------------------------------
+//! Something which runs tasks, on threads of its own choosing. Plug one into
+//! Options::callbackExecutor to have QClient callbacks run there, instead of
+//! on a dedicated thread per QClient.
+//!
+//! Implementations may run tasks concurrently and in any order - QClient
+//! takes care of ordering, see CallbackOrdering. Every submitted task must
+//! eventually run, including ones still pending during destruction: QClient
+//! waits for its callbacks to complete before going away.
+//------------------------------------------------------------------------------
+class Executor {
+public:
+  virtual ~Executor() {}
+  virtual void execute(std::function<void()> &&task) = 0;
+};
+
+//------------------------------------------------------------------------------
+//! Ordering guarantees for callbacks running on an Executor.
+//------------------------------------------------------------------------------
+enum class CallbackOrdering {
+  //----------------------------------------------------------------------------
+  //! All callbacks of a QClient run one at a time, in the order replies
+  //! arrived - the same semantics as the default, dedicated thread.
+  //----------------------------------------------------------------------------
+  kStrictFifo,
+
+  //----------------------------------------------------------------------------
+  //! Callbacks are ordered per QCallback object: Replies destined for the
+  //! same object are delivered one at a time and in order, replies for
+  //! different objects may be delivered concurrently. A slow callback then
+  //! only holds back replies for itself.
+  //!
+  //! All futures returned by a QClient share a single internal callback
+  //! object, so they are still fulfilled in order.
+  //----------------------------------------------------------------------------
+  kPerCallback
+};
+
+//------------------------------------------------------------------------------
+//! A fixed-size thread pool, where each worker has a queue of its own. Idle
+//! workers steal from the others, so a worker stuck in a slow task doesn't
+//! hold up the tasks queued behind it. Meant to be shared between several
+//! QClient objects.
+//!
+//! The destructor runs all pending tasks before joining the workers.
+//------------------------------------------------------------------------------
+class WorkStealingExecutor : public Executor {
+public:
+  WorkStealingExecutor(size_t threads);
+  virtual ~WorkStealingExecutor();
+
+  virtual void execute(std::function<void()> &&task) override final;
+
+  size_t getThreadCount() const {
+    return workers.size();
+  }
+
+private:
+  struct Worker {
+    std::mutex mtx;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void main(size_t id, ThreadAssistant &assistant);
+  bool grabTask(size_t id, std::function<void()> &task);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::unique_ptr<AssistedThread>> threads;
+
+  std::atomic<size_t> nextWorker {0};
+  std::atomic<int64_t> queuedTasks {0};
+  std::atomic<int64_t> sleepers {0};
+
+  std::mutex sleepMtx;
+  std::condition_variable sleepCv;
+};
+
+}
+
+#endif
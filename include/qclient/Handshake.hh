@@ -161,6 +161,55 @@ public:
   virtual std::unique_ptr<Handshake> clone() const override final;
 };
 
+//------------------------------------------------------------------------------
+//! ActivateStaleReads handshake - send 'ACTIVATE-STALE-READS', expect OK.
+//! Lets a QuarkDB follower serve reads on this connection, instead of
+//! redirecting them to the leader.
+//!
+//! If ignoreFailure is set, a server which doesn't know the command is fine:
+//! Plain redis replicas serve reads anyway.
+//------------------------------------------------------------------------------
+class ActivateStaleReadsHandshake : public Handshake {
+public:
+  //----------------------------------------------------------------------------
+  //! Basic interface
+  //----------------------------------------------------------------------------
+  ActivateStaleReadsHandshake(bool ignoreFailure = false);
+  virtual ~ActivateStaleReadsHandshake();
+  virtual std::vector<std::string> provideHandshake() override final;
+  virtual Status validateResponse(const redisReplyPtr &reply) override final;
+  virtual void restart() override final;
+  virtual std::unique_ptr<Handshake> clone() const override final;
+
+private:
+  bool ignoreFailures;
+};
+
+//------------------------------------------------------------------------------
+//! Hello3 handshake - send 'HELLO 3', expect a map describing the server.
+//! Switches the connection to RESP3: maps, sets, doubles and friends arrive
+//! as their native types, and pub/sub messages as PUSH replies.
+//!
+//! Chain it in with Options::chainHandshake. If ignoreFailure is set, a
+//! server which doesn't speak RESP3 is fine, the connection simply stays on
+//! RESP2.
+//------------------------------------------------------------------------------
+class Hello3Handshake : public Handshake {
+public:
+  //----------------------------------------------------------------------------
+  //! Basic interface
+  //----------------------------------------------------------------------------
+  Hello3Handshake(bool ignoreFailure = false);
+  virtual ~Hello3Handshake();
+  virtual std::vector<std::string> provideHandshake() override final;
+  virtual Status validateResponse(const redisReplyPtr &reply) override final;
+  virtual void restart() override final;
+  virtual std::unique_ptr<Handshake> clone() const override final;
+
+private:
+  bool ignoreFailures;
+};
+
 //------------------------------------------------------------------------------
 //! SetClientName handshake - send 'CLIENT SETNAME', expect OK
 //------------------------------------------------------------------------------
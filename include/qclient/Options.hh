@@ -26,8 +26,11 @@
 
 #include <chrono>
 #include <memory>
+#include <algorithm>
 #include "TlsFilter.hh"
 #include "Handshake.hh"
+#include "Executor.hh"
+#include "EventLoopGroup.hh"
 
 namespace qclient {
 
@@ -183,6 +186,155 @@ private:
   std::chrono::seconds timeout {0};
 };
 
+//------------------------------------------------------------------------------
+//! This class specifies how aggressively the writer thread should coalesce
+//! pending requests.
+//!
+//! Under pipelined load, many small requests are staged before the writer
+//! thread gets a chance to run. Instead of issuing one send() per request,
+//! the writer can gather everything that's already staged and flush it with
+//! a single writev().
+//------------------------------------------------------------------------------
+class WriteCoalescingStrategy {
+public:
+
+  //----------------------------------------------------------------------------
+  //! Use this if unsure, should provide a reasonable default value.
+  //----------------------------------------------------------------------------
+  static WriteCoalescingStrategy Default() {
+    return WithLimits(512u, 1024 * 1024);
+  }
+
+  //----------------------------------------------------------------------------
+  //! Gather at most maxRequests requests, or maxBytes bytes, into a single
+  //! writev() call - whichever limit is hit first. maxRequests is capped at
+  //! IOV_MAX.
+  //----------------------------------------------------------------------------
+  static WriteCoalescingStrategy WithLimits(size_t maxRequests, size_t maxBytes) {
+    WriteCoalescingStrategy ret;
+    ret.requestLimit = maxRequests;
+    ret.byteLimit = maxBytes;
+    return ret;
+  }
+
+  //----------------------------------------------------------------------------
+  //! One request per send() call, like in the old days.
+  //----------------------------------------------------------------------------
+  static WriteCoalescingStrategy Disabled() {
+    return WithLimits(1u, 0u);
+  }
+
+  bool active() const {
+    return requestLimit > 1u;
+  }
+
+  size_t getRequestLimit() const {
+    return requestLimit;
+  }
+
+  size_t getByteLimit() const {
+    return byteLimit;
+  }
+
+private:
+  //----------------------------------------------------------------------------
+  //! Private constructor - use static methods above to create an object.
+  //----------------------------------------------------------------------------
+  WriteCoalescingStrategy() {}
+
+  size_t requestLimit = 1u;
+  size_t byteLimit = 0u;
+};
+
+//------------------------------------------------------------------------------
+//! This class specifies how the event loop receives bytes from the socket.
+//!
+//! Bytes are received directly into the buffer of the response parser. Each
+//! recv() asks for initialReadSize bytes at first; whenever a read fills the
+//! whole request, the next one asks for twice as much, up to maxReadSize.
+//! Reads which come back mostly empty halve the size again.
+//!
+//! Once all buffered responses have been parsed, a buffer with more than
+//! maxUnusedBuffer bytes of unused space is released, so that a single huge
+//! reply does not pin memory forever. Zero means never release.
+//------------------------------------------------------------------------------
+class ReceiveBufferStrategy {
+public:
+
+  //----------------------------------------------------------------------------
+  //! Use this if unsure, should provide a reasonable default value.
+  //----------------------------------------------------------------------------
+  static ReceiveBufferStrategy Default() {
+    return WithLimits(16 * 1024, 1024 * 1024, 16 * 1024);
+  }
+
+  //----------------------------------------------------------------------------
+  //! Specify all limits explicitly. initialReadSize is raised to at least
+  //! one byte, maxReadSize to at least initialReadSize.
+  //----------------------------------------------------------------------------
+  static ReceiveBufferStrategy WithLimits(size_t initialReadSize, size_t maxReadSize,
+    size_t maxUnusedBuffer) {
+    ReceiveBufferStrategy ret;
+    ret.initialReadSize = std::max<size_t>(1u, initialReadSize);
+    ret.maxReadSize = std::max(ret.initialReadSize, maxReadSize);
+    ret.maxUnusedBuffer = maxUnusedBuffer;
+    return ret;
+  }
+
+  size_t getInitialReadSize() const {
+    return initialReadSize;
+  }
+
+  size_t getMaxReadSize() const {
+    return maxReadSize;
+  }
+
+  size_t getMaxUnusedBuffer() const {
+    return maxUnusedBuffer;
+  }
+
+  //----------------------------------------------------------------------------
+  //! Given the size of the previous read and how many bytes it returned,
+  //! decide on the size of the next one.
+  //----------------------------------------------------------------------------
+  size_t nextReadSize(size_t readSize, size_t bytesRead) const {
+    if(bytesRead >= readSize) {
+      return std::min(readSize * 2, maxReadSize);
+    }
+
+    if(bytesRead < readSize / 4) {
+      return std::max(readSize / 2, initialReadSize);
+    }
+
+    return readSize;
+  }
+
+private:
+  //----------------------------------------------------------------------------
+  //! Private constructor - use static methods above to create an object.
+  //----------------------------------------------------------------------------
+  ReceiveBufferStrategy() {}
+
+  size_t initialReadSize = 1u;
+  size_t maxReadSize = 1u;
+  size_t maxUnusedBuffer = 0u;
+};
+
+//------------------------------------------------------------------------------
+//! How bytes are moved to and from the socket, see Options::transport.
+//------------------------------------------------------------------------------
+enum class TransportBackend {
+  kPoll,
+  kIoUring
+};
+
+//------------------------------------------------------------------------------
+//! Where reads may be served from, see Options::readRouting.
+//------------------------------------------------------------------------------
+enum class ReadRouting {
+  kLeaderOnly,
+  kFollowers
+};
 
 //------------------------------------------------------------------------------
 //! QClient Options class.
@@ -214,6 +366,170 @@ public:
   //----------------------------------------------------------------------------
   BackpressureStrategy backpressureStrategy = BackpressureStrategy::Default();
 
+  //----------------------------------------------------------------------------
+  //! Specifies how many staged requests the writer thread may flush onto the
+  //! socket with a single writev() call.
+  //!
+  //! Default is up to 512 requests, or 1 MB, per call.
+  //----------------------------------------------------------------------------
+  WriteCoalescingStrategy writeCoalescingStrategy = WriteCoalescingStrategy::Default();
+
+  //----------------------------------------------------------------------------
+  //! Specifies how many bytes to receive per recv() call, and when to release
+  //! unused receive buffer space.
+  //!
+  //! Default is to start at 16 KB per call, growing up to 1 MB, and to keep
+  //! at most 16 KB of unused buffer space around.
+  //----------------------------------------------------------------------------
+  ReceiveBufferStrategy receiveBufferStrategy = ReceiveBufferStrategy::Default();
+
+  //----------------------------------------------------------------------------
+  //! If enabled, each reply is allocated from a single arena: parsing it
+  //! takes a few allocations instead of one per node and string, and freeing
+  //! it is nearly free. The downside is that holding on to any part of a
+  //! large reply keeps all of it in memory - but redisReplyPtr only points to
+  //! whole replies anyway.
+  //!
+  //! Default is on.
+  //----------------------------------------------------------------------------
+  bool arenaAllocatedReplies = true;
+
+  //----------------------------------------------------------------------------
+  //! If enabled, large strings inside replies are not copied out of the
+  //! receive buffer - they point straight into it, and the buffer stays
+  //! alive for as long as any reply referencing it does. Saves a copy of
+  //! every large value, at the cost of holding on to entire receive buffers
+  //! while replies are alive. Implies arenaAllocatedReplies.
+  //!
+  //! Default is off.
+  //----------------------------------------------------------------------------
+  bool zeroCopyReplies = false;
+
+  //----------------------------------------------------------------------------
+  //! How many times should the writer and callback threads poll their queues
+  //! for new items, before going to sleep.
+  //!
+  //! Spinning trades CPU for latency: it avoids a sleep / wakeup round-trip
+  //! per request when requests trickle in one by one. Only worth enabling
+  //! if you have cores to spare.
+  //!
+  //! Default is zero, sleep immediately.
+  //----------------------------------------------------------------------------
+  size_t queueSpinIterations = 0u;
+
+  //----------------------------------------------------------------------------
+  //! If enabled, callbacks run directly on the thread reading responses off
+  //! the socket, instead of being handed over to a dedicated callback thread.
+  //! Saves a thread hop - a queue push, and potentially a wakeup - per reply.
+  //!
+  //! This applies to every reply, including the ones fulfilling futures. In
+  //! exchange, callbacks are subject to strict reentrancy constraints:
+  //!
+  //! - They must be short and never block. While a callback runs, no other
+  //!   reply is read for this QClient, and no other callback runs.
+  //! - They must never wait on a future or reply of the same QClient, such
+  //!   as calling .get() on a future returned by exec(): The reply can't
+  //!   arrive until the callback returns, so this deadlocks.
+  //! - They may stage new requests on the same QClient, as long as the
+  //!   backpressure strategy can't make staging block - an unbounded window
+  //!   is always fine.
+  //! - They must never destroy the QClient they're called from.
+  //! - During shutdown or when pending requests are discarded, callbacks
+  //!   receive nullptr on whichever thread triggered that, not necessarily
+  //!   the reader thread.
+  //!
+  //! Default is off.
+  //----------------------------------------------------------------------------
+  bool inlineCallbacks = false;
+
+  //----------------------------------------------------------------------------
+  //! Run callbacks on this executor, instead of a thread dedicated to this
+  //! QClient. Several QClient objects may share the same executor, such as a
+  //! WorkStealingExecutor. Ignored if inlineCallbacks is set.
+  //!
+  //! Default is nullptr, use a dedicated thread.
+  //----------------------------------------------------------------------------
+  std::shared_ptr<Executor> callbackExecutor;
+
+  //----------------------------------------------------------------------------
+  //! Ordering guarantees for callbacks running on callbackExecutor. The
+  //! dedicated callback thread is always strictly FIFO.
+  //!
+  //! Default is kStrictFifo.
+  //----------------------------------------------------------------------------
+  CallbackOrdering callbackOrdering = CallbackOrdering::kStrictFifo;
+
+  //----------------------------------------------------------------------------
+  //! Attach to this EventLoopGroup, instead of running a reader and a writer
+  //! thread dedicated to this QClient. The group must outlive the QClient.
+  //! DNS lookups run on the group's resolver threads, away from the loop.
+  //!
+  //! Callbacks still run on a dedicated thread by default - combine with a
+  //! shared callbackExecutor, or inlineCallbacks, to get rid of that too.
+  //! Inline callbacks then run on the group's threads, and hold up every
+  //! other QClient pinned to the same thread while they run.
+  //!
+  //! Default is nullptr, use dedicated threads.
+  //----------------------------------------------------------------------------
+  std::shared_ptr<EventLoopGroup> eventLoopGroup;
+
+  //----------------------------------------------------------------------------
+  //! If enabled, a single thread owns the socket: It alternates between
+  //! writing out staged requests and reading replies, waiting for either
+  //! with a single epoll set. Saves a thread, and the cache line ping-pong
+  //! between reader and writer - ideal for clients issuing requests at a low
+  //! rate. Under a heavy pipelined load, the dedicated writer thread can
+  //! achieve better throughput.
+  //!
+  //! The same as attaching to a private EventLoopGroup with one thread.
+  //! Ignored if eventLoopGroup is set.
+  //!
+  //! Default is off.
+  //----------------------------------------------------------------------------
+  bool singleThreadedConnection = false;
+
+  //----------------------------------------------------------------------------
+  //! How the reader and writer threads talk to the socket. kPoll waits with
+  //! poll(), then calls recv() / writev().
+  //!
+  //! kIoUring keeps a multishot recv armed on the socket, receiving into
+  //! buffers registered with the kernel, and sends each batch as a single
+  //! sendmsg linked to a timeout. Under load, each wakeup of the reader
+  //! picks up many replies with a single syscall. Needs Linux 5.19 or newer;
+  //! falls back to kPoll with a warning if io_uring is unavailable or
+  //! disabled.
+  //!
+  //! Ignored if eventLoopGroup or singleThreadedConnection is set.
+  //!
+  //! Default is kPoll.
+  //----------------------------------------------------------------------------
+  TransportBackend transport = TransportBackend::kPoll;
+
+  //----------------------------------------------------------------------------
+  //! With kFollowers, QClient keeps an extra connection to every member, and
+  //! sends read-only commands to the ones not currently leading - see
+  //! CommandClassification.hh for which commands qualify. Replies may be
+  //! stale: A read might not observe a write acknowledged just before. Mark
+  //! such reads with EncodedRequest::requireLeader().
+  //!
+  //! Follower connections run ACTIVATE-STALE-READS on top of the handshake,
+  //! so that QuarkDB followers serve reads instead of redirecting them. A
+  //! read which fails on a follower - connection error, redirect, or
+  //! unavailable - is re-issued towards the leader, and the follower is
+  //! avoided for a while.
+  //!
+  //! Only requests with a callback of their own are routed: futures,
+  //! pooledExecute, typed execute<T>, coroutines, and executeUnordered. A
+  //! routed reply arrives on a thread of the follower connection, possibly
+  //! before replies to earlier requests. Callbacks passed to execute or
+  //! executeStreaming keep seeing their replies in order, one at a time, so
+  //! those requests always go to the leader - as do batches and MULTI
+  //! blocks. Ignored with a single member.
+  //!
+  //! Default is kLeaderOnly.
+  //----------------------------------------------------------------------------
+  ReadRouting readRouting = ReadRouting::kLeaderOnly;
+
   //----------------------------------------------------------------------------
   //! Specifies whether to use TLS - default is off.
   //----------------------------------------------------------------------------
@@ -277,6 +593,13 @@ public:
   //----------------------------------------------------------------------------
   std::shared_ptr<QPerfCallback> mPerfCb;
 
+  //----------------------------------------------------------------------------
+  //! Make an independent copy: Everything shared_ptr is shared, the handshake
+  //! is cloned. Handy when opening several connections with the same
+  //! configuration, see QClientPool.
+  //----------------------------------------------------------------------------
+  Options clone() const;
+
   //----------------------------------------------------------------------------
   //! Fluent interface: Chain a handshake. Explicit transfer of ownership to
   //! this object.
@@ -312,6 +635,57 @@ public:
   //! Fluent interface: Setting retry strategy
   //----------------------------------------------------------------------------
   qclient::Options& withRetryStrategy(const RetryStrategy& str);
+
+  //----------------------------------------------------------------------------
+  //! Fluent interface: Setting write coalescing strategy
+  //----------------------------------------------------------------------------
+  qclient::Options& withWriteCoalescingStrategy(const WriteCoalescingStrategy& str);
+
+  //----------------------------------------------------------------------------
+  //! Fluent interface: Poll internal queues this many times before sleeping
+  //----------------------------------------------------------------------------
+  qclient::Options& withQueueSpinning(size_t iterations);
+
+  //----------------------------------------------------------------------------
+  //! Fluent interface: Run callbacks on the reader thread. Read the
+  //! reentrancy constraints of inlineCallbacks first!
+  //----------------------------------------------------------------------------
+  qclient::Options& withInlineCallbacks();
+
+  //----------------------------------------------------------------------------
+  //! Fluent interface: Run callbacks on the given executor
+  //----------------------------------------------------------------------------
+  qclient::Options& withCallbackExecutor(std::shared_ptr<Executor> executor);
+
+  //----------------------------------------------------------------------------
+  //! Fluent interface: Setting callback ordering, see CallbackOrdering
+  //----------------------------------------------------------------------------
+  qclient::Options& withCallbackOrdering(CallbackOrdering ordering);
+
+  //----------------------------------------------------------------------------
+  //! Fluent interface: Attach to the given EventLoopGroup
+  //----------------------------------------------------------------------------
+  qclient::Options& withEventLoopGroup(std::shared_ptr<EventLoopGroup> group);
+
+  //----------------------------------------------------------------------------
+  //! Fluent interface: Read and write on the same thread
+  //----------------------------------------------------------------------------
+  qclient::Options& withSingleThreadedConnection();
+
+  //----------------------------------------------------------------------------
+  //! Fluent interface: Talk to the socket through io_uring
+  //----------------------------------------------------------------------------
+  qclient::Options& withIoUringTransport();
+
+  //----------------------------------------------------------------------------
+  //! Fluent interface: Send eligible reads to followers
+  //----------------------------------------------------------------------------
+  qclient::Options& withFollowerReads();
+
+  //----------------------------------------------------------------------------
+  //! Fluent interface: Setting receive buffer strategy
+  //----------------------------------------------------------------------------
+  qclient::Options& withReceiveBufferStrategy(const ReceiveBufferStrategy& str);
 };
 
 //------------------------------------------------------------------------------
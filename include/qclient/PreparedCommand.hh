@@ -0,0 +1,81 @@
+//------------------------------------------------------------------------------
+// File: PreparedCommand.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_PREPARED_COMMAND_HH
+#define QCLIENT_PREPARED_COMMAND_HH
+
+#include "qclient/EncodedRequest.hh"
+#include <initializer_list>
+#include <string>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// A command whose leading arguments never change, followed by a fixed number
+// of variable arguments. The array header and the leading arguments are
+// encoded only once, when constructing the object - encoding a request then
+// only needs to append the variable arguments:
+//
+//   static const PreparedCommand hset({"HSET"}, 3);
+//   qcl.execute(hset.encode(key, field, value));
+//
+// Passing a different number of variable arguments than declared is allowed,
+// but the array header then has to be formatted on every call.
+//
+// Immutable once constructed, safe to share between threads.
+//------------------------------------------------------------------------------
+class PreparedCommand {
+public:
+  PreparedCommand(std::initializer_list<std::string> fixedArgs, size_t variableArgs);
+
+  template<typename... Args>
+  EncodedRequest encode(const Args&... args) const {
+    const char* cstr[sizeof...(Args) + 1] { toCharPointer(args)... };
+    size_t sizes[sizeof...(Args) + 1] { toSize(args)... };
+
+    return encodeChunks(sizeof...(Args), cstr, sizes);
+  }
+
+  EncodedRequest encodeChunks(size_t nchunks, const char** chunks, const size_t* sizes) const;
+
+  size_t getFixedArgs() const {
+    return fixedArgs;
+  }
+
+  size_t getVariableArgs() const {
+    return variableArgs;
+  }
+
+private:
+  size_t fixedArgs;
+  size_t variableArgs;
+
+  // Array header for fixedArgs + variableArgs arguments, followed by the
+  // encoded fixed arguments.
+  std::string prefix;
+  size_t headerLength;
+};
+
+}
+
+#endif
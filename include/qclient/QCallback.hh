@@ -38,6 +38,61 @@ public:
   virtual void handleResponse(redisReplyPtr &&reply) = 0;
 };
 
+//------------------------------------------------------------------------------
+// A callback which receives its reply piece by piece, as bytes arrive from
+// the network, instead of as a fully buffered tree. Meant for huge replies,
+// such as multi-GB strings or scan pages with millions of elements: memory
+// usage stays bounded, and processing can start before the last byte
+// arrives.
+//
+// Only top-level bulk strings and aggregates (arrays, and RESP3 maps and sets)
+// are streamed. Any other reply (errors, integers, nil, ...) goes straight to
+// handleResponse, as usual.
+//
+// The streaming functions are called from the event loop thread, and must
+// not block. The data they receive is only valid during the call.
+//
+// Once a streamed reply has been fully received, handleResponse is called
+// with a reply of the same type, but with its contents stripped: an empty
+// string, array, map or set. Should the connection drop midway, the reply
+// may be streamed again from the start, once the request is retried.
+//------------------------------------------------------------------------------
+class QStreamingCallback : public QCallback {
+public:
+  QStreamingCallback() {}
+  virtual ~QStreamingCallback() {}
+
+  //----------------------------------------------------------------------------
+  // An array begins at the given depth - the top-level reply has depth 0.
+  // Its elements follow, at depth + 1.
+  //----------------------------------------------------------------------------
+  virtual void handleArray(size_t depth, size_t elements) = 0;
+
+  //----------------------------------------------------------------------------
+  // Same as handleArray, for any aggregate type: REDIS_REPLY_ARRAY, _MAP or
+  // _SET. The keys and values of a map are streamed interleaved, as elements
+  // in their own right: elements is twice the number of entries. Override to
+  // tell the types apart - by default, they're all handed to handleArray.
+  //----------------------------------------------------------------------------
+  virtual void handleAggregate(size_t depth, int type, size_t elements) {
+    handleArray(depth, elements);
+  }
+
+  //----------------------------------------------------------------------------
+  // A chunk of a bulk string at the given depth. Chunks arrive in order, the
+  // string is complete once offset + len == total. An empty string produces
+  // a single, empty chunk.
+  //----------------------------------------------------------------------------
+  virtual void handleStringChunk(size_t depth, const char *data, size_t len,
+    size_t offset, size_t total) = 0;
+
+  //----------------------------------------------------------------------------
+  // Any other element inside a streamed array: integers, nils, status
+  // replies, errors - these are delivered whole.
+  //----------------------------------------------------------------------------
+  virtual void handleElement(size_t depth, redisReplyPtr &&reply) = 0;
+};
+
   //----------------------------------------------------------------------------
   //! QClient performance measurement callback
   //----------------------------------------------------------------------------
@@ -40,11 +40,15 @@
 #include "qclient/Options.hh"
 #include "qclient/Handshake.hh"
 #include "qclient/EncodedRequest.hh"
+#include "qclient/PreparedCommand.hh"
 #include "qclient/ResponseBuilder.hh"
 #include "qclient/AssistedThread.hh"
 #include "qclient/FaultInjector.hh"
 #include "qclient/ReconnectionListener.hh"
 #include "qclient/Status.hh"
+#include "qclient/TypedDecoder.hh"
+#include "qclient/ReplyFuture.hh"
+#include "qclient/Task.hh"
 
 #if HAVE_FOLLY == 1
 #include <folly/futures/Future.h>
@@ -66,9 +70,11 @@ namespace qclient
   class QCallback;
   class NetworkStream;
   class WriterThread;
+  class LoopConnection;
   class ConnectionCore;
   class EndpointDecider;
   class HostResolver;
+  class ReadRouter;
 
 //------------------------------------------------------------------------------
 //! Describe a redisReplyPtr, in a format similar to what redis-cli would give.
@@ -112,10 +118,68 @@ public:
   //----------------------------------------------------------------------------
   std::future<redisReplyPtr> execute(EncodedRequest &&req);
   void execute(QCallback *callback, EncodedRequest &&req);
+
+  //----------------------------------------------------------------------------
+  //! Same as execute, but returns a ReplyFuture - cheaper than std::future,
+  //! ideal for synchronous calls which wait for the reply right away.
+  //----------------------------------------------------------------------------
+  ReplyFuture pooledExecute(EncodedRequest &&req);
 #if HAVE_FOLLY == 1
   folly::Future<redisReplyPtr> follyExecute(EncodedRequest &&req);
 #endif
 
+  //----------------------------------------------------------------------------
+  //! Pipeline multiple independent commands in one go. This is equivalent to
+  //! calling execute() on each request in turn, but much cheaper: backpressure
+  //! slots are reserved in bulk, and all requests are staged under a single
+  //! lock, with a single wakeup of the writer thread.
+  //!
+  //! Unlike a MULTI block, there's no atomicity - the requests are simply
+  //! sent back-to-back.
+  //!
+  //! The future version returns all replies at once, in order. The callback
+  //! version invokes the callback once per request, in order.
+  //----------------------------------------------------------------------------
+  std::future<std::vector<redisReplyPtr>> executeBatch(std::vector<EncodedRequest> &&reqs);
+  void executeBatch(QCallback *callback, std::vector<EncodedRequest> &&reqs);
+
+  //----------------------------------------------------------------------------
+  //! Execute a command whose reply may be too large to comfortably buffer in
+  //! full, such as a huge string or scan page: bulk strings and arrays are
+  //! handed to the callback piece by piece, as they arrive. See
+  //! QStreamingCallback.
+  //----------------------------------------------------------------------------
+  void executeStreaming(QStreamingCallback *callback, EncodedRequest &&req);
+
+  //----------------------------------------------------------------------------
+  //! Same as execute / executeStreaming with a callback, for a callback
+  //! dedicated to this one request - a promise, decoder or coroutine awaiter.
+  //!
+  //! Only these may be served by a follower, see Options::readRouting. The
+  //! reply then arrives on a thread of the follower connection, and may
+  //! overtake, or run concurrently with, replies to earlier requests. A
+  //! callback shared between requests must go through execute instead,
+  //! which always delivers its replies in order, one at a time.
+  //----------------------------------------------------------------------------
+  void executeUnordered(QCallback *callback, EncodedRequest &&req);
+  void executeStreamingUnordered(QStreamingCallback *callback, EncodedRequest &&req);
+
+  //----------------------------------------------------------------------------
+  //! Execute a command, and decode its reply straight into T, without
+  //! building an intermediate redisReply tree. Supported types: std::string,
+  //! integers, and vectors / sets / maps of strings - see TypedDecoder.hh.
+  //!
+  //! Errors are reported with the same wording as the parsers in
+  //! ResponseParsing.hh.
+  //----------------------------------------------------------------------------
+  template<typename T>
+  std::future<TypedResponse<T>> execute(EncodedRequest &&req) {
+    TypedDecoder<T> *decoder = new TypedDecoder<T>();
+    std::future<TypedResponse<T>> fut = decoder->getFuture();
+    executeStreamingUnordered(decoder, std::move(req));
+    return fut;
+  }
+
   //----------------------------------------------------------------------------
   //! Execute multiple commands in a MULTI / EXEC transaction. Retries will
   //! work as expected: If the connection dies in the middle, the whole block
@@ -172,6 +236,45 @@ public:
     return this->execute(EncodedRequest::make(args...));
   }
 
+  //----------------------------------------------------------------------------
+  // Same as the above, but the leading arguments come pre-encoded from the
+  // given PreparedCommand - only args are encoded on each call.
+  //----------------------------------------------------------------------------
+  template<typename... Args>
+  std::future<redisReplyPtr> exec(const PreparedCommand &cmd, const Args&... args) {
+    return this->execute(cmd.encode(args...));
+  }
+
+#if QCLIENT_HAVE_COROUTINES == 1
+  //----------------------------------------------------------------------------
+  //! co_await the result to get the reply, such as:
+  //!   redisReplyPtr reply = co_await qcl.coExec("HGET", key, field);
+  //!
+  //! See RequestAwaiter for where the coroutine resumes.
+  //----------------------------------------------------------------------------
+  RequestAwaiter<QClient> coExecute(EncodedRequest &&req) {
+    return RequestAwaiter<QClient>(*this, std::move(req));
+  }
+
+  template<typename... Args>
+  RequestAwaiter<QClient> coExec(const Args&... args) {
+    return coExecute(EncodedRequest::make(args...));
+  }
+#endif
+
+  //----------------------------------------------------------------------------
+  // The same as the above, but return a ReplyFuture - see pooledExecute.
+  //----------------------------------------------------------------------------
+  template<typename... Args>
+  ReplyFuture pooledExec(const Args&... args) {
+    return this->pooledExecute(EncodedRequest::make(args...));
+  }
+
+  template<typename... Args>
+  ReplyFuture pooledExec(const PreparedCommand &cmd, const Args&... args) {
+    return this->pooledExecute(cmd.encode(args...));
+  }
+
   //----------------------------------------------------------------------------
   // The same as the above, but takes a callback instead of return a future.
   // Different name, as overloading with a variadic template is a bad idea.
@@ -231,6 +334,13 @@ public:
   //----------------------------------------------------------------------------
   bool detachListener(ReconnectionListener *listener);
 
+  //----------------------------------------------------------------------------
+  //! Number of requests staged, which have not received a reply yet - both
+  //! the ones written out already, and the ones still waiting to be. Only a
+  //! snapshot, while other threads are staging requests.
+  //----------------------------------------------------------------------------
+  size_t getPendingRequests() const;
+
   //----------------------------------------------------------------------------
   //! Check whether we're currently connected by sending a PING -- synchronous
   //! operation with the given timeout.
@@ -256,11 +366,15 @@ private:
   void connect();
   bool handleConnectionEpoch(ThreadAssistant &assistant);
   bool shouldPurgePendingRequests();
+  void purgePendingRequests(bool shutdown);
+  bool getRetryDeadline(std::chrono::steady_clock::time_point &deadline);
   ResponseBuilder responseBuilder;
   int64_t currentConnectionEpoch = 0u;
 
   void cleanup(bool shutdown);
+  void teardownConnection();
   bool feed(const char* buf, size_t len);
+  bool processResponses();
   void connectTCP();
   void notifyConnectionLost(int errc, const std::string &err);
   void notifyConnectionEstablished();
@@ -269,11 +383,20 @@ private:
   EventFD shutdownEventFD;
   std::unique_ptr<WriterThread> writerThread;
 
+  // Only when attached to an EventLoopGroup: Takes the place of
+  // eventLoopThread, and of the thread inside writerThread.
+  std::unique_ptr<LoopConnection> loopConnection;
+
+  // Only with Options::readRouting set to kFollowers: Connections to every
+  // member, serving eligible reads.
+  std::unique_ptr<ReadRouter> readRouter;
+
   void processRedirection();
   AssistedThread eventLoopThread;
   FaultInjector faultInjector;
 
   friend class FaultInjector;
+  friend class LoopConnection;
 
   std::unique_ptr<HostResolver> hostResolver;
 
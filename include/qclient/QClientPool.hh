@@ -0,0 +1,243 @@
+//------------------------------------------------------------------------------
+// File: QClientPool.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_QCLIENT_POOL_HH
+#define QCLIENT_QCLIENT_POOL_HH
+
+#include "qclient/QClient.hh"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+//! How QClientPool picks a connection for each request.
+//------------------------------------------------------------------------------
+enum class PoolRouting {
+  //----------------------------------------------------------------------------
+  //! Each connection in turn. Cheapest, and even enough when requests are
+  //! all roughly the same size.
+  //----------------------------------------------------------------------------
+  kRoundRobin,
+
+  //----------------------------------------------------------------------------
+  //! The connection with the fewest requests awaiting a reply. Steers new
+  //! requests away from a connection stuck behind a huge reply.
+  //----------------------------------------------------------------------------
+  kLeastOutstanding,
+
+  //----------------------------------------------------------------------------
+  //! By hash of the key, taken to be the first argument after the command
+  //! name. All requests on the same key go through the same connection, so
+  //! they're executed in the order they were issued, same as with a single
+  //! QClient. Requests without any arguments are spread round-robin.
+  //----------------------------------------------------------------------------
+  kKeyHash
+};
+
+//------------------------------------------------------------------------------
+//! Several QClient connections towards the same cluster, behind the same
+//! execute / exec interface as a single QClient.
+//!
+//! A single QClient means a single socket, and a single thread parsing
+//! replies - a large reply holds up every request behind it. Spreading
+//! requests over several connections lifts both limits, at the cost of
+//! ordering: Unless routing is kKeyHash, two requests issued back-to-back
+//! may well execute in the opposite order.
+//!
+//! Callbacks passed to execute, executeStreaming or executeBatch are the
+//! exception: Unless routing is kKeyHash, all requests for the same callback
+//! object go through the same connection, so it receives its replies in
+//! order and one at a time, same as with a single QClient. With kKeyHash,
+//! the key wins - a callback shared by requests on different keys may be
+//! called concurrently, and out of order. The unordered variants spread
+//! requests regardless, see QClient::executeUnordered.
+//!
+//! Every connection gets its own copy of the given Options - the handshake
+//! is cloned, while TLS configuration, logger, executors and event loop
+//! group are shared.
+//!
+//! A MULTI block always goes through a single connection, as a whole. Not
+//! meant for pub/sub: use a plain QClient, or Subscriber.
+//------------------------------------------------------------------------------
+class QClientPool {
+public:
+  //----------------------------------------------------------------------------
+  //! Constructor taking simple host and port
+  //----------------------------------------------------------------------------
+  QClientPool(const std::string &host, int port, size_t connections,
+    Options &&options, PoolRouting routing = PoolRouting::kRoundRobin);
+
+  //----------------------------------------------------------------------------
+  //! Constructor taking a list of members for the cluster
+  //----------------------------------------------------------------------------
+  QClientPool(const Members &members, size_t connections,
+    Options &&options, PoolRouting routing = PoolRouting::kRoundRobin);
+
+  //----------------------------------------------------------------------------
+  //! Destructor
+  //----------------------------------------------------------------------------
+  ~QClientPool();
+
+  //----------------------------------------------------------------------------
+  //! Disallow copy and assign
+  //----------------------------------------------------------------------------
+  QClientPool(const QClientPool&) = delete;
+  void operator=(const QClientPool&) = delete;
+
+  //----------------------------------------------------------------------------
+  //! Number of connections in the pool
+  //----------------------------------------------------------------------------
+  size_t size() const;
+
+  //----------------------------------------------------------------------------
+  //! Access a single connection directly, to pin a sequence of requests to
+  //! it. index must be smaller than size().
+  //----------------------------------------------------------------------------
+  QClient& getConnection(size_t index);
+
+  //----------------------------------------------------------------------------
+  //! The connection the given request would be routed to.
+  //----------------------------------------------------------------------------
+  QClient& pick(const EncodedRequest &req);
+
+  //----------------------------------------------------------------------------
+  //! Hash the key of the given request - the first argument after the
+  //! command name. Returns false if there's no such argument.
+  //----------------------------------------------------------------------------
+  static bool hashKey(const EncodedRequest &req, uint64_t &hash);
+
+  //----------------------------------------------------------------------------
+  //! Same as QClient::execute, on the connection picked by the routing
+  //! policy.
+  //----------------------------------------------------------------------------
+  std::future<redisReplyPtr> execute(EncodedRequest &&req);
+  void execute(QCallback *callback, EncodedRequest &&req);
+  ReplyFuture pooledExecute(EncodedRequest &&req);
+  void executeStreaming(QStreamingCallback *callback, EncodedRequest &&req);
+  void executeUnordered(QCallback *callback, EncodedRequest &&req);
+  void executeStreamingUnordered(QStreamingCallback *callback, EncodedRequest &&req);
+
+  //----------------------------------------------------------------------------
+  //! Pipeline a batch of independent requests. With kKeyHash, the batch is
+  //! split up by key - each part staged in one go on its own connection -
+  //! and replies are still delivered in the order of the requests. With any
+  //! other routing, the whole batch goes through a single connection.
+  //----------------------------------------------------------------------------
+  std::future<std::vector<redisReplyPtr>> executeBatch(std::vector<EncodedRequest> &&reqs);
+  void executeBatch(QCallback *callback, std::vector<EncodedRequest> &&reqs);
+
+  //----------------------------------------------------------------------------
+  //! Execute a MULTI block, on a single connection. With kKeyHash, the
+  //! connection is picked by the key of the first request in the block.
+  //----------------------------------------------------------------------------
+  std::future<redisReplyPtr> execute(std::deque<EncodedRequest> &&reqs);
+  void execute(QCallback *callback, std::deque<EncodedRequest> &&reqs);
+
+  //----------------------------------------------------------------------------
+  //! Typed execute, see QClient::execute<T>.
+  //----------------------------------------------------------------------------
+  template<typename T>
+  std::future<TypedResponse<T>> execute(EncodedRequest &&req) {
+    TypedDecoder<T> *decoder = new TypedDecoder<T>();
+    std::future<TypedResponse<T>> fut = decoder->getFuture();
+    executeStreamingUnordered(decoder, std::move(req));
+    return fut;
+  }
+
+  template<typename T>
+  std::future<redisReplyPtr> execute(const T& container) {
+    return execute(EncodedRequest(container));
+  }
+
+  template<typename T>
+  void execute(QCallback *callback, const T& container) {
+    return execute(callback, EncodedRequest(container));
+  }
+
+  template<typename... Args>
+  std::future<redisReplyPtr> exec(const Args&... args) {
+    return this->execute(EncodedRequest::make(args...));
+  }
+
+  template<typename... Args>
+  std::future<redisReplyPtr> exec(const PreparedCommand &cmd, const Args&... args) {
+    return this->execute(cmd.encode(args...));
+  }
+
+#if QCLIENT_HAVE_COROUTINES == 1
+  RequestAwaiter<QClientPool> coExecute(EncodedRequest &&req) {
+    return RequestAwaiter<QClientPool>(*this, std::move(req));
+  }
+
+  template<typename... Args>
+  RequestAwaiter<QClientPool> coExec(const Args&... args) {
+    return coExecute(EncodedRequest::make(args...));
+  }
+#endif
+
+  template<typename... Args>
+  ReplyFuture pooledExec(const Args&... args) {
+    return this->pooledExecute(EncodedRequest::make(args...));
+  }
+
+  template<typename... Args>
+  ReplyFuture pooledExec(const PreparedCommand &cmd, const Args&... args) {
+    return this->pooledExecute(cmd.encode(args...));
+  }
+
+  template<typename... Args>
+  void execCB(QCallback *callback, const Args... args) {
+    return this->execute(callback, std::vector<std::string> {args...});
+  }
+
+  //----------------------------------------------------------------------------
+  //! Attach / detach a reconnection listener to every connection. It's
+  //! notified separately for each.
+  //----------------------------------------------------------------------------
+  void attachListener(ReconnectionListener *listener);
+  bool detachListener(ReconnectionListener *listener);
+
+  //----------------------------------------------------------------------------
+  //! Check every connection with a PING, returning the first failure.
+  //----------------------------------------------------------------------------
+  Status checkConnection(std::chrono::milliseconds timeout);
+
+private:
+  void initialize(const Members &members, size_t connections, Options &&options);
+  size_t pickIndex(const EncodedRequest &req);
+  size_t pickIndex(const EncodedRequest &req, const QCallback *callback);
+  size_t routeBatch(const std::vector<EncodedRequest> &reqs, const QCallback *callback,
+    std::vector<size_t> &targets);
+  size_t nextRoundRobin();
+  size_t leastOutstanding();
+
+  PoolRouting routing;
+  std::vector<std::unique_ptr<QClient>> connections;
+  std::atomic<size_t> roundRobin {0};
+};
+
+}
+
+#endif
@@ -33,6 +33,8 @@ typedef struct redisReply {
     char *str; /* Used for both REDIS_REPLY_ERROR and REDIS_REPLY_STRING */
     size_t elements; /* number of elements, for REDIS_REPLY_ARRAY */
     struct redisReply **element; /* elements vector for REDIS_REPLY_ARRAY */
+    double dval; /* The double when type is REDIS_REPLY_DOUBLE */
+    char vtype[4]; /* Verbatim string type, for REDIS_REPLY_VERB */
 } redisReply;
 
 #define REDIS_REPLY_STRING 1
@@ -43,6 +45,18 @@ typedef struct redisReply {
 #define REDIS_REPLY_ERROR 6
 #define REDIS_REPLY_PUSH 7
 
+/* RESP3 types. A MAP holds its keys and values interleaved in element, so
+ * elements is twice the number of entries. A DOUBLE and a BIGNUM keep their
+ * textual representation in str, and a BOOL its value in integer. Attributes
+ * are parsed, but dropped: REDIS_REPLY_ATTR never shows up in a reply. */
+#define REDIS_REPLY_DOUBLE 8
+#define REDIS_REPLY_BOOL 9
+#define REDIS_REPLY_MAP 10
+#define REDIS_REPLY_SET 11
+#define REDIS_REPLY_ATTR 12
+#define REDIS_REPLY_BIGNUM 13
+#define REDIS_REPLY_VERB 14
+
 namespace qclient {
 
 using Reply = redisReply;
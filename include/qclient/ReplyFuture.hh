@@ -0,0 +1,155 @@
+//------------------------------------------------------------------------------
+// File: ReplyFuture.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_REPLY_FUTURE_HH
+#define QCLIENT_REPLY_FUTURE_HH
+
+#include "qclient/QCallback.hh"
+#include <atomic>
+#include <chrono>
+#include <future>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+//! The shared state behind a ReplyFuture. It is the callback of the request
+//! itself, so there's no queue of promises to go through - and slots are
+//! recycled through a process-wide pool, instead of allocating a shared
+//! state per request like std::promise does.
+//!
+//! Only ever handled through ReplyFuture, and the connection internals.
+//------------------------------------------------------------------------------
+class FutureSlot : public QCallback {
+public:
+  //----------------------------------------------------------------------------
+  //! Grab a slot out of the pool, with two references: One for the future,
+  //! one for the pending request.
+  //----------------------------------------------------------------------------
+  static FutureSlot* acquire();
+
+  //----------------------------------------------------------------------------
+  //! Fulfill the slot, and drop the reference held by the pending request.
+  //----------------------------------------------------------------------------
+  virtual void handleResponse(redisReplyPtr &&reply) override final;
+
+  bool isReady() const;
+  void wait();
+  bool waitFor(std::chrono::nanoseconds timeout);
+  redisReplyPtr take();
+  void release();
+
+private:
+  friend class FutureSlotPool;
+
+  FutureSlot() {}
+  virtual ~FutureSlot() {}
+
+  std::atomic<uint32_t> state {0};
+  std::atomic<uint32_t> refs {0};
+  redisReplyPtr reply;
+  FutureSlot *nextFree = nullptr;
+};
+
+//------------------------------------------------------------------------------
+//! A lightweight alternative to std::future<redisReplyPtr>: The shared state
+//! comes from a pool, and waiting is a futex wait on the shared state itself.
+//! Meant for synchronous calls - issue a request, and wait for it right away.
+//!
+//! Same semantics as std::future otherwise: Move-only, and get() may only be
+//! called once, after which the future is no longer valid.
+//------------------------------------------------------------------------------
+class ReplyFuture {
+public:
+  ReplyFuture() {}
+
+  //----------------------------------------------------------------------------
+  //! Takes over one of the references on the given slot.
+  //----------------------------------------------------------------------------
+  explicit ReplyFuture(FutureSlot *s) : slot(s) {}
+
+  ~ReplyFuture() {
+    reset();
+  }
+
+  ReplyFuture(ReplyFuture &&other) : slot(other.slot) {
+    other.slot = nullptr;
+  }
+
+  ReplyFuture& operator=(ReplyFuture &&other) {
+    if(this != &other) {
+      reset();
+      slot = other.slot;
+      other.slot = nullptr;
+    }
+
+    return *this;
+  }
+
+  ReplyFuture(const ReplyFuture&) = delete;
+  ReplyFuture& operator=(const ReplyFuture&) = delete;
+
+  bool valid() const {
+    return slot != nullptr;
+  }
+
+  bool ready() const {
+    return slot->isReady();
+  }
+
+  void wait() {
+    slot->wait();
+  }
+
+  template<typename Rep, typename Period>
+  std::future_status wait_for(const std::chrono::duration<Rep, Period> &timeout) {
+    if(slot->waitFor(std::chrono::duration_cast<std::chrono::nanoseconds>(timeout))) {
+      return std::future_status::ready;
+    }
+
+    return std::future_status::timeout;
+  }
+
+  //----------------------------------------------------------------------------
+  //! Block until the reply arrives, and return it. Invalidates the future.
+  //----------------------------------------------------------------------------
+  redisReplyPtr get() {
+    slot->wait();
+    redisReplyPtr retval = slot->take();
+    reset();
+    return retval;
+  }
+
+private:
+  void reset() {
+    if(slot) {
+      slot->release();
+      slot = nullptr;
+    }
+  }
+
+  FutureSlot *slot = nullptr;
+};
+
+}
+
+#endif
@@ -0,0 +1,134 @@
+//------------------------------------------------------------------------------
+// File: RequestBufferAllocator.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_REQUEST_BUFFER_ALLOCATOR_HH
+#define QCLIENT_REQUEST_BUFFER_ALLOCATOR_HH
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// Interface for the memory allocator used by EncodedRequest, for buffers too
+// large to be stored inline.
+//
+// Buffers are typically allocated by application threads, and released by
+// the event loop thread once the request has been acknowledged - an
+// implementation must be thread-safe.
+//------------------------------------------------------------------------------
+class RequestBufferAllocator {
+public:
+  virtual ~RequestBufferAllocator() {}
+
+  //----------------------------------------------------------------------------
+  // Allocate a buffer of at least the given size.
+  //----------------------------------------------------------------------------
+  virtual char* allocate(size_t size) = 0;
+
+  //----------------------------------------------------------------------------
+  // Release a buffer - size is the same as what was passed to allocate().
+  //----------------------------------------------------------------------------
+  virtual void deallocate(char* buffer, size_t size) = 0;
+
+  //----------------------------------------------------------------------------
+  // The allocator used by newly constructed EncodedRequests. Unless changed,
+  // this is a process-wide PooledBufferAllocator.
+  //----------------------------------------------------------------------------
+  static RequestBufferAllocator* getDefault();
+
+  //----------------------------------------------------------------------------
+  // Change the allocator used by newly constructed EncodedRequests - pass
+  // nullptr to restore the built-in one. Existing requests keep using the
+  // allocator they were created with, so it must outlive them.
+  //----------------------------------------------------------------------------
+  static void setDefault(RequestBufferAllocator *allocator);
+};
+
+//------------------------------------------------------------------------------
+// Plain malloc / free.
+//------------------------------------------------------------------------------
+class MallocBufferAllocator : public RequestBufferAllocator {
+public:
+  char* allocate(size_t size) override;
+  void deallocate(char* buffer, size_t size) override;
+
+  //----------------------------------------------------------------------------
+  // Process-wide instance.
+  //----------------------------------------------------------------------------
+  static MallocBufferAllocator* instance();
+};
+
+//------------------------------------------------------------------------------
+// Recycles buffers through power-of-two size classes, from 256 bytes up to
+// 1 MB. Larger buffers go straight to malloc.
+//
+// Released buffers are kept in a per-class free list, up to maxCachedBytes
+// per class, and handed out again on the next allocation of that class. This
+// avoids going through malloc for every request, and in particular the
+// mmap / munmap and page faults malloc incurs for large buffers.
+//------------------------------------------------------------------------------
+class PooledBufferAllocator : public RequestBufferAllocator {
+public:
+  //----------------------------------------------------------------------------
+  // Constructor - keep at most maxCachedBytes of free buffers per size class.
+  //----------------------------------------------------------------------------
+  PooledBufferAllocator(size_t maxCachedBytes = 8 * 1024 * 1024);
+
+  //----------------------------------------------------------------------------
+  // Destructor - releases all cached buffers. Buffers still out there must
+  // not be deallocated through this object anymore.
+  //----------------------------------------------------------------------------
+  ~PooledBufferAllocator();
+
+  char* allocate(size_t size) override;
+  void deallocate(char* buffer, size_t size) override;
+
+  //----------------------------------------------------------------------------
+  // Number of free buffers currently cached, across all size classes.
+  //----------------------------------------------------------------------------
+  size_t getCachedBuffers() const;
+
+private:
+  static constexpr size_t kMinClassShift = 8;
+  static constexpr size_t kMaxClassShift = 20;
+  static constexpr size_t kClasses = kMaxClassShift - kMinClassShift + 1;
+
+  //----------------------------------------------------------------------------
+  // Size class index for the given size, or -1 if too large to be pooled.
+  //----------------------------------------------------------------------------
+  static int getSizeClass(size_t size);
+
+  struct SizeClass {
+    mutable std::mutex mtx;
+    std::vector<char*> freeList;
+  };
+
+  size_t maxCachedBytes;
+  SizeClass classes[kClasses];
+};
+
+}
+
+#endif
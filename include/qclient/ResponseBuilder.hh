@@ -26,11 +26,16 @@
 
 #include "qclient/Reply.hh"
 #include <vector>
+#include <memory>
 
 struct redisReader;
 
 namespace qclient {
 
+class QStreamingCallback;
+class ReplyArena;
+struct ReceiveBufferPin;
+
 class ResponseBuilder {
 public:
   enum class Status {
@@ -40,13 +45,44 @@ public:
   };
 
   ResponseBuilder();
+  ~ResponseBuilder();
 
   void feed(const char* buff, size_t len);
   void feed(const std::string &str);
 
+  // Zero-copy alternative to feed: Get writable space of at least len bytes
+  // at the end of the internal buffer, receive directly into it, then commit
+  // however many bytes were actually written. Returns nullptr on error.
+  char* getWritableTail(size_t len);
+  void commitTail(size_t len);
+
+  // Once fully consumed, an internal buffer with more than this many unused
+  // bytes is released. Zero means never release.
+  void setMaxUnusedBuffer(size_t len);
+
+  // If enabled (the default), each reply tree is allocated from a single
+  // arena, owned by the returned redisReplyPtr. Otherwise, every node and
+  // string is malloc'd separately. Takes effect on the next restart().
+  void setArenaAllocation(bool enabled);
+
+  // If enabled, large strings in replies aren't copied out of the receive
+  // buffer: they point straight into it, and the buffer stays alive for as
+  // long as any reply referencing it does. Implies arena allocation. Takes
+  // effect on the next restart().
+  void setZeroCopyReplies(bool enabled);
+
   Status pull(redisReplyPtr &reply);
   void restart();
 
+  // Same as pull, but if the next reply is a bulk string or an aggregate,
+  // hand it out piece by piece to the given callback as soon as bytes
+  // arrive, instead of buffering it in full. Once the reply is complete,
+  // returns kOk with the contents stripped: an empty string, array, map or
+  // set.
+  //
+  // The same callback must be passed on every call until kOk is returned.
+  Status pullStreaming(QStreamingCallback *cb, redisReplyPtr &reply);
+
   // Convenience functions for use in tests. Very inefficient!
   static redisReplyPtr makeInt(int val);
   static redisReplyPtr makeErr(const std::string &msg);
@@ -69,7 +105,38 @@ private:
     void operator()(redisReader *reader);
   };
 
+  void installArena();
+
+  bool finishStreamedElement();
+  Status completeStreaming(redisReplyPtr &reply);
+
+  // Must outlive the reader, which may call into it when destroyed.
+  std::unique_ptr<ReceiveBufferPin> pin;
+
   std::unique_ptr<redisReader, Deleter> reader;
+  size_t maxUnusedBuffer;
+  bool arenaAllocation;
+  bool zeroCopyReplies;
+  std::shared_ptr<ReplyArena> arena;
+
+  // State of the reply currently being streamed, if any.
+  struct StreamingState {
+    bool active = false;
+    int type = 0;
+
+    // For each open array, how many elements are still to come.
+    std::vector<size_t> remaining;
+
+    // Set while in the middle of a bulk string.
+    bool inString = false;
+    size_t stringOffset = 0;
+    size_t stringTotal = 0;
+
+    // Set while an element is being built by the regular reader.
+    bool delegated = false;
+  };
+
+  StreamingState streaming;
 };
 
 }
@@ -27,6 +27,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <iostream>
+#include <algorithm>
 
 namespace qclient {
 
@@ -43,16 +44,54 @@ public:
   void up() {
     std::lock_guard<std::mutex> lock(mtx);
     count++;
-    cv.notify_one();
+
+    if(bulkWaiters > 0) {
+      cv.notify_all();
+    }
+    else {
+      cv.notify_one();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Increase semaphore count by n.
+  //----------------------------------------------------------------------------
+  void up(int64_t n) {
+    std::lock_guard<std::mutex> lock(mtx);
+    count += n;
+    cv.notify_all();
+  }
+
+  //----------------------------------------------------------------------------
+  // Decrease count by n, all at once - blocks until n slots are available.
+  // Never holds on to part of n while waiting for the rest: Two callers
+  // each holding half the slots would otherwise wait on each other forever.
+  //
+  // While anyone is waiting here, down() waits too, so a steady stream of
+  // single reservations can't keep the count from ever reaching n. n must
+  // not exceed the initial count.
+  //----------------------------------------------------------------------------
+  void down(int64_t n) {
+    std::unique_lock<std::mutex> lock(mtx);
+    bulkWaiters++;
+
+    while(count < n) {
+      cv.wait_for(lock, std::chrono::seconds(1));
+    }
+
+    bulkWaiters--;
+    count -= n;
+    cv.notify_all();
   }
 
   //----------------------------------------------------------------------------
-  // Try to decrease count by one - blocks if count is already at zero.
+  // Try to decrease count by one - blocks if count is already at zero, or
+  // a bulk reservation is waiting.
   //----------------------------------------------------------------------------
   void down() {
     std::unique_lock<std::mutex> lock(mtx);
 
-    while(count <= 0) {
+    while(count <= 0 || bulkWaiters > 0) {
       cv.wait_for(lock, std::chrono::seconds(1));
     }
 
@@ -81,6 +120,7 @@ private:
   mutable std::mutex mtx;
   std::condition_variable cv;
   int64_t count;
+  int64_t bulkWaiters = 0;
 };
 
 }
@@ -0,0 +1,302 @@
+//------------------------------------------------------------------------------
+// File: Task.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_TASK_HH
+#define QCLIENT_TASK_HH
+
+//------------------------------------------------------------------------------
+// Coroutine support is header-only, and only available to translation units
+// compiled with C++20 coroutines enabled - the library itself doesn't need
+// them. Check QCLIENT_HAVE_COROUTINES before use.
+//------------------------------------------------------------------------------
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define QCLIENT_HAVE_COROUTINES 1
+#endif
+#endif
+
+#if QCLIENT_HAVE_COROUTINES == 1
+
+#include "qclient/QCallback.hh"
+#include "qclient/EncodedRequest.hh"
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+//! A lazily-started coroutine, producing a T. Runs once co_await'ed by
+//! another coroutine, which resumes as soon as the task finishes - or use
+//! spawn() to start it from regular code.
+//------------------------------------------------------------------------------
+template<typename T>
+class Task;
+
+namespace detail {
+
+class TaskPromiseBase {
+public:
+  struct FinalAwaiter {
+    bool await_ready() noexcept {
+      return false;
+    }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      if(handle.promise().continuation) {
+        return handle.promise().continuation;
+      }
+
+      return std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept {
+    return {};
+  }
+
+  FinalAwaiter final_suspend() noexcept {
+    return {};
+  }
+
+  void unhandled_exception() {
+    exception = std::current_exception();
+  }
+
+  void rethrowIfFailed() {
+    if(exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  std::coroutine_handle<> continuation;
+  std::exception_ptr exception;
+};
+
+template<typename T>
+class TaskPromise : public TaskPromiseBase {
+public:
+  Task<T> get_return_object();
+
+  template<typename U>
+  void return_value(U &&val) {
+    value.emplace(std::forward<U>(val));
+  }
+
+  T result() {
+    rethrowIfFailed();
+    return std::move(*value);
+  }
+
+private:
+  std::optional<T> value;
+};
+
+template<>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+  Task<void> get_return_object();
+
+  void return_void() {}
+
+  void result() {
+    rethrowIfFailed();
+  }
+};
+
+}
+
+template<typename T>
+class Task {
+public:
+  using promise_type = detail::TaskPromise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  explicit Task(Handle h) : handle(h) {}
+
+  Task(Task &&other) : handle(std::exchange(other.handle, nullptr)) {}
+
+  Task& operator=(Task &&other) {
+    if(this != &other) {
+      if(handle) handle.destroy();
+      handle = std::exchange(other.handle, nullptr);
+    }
+
+    return *this;
+  }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() {
+    if(handle) handle.destroy();
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    handle.promise().continuation = awaiting;
+    return handle;
+  }
+
+  T await_resume() {
+    return handle.promise().result();
+  }
+
+private:
+  Handle handle;
+};
+
+template<typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() {
+  return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object() {
+  return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+namespace detail {
+
+//------------------------------------------------------------------------------
+// Fire-and-forget coroutine, cleans up after itself.
+//------------------------------------------------------------------------------
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() noexcept {
+      return {};
+    }
+
+    std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+
+    std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+
+    void return_void() noexcept {}
+
+    void unhandled_exception() noexcept {
+      std::terminate();
+    }
+  };
+};
+
+template<typename T>
+DetachedTask runToPromise(Task<T> task, std::promise<T> promise) {
+  try {
+    if constexpr(std::is_void<T>::value) {
+      co_await task;
+      promise.set_value();
+    }
+    else {
+      promise.set_value(co_await task);
+    }
+  }
+  catch(...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+}
+
+//------------------------------------------------------------------------------
+//! Start the given task right away, on the calling thread, up until its first
+//! suspension point. The result, or exception, ends up in the returned
+//! future.
+//------------------------------------------------------------------------------
+template<typename T>
+std::future<T> spawn(Task<T> &&task) {
+  std::promise<T> promise;
+  std::future<T> retval = promise.get_future();
+  detail::runToPromise(std::move(task), std::move(promise));
+  return retval;
+}
+
+//------------------------------------------------------------------------------
+//! What QClient::coExecute returns: co_await it to get the reply.
+//!
+//! The awaiter is itself the request's callback, and lives inside the
+//! awaiting coroutine's frame - there's no promise, future, or allocation
+//! in-between. The coroutine resumes on whichever thread runs the callbacks
+//! of the QClient: The callback thread by default, Options::callbackExecutor
+//! if set, or the thread reading replies with Options::inlineCallbacks. The
+//! constraints on callbacks apply to the coroutine until its next suspension
+//! point.
+//!
+//! Should the request be discarded, or the QClient shut down, the reply is
+//! nullptr - and the coroutine may resume on the thread doing that.
+//!
+//! The awaiter only ever sees its own reply, so the request goes through
+//! executeUnordered: With Options::readRouting, a read may be served by a
+//! follower, and the coroutine then resumes on that connection's callback
+//! thread instead.
+//!
+//! Client can be anything with executeUnordered(QCallback*, EncodedRequest&&).
+//------------------------------------------------------------------------------
+template<typename Client>
+class RequestAwaiter : public QCallback {
+public:
+  RequestAwaiter(Client &cl, EncodedRequest &&r) : client(cl), req(std::move(r)) {}
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> awaiting) {
+    handle = awaiting;
+    client.executeUnordered(this, std::move(req));
+  }
+
+  redisReplyPtr await_resume() {
+    return std::move(reply);
+  }
+
+  virtual void handleResponse(redisReplyPtr &&rep) override {
+    reply = std::move(rep);
+
+    // Resuming may well destroy this object - don't touch it afterwards.
+    handle.resume();
+  }
+
+private:
+  Client &client;
+  EncodedRequest req;
+  redisReplyPtr reply;
+  std::coroutine_handle<> handle;
+};
+
+}
+
+#endif
+
+#endif
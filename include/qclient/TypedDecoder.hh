@@ -0,0 +1,304 @@
+//------------------------------------------------------------------------------
+// File: TypedDecoder.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_TYPED_DECODER_HH
+#define QCLIENT_TYPED_DECODER_HH
+
+#include "qclient/QCallback.hh"
+#include <algorithm>
+#include <future>
+#include <map>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// The outcome of a typed request: Either a value, or an error message - worded
+// exactly as the equivalent parser in ResponseParsing.hh would.
+//------------------------------------------------------------------------------
+template<typename T>
+class TypedResponse {
+public:
+  static TypedResponse fromValue(T &&v) {
+    TypedResponse resp;
+    resp.isOk = true;
+    resp.val = std::move(v);
+    return resp;
+  }
+
+  static TypedResponse fromError(const std::string &err) {
+    TypedResponse resp;
+    resp.isOk = false;
+    resp.error = err;
+    return resp;
+  }
+
+  bool ok() const {
+    return isOk;
+  }
+
+  std::string err() const {
+    return error;
+  }
+
+  const T& value() const {
+    return val;
+  }
+
+  T& value() {
+    return val;
+  }
+
+private:
+  TypedResponse() : isOk(false), val() {}
+
+  bool isOk;
+  std::string error;
+  T val;
+};
+
+//------------------------------------------------------------------------------
+// The reply shapes a TypedDecoder understands.
+//------------------------------------------------------------------------------
+enum class DecoderShape {
+  kString,       // a single bulk string
+  kInteger,      // a single integer
+  kStringArray,  // an array or set of bulk strings
+  kStringPairs   // a map, or an array of bulk strings taken as key-value pairs
+};
+
+//------------------------------------------------------------------------------
+// Decodes a reply as it streams in, without ever building a redisReply tree:
+// strings go straight into their final destination. Handles the structure
+// and error reporting, TypedDecoder<T> takes care of filling out T.
+//------------------------------------------------------------------------------
+class TypedDecoderBase : public QStreamingCallback {
+public:
+  TypedDecoderBase(DecoderShape shape);
+  virtual ~TypedDecoderBase();
+
+  virtual void handleArray(size_t depth, size_t elements) override final;
+  virtual void handleAggregate(size_t depth, int type, size_t elements) override final;
+  virtual void handleStringChunk(size_t depth, const char *data, size_t len,
+    size_t offset, size_t total) override final;
+  virtual void handleElement(size_t depth, redisReplyPtr &&reply) override final;
+  virtual void handleResponse(redisReplyPtr &&reply) override final;
+
+protected:
+  //----------------------------------------------------------------------------
+  // Forget anything decoded so far - the reply is being streamed anew.
+  //----------------------------------------------------------------------------
+  virtual void clearValue() = 0;
+  virtual void reserveValue(size_t elements) = 0;
+
+  //----------------------------------------------------------------------------
+  // Depending on the shape, the top-level string, or the next array element.
+  //----------------------------------------------------------------------------
+  virtual void addString(std::string &&str) = 0;
+
+  //----------------------------------------------------------------------------
+  // Returns false if the key already exists - key must be left untouched.
+  //----------------------------------------------------------------------------
+  virtual bool addPair(std::string &&key, std::string &&value) = 0;
+  virtual void setInteger(long long value) = 0;
+
+  //----------------------------------------------------------------------------
+  // Called exactly once, with an empty string on success. May delete this.
+  //----------------------------------------------------------------------------
+  virtual void finish(std::string &&error) = 0;
+
+private:
+  void restart();
+  void completeElement(std::string &&str);
+  void fail(const std::string &err);
+  void startRecording(const std::string &prefix, size_t depth, bool isString);
+  void finishRecording();
+  bool ignoreEvent(size_t depth);
+  void replay(const redisReplyPtr &root, const redisReply *reply, size_t depth);
+
+  DecoderShape shape;
+  bool started = false;
+  size_t elementIndex = 0;
+  std::string current;
+  std::string pendingKey;
+
+  // Once something has gone wrong, the rest of the reply is ignored. Should
+  // the offending part be an array or string, it's re-encoded into recorded
+  // as it streams by, so it can be described in the error message.
+  bool failed = false;
+  bool recording = false;
+  bool recordingString = false;
+  size_t recordDepth = 0;
+  std::string recorded;
+  std::string error;
+};
+
+//------------------------------------------------------------------------------
+// How to fill out each supported type. Specialize to add more.
+//------------------------------------------------------------------------------
+struct DefaultDecoderTraits {
+  template<typename T>
+  static void reserve(T &out, size_t elements) {}
+
+  template<typename T>
+  static void addString(T &out, std::string &&str) {}
+
+  template<typename T>
+  static bool addPair(T &out, std::string &&key, std::string &&value) {
+    return true;
+  }
+
+  template<typename T>
+  static void setInteger(T &out, long long value) {}
+};
+
+template<typename T, typename Enable = void>
+struct DecoderTraits;
+
+template<>
+struct DecoderTraits<std::string> : public DefaultDecoderTraits {
+  static constexpr DecoderShape shape = DecoderShape::kString;
+
+  static void addString(std::string &out, std::string &&str) {
+    out = std::move(str);
+  }
+};
+
+template<typename T>
+struct DecoderTraits<T, typename std::enable_if<std::is_integral<T>::value>::type> : public DefaultDecoderTraits {
+  static constexpr DecoderShape shape = DecoderShape::kInteger;
+
+  static void setInteger(T &out, long long value) {
+    out = value;
+  }
+};
+
+template<>
+struct DecoderTraits<std::vector<std::string>> : public DefaultDecoderTraits {
+  static constexpr DecoderShape shape = DecoderShape::kStringArray;
+
+  static void reserve(std::vector<std::string> &out, size_t elements) {
+    // Don't trust the server with the amount of memory to reserve up-front.
+    out.reserve(std::min<size_t>(elements, 1024 * 1024));
+  }
+
+  static void addString(std::vector<std::string> &out, std::string &&str) {
+    out.emplace_back(std::move(str));
+  }
+};
+
+template<typename T>
+struct SetDecoderTraits : public DefaultDecoderTraits {
+  static constexpr DecoderShape shape = DecoderShape::kStringArray;
+
+  static void addString(T &out, std::string &&str) {
+    out.emplace(std::move(str));
+  }
+};
+
+template<>
+struct DecoderTraits<std::set<std::string>>
+  : public SetDecoderTraits<std::set<std::string>> {};
+
+template<>
+struct DecoderTraits<std::unordered_set<std::string>>
+  : public SetDecoderTraits<std::unordered_set<std::string>> {};
+
+template<typename T>
+struct MapDecoderTraits : public DefaultDecoderTraits {
+  static constexpr DecoderShape shape = DecoderShape::kStringPairs;
+
+  static bool addPair(T &out, std::string &&key, std::string &&value) {
+    return out.try_emplace(std::move(key), std::move(value)).second;
+  }
+};
+
+template<>
+struct DecoderTraits<std::map<std::string, std::string>>
+  : public MapDecoderTraits<std::map<std::string, std::string>> {};
+
+template<>
+struct DecoderTraits<std::unordered_map<std::string, std::string>>
+  : public MapDecoderTraits<std::unordered_map<std::string, std::string>> {};
+
+//------------------------------------------------------------------------------
+// Decodes a reply into T, and satisfies a future with the result.
+// Heap-allocated per request, deletes itself once done.
+//------------------------------------------------------------------------------
+template<typename T>
+class TypedDecoder : public TypedDecoderBase {
+public:
+  using Traits = DecoderTraits<T>;
+
+  TypedDecoder() : TypedDecoderBase(Traits::shape) {}
+  virtual ~TypedDecoder() {}
+
+  std::future<TypedResponse<T>> getFuture() {
+    return promise.get_future();
+  }
+
+protected:
+  virtual void clearValue() override {
+    value = T();
+  }
+
+  virtual void reserveValue(size_t elements) override {
+    Traits::reserve(value, elements);
+  }
+
+  virtual void addString(std::string &&str) override {
+    Traits::addString(value, std::move(str));
+  }
+
+  virtual bool addPair(std::string &&key, std::string &&val) override {
+    return Traits::addPair(value, std::move(key), std::move(val));
+  }
+
+  virtual void setInteger(long long val) override {
+    Traits::setInteger(value, val);
+  }
+
+  virtual void finish(std::string &&error) override {
+    if(error.empty()) {
+      promise.set_value(TypedResponse<T>::fromValue(std::move(value)));
+    }
+    else {
+      promise.set_value(TypedResponse<T>::fromError(error));
+    }
+
+    delete this;
+  }
+
+private:
+  T value;
+  std::promise<TypedResponse<T>> promise;
+};
+
+}
+
+#endif
@@ -63,6 +63,20 @@ public:
   bool blockUntilReady(int shutdownFd = -1, std::chrono::seconds timeout =
     std::chrono::seconds(2) );
 
+  //----------------------------------------------------------------------------
+  // For callers doing their own polling: Call when the file descriptor
+  // signals an event, to fetch the outcome of ::connect.
+  //
+  // Return false if ::connect is still in progress.
+  //----------------------------------------------------------------------------
+  bool handleEvent();
+
+  //----------------------------------------------------------------------------
+  // Get file descriptor without releasing it - could be -1 if an error has
+  // occurred.
+  //----------------------------------------------------------------------------
+  int getFd() const;
+
   //----------------------------------------------------------------------------
   // Has there been an error yet? Note that, if ::connect is still pending,
   // there might be an error in the future.
@@ -0,0 +1,452 @@
+// ----------------------------------------------------------------------
+// File: LockFreeQueue.hh
+// Author: Georgios Bitzes - CERN
+// ----------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_LOCK_FREE_QUEUE_HH
+#define QCLIENT_LOCK_FREE_QUEUE_HH
+
+#include "qclient/utils/Futex.hh"
+#include "qclient/utils/CpuRelax.hh"
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// A multi-producer, single-consumer queue offering the same API as
+// WaitableQueue, but without any locks on the push path.
+//
+// Items live inside a singly-linked list of nodes. Producers append with a
+// single atomic exchange on the tail pointer, and then link the previous tail
+// to their node. The list always contains a sentinel node at the front, whose
+// item has either been popped already, or never existed.
+//
+// Iterators point to the node *before* the position they represent, which is
+// what allows them to stay valid when sitting past the end of the queue: The
+// item has arrived as soon as that node gets a successor.
+//
+// The consumer side (pop_front, begin, front, iterators) is meant to be used
+// by one party at a time, just like WaitableQueue. Consumers blocking on an
+// empty queue park on a futex, and producers only make a syscall when
+// somebody is actually sleeping.
+//
+// Note: A producer which gets preempted between the exchange and the link
+// delays visibility of its own item and of everything pushed after it, until
+// it resumes. Consumers simply see the queue as being shorter for a while.
+//
+// Nodes are recycled instead of going back to the heap: The consumer
+// collects popped nodes into chains of kRecycleBatch, and parks each chain in
+// one of kRecycleSlots slots. A producer which runs out of nodes takes a
+// whole chain with a single atomic exchange, and keeps whatever it doesn't
+// use in a thread-local spare list, shared by all queues of the same item
+// type. In steady state, that's one exchange per kRecycleBatch items instead
+// of a malloc / free pair per item - with the free happening on another
+// thread, which is what malloc handles worst. When all slots are taken, the
+// consumer frees the chain, which bounds the memory kept around.
+//------------------------------------------------------------------------------
+
+template<typename T>
+class LockFreeQueue {
+private:
+  struct Node {
+    std::atomic<Node*> next {nullptr};
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+    T* getObject() {
+      return reinterpret_cast<T*>(&storage);
+    }
+  };
+
+public:
+  //----------------------------------------------------------------------------
+  // Recycled nodes travel in chains of kRecycleBatch, and at most
+  // kRecycleSlots chains wait for a producer to pick them up.
+  //----------------------------------------------------------------------------
+  static constexpr size_t kRecycleBatch = 64;
+  static constexpr size_t kRecycleSlots = 16;
+
+  LockFreeQueue() {
+    head = new Node();
+    tail.store(head);
+  }
+
+  ~LockFreeQueue() {
+    clear();
+    delete head;
+    deleteChain(freeNodes);
+
+    for(size_t i = 0; i < kRecycleSlots; i++) {
+      deleteChain(recycled[i].exchange(nullptr));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Reset all contents, and start sequence numbers from 0 again. Not safe to
+  // call while there are concurrent producers.
+  //----------------------------------------------------------------------------
+  void reset() {
+    clear();
+    pushed = 0;
+    frontSequenceNumber = 0;
+  }
+
+  //----------------------------------------------------------------------------
+  // Constructs an item inside the queue.
+  //----------------------------------------------------------------------------
+  template<typename... Args>
+  void emplace_back(Args&&... args) {
+    Node *node = acquireNode();
+    new (node->getObject()) T(std::forward<Args>(args)...);
+    publish(node, node, 1);
+  }
+
+  //----------------------------------------------------------------------------
+  // Constructs count items inside the queue, with a single atomic exchange
+  // and at most one wakeup. construct(mem, i) must construct the i-th item in
+  // the raw memory pointed to by mem, using placement new.
+  //----------------------------------------------------------------------------
+  template<typename Constructor>
+  void emplace_back_batch(size_t count, Constructor construct) {
+    if(count == 0) return;
+
+    Node *first = nullptr;
+    Node *last = nullptr;
+
+    for(size_t i = 0; i < count; i++) {
+      Node *node = acquireNode();
+      construct(node->getObject(), i);
+
+      if(!first) {
+        first = node;
+      }
+      else {
+        last->next.store(node, std::memory_order_relaxed);
+      }
+
+      last = node;
+    }
+
+    publish(first, last, count);
+  }
+
+  //----------------------------------------------------------------------------
+  // Check size of the queue. While producers are active, this may include
+  // items which are not visible to iterators yet.
+  //----------------------------------------------------------------------------
+  size_t size() const {
+    // Front first: It never overtakes pushed, so this can't underflow even
+    // while a consumer is popping concurrently.
+    int64_t front = frontSequenceNumber.load();
+    return pushed.load() - front;
+  }
+
+  //----------------------------------------------------------------------------
+  // Pop an item from the front.
+  //----------------------------------------------------------------------------
+  void pop_front() {
+    Node *front = head->next.load(std::memory_order_acquire);
+    front->getObject()->~T();
+
+    //--------------------------------------------------------------------------
+    // The popped node becomes the new sentinel, the old one is recycled.
+    //--------------------------------------------------------------------------
+    releaseNode(head);
+    head = front;
+    frontSequenceNumber++;
+  }
+
+  //----------------------------------------------------------------------------
+  // Returns a reference to the top item.
+  //----------------------------------------------------------------------------
+  T& front() {
+    return *(head->next.load(std::memory_order_acquire)->getObject());
+  }
+
+  //----------------------------------------------------------------------------
+  // If blocking mode is set to false, threads in blockUntilItemHasArrived
+  // do not really block - see WaitableQueue.
+  //----------------------------------------------------------------------------
+  void setBlockingMode(bool value) {
+    blockingMode = value;
+    epoch.bump();
+  }
+
+  //----------------------------------------------------------------------------
+  // How many times should a consumer poll for new items, before going to
+  // sleep? Zero means sleep immediately.
+  //----------------------------------------------------------------------------
+  void setSpinIterations(size_t value) {
+    spinIterations = value;
+  }
+
+  class Iterator {
+  public:
+    Iterator() {}
+
+    Iterator(LockFreeQueue<T> *q, Node *prev, int64_t seq)
+    : queue(q), previous(prev), sequenceNumber(seq) {}
+
+    T& item() {
+      return *(previous->next.load(std::memory_order_acquire)->getObject());
+    }
+
+    const T& item() const {
+      return *(previous->next.load(std::memory_order_acquire)->getObject());
+    }
+
+    //--------------------------------------------------------------------------
+    // Return current position sequence number
+    //--------------------------------------------------------------------------
+    int64_t seq() const {
+      return sequenceNumber;
+    }
+
+    void next() {
+      previous = previous->next.load(std::memory_order_acquire);
+      sequenceNumber++;
+    }
+
+    //--------------------------------------------------------------------------
+    // If false, the item we're pointing to has not arrived yet. The iterator
+    // remains valid, see WaitableQueue.
+    //--------------------------------------------------------------------------
+    bool itemHasArrived() const {
+      return previous->next.load(std::memory_order_acquire) != nullptr;
+    }
+
+    //--------------------------------------------------------------------------
+    // Sleep until there's some item to process, or blocking mode is turned
+    // off. It's not safe to assume itemHasArrived == true after returning.
+    //--------------------------------------------------------------------------
+    void blockUntilItemHasArrived() {
+      for(size_t i = 0; i < queue->spinIterations; i++) {
+        if(!queue->blockingMode || itemHasArrived()) return;
+        cpuRelax();
+      }
+
+      while(true) {
+        //----------------------------------------------------------------------
+        // Announce ourselves and read the epoch *before* checking, so that a
+        // producer linking its item after our check is guaranteed to either
+        // see us, or to have changed the epoch already.
+        //----------------------------------------------------------------------
+        queue->sleeping.store(true, std::memory_order_seq_cst);
+        uint32_t observed = queue->epoch.load();
+
+        if(!queue->blockingMode ||
+           previous->next.load(std::memory_order_seq_cst) != nullptr) {
+          break;
+        }
+
+        queue->epoch.wait(observed);
+      }
+    }
+
+    //--------------------------------------------------------------------------
+    // Fetch the next item: If none exists, block. If none exists and blocking
+    // mode is disabled, return nullptr.
+    //--------------------------------------------------------------------------
+    T* getItemBlockOrNull() {
+      if(itemHasArrived()) {
+        return &item();
+      }
+
+      blockUntilItemHasArrived();
+      if(!itemHasArrived()) {
+        return nullptr;
+      }
+
+      return &item();
+    }
+
+  private:
+    LockFreeQueue<T> *queue = nullptr;
+    Node *previous = nullptr;
+    int64_t sequenceNumber = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  // Get iterator to the queue
+  //----------------------------------------------------------------------------
+  Iterator begin() {
+    return Iterator(this, head, frontSequenceNumber);
+  }
+
+  //----------------------------------------------------------------------------
+  // If we were to add a new element, what sequence number would it be assigned
+  // to? Only exact when there are no concurrent producers.
+  //----------------------------------------------------------------------------
+  int64_t getNextSequenceNumber() const {
+    return pushed.load();
+  }
+
+private:
+  //----------------------------------------------------------------------------
+  // Nodes taken from a recycled chain by this thread, but not used yet.
+  // Trivially destructible, so it remains valid for as long as the thread
+  // lives - SpareReleaser gives the nodes back to the heap at thread exit.
+  //----------------------------------------------------------------------------
+  struct SpareNodes {
+    Node *chain;
+  };
+
+  static SpareNodes& getSpareNodes() {
+    static thread_local SpareNodes spare {nullptr};
+    return spare;
+  }
+
+  struct SpareReleaser {
+    ~SpareReleaser() {
+      SpareNodes &spare = getSpareNodes();
+      deleteChain(spare.chain);
+      spare.chain = nullptr;
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  // Producer side: Get a node, preferably a recycled one.
+  //----------------------------------------------------------------------------
+  Node* acquireNode() {
+    SpareNodes &spare = getSpareNodes();
+
+    if(!spare.chain) {
+      for(size_t i = 0; i < kRecycleSlots && !spare.chain; i++) {
+        if(recycled[i].load(std::memory_order_relaxed) != nullptr) {
+          spare.chain = recycled[i].exchange(nullptr, std::memory_order_acquire);
+        }
+      }
+
+      if(!spare.chain) {
+        return new Node();
+      }
+
+      static thread_local SpareReleaser releaser;
+      (void) releaser;
+    }
+
+    Node *node = spare.chain;
+    spare.chain = node->next.load(std::memory_order_relaxed);
+    node->next.store(nullptr, std::memory_order_relaxed);
+    return node;
+  }
+
+  //----------------------------------------------------------------------------
+  // Consumer side: Recycle a node which has just left the queue. Once a
+  // full chain has been collected, park it in an empty slot - or free it,
+  // if there's none. Only the consumer ever stores a chain, so a slot can't
+  // fill up between our check and our store.
+  //----------------------------------------------------------------------------
+  void releaseNode(Node *node) {
+    node->next.store(freeNodes, std::memory_order_relaxed);
+    freeNodes = node;
+
+    if(++freeCount < kRecycleBatch) {
+      return;
+    }
+
+    for(size_t i = 0; i < kRecycleSlots; i++) {
+      size_t slot = (nextSlot + i) % kRecycleSlots;
+
+      if(recycled[slot].load(std::memory_order_relaxed) == nullptr) {
+        recycled[slot].store(freeNodes, std::memory_order_release);
+        nextSlot = slot + 1;
+        freeNodes = nullptr;
+        freeCount = 0;
+        return;
+      }
+    }
+
+    deleteChain(freeNodes);
+    freeNodes = nullptr;
+    freeCount = 0;
+  }
+
+  static void deleteChain(Node *node) {
+    while(node) {
+      Node *next = node->next.load(std::memory_order_relaxed);
+      delete node;
+      node = next;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Append the already linked chain first...last to the queue.
+  //----------------------------------------------------------------------------
+  void publish(Node *first, Node *last, size_t count) {
+    pushed.fetch_add(count);
+
+    Node *prev = tail.exchange(last, std::memory_order_acq_rel);
+    prev->next.store(first, std::memory_order_seq_cst);
+
+    //--------------------------------------------------------------------------
+    // Pairs with blockUntilItemHasArrived: Either we see the sleeper, or the
+    // sleeper sees our item. Only the first producer to notice a sleeper
+    // pays for the wakeup syscall.
+    //--------------------------------------------------------------------------
+    if(sleeping.load(std::memory_order_seq_cst) &&
+       sleeping.exchange(false, std::memory_order_seq_cst)) {
+      epoch.bump();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Pop everything which has arrived.
+  //----------------------------------------------------------------------------
+  void clear() {
+    while(head->next.load(std::memory_order_acquire) != nullptr) {
+      pop_front();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Producer-side state, kept away from the consumer's cache line.
+  //----------------------------------------------------------------------------
+  std::atomic<Node*> tail;
+  std::atomic<int64_t> pushed {0};
+  char producerPadding[64];
+
+  //----------------------------------------------------------------------------
+  // Consumer-side state.
+  //----------------------------------------------------------------------------
+  Node *head;
+  std::atomic<int64_t> frontSequenceNumber {0};
+  std::atomic<bool> sleeping {false};
+  std::atomic<bool> blockingMode {true};
+  std::atomic<size_t> spinIterations {0};
+  Futex epoch;
+  Node *freeNodes = nullptr;
+  size_t freeCount = 0;
+  size_t nextSlot = 0;
+  char consumerPadding[64];
+
+  //----------------------------------------------------------------------------
+  // Chains of recycled nodes, on their way from the consumer to producers.
+  //----------------------------------------------------------------------------
+  std::atomic<Node*> recycled[kRecycleSlots] {};
+};
+
+}
+
+#endif
@@ -113,6 +113,30 @@ public:
     return nextSequenceNumber++;
   }
 
+  //----------------------------------------------------------------------------
+  // Constructs count items inside the queue, while taking the push lock only
+  // once. construct(mem, i) must construct the i-th item in the raw memory
+  // pointed to by mem, using placement new.
+  //
+  // Returns the sequence number of the last item, or -1 if count is zero.
+  //----------------------------------------------------------------------------
+  template<typename Constructor>
+  int64_t emplace_back_batch(size_t count, Constructor construct) {
+    std::lock_guard<std::mutex> lock(pushMutex);
+
+    for(size_t i = 0; i < count; i++) {
+      construct(lastBlock->getObject(lastBlockNextPos), i);
+      lastBlockNextPos++;
+
+      if(lastBlockNextPos == BlockSize) {
+        allocateBlock();
+      }
+    }
+
+    nextSequenceNumber += count;
+    return nextSequenceNumber - 1;
+  }
+
   //----------------------------------------------------------------------------
   // Returns a reference to the top item.
   //----------------------------------------------------------------------------
@@ -141,6 +165,25 @@ public:
     return frontSequenceNumber++;
   }
 
+  //----------------------------------------------------------------------------
+  // Pops count items from the queue, while taking the pop lock only once.
+  // The caller must make sure that many items are actually there.
+  //----------------------------------------------------------------------------
+  void pop_front_batch(size_t count) {
+    std::lock_guard<std::mutex> lock(popMutex);
+
+    for(size_t i = 0; i < count; i++) {
+      root->getObject(firstBlockNextToPop)->~T();
+
+      firstBlockNextToPop++;
+      if(firstBlockNextToPop == BlockSize) {
+        removeRoot();
+      }
+    }
+
+    frontSequenceNumber += count;
+  }
+
   class Iterator {
   public:
     Iterator() {}
@@ -25,6 +25,7 @@
 #define QCLIENT_WAITABLE_QUEUE_H
 
 #include "qclient/queueing/ThreadSafeQueue.hh"
+#include "qclient/utils/CpuRelax.hh"
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
@@ -57,13 +58,30 @@ public:
   }
 
   //----------------------------------------------------------------------------
-  // Constructs an item inside the queue.
+  // Constructs an item inside the queue. The lock and notification are only
+  // paid for if a consumer is actually asleep.
   //----------------------------------------------------------------------------
   template<typename... Args>
   void emplace_back(Args&&... args) {
-    std::lock_guard<std::mutex> lock(mtx);
-    highestSequence = queue.emplace_back(std::forward<Args>(args)...);
-    cv.notify_one();
+    publish(queue.emplace_back(std::forward<Args>(args)...));
+  }
+
+  //----------------------------------------------------------------------------
+  // Constructs count items inside the queue, with at most a single
+  // notification. See ThreadSafeQueue::emplace_back_batch.
+  //----------------------------------------------------------------------------
+  template<typename Constructor>
+  void emplace_back_batch(size_t count, Constructor construct) {
+    if(count == 0) return;
+    publish(queue.emplace_back_batch(count, construct));
+  }
+
+  //----------------------------------------------------------------------------
+  // How many times should a consumer poll for new items, before going to
+  // sleep? Zero means sleep immediately.
+  //----------------------------------------------------------------------------
+  void setSpinIterations(size_t value) {
+    spinIterations = value;
   }
 
   //----------------------------------------------------------------------------
@@ -80,6 +98,13 @@ public:
     queue.pop_front();
   }
 
+  //----------------------------------------------------------------------------
+  // Pop count items from the front, taking the lock only once.
+  //----------------------------------------------------------------------------
+  void pop_front_batch(size_t count) {
+    queue.pop_front_batch(count);
+  }
+
   //----------------------------------------------------------------------------
   // Returns a reference to the top item.
   //----------------------------------------------------------------------------
@@ -155,11 +180,19 @@ public:
     // itemHasArrived again.
     //--------------------------------------------------------------------------
     void blockUntilItemHasArrived() {
+      for(size_t i = 0; i < queue->spinIterations; i++) {
+        if(!queue->blockingMode || itemHasArrived()) return;
+        cpuRelax();
+      }
+
       std::unique_lock<std::mutex> lock(queue->mtx);
+      queue->waiters.fetch_add(1, std::memory_order_seq_cst);
 
-      while(queue->blockingMode && iterator.seq() > queue->highestSequence) {
+      while(queue->blockingMode && iterator.seq() > queue->highestSequence.load(std::memory_order_seq_cst)) {
         queue->cv.wait(lock);
       }
+
+      queue->waiters.fetch_sub(1, std::memory_order_seq_cst);
     }
 
     //--------------------------------------------------------------------------
@@ -205,12 +238,37 @@ public:
   }
 
 private:
+  //----------------------------------------------------------------------------
+  // Make item with the given sequence number visible to consumers.
+  //
+  // Producers no longer serialize on mtx, so highestSequence may be updated
+  // out of order - only ever move it forward. That's safe: ThreadSafeQueue
+  // hands out sequence numbers under its push lock, so once item N has been
+  // constructed, all items before it have been too.
+  //----------------------------------------------------------------------------
+  void publish(int64_t seq) {
+    int64_t current = highestSequence.load();
+    while(current < seq && !highestSequence.compare_exchange_weak(current, seq)) { }
+
+    //--------------------------------------------------------------------------
+    // Pairs with blockUntilItemHasArrived: Either we see the waiter, or the
+    // waiter sees our item. Taking mtx before notifying guarantees the waiter
+    // is already inside cv.wait().
+    //--------------------------------------------------------------------------
+    if(waiters.load(std::memory_order_seq_cst) != 0) {
+      std::lock_guard<std::mutex> lock(mtx);
+      cv.notify_one();
+    }
+  }
+
   friend class WaitableQueue<T, BlockSize>::Iterator;
   ThreadSafeQueue<T, BlockSize> queue;
   std::atomic<int64_t> highestSequence {-1};
   std::mutex mtx;
   std::condition_variable cv;
   std::atomic<bool> blockingMode {true};
+  std::atomic<int32_t> waiters {0};
+  std::atomic<size_t> spinIterations {0};
 };
 
 }
@@ -136,7 +136,8 @@ public:
   //! @return return true if successful, otherwise false
   //----------------------------------------------------------------------------
   bool hset(const std::string& field, const std::string& value) {
-    redisReplyPtr reply = mClient->exec("HSET", mKey, field, value).get();
+    static const PreparedCommand hsetCmd({"HSET"}, 3);
+    redisReplyPtr reply = mClient->pooledExec(hsetCmd, mKey, field, value).get();
 
     if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
       throw std::runtime_error("[FATAL] Error hset key: " + mKey + " field: "
@@ -332,7 +333,7 @@ QHash::hset_async(const std::string& field, const std::string& value, AsyncHandl
 //------------------------------------------------------------------------------
 inline bool QHash::hsetnx(const std::string& field, const std::string& value)
 {
-  redisReplyPtr reply = mClient->exec("HSETNX", mKey, field, value).get();
+  redisReplyPtr reply = mClient->pooledExec("HSETNX", mKey, field, value).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
     throw std::runtime_error("[FATAL] Error hsetnx key: " + mKey + " field: "
@@ -359,7 +360,7 @@ QHash::hincrby_async(const std::string& field, const T& increment,
 template <typename T>
 long long int QHash::hincrby(const std::string& field, const T& increment)
 {
-  redisReplyPtr reply = mClient->exec("HINCRBY", mKey, field,
+  redisReplyPtr reply = mClient->pooledExec("HINCRBY", mKey, field,
                                       std::to_string(increment)).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
@@ -376,7 +377,7 @@ long long int QHash::hincrby(const std::string& field, const T& increment)
 template <typename T>
 double QHash::hincrbyfloat(const std::string& field, const T& increment)
 {
-  redisReplyPtr reply = mClient->exec("HINCRBYFLOAT", mKey, field,
+  redisReplyPtr reply = mClient->pooledExec("HINCRBYFLOAT", mKey, field,
                                       std::to_string(increment)).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_STRING)) {
@@ -45,7 +45,7 @@ public:
     while(!reachedEnd && results.empty()) {
       reqs++;
 
-      redisReplyPtr reply = qcl.exec("SCAN", cursor, "MATCH", pattern,
+      redisReplyPtr reply = qcl.pooledExec("SCAN", cursor, "MATCH", pattern,
                                      "COUNT", std::to_string(count)).get();
 
       if (reply == nullptr) {
@@ -288,7 +288,8 @@ QSet::sadd_async(const Iter& begin, const Iter& end, AsyncHandler* ah)
 
 inline bool QSet::sadd(const std::string& member)
 {
-  redisReplyPtr reply = mClient->exec("SADD", mKey, member).get();
+  static const PreparedCommand saddCmd({"SADD"}, 2);
+  redisReplyPtr reply = mClient->pooledExec(saddCmd, mKey, member).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
     throw std::runtime_error("[FATAL] Error sadd key: " + mKey + " field: "
@@ -305,7 +306,8 @@ inline void QSet::srem_async(const std::string& member, AsyncHandler* ah)
 
 inline bool QSet::srem(const std::string& member)
 {
-  redisReplyPtr reply = mClient->exec("SREM", mKey, member).get();
+  static const PreparedCommand sremCmd({"SREM"}, 2);
+  redisReplyPtr reply = mClient->pooledExec(sremCmd, mKey, member).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
     throw std::runtime_error("[FATAL] Error srem key: " + mKey + " member: "
@@ -317,7 +319,8 @@ inline bool QSet::srem(const std::string& member)
 
 inline bool QSet::sismember(const std::string& member)
 {
-  redisReplyPtr reply = mClient->exec("SISMEMBER", mKey, member).get();
+  static const PreparedCommand sismemberCmd({"SISMEMBER"}, 2);
+  redisReplyPtr reply = mClient->pooledExec(sismemberCmd, mKey, member).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
     throw std::runtime_error("[FATAL] Error sismember key: " + mKey + " member: "
@@ -0,0 +1,108 @@
+// ----------------------------------------------------------------------
+// File: Futex.hh
+// Author: Georgios Bitzes - CERN
+// ----------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2020 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_UTILS_FUTEX_HH
+#define QCLIENT_UTILS_FUTEX_HH
+
+#include <atomic>
+#include <cstdint>
+#include <climits>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+//! A 32-bit word which threads can sleep on, until its value changes.
+//!
+//! Typical use is an "epoch" counter: A waiter reads the current value,
+//! re-checks whatever condition it's waiting for, then calls wait() with the
+//! value it read. A waker first makes the condition true, then calls bump().
+//! If the bump happens between the read and wait(), wait() returns
+//! immediately - no wakeups can be lost.
+//!
+//! On Linux this maps directly to the futex syscall, elsewhere we fall back
+//! to a mutex and condition variable.
+//------------------------------------------------------------------------------
+class Futex {
+public:
+  //----------------------------------------------------------------------------
+  //! Read current value.
+  //----------------------------------------------------------------------------
+  uint32_t load() const {
+    return word.load(std::memory_order_seq_cst);
+  }
+
+  //----------------------------------------------------------------------------
+  //! Sleep as long as the value is equal to expected. May return spuriously,
+  //! callers need to re-check their condition.
+  //----------------------------------------------------------------------------
+  void wait(uint32_t expected) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE,
+            expected, nullptr, nullptr, 0);
+#else
+    std::unique_lock<std::mutex> lock(mtx);
+    while(word.load() == expected) {
+      cv.wait(lock);
+    }
+#endif
+  }
+
+  //----------------------------------------------------------------------------
+  //! Change the value, and wake up all sleeping threads.
+  //----------------------------------------------------------------------------
+  void bump() {
+#ifdef __linux__
+    word.fetch_add(1, std::memory_order_seq_cst);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE,
+            INT_MAX, nullptr, nullptr, 0);
+#else
+    std::lock_guard<std::mutex> lock(mtx);
+    word.fetch_add(1, std::memory_order_seq_cst);
+    cv.notify_all();
+#endif
+  }
+
+private:
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+    "std::atomic<uint32_t> must be layout-compatible with uint32_t");
+
+  std::atomic<uint32_t> word {0};
+
+#ifndef __linux__
+  std::mutex mtx;
+  std::condition_variable cv;
+#endif
+};
+
+}
+
+#endif
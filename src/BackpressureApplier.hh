@@ -26,6 +26,7 @@
 
 #include "qclient/Semaphore.hh"
 #include "qclient/Options.hh"
+#include <limits>
 
 namespace qclient {
 
@@ -44,6 +45,22 @@ public:
     }
   }
 
+  void reserve(size_t count) {
+    // Reserve several slots at once. If not possible, block.
+    if(strategy.active() && count > 0) {
+      semaphore.down(count);
+    }
+  }
+
+  // The largest number of slots which can be reserved at once.
+  size_t getReservationLimit() const {
+    if(strategy.active()) {
+      return strategy.getRequestLimit();
+    }
+
+    return std::numeric_limits<size_t>::max();
+  }
+
   void release() {
     // Release a single slot.
     if(strategy.active()) {
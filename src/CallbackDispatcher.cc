@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+// File: CallbackDispatcher.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "CallbackDispatcher.hh"
+#include <algorithm>
+#include <vector>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// How many callbacks a lane may run in a row, before giving other tasks on
+// the executor a turn.
+//------------------------------------------------------------------------------
+static constexpr size_t kMaxLaneBatch = 64u;
+
+CallbackDispatcher::CallbackDispatcher(std::shared_ptr<Executor> exec, CallbackOrdering ord)
+: executor(exec), ordering(ord) {}
+
+CallbackDispatcher::~CallbackDispatcher() {
+  std::unique_lock<std::mutex> lock(mtx);
+  idleCv.wait(lock, [this]() { return lanes.empty(); });
+}
+
+void CallbackDispatcher::stage(QCallback *callback, redisReplyPtr &&reply) {
+  if(!callback) return;
+
+  QCallback *key = nullptr;
+  if(ordering == CallbackOrdering::kPerCallback) {
+    key = callback;
+  }
+
+  bool schedule = false;
+
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = lanes.find(key);
+    if(it == lanes.end()) {
+      it = lanes.emplace(key, std::deque<PendingCallback>()).first;
+      schedule = true;
+    }
+
+    it->second.emplace_back(callback, std::move(reply));
+  }
+
+  if(schedule) {
+    executor->execute([this, key]() { drain(key); });
+  }
+}
+
+void CallbackDispatcher::drain(QCallback *key) {
+  //----------------------------------------------------------------------------
+  // Take a batch of callbacks out of the lane under a single lock, and run
+  // them. The lane stays in place meanwhile, so anything staged in the
+  // meantime queues up behind them.
+  //----------------------------------------------------------------------------
+  std::vector<PendingCallback> batch;
+
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = lanes.find(key);
+    if(it->second.empty()) {
+      lanes.erase(it);
+
+      if(lanes.empty()) {
+        idleCv.notify_all();
+      }
+
+      return;
+    }
+
+    size_t count = std::min(it->second.size(), kMaxLaneBatch);
+    batch.reserve(count);
+
+    for(size_t i = 0; i < count; i++) {
+      batch.emplace_back(std::move(it->second.front()));
+      it->second.pop_front();
+    }
+  }
+
+  for(PendingCallback &cb : batch) {
+    cb.callback->handleResponse(std::move(cb.reply));
+  }
+
+  //----------------------------------------------------------------------------
+  // Go to the back of the line, giving other tasks on the executor a turn.
+  // The lane is removed on the next round, if there's nothing more to do.
+  //----------------------------------------------------------------------------
+  executor->execute([this, key]() { drain(key); });
+}
+
+}
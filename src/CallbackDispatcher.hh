@@ -0,0 +1,71 @@
+//------------------------------------------------------------------------------
+// File: CallbackDispatcher.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_CALLBACK_DISPATCHER_HH
+#define QCLIENT_CALLBACK_DISPATCHER_HH
+
+#include "CallbackExecutorThread.hh"
+#include "qclient/Executor.hh"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// Runs callbacks on a user-provided Executor, instead of a dedicated thread.
+// Ordering is preserved through serial lanes: Callbacks in the same lane run
+// one at a time, in the order they were staged, and a lane occupies at most
+// a single task on the executor at any point in time.
+//
+// With kStrictFifo there's a single lane, with kPerCallback one per QCallback
+// object.
+//------------------------------------------------------------------------------
+class CallbackDispatcher {
+public:
+  CallbackDispatcher(std::shared_ptr<Executor> executor, CallbackOrdering ordering);
+
+  //----------------------------------------------------------------------------
+  // Blocks until all staged callbacks have run.
+  //----------------------------------------------------------------------------
+  ~CallbackDispatcher();
+
+  void stage(QCallback *callback, redisReplyPtr &&reply);
+
+private:
+  void drain(QCallback *key);
+
+  std::shared_ptr<Executor> executor;
+  CallbackOrdering ordering;
+
+  // A lane exists for as long as it's scheduled on the executor.
+  std::mutex mtx;
+  std::condition_variable idleCv;
+  std::unordered_map<QCallback*, std::deque<PendingCallback>> lanes;
+};
+
+}
+
+#endif
@@ -49,6 +49,7 @@ public:
 
   void main(ThreadAssistant &assistant);
   void stage(QCallback *callback, redisReplyPtr &&reply);
+  void setSpinIterations(size_t value);
 
 private:
   WaitableQueue<PendingCallback, 5000> pendingCallbacks;
@@ -33,10 +33,19 @@ namespace qclient {
 
 ConnectionCore::ConnectionCore(Logger *log, Handshake *hs, BackpressureStrategy bp,
                                bool transUnavail, MessageListener *ms, bool exclpubsub,
-                               QPerfCallback* perf_cb)
+                               QPerfCallback* perf_cb, bool inlinecb,
+                               std::shared_ptr<Executor> executor,
+                               CallbackOrdering ordering)
   : logger(log), handshake(hs), backpressure(bp),
     transparentUnavailable(transUnavail), listener(ms),
-    exclusivePubsub(exclpubsub), mPerfCb(perf_cb) {
+    exclusivePubsub(exclpubsub), inlineCallbacks(inlinecb), mPerfCb(perf_cb) {
+  if(!inlineCallbacks && executor) {
+    dispatcher.reset(new CallbackDispatcher(executor, ordering));
+  }
+  else if(!inlineCallbacks) {
+    cbExecutor.reset(new CallbackExecutorThread());
+  }
+
   reconnection();
 }
 
@@ -98,24 +107,62 @@ void ConnectionCore::reconnection() {
   nextToAcknowledgeIterator = requestQueue.begin();
 }
 
+void ConnectionCore::setQueueSpinIterations(size_t iterations) {
+  handshakeRequests.setSpinIterations(iterations);
+  requestQueue.setSpinIterations(iterations);
+  if(cbExecutor) {
+    cbExecutor->setSpinIterations(iterations);
+  }
+}
+
 size_t ConnectionCore::clearAllPending() {
-  std::lock_guard<std::mutex> lock(mtx);
+  std::vector<QCallback*> orphaned;
+  size_t retval;
 
-  //----------------------------------------------------------------------------
-  // The party's over, any requests that still remain un-acknowledged
-  // will get a null response.
-  //----------------------------------------------------------------------------
-  inHandshake = false;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    //--------------------------------------------------------------------------
+    // The party's over, any requests that still remain un-acknowledged
+    // will get a null response.
+    //
+    // Inline callbacks are collected and only run once mtx is released,
+    // since they're allowed to stage further requests.
+    //--------------------------------------------------------------------------
+    inHandshake = false;
+
+    redisReplyPtr nullReply;
+    while(nextToAcknowledgeIterator.itemHasArrived()) {
+      if(inlineCallbacks) {
+        auto& stage_req = nextToAcknowledgeIterator.item();
+
+        if (mPerfCb) {
+          measurePerf(stage_req);
+        }
+
+        orphaned.emplace_back(stage_req.getCallback());
+        discardPending();
+      }
+      else {
+        acknowledgePending(std::move(nullReply));
+      }
+    }
 
-  redisReplyPtr nullReply;
-  while(nextToAcknowledgeIterator.itemHasArrived()) {
-    acknowledgePending(std::move(nullReply));
+    //--------------------------------------------------------------------------
+    // No need to reset the request queue: Everything that had arrived has been
+    // acknowledged and popped. Producers don't take mtx, so anything staged
+    // concurrently simply remains for the next connection.
+    //--------------------------------------------------------------------------
+    retval = requestQueue.size();
+    reconnection();
   }
 
-  size_t retval = requestQueue.size();
+  for(QCallback *callback : orphaned) {
+    if(callback) {
+      callback->handleResponse(redisReplyPtr());
+    }
+  }
 
-  requestQueue.reset();
-  reconnection();
   return retval;
 }
 
@@ -124,9 +171,14 @@ void
 ConnectionCore::stage(QCallback *callback, EncodedRequest &&req,
                       size_t multiSize)
 {
+  //----------------------------------------------------------------------------
+  // Lock-free: The request queue tolerates any number of concurrent
+  // producers. mtx is only needed to keep future promises in the same order
+  // as their requests.
+  //----------------------------------------------------------------------------
   backpressure.reserve();
-  std::lock_guard<std::mutex> lock(mtx);
   requestQueue.emplace_back(callback, std::move(req), multiSize);
+  wakeWriter();
 }
 
 
@@ -136,6 +188,101 @@ ConnectionCore::stage(EncodedRequest &&req, size_t multiSize)
   std::lock_guard<std::mutex> lock(mtx);
   std::future<redisReplyPtr> retval = futureHandler.stage();
   requestQueue.emplace_back(&futureHandler, std::move(req), multiSize);
+  wakeWriter();
+  return retval;
+}
+
+
+ReplyFuture
+ConnectionCore::pooledStage(EncodedRequest &&req, size_t multiSize)
+{
+  FutureSlot *slot = FutureSlot::acquire();
+  ReplyFuture retval(slot);
+  stage(slot, std::move(req), multiSize);
+  return retval;
+}
+
+void
+ConnectionCore::stageMulti(QCallback *callback, std::deque<EncodedRequest> &&reqs)
+{
+  // MULTI, and each request, produce a reply we don't pass on.
+  size_t multiSize = reqs.size() + 1;
+
+  backpressure.reserve();
+  requestQueue.emplace_back(callback, std::move(reqs), multiSize);
+  wakeWriter();
+}
+
+std::future<redisReplyPtr>
+ConnectionCore::stageMulti(std::deque<EncodedRequest> &&reqs)
+{
+  size_t multiSize = reqs.size() + 1;
+
+  std::lock_guard<std::mutex> lock(mtx);
+  std::future<redisReplyPtr> retval = futureHandler.stage();
+  requestQueue.emplace_back(&futureHandler, std::move(reqs), multiSize);
+  wakeWriter();
+  return retval;
+}
+
+void
+ConnectionCore::stageStreaming(QStreamingCallback *callback, EncodedRequest &&req)
+{
+  backpressure.reserve();
+  requestQueue.emplace_back(callback, std::move(req), StagedRequest::StreamReply());
+  wakeWriter();
+}
+
+QStreamingCallback* ConnectionCore::getStreamingCallback() {
+  //----------------------------------------------------------------------------
+  // Handshake replies and pub/sub messages are never streamed. Since we
+  // never stream a PUSH reply either, an out-of-band message arriving ahead
+  // of the streamed reply is harmless.
+  //----------------------------------------------------------------------------
+  if(inHandshake || (listener && exclusivePubsub)) {
+    return nullptr;
+  }
+
+  if(!nextToAcknowledgeIterator.itemHasArrived()) {
+    return nullptr;
+  }
+
+  return nextToAcknowledgeIterator.item().getStreamingCallback();
+}
+
+void
+ConnectionCore::stageBatch(QCallback *callback, std::vector<EncodedRequest> &&reqs)
+{
+  //----------------------------------------------------------------------------
+  // A batch larger than the backpressure limit could never obtain all its
+  // slots at once - stage it in chunks which fit.
+  //----------------------------------------------------------------------------
+  size_t chunkSize = std::max<size_t>(1u, backpressure.getReservationLimit());
+
+  for(size_t offset = 0; offset < reqs.size(); offset += chunkSize) {
+    size_t count = std::min(chunkSize, reqs.size() - offset);
+    backpressure.reserve(count);
+    requestQueue.emplace_back_batch(count, [&](StagedRequest *mem, size_t i) {
+      new (mem) StagedRequest(callback, std::move(reqs[offset + i]));
+    });
+    wakeWriter();
+  }
+}
+
+std::future<std::vector<redisReplyPtr>>
+ConnectionCore::stageBatch(std::vector<EncodedRequest> &&reqs)
+{
+  if(reqs.empty()) {
+    std::promise<std::vector<redisReplyPtr>> prom;
+    prom.set_value({});
+    return prom.get_future();
+  }
+
+  // The handler deletes itself once it has seen the last reply.
+  BatchFutureHandler *handler = new BatchFutureHandler(reqs.size());
+  std::future<std::vector<redisReplyPtr>> retval = handler->getFuture();
+
+  stageBatch(handler, std::move(reqs));
   return retval;
 }
 
@@ -147,6 +294,20 @@ ConnectionCore::follyStage(EncodedRequest &&req, size_t multiSize)
   std::lock_guard<std::mutex> lock(mtx);
   folly::Future<redisReplyPtr> retval = follyFutureHandler.stage();
   requestQueue.emplace_back(&follyFutureHandler, std::move(req), multiSize);
+  wakeWriter();
+  return retval;
+}
+
+folly::Future<redisReplyPtr>
+ConnectionCore::follyStageMulti(std::deque<EncodedRequest> &&reqs)
+{
+  size_t multiSize = reqs.size() + 1;
+
+  backpressure.reserve();
+  std::lock_guard<std::mutex> lock(mtx);
+  folly::Future<redisReplyPtr> retval = follyFutureHandler.stage();
+  requestQueue.emplace_back(&follyFutureHandler, std::move(reqs), multiSize);
+  wakeWriter();
   return retval;
 }
 #endif
@@ -158,8 +319,29 @@ void ConnectionCore::acknowledgePending(redisReplyPtr &&reply) {
     measurePerf(stage_req);
   }
 
-  cbExecutor.stage(stage_req.getCallback(), std::move(reply));
+  if(dispatcher) {
+    dispatcher->stage(stage_req.getCallback(), std::move(reply));
+    discardPending();
+    return;
+  }
+
+  if(cbExecutor) {
+    cbExecutor->stage(stage_req.getCallback(), std::move(reply));
+    discardPending();
+    return;
+  }
+
+  //----------------------------------------------------------------------------
+  // Inline mode: Pop the request and release its backpressure slot before
+  // running the callback, so that the callback may stage follow-up requests
+  // without waiting on a slot only we could free.
+  //----------------------------------------------------------------------------
+  QCallback *callback = stage_req.getCallback();
   discardPending();
+
+  if(callback) {
+    callback->handleResponse(std::move(reply));
+  }
 }
 
 void ConnectionCore::discardPending() {
@@ -353,6 +535,69 @@ StagedRequest* ConnectionCore::getNextToWrite() {
   return item;
 }
 
+StagedRequest* ConnectionCore::tryGetNextToWrite() {
+  //----------------------------------------------------------------------------
+  // Unlike getNextToWrite, we don't trim the request queue in exclusive
+  // pub-sub mode: the writer may still be holding on to previously returned
+  // requests which have not been fully written yet.
+  //----------------------------------------------------------------------------
+  if(inHandshake) {
+    if(!handshakeIterator.itemHasArrived()) return nullptr;
+
+    StagedRequest *item = &handshakeIterator.item();
+    handshakeIterator.next();
+    return item;
+  }
+
+  if(!nextToWriteIterator.itemHasArrived()) return nullptr;
+
+  StagedRequest *item = &nextToWriteIterator.item();
+  nextToWriteIterator.next();
+  return item;
+}
+
+StagedRequest* ConnectionCore::pollNextToWrite() {
+  if(!inHandshake && listener && exclusivePubsub) {
+    while(nextToWriteIterator.seq() > nextToAcknowledgeIterator.seq()) {
+      discardPending();
+    }
+  }
+
+  return tryGetNextToWrite();
+}
+
+void ConnectionCore::setWriteNotifier(std::function<void()> notifier) {
+  writeNotifier = std::move(notifier);
+  writerParked = false;
+}
+
+bool ConnectionCore::parkWriter() {
+  //----------------------------------------------------------------------------
+  // Same protocol as LockFreeQueue's sleepers: Announce ourselves *before*
+  // checking for new items, so that a producer publishing after our check is
+  // guaranteed to see us.
+  //----------------------------------------------------------------------------
+  writerParked.store(true, std::memory_order_seq_cst);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  bool arrived = inHandshake ? handshakeIterator.itemHasArrived()
+                             : nextToWriteIterator.itemHasArrived();
+
+  if(arrived) {
+    writerParked.store(false, std::memory_order_seq_cst);
+    return false;
+  }
+
+  return true;
+}
+
+void ConnectionCore::wakeWriter() {
+  if(writerParked.load(std::memory_order_seq_cst) &&
+     writerParked.exchange(false, std::memory_order_seq_cst)) {
+    writeNotifier();
+  }
+}
+
 //------------------------------------------------------------------------------
 // Mesasure request performance and sent info to the perf callback
 //------------------------------------------------------------------------------
@@ -29,7 +29,10 @@
 #include "RequestQueue.hh"
 #include "FutureHandler.hh"
 #include "CallbackExecutorThread.hh"
+#include "CallbackDispatcher.hh"
+#include "qclient/ReplyFuture.hh"
 #include "qclient/Logger.hh"
+#include <functional>
 
 namespace qclient {
 
@@ -45,12 +48,19 @@ class ConnectionCore {
 public:
   ConnectionCore(Logger *log, Handshake *hs, BackpressureStrategy backpressure,
                  bool transparentUnavailable, MessageListener *listener = nullptr,
-                 bool exclusivePubsub = true, QPerfCallback* perf_cb = nullptr);
+                 bool exclusivePubsub = true, QPerfCallback* perf_cb = nullptr,
+                 bool inlineCallbacks = false,
+                 std::shared_ptr<Executor> executor = {},
+                 CallbackOrdering ordering = CallbackOrdering::kStrictFifo);
 
   ~ConnectionCore() = default;
 
   void reconnection();
 
+  // How many times should the writer and callback threads poll for new
+  // items, before going to sleep? Zero means sleep immediately.
+  void setQueueSpinIterations(size_t iterations);
+
   // Returns whether connection is still alive after consuming this response.
   // False can happen durnig a failed handshake, for example.
   bool consumeResponse(redisReplyPtr &&reply);
@@ -59,18 +69,75 @@ public:
 
   std::future<redisReplyPtr> stage(EncodedRequest &&req, size_t multiSize = 0u);
 
+  // Same as above, but returns a pooled ReplyFuture: The future's shared
+  // state is the request's callback, so no lock is taken.
+  ReplyFuture pooledStage(EncodedRequest &&req, size_t multiSize = 0u);
+
+  // Stage several independent requests at once: backpressure slots are
+  // reserved in bulk, and all requests are appended to the queue within a
+  // single critical section, with a single wakeup of the writer.
+  //
+  // The callback is invoked once per request, in order.
+  void stageBatch(QCallback *callback, std::vector<EncodedRequest> &&reqs);
+
+  // Same as above, but the replies are aggregated into a single future.
+  std::future<std::vector<redisReplyPtr>> stageBatch(std::vector<EncodedRequest> &&reqs);
+
+  // Stage a MULTI block. The requests are kept as they are, and written out
+  // back-to-back surrounded by MULTI / EXEC - they're never fused into a
+  // single buffer.
+  void stageMulti(QCallback *callback, std::deque<EncodedRequest> &&reqs);
+
+  std::future<redisReplyPtr> stageMulti(std::deque<EncodedRequest> &&reqs);
+
+  // Stage a request whose reply is streamed to the given callback, see
+  // QStreamingCallback.
+  void stageStreaming(QStreamingCallback *callback, EncodedRequest &&req);
+
+  // If the next reply belongs to a request staged with stageStreaming,
+  // return its callback. nullptr otherwise.
+  QStreamingCallback* getStreamingCallback();
+
 #if HAVE_FOLLY == 1
   folly::Future<redisReplyPtr> follyStage(EncodedRequest &&req,
                                           size_t multiSize = 0u);
+
+  folly::Future<redisReplyPtr> follyStageMulti(std::deque<EncodedRequest> &&reqs);
 #endif
 
   void setBlockingMode(bool value);
 
   StagedRequest* getNextToWrite();
 
+  // Same as getNextToWrite, but never blocks: Returns nullptr if there's
+  // nothing staged at the moment.
+  StagedRequest* tryGetNextToWrite();
+
+  // Same as tryGetNextToWrite, but trims the request queue in exclusive
+  // pub-sub mode just like getNextToWrite. Only safe when the writer holds
+  // no previously returned requests which are still being written, and
+  // runs on the same thread as the reader.
+  StagedRequest* pollNextToWrite();
+
+  // For writers which don't block in getNextToWrite: Once parked, staging a
+  // request calls the notifier, at most once until parkWriter is called
+  // again. Returns false if something arrived in the meantime, in which
+  // case the writer is not parked and should keep going.
+  //
+  // Producers call the notifier without synchronization: Set it before the
+  // writer first parks, and never change it afterwards.
+  void setWriteNotifier(std::function<void()> notifier);
+  bool parkWriter();
+
   // Wipe out pending request queue - return size of queue
   size_t clearAllPending();
 
+  // Requests staged, but not acknowledged yet. Safe to call from any thread,
+  // though only a snapshot while requests are in flight.
+  size_t getPendingCount() const {
+    return requestQueue.size();
+  }
+
   //----------------------------------------------------------------------------
   //! Mesasure request performance and sent info to the perf callback
   //!
@@ -94,6 +161,7 @@ private:
   bool exclusivePubsub;
 
   void acknowledgePending(redisReplyPtr &&reply);
+  void wakeWriter();
   void discardPending();
   size_t ignoredResponses = 0u;
 
@@ -113,9 +181,18 @@ private:
 
   // NOTE: cbExecutor must be destroyed before FutureHandler, so it has to be
   // below it in the member variables definition.
-  CallbackExecutorThread cbExecutor;
+  //
+  // Not created at all when callbacks run inline, on the thread consuming
+  // responses - see Options::inlineCallbacks. When a user-provided executor
+  // is in use, dispatcher takes the place of cbExecutor.
+  bool inlineCallbacks;
+  std::unique_ptr<CallbackExecutorThread> cbExecutor;
+  std::unique_ptr<CallbackDispatcher> dispatcher;
   QPerfCallback* mPerfCb = nullptr; ///< Performance measurement callback
   std::mutex mtx;
+
+  std::function<void()> writeNotifier;
+  std::atomic<bool> writerParked {false};
 };
 
 }
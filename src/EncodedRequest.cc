@@ -30,11 +30,25 @@
 namespace qclient {
 
 void EncodedRequest::initFromChunks(size_t nchunks, const char** chunks, const size_t* sizes) {
+  fmt::format_int nchunksFormatted(nchunks);
+
+  char header[32];
+  header[0] = '*';
+  memcpy(header+1, nchunksFormatted.data(), nchunksFormatted.size());
+
+  size_t headerLen = 1 + nchunksFormatted.size();
+  header[headerLen++] = '\r';
+  header[headerLen++] = '\n';
+
+  initFromPrefix(header, headerLen, nchunks, chunks, sizes);
+}
+
+void EncodedRequest::initFromPrefix(const char* prefix, size_t prefixLen, size_t nchunks,
+  const char** chunks, const size_t* sizes) {
+
   // First, format all integers we're going to need.. fmt::format_int
   // keeps its buffers on the stack.
 
-  fmt::format_int nchunksFormatted(nchunks);
-
   // Abuse a stack memory region to store fmt::format_int's. I found no better
   // way to do this, while making sure all variables are kept on the stack.
   // We use placement new to construct the objects directly in a custom memory
@@ -45,15 +59,62 @@ void EncodedRequest::initFromChunks(size_t nchunks, const char** chunks, const s
   }
 
   // Calculate the required size of our buffer.
-  length = 0;
+  length = prefixLen;
   for(size_t i = 0; i < nchunks; i++) {
     length += sizes[i] + (((fmt::format_int*) memoryRegion)[i]).size();
     length += 1 + 2 + 2;
   }
 
+  char* buff = allocateBuffer(length);
+  memcpy(buff, prefix, prefixLen);
+  size_t pos = prefixLen;
+
+  for(size_t i = 0; i < nchunks; i++) {
+    buff[pos++] = '$';
+
+    fmt::format_int *formatted = reinterpret_cast<fmt::format_int*>(&memoryRegion[sizeof(fmt::format_int)*i]);
+    memcpy(buff+pos, formatted->data(), formatted->size());
+    pos += formatted->size();
+
+    buff[pos++] = '\r';
+    buff[pos++] = '\n';
+
+    memcpy(buff+pos, chunks[i], sizes[i]);
+    pos += sizes[i];
+
+    buff[pos++] = '\r';
+    buff[pos++] = '\n';
+  }
+}
+
+void EncodedRequest::initFromRequestChunks(size_t nchunks, const RequestChunk* chunks) {
+  fmt::format_int nchunksFormatted(nchunks);
+
+  // Same trick as in initFromChunks, keep fmt::format_int's on the stack.
+  char memoryRegion[sizeof(fmt::format_int) * nchunks];
+  for(size_t i = 0; i < nchunks; i++) {
+    new (memoryRegion + (i*sizeof(fmt::format_int))) fmt::format_int(chunks[i].size);
+  }
+
+  auto isReferenced = [](const RequestChunk &chunk) {
+    return chunk.payload != nullptr && chunk.size >= kZeroCopyThreshold;
+  };
+
+  // Calculate the total length, and how much of it goes into our buffer.
+  length = 0;
+  size_t referenced = 0;
+  for(size_t i = 0; i < nchunks; i++) {
+    length += chunks[i].size + (((fmt::format_int*) memoryRegion)[i]).size();
+    length += 1 + 2 + 2;
+
+    if(isReferenced(chunks[i])) {
+      referenced += chunks[i].size;
+    }
+  }
+
   length += nchunksFormatted.size() + 3;
 
-  char* buff = (char*) malloc(length);
+  char* buff = allocateBuffer(length - referenced);
   buff[0] = '*';
   memcpy(buff+1, nchunksFormatted.data(), nchunksFormatted.size());
 
@@ -61,6 +122,8 @@ void EncodedRequest::initFromChunks(size_t nchunks, const char** chunks, const s
   buff[pos++] = '\r';
   buff[pos++] = '\n';
 
+  size_t segmentStart = 0;
+
   for(size_t i = 0; i < nchunks; i++) {
     buff[pos++] = '$';
 
@@ -71,14 +134,62 @@ void EncodedRequest::initFromChunks(size_t nchunks, const char** chunks, const s
     buff[pos++] = '\r';
     buff[pos++] = '\n';
 
-    memcpy(buff+pos, chunks[i], sizes[i]);
-    pos += sizes[i];
+    if(isReferenced(chunks[i])) {
+      addBufferSegment(segmentStart, pos - segmentStart);
+      addPayloadSegment(*chunks[i].payload, 0, chunks[i].size);
+      segmentStart = pos;
+    }
+    else {
+      memcpy(buff+pos, chunks[i].data, chunks[i].size);
+      pos += chunks[i].size;
+    }
 
     buff[pos++] = '\r';
     buff[pos++] = '\n';
   }
 
-  buffer.reset(buff);
+  if(!segments.empty()) {
+    addBufferSegment(segmentStart, pos - segmentStart);
+  }
+}
+
+void EncodedRequest::addBufferSegment(size_t offset, size_t len) {
+  if(len == 0) return;
+
+  if(!segments.empty()) {
+    Segment &last = segments.back();
+    if(last.payload < 0 && last.offset + last.length == offset) {
+      last.length += len;
+      return;
+    }
+  }
+
+  segments.push_back(Segment { -1, offset, len });
+}
+
+void EncodedRequest::addPayloadSegment(const RequestPayload &payload, size_t offset, size_t len) {
+  if(len == 0) return;
+
+  if(payloads.empty() || payloads.back() != payload) {
+    payloads.push_back(payload);
+  }
+
+  segments.push_back(Segment { (int64_t) payloads.size() - 1, offset, len });
+}
+
+char* EncodedRequest::allocateBuffer(size_t len) {
+  bufferLength = len;
+
+  if(len <= kInlineCapacity) {
+    buffer = inlineStorage;
+    allocator = nullptr;
+  }
+  else {
+    allocator = RequestBufferAllocator::getDefault();
+    buffer = allocator->allocate(len);
+  }
+
+  return buffer;
 }
 
 EncodedRequest::EncodedRequest(size_t nchunks, const char** chunks, const size_t* sizes) {
@@ -86,21 +197,54 @@ EncodedRequest::EncodedRequest(size_t nchunks, const char** chunks, const size_t
 }
 
 EncodedRequest EncodedRequest::fuseIntoBlock(const std::deque<EncodedRequest> &block) {
+  //----------------------------------------------------------------------------
+  // Everything stored in the buffers of the individual requests is copied,
+  // referenced payloads remain referenced.
+  //----------------------------------------------------------------------------
   size_t fusedSize = 0u;
+  size_t copiedSize = 0u;
+  bool contiguous = true;
+
   for(size_t i = 0; i < block.size(); i++) {
     fusedSize += block[i].getLen();
+
+    if(block[i].isContiguous()) {
+      copiedSize += block[i].getLen();
+    }
+    else {
+      contiguous = false;
+      copiedSize += block[i].bufferLength;
+    }
   }
 
-  char* buff = (char*) malloc(fusedSize);
+  EncodedRequest fused;
+  fused.length = fusedSize;
+  char* buff = fused.allocateBuffer(copiedSize);
 
   size_t pos = 0;
   for(size_t i = 0; i < block.size(); i++) {
-    size_t localSize = block[i].getLen();
-    memcpy(buff+pos, block[i].getBuffer(), localSize);
-    pos += localSize;
+    const EncodedRequest &req = block[i];
+
+    if(req.isContiguous()) {
+      memcpy(buff+pos, req.getBuffer(), req.getLen());
+      if(!contiguous) fused.addBufferSegment(pos, req.getLen());
+      pos += req.getLen();
+      continue;
+    }
+
+    for(const Segment &segment : req.segments) {
+      if(segment.payload >= 0) {
+        fused.addPayloadSegment(req.payloads[segment.payload], segment.offset, segment.length);
+        continue;
+      }
+
+      memcpy(buff+pos, req.buffer + segment.offset, segment.length);
+      fused.addBufferSegment(pos, segment.length);
+      pos += segment.length;
+    }
   }
 
-  return EncodedRequest(buff, fusedSize);
+  return fused;
 }
 
 EncodedRequest EncodedRequest::fuseIntoBlockAndSurround(std::deque<EncodedRequest> &&block) {
@@ -130,12 +274,23 @@ std::string escapeNonPrintable(const std::string &str) {
 }
 }
 
+std::string EncodedRequest::toString() const {
+  std::string retval;
+  retval.reserve(length);
+
+  for(size_t i = 0; i < getSegmentCount(); i++) {
+    retval.append(getSegmentData(i), getSegmentLength(i));
+  }
+
+  return retval;
+}
+
 std::string EncodedRequest::toPrintableString() const {
   if(!buffer) {
     return "!!!uninitialized!!!";
   }
 
-  return escapeNonPrintable(std::string(buffer.get(), length));
+  return escapeNonPrintable(toString());
 }
 
 }
\ No newline at end of file
@@ -89,6 +89,7 @@ bool EndpointDecider::getNextEndpoint(ServiceEndpoint &resolved) {
     Endpoint endpoint = getNext();
 
     Status st;
+    current = endpoint;
     resolvedEndpoints = resolver->resolve(endpoint.getHost(), endpoint.getPort(), st);
     std::reverse(resolvedEndpoints.begin(), resolvedEndpoints.end());
 
@@ -121,5 +122,12 @@ bool EndpointDecider::madeFullCircle() const {
   return fullCircle;
 }
 
+//------------------------------------------------------------------------------
+// The non-resolved endpoint behind the last service endpoint handed out
+//------------------------------------------------------------------------------
+const Endpoint& EndpointDecider::getCurrent() const {
+  return current;
+}
+
 
 }
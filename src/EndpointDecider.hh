@@ -79,6 +79,12 @@ public:
   //----------------------------------------------------------------------------
   bool madeFullCircle() const;
 
+  //----------------------------------------------------------------------------
+  // The non-resolved endpoint behind the last service endpoint handed out -
+  // either a member, or a redirection target.
+  //----------------------------------------------------------------------------
+  const Endpoint& getCurrent() const;
+
 
 private:
   Logger *logger;
@@ -89,6 +95,7 @@ private:
 
   Members members;
   Endpoint redirection;
+  Endpoint current;
 
   std::vector<ServiceEndpoint> resolvedEndpoints;
 
@@ -0,0 +1,254 @@
+//------------------------------------------------------------------------------
+// File: EventLoop.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "EventLoop.hh"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <iostream>
+#include <signal.h>
+#include <future>
+#include <cmath>
+
+namespace qclient {
+
+static constexpr int kMaxEventsPerIteration = 256;
+
+EventLoop::EventLoop() {
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if(epollFd < 0) {
+    std::cerr << "EventLoop: CRITICAL: Could not create epoll instance, errno = " << errno << std::endl;
+    std::abort();
+  }
+
+  //----------------------------------------------------------------------------
+  // epoll is Linux-only anyway, so use a real eventfd for wakeups instead of
+  // EventFD's pipe. Edge-triggered: every write() raises a new event, so
+  // there's no need to ever read() it back - the counter won't overflow in
+  // our lifetime.
+  //
+  // It's the only fd not belonging to a handler - recognized by its number,
+  // like all the others.
+  //----------------------------------------------------------------------------
+  wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(wakeupFd < 0) {
+    std::cerr << "EventLoop: CRITICAL: Could not create eventfd, errno = " << errno << std::endl;
+    std::abort();
+  }
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = wakeupFd;
+  if(epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &ev) != 0) {
+    std::cerr << "EventLoop: CRITICAL: Could not register wakeup fd, errno = " << errno << std::endl;
+    std::abort();
+  }
+
+  thread.reset(&EventLoop::main, this);
+}
+
+EventLoop::~EventLoop() {
+  thread.stop();
+  wakeup();
+  thread.join();
+
+  runTasks();
+  ::close(wakeupFd);
+  ::close(epollFd);
+}
+
+void EventLoop::wakeup() {
+  uint64_t value = 1;
+  if(::write(wakeupFd, &value, sizeof(value)) != sizeof(value)) {
+    std::cerr << "EventLoop: could not write to eventfd, errno = " << errno << std::endl;
+  }
+}
+
+bool EventLoop::inLoopThread() const {
+  return loopThreadId.load() == std::this_thread::get_id();
+}
+
+void EventLoop::watch(int fd, uint32_t events, EventHandler *handler) {
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.fd = fd;
+
+  auto it = handlers.find(fd);
+  if(it == handlers.end()) {
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      std::cerr << "EventLoop: Could not add fd " << fd << " to epoll, errno = " << errno << std::endl;
+    }
+
+    handlers[fd] = handler;
+    return;
+  }
+
+  it->second = handler;
+  if(epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+    std::cerr << "EventLoop: Could not modify fd " << fd << " in epoll, errno = " << errno << std::endl;
+  }
+}
+
+void EventLoop::unwatch(int fd) {
+  auto it = handlers.find(fd);
+  if(it == handlers.end()) return;
+
+  handlers.erase(it);
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+
+  //----------------------------------------------------------------------------
+  // The handler may be going away: make sure we don't deliver anything
+  // already collected for this fd.
+  //----------------------------------------------------------------------------
+  for(int i = 0; i < currentEventCount; i++) {
+    if(currentEvents[i].data.fd == fd) {
+      currentEvents[i].data.fd = -1;
+    }
+  }
+}
+
+void EventLoop::setTimer(EventHandler *handler, Clock::time_point deadline) {
+  cancelTimer(handler);
+  timers.emplace(deadline, handler);
+  timerDeadlines[handler] = deadline;
+}
+
+void EventLoop::cancelTimer(EventHandler *handler) {
+  auto it = timerDeadlines.find(handler);
+  if(it == timerDeadlines.end()) return;
+
+  timers.erase(std::make_pair(it->second, handler));
+  timerDeadlines.erase(it);
+}
+
+void EventLoop::post(std::function<void()> &&task) {
+  bool wasEmpty;
+
+  {
+    std::lock_guard<std::mutex> lock(tasksMtx);
+    wasEmpty = tasks.empty();
+    tasks.emplace_back(std::move(task));
+  }
+
+  //----------------------------------------------------------------------------
+  // If there were tasks pending already, somebody has woken up the loop.
+  // No need to do it either if we're the loop, tasks run at the end of
+  // every iteration.
+  //----------------------------------------------------------------------------
+  if(wasEmpty && !inLoopThread()) {
+    wakeup();
+  }
+}
+
+void EventLoop::runSync(std::function<void()> &&task) {
+  if(inLoopThread()) {
+    task();
+    return;
+  }
+
+  std::promise<void> done;
+  post([&]() {
+    task();
+    done.set_value();
+  });
+
+  done.get_future().wait();
+}
+
+//------------------------------------------------------------------------------
+// Milliseconds until the earliest timer, rounded up - or -1 if there are no
+// timers, to sleep indefinitely.
+//------------------------------------------------------------------------------
+int EventLoop::computeTimeout() {
+  if(timers.empty()) return -1;
+
+  Clock::duration remaining = timers.begin()->first - Clock::now();
+  if(remaining <= Clock::duration::zero()) return 0;
+
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(remaining);
+  if(ms < remaining) ms++;
+  return ms.count();
+}
+
+void EventLoop::runTimers() {
+  Clock::time_point now = Clock::now();
+
+  while(!timers.empty() && timers.begin()->first <= now) {
+    EventHandler *handler = timers.begin()->second;
+    timers.erase(timers.begin());
+    timerDeadlines.erase(handler);
+    handler->handleTimer();
+  }
+}
+
+void EventLoop::runTasks() {
+  std::vector<std::function<void()>> batch;
+
+  {
+    std::lock_guard<std::mutex> lock(tasksMtx);
+    std::swap(batch, tasks);
+  }
+
+  for(auto &task : batch) {
+    task();
+  }
+}
+
+void EventLoop::main(ThreadAssistant &assistant) {
+  signal(SIGPIPE, SIG_IGN);
+  loopThreadId = std::this_thread::get_id();
+
+  struct epoll_event events[kMaxEventsPerIteration];
+
+  while(!assistant.terminationRequested()) {
+    int count = epoll_wait(epollFd, events, kMaxEventsPerIteration, computeTimeout());
+    iterations++;
+
+    if(count < 0 && errno != EINTR) {
+      std::cerr << "EventLoop: error during epoll_wait, errno = " << errno << std::endl;
+    }
+
+    currentEvents = events;
+    currentEventCount = std::max(count, 0);
+
+    for(int i = 0; i < currentEventCount; i++) {
+      int fd = events[i].data.fd;
+      if(fd < 0) continue;
+
+      if(fd == wakeupFd) continue;
+
+      auto it = handlers.find(fd);
+      if(it != handlers.end()) {
+        it->second->handleEvents(fd, events[i].events);
+      }
+    }
+
+    currentEvents = nullptr;
+    currentEventCount = 0;
+
+    runTimers();
+    runTasks();
+  }
+}
+
+}
@@ -0,0 +1,141 @@
+//------------------------------------------------------------------------------
+// File: EventLoop.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_EVENT_LOOP_HH
+#define QCLIENT_EVENT_LOOP_HH
+
+#include "qclient/AssistedThread.hh"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct epoll_event;
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// Something registered with an EventLoop: Receives readiness events for its
+// file descriptors, and timer expirations. Always called on the loop thread.
+//------------------------------------------------------------------------------
+class EventHandler {
+public:
+  virtual ~EventHandler() {}
+
+  // events is a mask of EPOLLIN, EPOLLOUT, EPOLLERR, EPOLLHUP.
+  virtual void handleEvents(int fd, uint32_t events) = 0;
+  virtual void handleTimer() = 0;
+};
+
+//------------------------------------------------------------------------------
+// A single epoll-based thread, multiplexing the file descriptors and timers
+// of many EventHandlers - see EventLoopGroup.
+//
+// Everything except post() and runSync() must be called on the loop thread.
+//------------------------------------------------------------------------------
+class EventLoop {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  EventLoop();
+
+  //----------------------------------------------------------------------------
+  // All handlers must have been detached by now.
+  //----------------------------------------------------------------------------
+  ~EventLoop();
+
+  //----------------------------------------------------------------------------
+  // Start watching fd for the given events, or change the events being
+  // watched if we're doing so already. Level-triggered.
+  //----------------------------------------------------------------------------
+  void watch(int fd, uint32_t events, EventHandler *handler);
+
+  //----------------------------------------------------------------------------
+  // Stop watching fd. Events already collected for it during the current
+  // iteration are dropped, even if they're yet to be delivered.
+  //----------------------------------------------------------------------------
+  void unwatch(int fd);
+
+  //----------------------------------------------------------------------------
+  // Call handleTimer once the deadline passes. A handler has at most one
+  // timer: Setting it again replaces the previous deadline.
+  //----------------------------------------------------------------------------
+  void setTimer(EventHandler *handler, Clock::time_point deadline);
+  void cancelTimer(EventHandler *handler);
+
+  //----------------------------------------------------------------------------
+  // Run the given task on the loop thread, at the end of the current or next
+  // iteration. Tasks run in the order they were posted. Thread-safe.
+  //----------------------------------------------------------------------------
+  void post(std::function<void()> &&task);
+
+  //----------------------------------------------------------------------------
+  // Same as post, but block until the task has run. Runs the task right away
+  // if called on the loop thread.
+  //----------------------------------------------------------------------------
+  void runSync(std::function<void()> &&task);
+
+  bool inLoopThread() const;
+
+  //----------------------------------------------------------------------------
+  // How many iterations has the loop gone through? A rough measure of how
+  // many times it has woken up.
+  //----------------------------------------------------------------------------
+  uint64_t getIterations() const {
+    return iterations;
+  }
+
+private:
+  void main(ThreadAssistant &assistant);
+  int computeTimeout();
+  void runTimers();
+  void runTasks();
+
+  void wakeup();
+
+  int epollFd = -1;
+  int wakeupFd = -1;
+
+  // Only accessed from the loop thread.
+  std::unordered_map<int, EventHandler*> handlers;
+  std::set<std::pair<Clock::time_point, EventHandler*>> timers;
+  std::map<EventHandler*, Clock::time_point> timerDeadlines;
+  struct epoll_event *currentEvents = nullptr;
+  int currentEventCount = 0;
+
+  std::mutex tasksMtx;
+  std::vector<std::function<void()>> tasks;
+
+  std::atomic<uint64_t> iterations {0};
+  std::atomic<std::thread::id> loopThreadId;
+  AssistedThread thread;
+};
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// File: EventLoopGroup.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "qclient/EventLoopGroup.hh"
+#include "EventLoop.hh"
+
+namespace qclient {
+
+EventLoopGroup::EventLoopGroup(size_t threads, size_t resolverThreads) {
+  if(threads == 0) {
+    threads = 1;
+  }
+
+  for(size_t i = 0; i < threads; i++) {
+    loops.emplace_back(new EventLoop());
+  }
+
+  if(resolverThreads != 0) {
+    resolver.reset(new WorkStealingExecutor(resolverThreads));
+  }
+}
+
+EventLoopGroup::~EventLoopGroup() {}
+
+uint64_t EventLoopGroup::getIterations() const {
+  uint64_t total = 0;
+
+  for(const auto &loop : loops) {
+    total += loop->getIterations();
+  }
+
+  return total;
+}
+
+EventLoop* EventLoopGroup::pick() {
+  return loops[nextLoop++ % loops.size()].get();
+}
+
+}
@@ -47,6 +47,11 @@ std::string escapeNonPrintable(const std::string &str) {
   }
   return ss.str();
 }
+
+bool isAggregate(const redisReply *const reply) {
+  return reply->type == REDIS_REPLY_ARRAY || reply->type == REDIS_REPLY_PUSH ||
+         reply->type == REDIS_REPLY_MAP || reply->type == REDIS_REPLY_SET;
+}
 }
 
 namespace qclient {
@@ -72,18 +77,52 @@ std::string describeRedisReply(const redisReply *const redisReply, const std::st
     return SSTR(prefix << escapeNonPrintable(std::string(redisReply->str, redisReply->len)));
   }
 
-  if(redisReply->type == REDIS_REPLY_STRING) {
+  if(redisReply->type == REDIS_REPLY_STRING || redisReply->type == REDIS_REPLY_VERB) {
     return SSTR(prefix << "\"" <<
       escapeNonPrintable(std::string(redisReply->str, redisReply->len)) <<
       "\"");
   }
 
+  if(redisReply->type == REDIS_REPLY_DOUBLE) {
+    return SSTR(prefix << "(double) " << std::string(redisReply->str, redisReply->len));
+  }
+
+  if(redisReply->type == REDIS_REPLY_BOOL) {
+    return SSTR(prefix << (redisReply->integer ? "(true)" : "(false)"));
+  }
+
+  if(redisReply->type == REDIS_REPLY_BIGNUM) {
+    return SSTR(prefix << "(big number) " << std::string(redisReply->str, redisReply->len));
+  }
+
   std::string spacePrefix;
   for(size_t i = 0; i < prefix.size(); i++) {
     spacePrefix += " ";
   }
 
-  if(redisReply->type == REDIS_REPLY_ARRAY || redisReply->type == REDIS_REPLY_PUSH) {
+  // Same layout as redis-cli: "1# key => value"
+  if(redisReply->type == REDIS_REPLY_MAP) {
+    std::stringstream ss;
+
+    if(redisReply->elements == 0u) {
+      ss << prefix << "(empty hash)" << std::endl;
+    }
+
+    for(size_t i = 0; i + 1 < redisReply->elements; i += 2) {
+      std::string key = describeRedisReply(redisReply->element[i],
+        SSTR((i == 0 ? prefix : spacePrefix) << (i/2)+1 << "# "));
+
+      ss << describeRedisReply(redisReply->element[i+1], SSTR(key << " => "));
+
+      if(!isAggregate(redisReply->element[i+1])) {
+        ss << std::endl;
+      }
+    }
+
+    return ss.str();
+  }
+
+  if(isAggregate(redisReply)) {
     std::stringstream ss;
 
     if(redisReply->elements == 0u) {
@@ -98,7 +137,7 @@ std::string describeRedisReply(const redisReply *const redisReply, const std::st
         ss << describeRedisReply(redisReply->element[i], SSTR(spacePrefix << i+1 << ") ") );
       }
 
-      if(redisReply->element[i]->type != REDIS_REPLY_ARRAY && redisReply->element[i]->type != REDIS_REPLY_PUSH) {
+      if(!isAggregate(redisReply->element[i])) {
         ss << std::endl;
       }
     }
@@ -63,4 +63,23 @@ void FutureHandler::handleResponse(redisReplyPtr &&reply) {
   promises.pop_front();
 }
 
+BatchFutureHandler::BatchFutureHandler(size_t count) : expected(count) {
+  replies.reserve(count);
+}
+
+BatchFutureHandler::~BatchFutureHandler() {}
+
+std::future<std::vector<redisReplyPtr>> BatchFutureHandler::getFuture() {
+  return promise.get_future();
+}
+
+void BatchFutureHandler::handleResponse(redisReplyPtr &&reply) {
+  replies.emplace_back(std::move(reply));
+
+  if(replies.size() == expected) {
+    promise.set_value(std::move(replies));
+    delete this;
+  }
+}
+
 }
@@ -27,6 +27,7 @@
 #include "qclient/QCallback.hh"
 #include "qclient/queueing/ThreadSafeQueue.hh"
 #include <future>
+#include <vector>
 
 #if HAVE_FOLLY == 1
 #include <folly/futures/Future.h>
@@ -59,6 +60,25 @@ private:
   ThreadSafeQueue<std::promise<redisReplyPtr>, 5000> promises;
 };
 
+//------------------------------------------------------------------------------
+// Collects the replies of a batch of requests, and satisfies a single future
+// once all of them have arrived. Heap-allocated per batch, deletes itself
+// after handling the last reply.
+//------------------------------------------------------------------------------
+class BatchFutureHandler : public QCallback {
+public:
+  BatchFutureHandler(size_t count);
+  virtual ~BatchFutureHandler();
+
+  std::future<std::vector<redisReplyPtr>> getFuture();
+  virtual void handleResponse(redisReplyPtr &&reply) override;
+
+private:
+  size_t expected;
+  std::vector<redisReplyPtr> replies;
+  std::promise<std::vector<redisReplyPtr>> promise;
+};
+
 }
 
 #endif
@@ -27,6 +27,7 @@
 #include <iostream>
 #include "qclient/Handshake.hh"
 #include "qclient/utils/Macros.hh"
+#include "qclient/QClient.hh"
 using namespace qclient;
 
 //------------------------------------------------------------------------------
@@ -343,6 +344,97 @@ std::unique_ptr<Handshake> ActivatePushTypesHandshake::clone() const {
   return std::unique_ptr<Handshake>(new ActivatePushTypesHandshake());
 }
 
+//------------------------------------------------------------------------------
+// Activate stale reads handshake: Constructor
+//------------------------------------------------------------------------------
+ActivateStaleReadsHandshake::ActivateStaleReadsHandshake(bool ignorefail)
+: ignoreFailures(ignorefail) {}
+
+//------------------------------------------------------------------------------
+// Activate stale reads handshake: Destructor
+//------------------------------------------------------------------------------
+ActivateStaleReadsHandshake::~ActivateStaleReadsHandshake() {}
+
+//------------------------------------------------------------------------------
+// Activate stale reads handshake: Provide handshake
+//------------------------------------------------------------------------------
+std::vector<std::string> ActivateStaleReadsHandshake::provideHandshake() {
+  return { "ACTIVATE-STALE-READS" };
+}
+
+//------------------------------------------------------------------------------
+// Activate stale reads handshake: Validate response, expect OK
+//------------------------------------------------------------------------------
+Handshake::Status ActivateStaleReadsHandshake::validateResponse(const redisReplyPtr &reply) {
+  if(ignoreFailures) {
+    return Status::VALID_COMPLETE;
+  }
+
+  if(reply->type != REDIS_REPLY_STATUS || std::string(reply->str, reply->len) != "OK") {
+    std::cerr << "qclient: ActivateStaleReadsHandshake received invalid response - " << qclient::describeRedisReply(reply) << std::endl;
+    return Status::INVALID;
+  }
+
+  return Status::VALID_COMPLETE;
+}
+
+//------------------------------------------------------------------------------
+// Activate stale reads handshake: Restart
+//------------------------------------------------------------------------------
+void ActivateStaleReadsHandshake::restart() {}
+
+//------------------------------------------------------------------------------
+// Activate stale reads handshake: Clone
+//------------------------------------------------------------------------------
+std::unique_ptr<Handshake> ActivateStaleReadsHandshake::clone() const {
+  return std::unique_ptr<Handshake>(new ActivateStaleReadsHandshake(ignoreFailures));
+}
+
+//------------------------------------------------------------------------------
+// Hello3 handshake: Constructor
+//------------------------------------------------------------------------------
+Hello3Handshake::Hello3Handshake(bool ignorefail) : ignoreFailures(ignorefail) {}
+
+//------------------------------------------------------------------------------
+// Hello3 handshake: Destructor
+//------------------------------------------------------------------------------
+Hello3Handshake::~Hello3Handshake() {}
+
+//------------------------------------------------------------------------------
+// Hello3 handshake: Provide handshake
+//------------------------------------------------------------------------------
+std::vector<std::string> Hello3Handshake::provideHandshake() {
+  return { "HELLO", "3" };
+}
+
+//------------------------------------------------------------------------------
+// Hello3 handshake: Validate response, expect a map
+//------------------------------------------------------------------------------
+Handshake::Status Hello3Handshake::validateResponse(const redisReplyPtr &reply) {
+  if(ignoreFailures) {
+    return Status::VALID_COMPLETE;
+  }
+
+  if(!reply || reply->type != REDIS_REPLY_MAP) {
+    std::cerr << "qclient: Hello3Handshake received invalid response - " << qclient::describeRedisReply(reply) << std::endl;
+    return Status::INVALID;
+  }
+
+  return Status::VALID_COMPLETE;
+}
+
+//------------------------------------------------------------------------------
+// Hello3 handshake: Restart
+//------------------------------------------------------------------------------
+void Hello3Handshake::restart() {}
+
+//------------------------------------------------------------------------------
+// Hello3 handshake: Clone
+//------------------------------------------------------------------------------
+std::unique_ptr<Handshake> Hello3Handshake::clone() const {
+  return std::unique_ptr<Handshake>(new Hello3Handshake(ignoreFailures));
+}
+
 //------------------------------------------------------------------------------
 // Set client name handshake: Constructor
 //------------------------------------------------------------------------------
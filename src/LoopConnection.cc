@@ -0,0 +1,405 @@
+//------------------------------------------------------------------------------
+// File: LoopConnection.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "LoopConnection.hh"
+#include "qclient/QClient.hh"
+#include "qclient/Logger.hh"
+#include "qclient/network/HostResolver.hh"
+#include "network/NetworkStream.hh"
+#include "WriterThread.hh"
+#include "EndpointDecider.hh"
+#include "ConnectionCore.hh"
+#include "qclient/Executor.hh"
+#include <sys/epoll.h>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// Batches written per turn - a client with a constant stream of requests
+// mustn't starve the other connections on the same loop.
+//------------------------------------------------------------------------------
+static constexpr size_t kMaxBatchesPerTurn = 16;
+
+LoopConnection::LoopConnection(QClient &qc, EventLoop *lp, Executor *res)
+: qcl(qc), loop(lp), resolver(res), alive(std::make_shared<bool>(true)) {}
+
+LoopConnection::~LoopConnection() {}
+
+void LoopConnection::post(std::function<void()> &&task) {
+  std::weak_ptr<bool> token = alive;
+
+  loop->post([token, task]() {
+    if(token.lock()) {
+      task();
+    }
+  });
+}
+
+void LoopConnection::start() {
+  std::weak_ptr<bool> token = alive;
+  EventLoop *lp = loop;
+
+  //----------------------------------------------------------------------------
+  // Producers call the notifier concurrently, so it's never replaced: Once
+  // we're torn down, the expired token turns it into a no-op. It mustn't
+  // touch our members - only the posted task does, on the loop thread,
+  // after checking the token.
+  //----------------------------------------------------------------------------
+  qcl.connectionCore->setWriteNotifier([this, lp, token]() {
+    if(token.expired()) {
+      return;
+    }
+
+    lp->post([this, token]() {
+      if(token.lock()) {
+        writeRequests();
+      }
+    });
+  });
+
+  post([this]() { connect(); });
+}
+
+void LoopConnection::stop() {
+  loop->runSync([this]() { teardown(); });
+
+  //----------------------------------------------------------------------------
+  // Its result is dropped, but a lookup may still be using the QClient's
+  // EndpointDecider.
+  //----------------------------------------------------------------------------
+  std::unique_lock<std::mutex> lock(resolvingMtx);
+  resolvingCv.wait(lock, [this]() { return !resolving; });
+}
+
+//------------------------------------------------------------------------------
+// Same as QClient::connect and QClient::connectTCP, minus the blocking.
+//------------------------------------------------------------------------------
+void LoopConnection::connect() {
+  qcl.currentConnectionEpoch++;
+  if(qcl.currentConnectionEpoch != 1) {
+    qcl.cleanup(false);
+  }
+
+  receivedBytes = false;
+
+  if(!resolver) {
+    ServiceEndpoint resolved;
+    bool found = qcl.endpointDecider->getNextEndpoint(resolved);
+    finishResolving(found, resolved);
+    return;
+  }
+
+  //----------------------------------------------------------------------------
+  // getNextEndpoint may block in getaddrinfo: Keep it off the loop, so as to
+  // not hold up the other connections on it. Until the result is posted
+  // back, nothing on the loop touches the EndpointDecider - we're neither
+  // connected, nor backing off.
+  //----------------------------------------------------------------------------
+  state = State::kResolving;
+
+  {
+    std::lock_guard<std::mutex> lock(resolvingMtx);
+    resolving = true;
+  }
+
+  std::weak_ptr<bool> token = alive;
+  EventLoop *lp = loop;
+
+  resolver->execute([this, lp, token]() {
+    ServiceEndpoint resolved;
+    bool found = qcl.endpointDecider->getNextEndpoint(resolved);
+
+    {
+      std::lock_guard<std::mutex> lock(resolvingMtx);
+      resolving = false;
+      resolvingCv.notify_all();
+    }
+
+    //--------------------------------------------------------------------------
+    // stop() may have returned by now, and we may be gone: Only the token
+    // tells.
+    //--------------------------------------------------------------------------
+    lp->post([this, token, found, resolved]() {
+      if(token.lock()) {
+        finishResolving(found, resolved);
+      }
+    });
+  });
+}
+
+void LoopConnection::finishResolving(bool found, const ServiceEndpoint &resolved) {
+  if(!found) {
+    endEpoch();
+    return;
+  }
+
+  endpoint = resolved;
+  connector.reset(new AsyncConnector(endpoint));
+  if(!connector->ok()) {
+    QCLIENT_LOG(qcl.options.logger, LogLevel::kInfo, "Encountered an error when connecting to " << endpoint.getString() << ": " << connector->getError());
+    connector.reset();
+    endEpoch();
+    return;
+  }
+
+  //----------------------------------------------------------------------------
+  // The socket turns writable once ::connect completes, even if it did so
+  // immediately.
+  //----------------------------------------------------------------------------
+  state = State::kConnecting;
+  fd = connector->getFd();
+  loop->watch(fd, EPOLLOUT, this);
+  loop->setTimer(this, EventLoop::Clock::now() + qcl.options.tcpTimeout);
+}
+
+void LoopConnection::finishConnecting() {
+  loop->cancelTimer(this);
+
+  if(!connector->ok()) {
+    QCLIENT_LOG(qcl.options.logger, LogLevel::kInfo, "Encountered an error when connecting to " << endpoint.getString() << ": " << connector->getError());
+    loop->unwatch(fd);
+    connector.reset();
+    endEpoch();
+    return;
+  }
+
+  qcl.networkStream.reset(new NetworkStream(connector->release(), qcl.options.tlsconfig));
+  connector.reset();
+
+  if(!qcl.networkStream->ok()) {
+    loop->unwatch(fd);
+    endEpoch();
+    return;
+  }
+
+  qcl.notifyConnectionEstablished();
+  qcl.writerThread->clearBatch();
+
+  state = State::kConnected;
+  readSize = qcl.options.receiveBufferStrategy.getInitialReadSize();
+  wantWrite = false;
+  loop->watch(fd, EPOLLIN, this);
+
+  writeRequests();
+}
+
+void LoopConnection::handleEvents(int, uint32_t events) {
+  if(state == State::kConnecting) {
+    if(connector->handleEvent()) {
+      finishConnecting();
+    }
+
+    return;
+  }
+
+  if(state != State::kConnected) return;
+
+  if(events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+    readResponses();
+  }
+
+  if(state == State::kConnected && (events & EPOLLOUT)) {
+    writeRequests();
+  }
+}
+
+void LoopConnection::handleTimer() {
+  if(state == State::kConnecting) {
+    //--------------------------------------------------------------------------
+    // ::connect timed out
+    //--------------------------------------------------------------------------
+    loop->unwatch(fd);
+    connector.reset();
+    endEpoch();
+    return;
+  }
+
+  if(state == State::kBackoff) {
+    if(EventLoop::Clock::now() < backoffUntil) {
+      //------------------------------------------------------------------------
+      // Woke up early, pending requests ran out of retry time.
+      //------------------------------------------------------------------------
+      qcl.purgePendingRequests(false);
+      loop->setTimer(this, backoffUntil);
+      return;
+    }
+
+    //--------------------------------------------------------------------------
+    // Give some more leeway, update lastAvailable after sleeping.
+    //--------------------------------------------------------------------------
+    if(qcl.successfulResponses) {
+      qcl.lastAvailable = std::chrono::steady_clock::now();
+    }
+
+    if(backoff < std::chrono::milliseconds(2048)) {
+      backoff++;
+    }
+
+    connect();
+  }
+}
+
+//------------------------------------------------------------------------------
+// Same as QClient::handleConnectionEpoch: Keep reading until the socket has
+// nothing more to give - there may be data cached inside OpenSSL, which
+// epoll will not detect.
+//------------------------------------------------------------------------------
+void LoopConnection::readResponses() {
+  const ReceiveBufferStrategy &receiveStrategy = qcl.options.receiveBufferStrategy;
+  NetworkStream *networkStream = qcl.networkStream.get();
+
+  RecvStatus status(true, 0, 0);
+  do {
+    char *buffer = qcl.responseBuilder.getWritableTail(readSize);
+    if(!buffer) {
+      qcl.notifyConnectionLost(ENOMEM, "unable to allocate receive buffer");
+      endEpoch();
+      return;
+    }
+
+    status = networkStream->recv(buffer, readSize, 0);
+
+    if(!status.connectionAlive) {
+      endEpoch();
+      return;
+    }
+
+    if(status.bytesRead > 0) {
+      qcl.responseBuilder.commitTail(status.bytesRead);
+      readSize = receiveStrategy.nextReadSize(readSize, status.bytesRead);
+
+      if(!qcl.processResponses()) {
+        qcl.notifyConnectionLost(EINVAL, "protocol violation");
+        endEpoch();
+        return;
+      }
+    }
+
+    receivedBytes = true;
+  } while(status.bytesRead > 0 && networkStream->ok());
+
+  if(!networkStream->ok()) {
+    endEpoch();
+    return;
+  }
+
+  //----------------------------------------------------------------------------
+  // The replies may have advanced the handshake, or released requests
+  // waiting for it to complete.
+  //----------------------------------------------------------------------------
+  writeRequests();
+}
+
+void LoopConnection::writeRequests() {
+  if(state != State::kConnected) return;
+
+  switch(qcl.writerThread->writeSome(qcl.networkStream.get(), kMaxBatchesPerTurn)) {
+    case WriteStatus::kParked: {
+      setWantWrite(false);
+      return;
+    }
+    case WriteStatus::kBlocked:
+    case WriteStatus::kYielded: {
+      //------------------------------------------------------------------------
+      // When yielding, the socket is still writable: epoll will call us
+      // again during the next iteration, after the other connections have
+      // had their turn.
+      //------------------------------------------------------------------------
+      setWantWrite(true);
+      return;
+    }
+    case WriteStatus::kFailed: {
+      endEpoch();
+      return;
+    }
+  }
+}
+
+void LoopConnection::setWantWrite(bool value) {
+  if(wantWrite == value) return;
+
+  wantWrite = value;
+  loop->watch(fd, value ? (EPOLLIN | EPOLLOUT) : EPOLLIN, this);
+}
+
+//------------------------------------------------------------------------------
+// The current connection attempt, or connection, is over: Back off, then try
+// again. The connection itself is cleaned up when reconnecting, same as
+// QClient::eventLoop.
+//------------------------------------------------------------------------------
+void LoopConnection::endEpoch() {
+  if(state == State::kConnected) {
+    NetworkStream *networkStream = qcl.networkStream.get();
+    if(!networkStream->ok()) {
+      qcl.notifyConnectionLost(networkStream->getErrno(), networkStream->getError());
+    }
+
+    loop->unwatch(fd);
+  }
+
+  fd = -1;
+
+  if(receivedBytes) {
+    backoff = std::chrono::milliseconds(1);
+  }
+
+  //----------------------------------------------------------------------------
+  // Same as QClient::eventLoop: Should pending requests run out of retry time
+  // before the next attempt, wake up right then to discard them.
+  //----------------------------------------------------------------------------
+  state = State::kBackoff;
+  backoffUntil = EventLoop::Clock::now() + backoff;
+
+  EventLoop::Clock::time_point wakeup = backoffUntil;
+  std::chrono::steady_clock::time_point retryDeadline;
+
+  if(qcl.getRetryDeadline(retryDeadline) && retryDeadline < wakeup) {
+    wakeup = retryDeadline;
+  }
+
+  loop->setTimer(this, wakeup);
+}
+
+void LoopConnection::teardown() {
+  if(state == State::kConnected) {
+    qcl.notifyConnectionLost(0, "shutdown requested");
+  }
+
+  if(fd >= 0) {
+    loop->unwatch(fd);
+    fd = -1;
+  }
+
+  loop->cancelTimer(this);
+  connector.reset();
+  state = State::kStopped;
+
+  //----------------------------------------------------------------------------
+  // Nobody is going to write anymore - stops producers from posting on the
+  // loop, see start().
+  //----------------------------------------------------------------------------
+  alive.reset();
+  qcl.feed(NULL, 0);
+}
+
+}
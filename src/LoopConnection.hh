@@ -0,0 +1,115 @@
+//------------------------------------------------------------------------------
+// File: LoopConnection.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_LOOP_CONNECTION_HH
+#define QCLIENT_LOOP_CONNECTION_HH
+
+#include "EventLoop.hh"
+#include "qclient/network/AsyncConnector.hh"
+#include "qclient/network/HostResolver.hh"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace qclient {
+
+class QClient;
+class Executor;
+
+//------------------------------------------------------------------------------
+// Drives the connection of a QClient attached to an EventLoopGroup: The same
+// steps as QClient::eventLoop and WriterThread::eventLoop, turned into a
+// state machine running on a shared EventLoop instead of two threads of its
+// own.
+//
+// Since a connection is pinned to a single loop, reading, writing and
+// reconnecting never overlap - ordering is the same as with dedicated
+// threads. The one exception are DNS lookups, which run on the resolver,
+// if given one: The EndpointDecider is left alone until they're done.
+//------------------------------------------------------------------------------
+class LoopConnection : public EventHandler {
+public:
+  LoopConnection(QClient &qcl, EventLoop *loop, Executor *resolver);
+  virtual ~LoopConnection();
+
+  //----------------------------------------------------------------------------
+  // Start connecting. Thread-safe.
+  //----------------------------------------------------------------------------
+  void start();
+
+  //----------------------------------------------------------------------------
+  // Tear down the current connection, and detach from the loop. Blocks until
+  // done, including any DNS lookup in flight. Thread-safe.
+  //----------------------------------------------------------------------------
+  void stop();
+
+  virtual void handleEvents(int fd, uint32_t events) override final;
+  virtual void handleTimer() override final;
+
+private:
+  enum class State {
+    kIdle,
+    kResolving,
+    kConnecting,
+    kConnected,
+    kBackoff,
+    kStopped
+  };
+
+  void post(std::function<void()> &&task);
+  void connect();
+  void finishResolving(bool found, const ServiceEndpoint &resolved);
+  void finishConnecting();
+  void readResponses();
+  void writeRequests();
+  void setWantWrite(bool value);
+  void endEpoch();
+  void teardown();
+
+  QClient &qcl;
+  EventLoop *loop;
+  Executor *resolver;
+  State state = State::kIdle;
+
+  // Set while a DNS lookup runs on the resolver - stop() waits for it.
+  std::mutex resolvingMtx;
+  std::condition_variable resolvingCv;
+  bool resolving = false;
+
+  // Tasks posted on the loop hold a weak reference: Anything still queued
+  // after we're gone does nothing.
+  std::shared_ptr<bool> alive;
+
+  ServiceEndpoint endpoint;
+  std::unique_ptr<AsyncConnector> connector;
+  int fd = -1;
+  bool wantWrite = false;
+  size_t readSize = 0;
+  bool receivedBytes = false;
+  std::chrono::milliseconds backoff {1};
+  EventLoop::Clock::time_point backoffUntil;
+};
+
+}
+
+#endif
@@ -32,6 +32,42 @@
 
 using namespace qclient;
 
+//------------------------------------------------------------------------------
+// Make an independent copy: Everything shared_ptr is shared, the handshake
+// is cloned.
+//------------------------------------------------------------------------------
+Options Options::clone() const {
+  Options copy;
+  copy.transparentRedirects = transparentRedirects;
+  copy.retryStrategy = retryStrategy;
+  copy.backpressureStrategy = backpressureStrategy;
+  copy.writeCoalescingStrategy = writeCoalescingStrategy;
+  copy.receiveBufferStrategy = receiveBufferStrategy;
+  copy.arenaAllocatedReplies = arenaAllocatedReplies;
+  copy.zeroCopyReplies = zeroCopyReplies;
+  copy.queueSpinIterations = queueSpinIterations;
+  copy.inlineCallbacks = inlineCallbacks;
+  copy.callbackExecutor = callbackExecutor;
+  copy.callbackOrdering = callbackOrdering;
+  copy.eventLoopGroup = eventLoopGroup;
+  copy.singleThreadedConnection = singleThreadedConnection;
+  copy.transport = transport;
+  copy.readRouting = readRouting;
+  copy.tlsconfig = tlsconfig;
+
+  if(handshake) {
+    copy.handshake = handshake->clone();
+  }
+
+  copy.ensureConnectionIsPrimed = ensureConnectionIsPrimed;
+  copy.tcpTimeout = tcpTimeout;
+  copy.logger = logger;
+  copy.messageListener = messageListener;
+  copy.exclusivePubsub = exclusivePubsub;
+  copy.mPerfCb = mPerfCb;
+  return copy;
+}
+
 //------------------------------------------------------------------------------
 // Fluent interface: Chain HMAC handshake. If password is empty, any existing
 // handshake is left untouched.
@@ -97,3 +133,83 @@ qclient::Options& Options::withRetryStrategy(const RetryStrategy& str) {
   retryStrategy = str;
   return *this;
 }
+
+//------------------------------------------------------------------------------
+// Fluent interface: Setting write coalescing strategy
+//------------------------------------------------------------------------------
+qclient::Options& Options::withWriteCoalescingStrategy(const WriteCoalescingStrategy& str) {
+  writeCoalescingStrategy = str;
+  return *this;
+}
+
+//------------------------------------------------------------------------------
+// Fluent interface: Poll internal queues this many times before sleeping
+//------------------------------------------------------------------------------
+qclient::Options& Options::withQueueSpinning(size_t iterations) {
+  queueSpinIterations = iterations;
+  return *this;
+}
+
+//------------------------------------------------------------------------------
+// Fluent interface: Run callbacks on the reader thread
+//------------------------------------------------------------------------------
+qclient::Options& Options::withInlineCallbacks() {
+  inlineCallbacks = true;
+  return *this;
+}
+
+//------------------------------------------------------------------------------
+// Fluent interface: Run callbacks on the given executor
+//------------------------------------------------------------------------------
+qclient::Options& Options::withCallbackExecutor(std::shared_ptr<Executor> executor) {
+  callbackExecutor = executor;
+  return *this;
+}
+
+//------------------------------------------------------------------------------
+// Fluent interface: Setting callback ordering
+//------------------------------------------------------------------------------
+qclient::Options& Options::withCallbackOrdering(CallbackOrdering ordering) {
+  callbackOrdering = ordering;
+  return *this;
+}
+
+//------------------------------------------------------------------------------
+// Fluent interface: Attach to the given EventLoopGroup
+//------------------------------------------------------------------------------
+qclient::Options& Options::withEventLoopGroup(std::shared_ptr<EventLoopGroup> group) {
+  eventLoopGroup = group;
+  return *this;
+}
+
+//------------------------------------------------------------------------------
+// Fluent interface: Read and write on the same thread
+//------------------------------------------------------------------------------
+qclient::Options& Options::withSingleThreadedConnection() {
+  singleThreadedConnection = true;
+  return *this;
+}
+
+//------------------------------------------------------------------------------
+// Fluent interface: Talk to the socket through io_uring
+//------------------------------------------------------------------------------
+qclient::Options& Options::withIoUringTransport() {
+  transport = TransportBackend::kIoUring;
+  return *this;
+}
+
+//------------------------------------------------------------------------------
+// Fluent interface: Send eligible reads to followers
+//------------------------------------------------------------------------------
+qclient::Options& Options::withFollowerReads() {
+  readRouting = ReadRouting::kFollowers;
+  return *this;
+}
+
+//------------------------------------------------------------------------------
+// Fluent interface: Setting receive buffer strategy
+//------------------------------------------------------------------------------
+qclient::Options& Options::withReceiveBufferStrategy(const ReceiveBufferStrategy& str) {
+  receiveBufferStrategy = str;
+  return *this;
+}
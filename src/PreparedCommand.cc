@@ -0,0 +1,73 @@
+//------------------------------------------------------------------------------
+// File: PreparedCommand.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "qclient/PreparedCommand.hh"
+#include "fmt/format.h"
+
+namespace qclient {
+
+namespace {
+std::string encodeHeader(size_t nargs) {
+  fmt::format_int formatted(nargs);
+
+  std::string retval = "*";
+  retval.append(formatted.data(), formatted.size());
+  retval.append("\r\n");
+  return retval;
+}
+}
+
+PreparedCommand::PreparedCommand(std::initializer_list<std::string> fixed, size_t variable)
+: fixedArgs(fixed.size()), variableArgs(variable) {
+
+  prefix = encodeHeader(fixedArgs + variableArgs);
+  headerLength = prefix.size();
+
+  for(auto it = fixed.begin(); it != fixed.end(); it++) {
+    fmt::format_int formatted(it->size());
+
+    prefix.append("$");
+    prefix.append(formatted.data(), formatted.size());
+    prefix.append("\r\n");
+    prefix.append(*it);
+    prefix.append("\r\n");
+  }
+}
+
+EncodedRequest PreparedCommand::encodeChunks(size_t nchunks, const char** chunks, const size_t* sizes) const {
+  EncodedRequest retval;
+
+  if(nchunks == variableArgs) {
+    retval.initFromPrefix(prefix.data(), prefix.size(), nchunks, chunks, sizes);
+    return retval;
+  }
+
+  // Unexpected number of arguments, slow path.
+  std::string slowPrefix = encodeHeader(fixedArgs + nchunks);
+  slowPrefix.append(prefix, headerLength, std::string::npos);
+
+  retval.initFromPrefix(slowPrefix.data(), slowPrefix.size(), nchunks, chunks, sizes);
+  return retval;
+}
+
+}
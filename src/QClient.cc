@@ -28,15 +28,17 @@
 #include "network/NetworkStream.hh"
 #include <unistd.h>
 #include <string.h>
-#include <poll.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <sstream>
 #include <iterator>
+#include <mutex>
 #include "qclient/Logger.hh"
 #include "WriterThread.hh"
 #include "EndpointDecider.hh"
 #include "ConnectionCore.hh"
+#include "LoopConnection.hh"
+#include "ReadRouter.hh"
 #include "qclient/GlobalInterceptor.hh"
 
 //------------------------------------------------------------------------------
@@ -77,8 +79,18 @@ QClient::QClient(const Members& members_, Options &&opts)
 //------------------------------------------------------------------------------
 QClient::~QClient()
 {
-  shutdownEventFD.notify();
-  eventLoopThread.join();
+  if(loopConnection) {
+    loopConnection->stop();
+  }
+  else {
+    shutdownEventFD.notify();
+    eventLoopThread.join();
+  }
+
+  // Only once the event loop is gone, as it updates the leader. Reads in
+  // flight towards followers may still fall back to us, so before cleanup.
+  readRouter.reset();
+
   cleanup(true);
 }
 
@@ -91,42 +103,89 @@ void QClient::execute(QCallback *callback, EncodedRequest &&req) {
 }
 
 std::future<redisReplyPtr> QClient::execute(EncodedRequest &&req) {
+  if(readRouter && readRouter->eligible(req)) {
+    return readRouter->route(std::move(req));
+  }
+
   return connectionCore->stage(std::move(req));
 }
 
+ReplyFuture QClient::pooledExecute(EncodedRequest &&req) {
+  if(readRouter && readRouter->eligible(req)) {
+    FutureSlot *slot = FutureSlot::acquire();
+    ReplyFuture retval(slot);
+    readRouter->route(slot, std::move(req));
+    return retval;
+  }
+
+  return connectionCore->pooledStage(std::move(req));
+}
+
 #if HAVE_FOLLY == 1
 folly::Future<redisReplyPtr> QClient::follyExecute(EncodedRequest &&req) {
   return connectionCore->follyStage(std::move(req));
 }
 #endif
 
+//------------------------------------------------------------------------------
+// Pipeline a batch of independent requests.
+//------------------------------------------------------------------------------
+void QClient::executeBatch(QCallback *callback, std::vector<EncodedRequest> &&reqs) {
+  connectionCore->stageBatch(callback, std::move(reqs));
+}
+
+std::future<std::vector<redisReplyPtr>> QClient::executeBatch(std::vector<EncodedRequest> &&reqs) {
+  return connectionCore->stageBatch(std::move(reqs));
+}
+
+void QClient::executeStreaming(QStreamingCallback *callback, EncodedRequest &&req) {
+  connectionCore->stageStreaming(callback, std::move(req));
+}
+
+//------------------------------------------------------------------------------
+// Callbacks dedicated to a single request - eligible reads may go to a
+// follower.
+//------------------------------------------------------------------------------
+void QClient::executeUnordered(QCallback *callback, EncodedRequest &&req) {
+  if(readRouter && readRouter->eligible(req)) {
+    return readRouter->route(callback, std::move(req));
+  }
+
+  connectionCore->stage(callback, std::move(req));
+}
+
+void QClient::executeStreamingUnordered(QStreamingCallback *callback, EncodedRequest &&req) {
+  if(readRouter && readRouter->eligible(req)) {
+    return readRouter->routeStreaming(callback, std::move(req));
+  }
+
+  connectionCore->stageStreaming(callback, std::move(req));
+}
+
 //------------------------------------------------------------------------------
 // Execute a MULTI block.
 //------------------------------------------------------------------------------
 void QClient::execute(QCallback *callback, std::deque<EncodedRequest> &&reqs) {
-  size_t ignoredResponses = reqs.size() + 1;
-
-  connectionCore->stage(
-    callback,
-    EncodedRequest::fuseIntoBlockAndSurround(std::move(reqs)), ignoredResponses);
+  connectionCore->stageMulti(callback, std::move(reqs));
 }
 
 std::future<redisReplyPtr> QClient::execute(std::deque<EncodedRequest> &&reqs) {
-  size_t ignoredResponses = reqs.size() + 1;
-
-  return connectionCore->stage(
-    EncodedRequest::fuseIntoBlockAndSurround(std::move(reqs)), ignoredResponses);
+  return connectionCore->stageMulti(std::move(reqs));
 }
 
 #if HAVE_FOLLY == 1
 folly::Future<redisReplyPtr> QClient::follyExecute(std::deque<EncodedRequest> &&req) {
-  size_t ignoredResponses = req.size() + 1;
-
-  return connectionCore->follyStage(
-    EncodedRequest::fuseIntoBlockAndSurround(std::move(req)), ignoredResponses);
+  return connectionCore->follyStageMulti(std::move(req));
 }
 #endif
 
+//------------------------------------------------------------------------------
+// Number of requests which have not received a reply yet
+//------------------------------------------------------------------------------
+size_t QClient::getPendingRequests() const {
+  return connectionCore->getPendingCount();
+}
+
 //------------------------------------------------------------------------------
 // Event loop for the client
 //------------------------------------------------------------------------------
@@ -146,14 +205,39 @@ void QClient::startEventLoop()
   hostResolver = std::make_unique<HostResolver>(options.logger.get());
   endpointDecider = std::make_unique<EndpointDecider>(options.logger.get(), hostResolver.get(), members);
 
+  // A single-threaded connection is just a private, one-thread loop. Nobody
+  // else is on it, DNS lookups may as well block it.
+  if(options.singleThreadedConnection && !options.eventLoopGroup) {
+    options.eventLoopGroup = std::make_shared<EventLoopGroup>(1, 0);
+  }
+
   // Give some leeway when starting up before declaring the cluster broken.
   lastAvailable = std::chrono::steady_clock::now();
 
   connectionCore.reset(new ConnectionCore(options.logger.get(), options.handshake.get(),
                                           options.backpressureStrategy, options.transparentRedirects,
                                           options.messageListener.get(), options.exclusivePubsub,
-                                          options.mPerfCb.get()));
-  writerThread.reset(new WriterThread(options.logger.get(), *connectionCore.get(), shutdownEventFD));
+                                          options.mPerfCb.get(), options.inlineCallbacks,
+                                          options.callbackExecutor, options.callbackOrdering));
+  connectionCore->setQueueSpinIterations(options.queueSpinIterations);
+  responseBuilder.setMaxUnusedBuffer(options.receiveBufferStrategy.getMaxUnusedBuffer());
+  responseBuilder.setArenaAllocation(options.arenaAllocatedReplies);
+  responseBuilder.setZeroCopyReplies(options.zeroCopyReplies);
+  responseBuilder.restart();
+  writerThread.reset(new WriterThread(options.logger.get(), *connectionCore.get(), shutdownEventFD,
+                                      options.writeCoalescingStrategy));
+
+  if(options.readRouting == ReadRouting::kFollowers && members.size() > 1) {
+    readRouter.reset(new ReadRouter(*connectionCore, members, options));
+  }
+
+  if(options.eventLoopGroup) {
+    loopConnection.reset(new LoopConnection(*this, options.eventLoopGroup->pick(),
+      options.eventLoopGroup->getResolver()));
+    loopConnection->start();
+    return;
+  }
+
   eventLoopThread.reset(&QClient::eventLoop, this);
 }
 
@@ -163,10 +247,25 @@ void QClient::startEventLoop()
 bool QClient::feed(const char* buf, size_t len)
 {
   responseBuilder.feed(buf, len);
+  return processResponses();
+}
 
+//------------------------------------------------------------------------------
+// Pull and handle all complete responses out of the response builder
+//------------------------------------------------------------------------------
+bool QClient::processResponses()
+{
   while (true) {
     redisReplyPtr rr;
-    ResponseBuilder::Status status = responseBuilder.pull(rr);
+    ResponseBuilder::Status status;
+
+    QStreamingCallback *streamingCallback = connectionCore->getStreamingCallback();
+    if(streamingCallback) {
+      status = responseBuilder.pullStreaming(streamingCallback, rr);
+    }
+    else {
+      status = responseBuilder.pull(rr);
+    }
 
     if(status == ResponseBuilder::Status::kProtocolError) {
       return false;
@@ -262,26 +361,64 @@ bool QClient::shouldPurgePendingRequests() {
 //------------------------------------------------------------------------------
 void QClient::cleanup(bool shutdown)
 {
-  writerThread->deactivate();
-  networkStream.reset();
+  teardownConnection();
 
   responseBuilder.restart();
   successfulResponsesEver = successfulResponsesEver | successfulResponses;
   successfulResponses = false;
 
-  if(shouldPurgePendingRequests()) {
+  purgePendingRequests(shutdown);
+  connectionCore->reconnection();
+}
 
-    size_t previouslyPending = connectionCore->clearAllPending();
-    if(shutdown) {
-      QCLIENT_LOG(options.logger, LogLevel::kDebug, SSTR("Shutting down QClient, discarding " << previouslyPending << " pending requests"));
-    }
-    else {
-      QCLIENT_LOG(options.logger, LogLevel::kInfo, SSTR("Backend is unavailable, discarding " << previouslyPending << " pending requests"));
-    }
+//------------------------------------------------------------------------------
+// Stop the writer and close the connection of the epoch that just ended.
+// Pending requests may only be touched afterwards: The writer holds on to
+// them while it runs.
+//------------------------------------------------------------------------------
+void QClient::teardownConnection()
+{
+  writerThread->deactivate();
+  networkStream.reset();
+}
 
+//------------------------------------------------------------------------------
+// Discard pending requests, if it's time to give up on them
+//------------------------------------------------------------------------------
+void QClient::purgePendingRequests(bool shutdown)
+{
+  if(!shouldPurgePendingRequests()) {
+    return;
   }
 
-  connectionCore->reconnection();
+  size_t previouslyPending = connectionCore->clearAllPending();
+  if(shutdown) {
+    QCLIENT_LOG(options.logger, LogLevel::kDebug, SSTR("Shutting down QClient, discarding " << previouslyPending << " pending requests"));
+  }
+  else {
+    QCLIENT_LOG(options.logger, LogLevel::kInfo, SSTR("Backend is unavailable, discarding " << previouslyPending << " pending requests"));
+  }
+}
+
+//------------------------------------------------------------------------------
+// When pending requests run out of retry time, should the backend remain
+// unavailable until then. Returns false if there's no such deadline.
+//------------------------------------------------------------------------------
+bool QClient::getRetryDeadline(std::chrono::steady_clock::time_point &deadline)
+{
+  if(options.retryStrategy.getMode() != RetryStrategy::Mode::kRetryWithTimeout) {
+    return false;
+  }
+
+  //----------------------------------------------------------------------------
+  // The last epoch went well, lastAvailable is about to be refreshed.
+  //----------------------------------------------------------------------------
+  if(successfulResponses) {
+    return false;
+  }
+
+  deadline = lastAvailable + options.retryStrategy.getTimeout();
+  return true;
 }
 
 //------------------------------------------------------------------------------
@@ -311,11 +448,19 @@ void QClient::connectTCP()
     return;
   }
 
-  networkStream.reset(new NetworkStream(connector.release(), options.tlsconfig));
+  networkStream.reset(new NetworkStream(connector.release(), options.tlsconfig,
+    options.transport, shutdownEventFD.getFD()));
   if(!networkStream->ok()) {
     return;
   }
 
+  if(options.transport != networkStream->getTransport()) {
+    static std::once_flag fallbackWarning;
+    std::call_once(fallbackWarning, [&]() {
+      QCLIENT_LOG(options.logger, LogLevel::kWarn, "io_uring is unavailable, falling back to poll()");
+    });
+  }
+
   notifyConnectionEstablished();
   writerThread->activate(networkStream.get());
 }
@@ -345,11 +490,25 @@ void QClient::eventLoop(ThreadAssistant &assistant)
     this->connect();
 
     bool receivedBytes = handleConnectionEpoch(assistant);
+    teardownConnection();
+
     if(receivedBytes) {
       backoff = std::chrono::milliseconds(1);
     }
 
-    assistant.wait_for(backoff);
+    //--------------------------------------------------------------------------
+    // Should pending requests run out of retry time before the next attempt,
+    // wake up right then to discard them - the backoff may be seconds long.
+    //--------------------------------------------------------------------------
+    std::chrono::steady_clock::time_point wakeup = std::chrono::steady_clock::now() + backoff;
+    std::chrono::steady_clock::time_point retryDeadline;
+
+    if(getRetryDeadline(retryDeadline) && retryDeadline < wakeup) {
+      assistant.wait_until(retryDeadline);
+      purgePendingRequests(false);
+    }
+
+    assistant.wait_until(wakeup);
 
     if (assistant.terminationRequested()) {
       feed(NULL, 0);
@@ -413,6 +572,10 @@ bool QClient::detachListener(ReconnectionListener *listener) {
 // Notify that a connection has been established
 //------------------------------------------------------------------------------
 void QClient::notifyConnectionEstablished() {
+  if(readRouter) {
+    readRouter->setLeader(endpointDecider->getCurrent());
+  }
+
   std::unique_lock<std::mutex> lock(reconnectionListenersMtx);
 
   for(auto it = reconnectionListeners.begin(); it != reconnectionListeners.end(); it++) {
@@ -439,19 +602,15 @@ void QClient::notifyConnectionLost(int errc, const std::string &err) {
 // from the server.
 //------------------------------------------------------------------------------
 bool QClient::handleConnectionEpoch(ThreadAssistant &assistant) {
-  const size_t BUFFER_SIZE = 1024 * 2;
-  char buffer[BUFFER_SIZE];
+  const ReceiveBufferStrategy &receiveStrategy = options.receiveBufferStrategy;
+  size_t readSize = receiveStrategy.getInitialReadSize();
   bool receivedBytes = false;
 
   if(!networkStream || !networkStream->ok()) {
     return false;
   }
 
-  struct pollfd polls[2];
-  polls[0].fd = shutdownEventFD.getFD();
-  polls[0].events = POLLIN;
-  polls[1].fd = networkStream->getFd();
-  polls[1].events = POLLIN;
+  bool shutdownRequested = false;
 
   RecvStatus status(true, 0, 0);
   while (networkStream->ok()) {
@@ -460,26 +619,40 @@ bool QClient::handleConnectionEpoch(ThreadAssistant &assistant) {
     // OpenSSL, which poll() will not detect.
 
     if(status.bytesRead <= 0) {
-      int rpoll = poll(polls, 2, 60);
-      if(rpoll < 0 && errno != EINTR) {
+      WaitStatus wait = networkStream->waitReadable(-1);
+      if(wait == WaitStatus::kError) {
         // something's wrong, try to reconnect
         break;
       }
+
+      shutdownRequested = (wait == WaitStatus::kShutdown);
     }
 
-    if( (polls[0].revents != 0) || assistant.terminationRequested()) {
+    if(shutdownRequested || assistant.terminationRequested()) {
       notifyConnectionLost(0, "shutdown requested");
       break;
     }
 
-    // looks like a legit connection
-    status = networkStream->recv(buffer, BUFFER_SIZE, 0);
+    // looks like a legit connection - receive straight into the buffer
+    // of the response builder, no intermediate copies.
+    char *buffer = responseBuilder.getWritableTail(readSize);
+    if(!buffer) {
+      notifyConnectionLost(ENOMEM, "unable to allocate receive buffer");
+      break;
+    }
+
+    status = networkStream->recv(buffer, readSize, 0);
 
     if(!status.connectionAlive) {
       break; // connection died on us
     }
 
-    if(status.bytesRead > 0 && !feed(buffer, status.bytesRead)) {
+    if(status.bytesRead > 0) {
+      responseBuilder.commitTail(status.bytesRead);
+      readSize = receiveStrategy.nextReadSize(readSize, status.bytesRead);
+    }
+
+    if(status.bytesRead > 0 && !processResponses()) {
       notifyConnectionLost(EINVAL, "protocol violation");
       break; // protocol violation
     }
@@ -501,7 +674,7 @@ bool QClient::handleConnectionEpoch(ThreadAssistant &assistant) {
 long long int
 QClient::exists(const std::string& key)
 {
-  redisReplyPtr reply = exec("EXISTS", key).get();
+  redisReplyPtr reply = pooledExec("EXISTS", key).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
     throw std::runtime_error("[FATAL] Error exists key: " + key +
@@ -517,7 +690,7 @@ QClient::exists(const std::string& key)
 long long int
 QClient::del(const std::string& key)
 {
-  redisReplyPtr reply = exec("DEL", key).get();
+  redisReplyPtr reply = pooledExec("DEL", key).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
     throw std::runtime_error("[FATAL] Error del key: " + key +
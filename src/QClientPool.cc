@@ -0,0 +1,419 @@
+//------------------------------------------------------------------------------
+// File: QClientPool.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "qclient/QClientPool.hh"
+#include "RequestCursor.hh"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+
+namespace qclient {
+
+namespace {
+
+//------------------------------------------------------------------------------
+// A batch split up over several connections. Puts the replies back in order,
+// and only then hands them over: to the callback one by one, or to the
+// promise all at once. Deletes itself after the last reply.
+//------------------------------------------------------------------------------
+class BatchJoiner {
+public:
+  //----------------------------------------------------------------------------
+  // The part of the batch staged on a single connection. Receives replies
+  // in the order of its own requests.
+  //----------------------------------------------------------------------------
+  class Part : public QCallback {
+  public:
+    Part(BatchJoiner &j) : joiner(j) {}
+
+    virtual void handleResponse(redisReplyPtr &&reply) override {
+      // May delete this, must be the very last thing we do.
+      joiner.arrive(positions[nextPosition++], std::move(reply));
+    }
+
+    BatchJoiner &joiner;
+    std::vector<size_t> positions;
+    size_t nextPosition = 0;
+  };
+
+  BatchJoiner(size_t total, size_t partCount, QCallback *cb)
+  : callback(cb), replies(total), arrived(total, false), remaining(total) {
+    for(size_t i = 0; i < partCount; i++) {
+      parts.emplace_back(new Part(*this));
+    }
+  }
+
+  Part& getPart(size_t index) {
+    return *parts[index];
+  }
+
+  std::future<std::vector<redisReplyPtr>> getFuture() {
+    return promise.get_future();
+  }
+
+  void arrive(size_t position, redisReplyPtr &&reply) {
+    std::unique_lock<std::mutex> lock(mtx);
+    replies[position] = std::move(reply);
+    arrived[position] = true;
+
+    //--------------------------------------------------------------------------
+    // Callbacks run with the lock held: Parts may receive their replies on
+    // different threads, yet the callback must see them in order, one at
+    // a time.
+    //--------------------------------------------------------------------------
+    if(callback) {
+      while(nextToDeliver < replies.size() && arrived[nextToDeliver]) {
+        callback->handleResponse(std::move(replies[nextToDeliver]));
+        nextToDeliver++;
+      }
+    }
+
+    if(--remaining != 0) {
+      return;
+    }
+
+    if(!callback) {
+      promise.set_value(std::move(replies));
+    }
+
+    lock.unlock();
+    delete this;
+  }
+
+private:
+  QCallback *callback;
+  std::promise<std::vector<redisReplyPtr>> promise;
+
+  std::mutex mtx;
+  std::vector<redisReplyPtr> replies;
+  std::vector<bool> arrived;
+  size_t nextToDeliver = 0;
+  size_t remaining;
+
+  std::vector<std::unique_ptr<Part>> parts;
+};
+
+//------------------------------------------------------------------------------
+// Stage each part of a split batch on its own connection. Careful: joiner
+// may be gone as soon as the last part is staged.
+//------------------------------------------------------------------------------
+void dispatchBatch(std::vector<std::unique_ptr<QClient>> &connections,
+  BatchJoiner *joiner, std::vector<EncodedRequest> &&reqs,
+  const std::vector<size_t> &targets) {
+
+  std::vector<std::vector<EncodedRequest>> parts(connections.size());
+
+  for(size_t i = 0; i < reqs.size(); i++) {
+    joiner->getPart(targets[i]).positions.push_back(i);
+    parts[targets[i]].emplace_back(std::move(reqs[i]));
+  }
+
+  std::vector<QCallback*> callbacks;
+  for(size_t i = 0; i < parts.size(); i++) {
+    callbacks.push_back(&joiner->getPart(i));
+  }
+
+  for(size_t i = 0; i < parts.size(); i++) {
+    if(!parts[i].empty()) {
+      connections[i]->executeBatch(callbacks[i], std::move(parts[i]));
+    }
+  }
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Constructor taking simple host and port
+//------------------------------------------------------------------------------
+QClientPool::QClientPool(const std::string &host, int port, size_t count,
+  Options &&options, PoolRouting r) : routing(r) {
+
+  initialize(Members(host, port), count, std::move(options));
+}
+
+//------------------------------------------------------------------------------
+// Constructor taking a list of members for the cluster
+//------------------------------------------------------------------------------
+QClientPool::QClientPool(const Members &members, size_t count,
+  Options &&options, PoolRouting r) : routing(r) {
+
+  initialize(members, count, std::move(options));
+}
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+QClientPool::~QClientPool() {}
+
+//------------------------------------------------------------------------------
+// Open all connections - always at least one. The last one gets the
+// original options, the rest a clone each.
+//------------------------------------------------------------------------------
+void QClientPool::initialize(const Members &members, size_t count, Options &&options) {
+  count = std::max<size_t>(count, 1u);
+
+  for(size_t i = 0; i + 1 < count; i++) {
+    connections.emplace_back(new QClient(members, options.clone()));
+  }
+
+  connections.emplace_back(new QClient(members, std::move(options)));
+}
+
+size_t QClientPool::size() const {
+  return connections.size();
+}
+
+QClient& QClientPool::getConnection(size_t index) {
+  return *connections[index];
+}
+
+QClient& QClientPool::pick(const EncodedRequest &req) {
+  return *connections[pickIndex(req)];
+}
+
+//------------------------------------------------------------------------------
+// Hash the first argument after the command name, FNV-1a.
+//------------------------------------------------------------------------------
+bool QClientPool::hashKey(const EncodedRequest &req, uint64_t &hash) {
+  RequestCursor cursor(req);
+  size_t arguments, length;
+
+  if(!cursor.readHeader('*', arguments) || arguments < 2) return false;
+  if(!cursor.readHeader('$', length) || !cursor.skip(length + 2)) return false;
+  if(!cursor.readHeader('$', length)) return false;
+
+  hash = 14695981039346656037ull;
+
+  for(size_t i = 0; i < length; i++) {
+    char c;
+    if(!cursor.next(c)) return false;
+
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+
+  return true;
+}
+
+size_t QClientPool::nextRoundRobin() {
+  return roundRobin.fetch_add(1, std::memory_order_relaxed) % connections.size();
+}
+
+//------------------------------------------------------------------------------
+// Start scanning at a different connection every time, so that ties don't
+// all go to the first one.
+//------------------------------------------------------------------------------
+size_t QClientPool::leastOutstanding() {
+  size_t start = nextRoundRobin();
+  size_t best = start;
+  size_t bestPending = std::numeric_limits<size_t>::max();
+
+  for(size_t i = 0; i < connections.size(); i++) {
+    size_t index = (start + i) % connections.size();
+    size_t pending = connections[index]->getPendingRequests();
+
+    if(pending < bestPending) {
+      best = index;
+      bestPending = pending;
+      if(pending == 0u) break;
+    }
+  }
+
+  return best;
+}
+
+size_t QClientPool::pickIndex(const EncodedRequest &req) {
+  if(connections.size() == 1u) {
+    return 0u;
+  }
+
+  switch(routing) {
+    case PoolRouting::kRoundRobin: {
+      return nextRoundRobin();
+    }
+    case PoolRouting::kLeastOutstanding: {
+      return leastOutstanding();
+    }
+    case PoolRouting::kKeyHash: {
+      uint64_t hash;
+      if(hashKey(req, hash)) {
+        return hash % connections.size();
+      }
+
+      return nextRoundRobin();
+    }
+  }
+
+  return 0u;
+}
+
+//------------------------------------------------------------------------------
+// A request handing its reply to a shared callback: Unless routing by key,
+// pin it to a connection by the address of the callback, so that it sees
+// its replies in order, one at a time.
+//------------------------------------------------------------------------------
+size_t QClientPool::pickIndex(const EncodedRequest &req, const QCallback *callback) {
+  if(!callback || routing == PoolRouting::kKeyHash || connections.size() == 1u) {
+    return pickIndex(req);
+  }
+
+  // Fibonacci hashing, the low bits of an address are mostly zero.
+  uint64_t hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(callback));
+  hash *= 11400714819323198485ull;
+  return (hash >> 32) % connections.size();
+}
+
+//------------------------------------------------------------------------------
+// Where should the given batch go? Returns the index of the connection if it
+// can go through a single one, or size() if it has to be split up - then,
+// targets holds the connection of each request.
+//------------------------------------------------------------------------------
+size_t QClientPool::routeBatch(const std::vector<EncodedRequest> &reqs,
+  const QCallback *callback, std::vector<size_t> &targets) {
+
+  if(reqs.empty()) {
+    return 0u;
+  }
+
+  if(routing != PoolRouting::kKeyHash || connections.size() == 1u) {
+    return pickIndex(reqs[0], callback);
+  }
+
+  targets.reserve(reqs.size());
+  for(size_t i = 0; i < reqs.size(); i++) {
+    targets.push_back(pickIndex(reqs[i]));
+  }
+
+  for(size_t i = 1; i < targets.size(); i++) {
+    if(targets[i] != targets[0]) {
+      return connections.size();
+    }
+  }
+
+  return targets[0];
+}
+
+//------------------------------------------------------------------------------
+// Single requests
+//------------------------------------------------------------------------------
+std::future<redisReplyPtr> QClientPool::execute(EncodedRequest &&req) {
+  return pick(req).execute(std::move(req));
+}
+
+void QClientPool::execute(QCallback *callback, EncodedRequest &&req) {
+  size_t index = pickIndex(req, callback);
+  connections[index]->execute(callback, std::move(req));
+}
+
+ReplyFuture QClientPool::pooledExecute(EncodedRequest &&req) {
+  return pick(req).pooledExecute(std::move(req));
+}
+
+void QClientPool::executeStreaming(QStreamingCallback *callback, EncodedRequest &&req) {
+  size_t index = pickIndex(req, callback);
+  connections[index]->executeStreaming(callback, std::move(req));
+}
+
+void QClientPool::executeUnordered(QCallback *callback, EncodedRequest &&req) {
+  pick(req).executeUnordered(callback, std::move(req));
+}
+
+void QClientPool::executeStreamingUnordered(QStreamingCallback *callback, EncodedRequest &&req) {
+  pick(req).executeStreamingUnordered(callback, std::move(req));
+}
+
+//------------------------------------------------------------------------------
+// Batches: Only kKeyHash needs to split them up.
+//------------------------------------------------------------------------------
+std::future<std::vector<redisReplyPtr>> QClientPool::executeBatch(std::vector<EncodedRequest> &&reqs) {
+  std::vector<size_t> targets;
+  size_t index = routeBatch(reqs, nullptr, targets);
+
+  if(index != connections.size()) {
+    return connections[index]->executeBatch(std::move(reqs));
+  }
+
+  BatchJoiner *joiner = new BatchJoiner(reqs.size(), connections.size(), nullptr);
+  std::future<std::vector<redisReplyPtr>> fut = joiner->getFuture();
+  dispatchBatch(connections, joiner, std::move(reqs), targets);
+  return fut;
+}
+
+void QClientPool::executeBatch(QCallback *callback, std::vector<EncodedRequest> &&reqs) {
+  std::vector<size_t> targets;
+  size_t index = routeBatch(reqs, callback, targets);
+
+  if(index != connections.size()) {
+    return connections[index]->executeBatch(callback, std::move(reqs));
+  }
+
+  BatchJoiner *joiner = new BatchJoiner(reqs.size(), connections.size(), callback);
+  dispatchBatch(connections, joiner, std::move(reqs), targets);
+}
+
+//------------------------------------------------------------------------------
+// MULTI blocks: The whole block on a single connection.
+//------------------------------------------------------------------------------
+std::future<redisReplyPtr> QClientPool::execute(std::deque<EncodedRequest> &&reqs) {
+  size_t index = reqs.empty() ? 0u : pickIndex(reqs.front());
+  return connections[index]->execute(std::move(reqs));
+}
+
+void QClientPool::execute(QCallback *callback, std::deque<EncodedRequest> &&reqs) {
+  size_t index = reqs.empty() ? 0u : pickIndex(reqs.front(), callback);
+  connections[index]->execute(callback, std::move(reqs));
+}
+
+//------------------------------------------------------------------------------
+// Reconnection listeners
+//------------------------------------------------------------------------------
+void QClientPool::attachListener(ReconnectionListener *listener) {
+  for(auto &connection : connections) {
+    connection->attachListener(listener);
+  }
+}
+
+bool QClientPool::detachListener(ReconnectionListener *listener) {
+  bool found = false;
+
+  for(auto &connection : connections) {
+    found |= connection->detachListener(listener);
+  }
+
+  return found;
+}
+
+//------------------------------------------------------------------------------
+// Check every connection with a PING, returning the first failure.
+//------------------------------------------------------------------------------
+Status QClientPool::checkConnection(std::chrono::milliseconds timeout) {
+  for(auto &connection : connections) {
+    Status st = connection->checkConnection(timeout);
+    if(!st.ok()) return st;
+  }
+
+  return Status();
+}
+
+}
@@ -0,0 +1,301 @@
+//------------------------------------------------------------------------------
+// File: ReadRouter.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "ReadRouter.hh"
+#include "ConnectionCore.hh"
+#include "RequestCursor.hh"
+#include "qclient/CommandClassification.hh"
+#include "qclient/QClient.hh"
+#include <string.h>
+
+namespace qclient {
+
+namespace {
+
+//------------------------------------------------------------------------------
+// A contiguous copy of the given request.
+//------------------------------------------------------------------------------
+EncodedRequest duplicate(const EncodedRequest &req) {
+  size_t len = 0;
+  for(size_t i = 0; i < req.getSegmentCount(); i++) {
+    len += req.getSegmentLength(i);
+  }
+
+  char *buffer = static_cast<char*>(malloc(len));
+  char *pos = buffer;
+
+  for(size_t i = 0; i < req.getSegmentCount(); i++) {
+    memcpy(pos, req.getSegmentData(i), req.getSegmentLength(i));
+    pos += req.getSegmentLength(i);
+  }
+
+  return EncodedRequest(buffer, len);
+}
+
+//------------------------------------------------------------------------------
+// Satisfies a future, for reads routed through the callback interface.
+// Deletes itself once done.
+//------------------------------------------------------------------------------
+class PromiseCallback : public QCallback {
+public:
+  std::future<redisReplyPtr> getFuture() {
+    return promise.get_future();
+  }
+
+  virtual void handleResponse(redisReplyPtr &&reply) override {
+    promise.set_value(std::move(reply));
+    delete this;
+  }
+
+private:
+  std::promise<redisReplyPtr> promise;
+};
+
+}
+
+//------------------------------------------------------------------------------
+// A read in flight towards a follower. Passes everything through to the
+// original callback, unless the follower fails it - then, the copy of the
+// request goes to the leader instead. Deletes itself once done.
+//
+// A streamed reply can't be retried once any part of it has reached the
+// callback, since the leader would stream it again from the start: The
+// failure is passed through instead.
+//------------------------------------------------------------------------------
+class FollowerRead : public QStreamingCallback {
+public:
+  FollowerRead(ReadRouter &r, size_t f, QCallback *cb, QStreamingCallback *s,
+    EncodedRequest &&req) : router(r), follower(f), callback(cb), streaming(s),
+    request(std::move(req)) {}
+
+  virtual void handleArray(size_t depth, size_t elements) override {
+    forwarded = true;
+    streaming->handleArray(depth, elements);
+  }
+
+  virtual void handleAggregate(size_t depth, int type, size_t elements) override {
+    forwarded = true;
+    streaming->handleAggregate(depth, type, elements);
+  }
+
+  virtual void handleStringChunk(size_t depth, const char *data, size_t len,
+    size_t offset, size_t total) override {
+    forwarded = true;
+    streaming->handleStringChunk(depth, data, len, offset, total);
+  }
+
+  virtual void handleElement(size_t depth, redisReplyPtr &&reply) override {
+    forwarded = true;
+    streaming->handleElement(depth, std::move(reply));
+  }
+
+  virtual void handleResponse(redisReplyPtr &&reply) override {
+    // The follower is avoided either way, even if we can't retry.
+    if(!ReadRouter::failedOnFollower(reply) || !router.fallbackToLeader(follower) || forwarded) {
+      callback->handleResponse(std::move(reply));
+    }
+    else if(streaming) {
+      router.getLeader().stageStreaming(streaming, std::move(request));
+    }
+    else {
+      router.getLeader().stage(callback, std::move(request));
+    }
+
+    delete this;
+  }
+
+private:
+  ReadRouter &router;
+  size_t follower;
+  QCallback *callback;
+  QStreamingCallback *streaming;
+  EncodedRequest request;
+  bool forwarded = false;
+};
+
+//------------------------------------------------------------------------------
+// Constructor - open a connection to every member. Each gets a copy of the
+// options, minus anything which would send it looking for the leader:
+// Redirects and failures bounce back to us, and we retry on the leader.
+//------------------------------------------------------------------------------
+ReadRouter::ReadRouter(ConnectionCore &ldr, const Members &memb, const Options &options)
+: leader(ldr), members(memb) {
+
+  for(const Endpoint &endpoint : members.getEndpoints()) {
+    Options opts = options.clone();
+    opts.readRouting = ReadRouting::kLeaderOnly;
+    opts.transparentRedirects = false;
+    opts.retryStrategy = RetryStrategy::NoRetries();
+    opts.messageListener.reset();
+    opts.chainHandshake(std::unique_ptr<Handshake>(new ActivateStaleReadsHandshake(true)));
+
+    std::unique_ptr<Follower> follower(new Follower());
+    follower->client.reset(new QClient(Members(endpoint.getHost(), endpoint.getPort()), std::move(opts)));
+    followers.emplace_back(std::move(follower));
+  }
+}
+
+//------------------------------------------------------------------------------
+// Destructor - reads still in flight get a nullptr, instead of a retry on
+// a leader which may be shutting down.
+//------------------------------------------------------------------------------
+ReadRouter::~ReadRouter() {
+  shuttingDown = true;
+  followers.clear();
+}
+
+//------------------------------------------------------------------------------
+// Is this a read which may be served by a follower?
+//------------------------------------------------------------------------------
+bool ReadRouter::eligible(const EncodedRequest &req) const {
+  if(req.requiresLeader()) {
+    return false;
+  }
+
+  RequestCursor cursor(req);
+  size_t arguments, length;
+  char name[32];
+
+  if(!cursor.readHeader('*', arguments) || arguments == 0) return false;
+  if(!cursor.readHeader('$', length) || length > sizeof(name)) return false;
+  if(!cursor.read(name, length)) return false;
+
+  return classifyCommand(std::string_view(name, length)) == CommandType::kRead;
+}
+
+//------------------------------------------------------------------------------
+// Should this reply from a follower be retried on the leader?
+//------------------------------------------------------------------------------
+bool ReadRouter::failedOnFollower(const redisReplyPtr &reply) {
+  if(!reply) {
+    return true;
+  }
+
+  if(reply->type != REDIS_REPLY_ERROR) {
+    return false;
+  }
+
+  static const char* kFailures[] = { "MOVED ", "ERR unavailable", "UNAVAILABLE" };
+
+  for(const char *failure : kFailures) {
+    size_t len = strlen(failure);
+
+    if(reply->len >= len && strncmp(reply->str, failure, len) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//------------------------------------------------------------------------------
+// Next follower in turn, skipping the leader and any being avoided. Returns
+// kNone if there's no one left.
+//------------------------------------------------------------------------------
+size_t ReadRouter::pickFollower() {
+  int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+  size_t current = leaderIndex.load(std::memory_order_relaxed);
+  size_t start = roundRobin.fetch_add(1, std::memory_order_relaxed);
+
+  for(size_t i = 0; i < followers.size(); i++) {
+    size_t index = (start + i) % followers.size();
+
+    if(index != current && followers[index]->avoidUntil.load(std::memory_order_relaxed) <= now) {
+      return index;
+    }
+  }
+
+  return kNone;
+}
+
+void ReadRouter::dispatch(QCallback *callback, QStreamingCallback *streaming, EncodedRequest &&req) {
+  size_t index = pickFollower();
+
+  if(index == kNone) {
+    if(streaming) {
+      leader.stageStreaming(streaming, std::move(req));
+    }
+    else {
+      leader.stage(callback, std::move(req));
+    }
+
+    return;
+  }
+
+  FollowerRead *read = new FollowerRead(*this, index, callback, streaming, duplicate(req));
+
+  if(streaming) {
+    followers[index]->client->executeStreaming(read, std::move(req));
+  }
+  else {
+    followers[index]->client->execute(read, std::move(req));
+  }
+}
+
+std::future<redisReplyPtr> ReadRouter::route(EncodedRequest &&req) {
+  PromiseCallback *callback = new PromiseCallback();
+  std::future<redisReplyPtr> fut = callback->getFuture();
+  dispatch(callback, nullptr, std::move(req));
+  return fut;
+}
+
+void ReadRouter::route(QCallback *callback, EncodedRequest &&req) {
+  dispatch(callback, nullptr, std::move(req));
+}
+
+void ReadRouter::routeStreaming(QStreamingCallback *callback, EncodedRequest &&req) {
+  dispatch(callback, callback, std::move(req));
+}
+
+//------------------------------------------------------------------------------
+// The main connection has just connected to this endpoint
+//------------------------------------------------------------------------------
+void ReadRouter::setLeader(const Endpoint &endpoint) {
+  const std::vector<Endpoint> &endpoints = members.getEndpoints();
+  size_t index = kNone;
+
+  for(size_t i = 0; i < endpoints.size(); i++) {
+    if(endpoints[i] == endpoint) {
+      index = i;
+      break;
+    }
+  }
+
+  leaderIndex.store(index, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+// A read failed on this follower: Leave it alone for a while, and tell the
+// caller whether to retry on the leader.
+//------------------------------------------------------------------------------
+bool ReadRouter::fallbackToLeader(size_t follower) {
+  if(shuttingDown) {
+    return false;
+  }
+
+  int64_t until = (std::chrono::steady_clock::now() + kFollowerBackoff).time_since_epoch().count();
+  followers[follower]->avoidUntil.store(until, std::memory_order_relaxed);
+  return true;
+}
+
+}
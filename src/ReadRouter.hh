@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// File: ReadRouter.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_READ_ROUTER_HH
+#define QCLIENT_READ_ROUTER_HH
+
+#include "qclient/Members.hh"
+#include "qclient/Options.hh"
+#include "qclient/QCallback.hh"
+#include "qclient/EncodedRequest.hh"
+#include "qclient/utils/Macros.hh"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace qclient {
+
+class QClient;
+class ConnectionCore;
+
+//------------------------------------------------------------------------------
+// Sends reads to followers, on behalf of a QClient with
+// Options::readRouting set to kFollowers. Keeps a connection of its own to
+// every member, and picks among the ones not currently leading, in turn.
+//
+// Every routed read carries a copy of the request: Should the follower fail
+// it, the copy is staged on the leader connection, and the follower avoided
+// for kFollowerBackoff.
+//------------------------------------------------------------------------------
+class ReadRouter {
+public:
+  static constexpr std::chrono::seconds kFollowerBackoff {5};
+
+  //----------------------------------------------------------------------------
+  // Constructor - leader is the ConnectionCore of the main connection.
+  //----------------------------------------------------------------------------
+  ReadRouter(ConnectionCore &leader, const Members &members, const Options &options);
+  ~ReadRouter();
+
+  //----------------------------------------------------------------------------
+  // Is this a read which may be served by a follower?
+  //----------------------------------------------------------------------------
+  bool eligible(const EncodedRequest &req) const;
+
+  //----------------------------------------------------------------------------
+  // Send an eligible read to a follower - or the leader, if all followers
+  // are being avoided. The callback must be dedicated to this request: Its
+  // reply arrives on a thread of the follower connection, unordered with
+  // respect to anything else.
+  //----------------------------------------------------------------------------
+  std::future<redisReplyPtr> route(EncodedRequest &&req);
+  void route(QCallback *callback, EncodedRequest &&req);
+  void routeStreaming(QStreamingCallback *callback, EncodedRequest &&req);
+
+  //----------------------------------------------------------------------------
+  // The main connection has just connected to this endpoint. If it's one of
+  // the members, stop sending reads there.
+  //----------------------------------------------------------------------------
+  void setLeader(const Endpoint &endpoint);
+
+  //----------------------------------------------------------------------------
+  // A read failed on this follower: Leave it alone for a while. Returns
+  // whether to retry on the leader - not while shutting down.
+  //----------------------------------------------------------------------------
+  bool fallbackToLeader(size_t follower);
+
+  //----------------------------------------------------------------------------
+  // Should this reply from a follower be retried on the leader? Covers the
+  // follower going away, redirecting us because it doesn't serve stale
+  // reads, or being temporarily unavailable.
+  //----------------------------------------------------------------------------
+  static bool failedOnFollower(const redisReplyPtr &reply);
+
+  ConnectionCore& getLeader() {
+    return leader;
+  }
+
+PUBLIC_FOR_TESTS_ONLY:
+  static constexpr size_t kNone = static_cast<size_t>(-1);
+
+  //----------------------------------------------------------------------------
+  // Next follower in turn, skipping the leader and any being avoided.
+  // Returns kNone if there's no one left.
+  //----------------------------------------------------------------------------
+  size_t pickFollower();
+
+private:
+  void dispatch(QCallback *callback, QStreamingCallback *streaming, EncodedRequest &&req);
+
+  ConnectionCore &leader;
+  Members members;
+
+  struct Follower {
+    std::unique_ptr<QClient> client;
+    std::atomic<int64_t> avoidUntil {0};
+  };
+
+  std::vector<std::unique_ptr<Follower>> followers;
+  std::atomic<size_t> leaderIndex {kNone};
+  std::atomic<size_t> roundRobin {0};
+  std::atomic<bool> shuttingDown {false};
+};
+
+}
+
+#endif
@@ -0,0 +1,279 @@
+//------------------------------------------------------------------------------
+// File: ReplyArena.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "ReplyArena.hh"
+#include "reader/reader.hh"
+#include "reader/sds.hh"
+#include "qclient/Reply.hh"
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <new>
+
+namespace qclient {
+
+namespace {
+
+constexpr size_t kAlignment = alignof(std::max_align_t);
+
+size_t alignUp(size_t len) {
+  return (len + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+//------------------------------------------------------------------------------
+// The reply object backend - same semantics as the default one in reader.cc,
+// but every node is allocated from the ReplyArena given as privdata.
+//------------------------------------------------------------------------------
+redisReply* createReply(const redisReadTask *task, int type, size_t extra) {
+  ReplyArena *arena = static_cast<ReplyArena*>(task->privdata);
+
+  void *mem = arena->allocate(alignUp(sizeof(redisReply)) + extra);
+  if(mem == nullptr) return nullptr;
+
+  redisReply *r = new (mem) redisReply();
+  r->type = type;
+  return r;
+}
+
+void attachToParent(const redisReadTask *task, redisReply *r) {
+  if(task->parent) {
+    redisReply *parent = static_cast<redisReply*>(task->parent->obj);
+    assert(parent->type == REDIS_REPLY_ARRAY || parent->type == REDIS_REPLY_PUSH ||
+           parent->type == REDIS_REPLY_MAP || parent->type == REDIS_REPLY_SET ||
+           parent->type == REDIS_REPLY_ATTR);
+    parent->element[task->idx] = r;
+  }
+}
+
+//------------------------------------------------------------------------------
+// A verbatim string begins with its three-letter type, and a colon.
+//------------------------------------------------------------------------------
+void splitVerbatimType(const redisReadTask *task, redisReply *r, char *&str, size_t &len) {
+  if(task->type == REDIS_REPLY_VERB) {
+    memcpy(r->vtype, str, 3);
+    r->vtype[3] = '\0';
+    str += 4;
+    len -= 4;
+  }
+}
+
+void* createString(const redisReadTask *task, char *str, size_t len) {
+  redisReply *r = createReply(task, task->type, len + 1);
+  if(r == nullptr) return nullptr;
+
+  splitVerbatimType(task, r, str, len);
+
+  r->str = reinterpret_cast<char*>(r) + alignUp(sizeof(redisReply));
+  memcpy(r->str, str, len);
+  r->str[len] = '\0';
+  r->len = len;
+
+  attachToParent(task, r);
+  return r;
+}
+
+void* createArray(const redisReadTask *task, size_t elements, int type) {
+  redisReply *r = createReply(task, type, elements * sizeof(redisReply*));
+  if(r == nullptr) return nullptr;
+
+  if(elements > 0) {
+    r->element = reinterpret_cast<redisReply**>(reinterpret_cast<char*>(r) + alignUp(sizeof(redisReply)));
+    memset(r->element, 0, elements * sizeof(redisReply*));
+  }
+
+  r->elements = elements;
+
+  // An attribute is only referenced by its task, until dropped.
+  if(type != REDIS_REPLY_ATTR) {
+    attachToParent(task, r);
+  }
+
+  return r;
+}
+
+void* createInteger(const redisReadTask *task, long long value) {
+  redisReply *r = createReply(task, REDIS_REPLY_INTEGER, 0);
+  if(r == nullptr) return nullptr;
+
+  r->integer = value;
+  attachToParent(task, r);
+  return r;
+}
+
+void* createDouble(const redisReadTask *task, double value, char *str, size_t len) {
+  redisReply *r = createReply(task, REDIS_REPLY_DOUBLE, len + 1);
+  if(r == nullptr) return nullptr;
+
+  r->str = reinterpret_cast<char*>(r) + alignUp(sizeof(redisReply));
+  memcpy(r->str, str, len);
+  r->str[len] = '\0';
+  r->len = len;
+  r->dval = value;
+
+  attachToParent(task, r);
+  return r;
+}
+
+void* createNil(const redisReadTask *task) {
+  redisReply *r = createReply(task, REDIS_REPLY_NIL, 0);
+  if(r == nullptr) return nullptr;
+
+  attachToParent(task, r);
+  return r;
+}
+
+void* createBool(const redisReadTask *task, int value) {
+  redisReply *r = createReply(task, REDIS_REPLY_BOOL, 0);
+  if(r == nullptr) return nullptr;
+
+  r->integer = (value != 0);
+  attachToParent(task, r);
+  return r;
+}
+
+void* createStringView(const redisReadTask *task, char *str, size_t len) {
+  ReplyArena *arena = static_cast<ReplyArena*>(task->privdata);
+  ReceiveBufferPin *pin = arena->getPin();
+
+  if(len < ReplyArena::kMinViewSize || pin == nullptr) {
+    return createString(task, str, len);
+  }
+
+  redisReply *r = createReply(task, task->type, 0);
+  if(r == nullptr) return nullptr;
+
+  splitVerbatimType(task, r, str, len);
+
+  if(!pin->reader->pinned) {
+    pin->chunk = std::make_shared<ReceiveChunk>(pin->reader->buf);
+    pin->reader->pinned = 1;
+  }
+
+  arena->retain(pin->chunk);
+
+  // The reader skips over the terminator without looking at it, we're free
+  // to overwrite it.
+  str[len] = '\0';
+  r->str = str;
+  r->len = len;
+
+  attachToParent(task, r);
+  return r;
+}
+
+void freeObject(void *reply) {
+  // Nothing to do, memory goes away along with the arena.
+}
+
+redisReplyObjectFunctions arenaFunctions = {
+  createString,
+  createArray,
+  createInteger,
+  createDouble,
+  createNil,
+  createBool,
+  freeObject
+};
+
+redisReplyObjectFunctions viewFunctions = {
+  createStringView,
+  createArray,
+  createInteger,
+  createDouble,
+  createNil,
+  createBool,
+  freeObject
+};
+
+}
+
+ReceiveChunk::~ReceiveChunk() {
+  sdsfree(buf);
+}
+
+void ReceiveBufferPin::releaseChunk(void *pin, char *buf) {
+  ReceiveBufferPin *self = static_cast<ReceiveBufferPin*>(pin);
+  assert(self->chunk && self->chunk->getBuffer() == buf);
+  self->chunk.reset();
+}
+
+ReplyArena::ReplyArena()
+: current(inlineBlock), remaining(kInlineBlockSize), nextBlockSize(4096) {}
+
+ReplyArena::~ReplyArena() {
+  while(blocks) {
+    Block *next = blocks->next;
+    free(blocks);
+    blocks = next;
+  }
+}
+
+void* ReplyArena::allocate(size_t len) {
+  len = alignUp(len);
+
+  if(len <= remaining) {
+    void *retval = current;
+    current += len;
+    remaining -= len;
+    return retval;
+  }
+
+  // Large allocations get a block of their own, so as not to waste the
+  // rest of the current one.
+  if(len > nextBlockSize / 2) {
+    return allocateBlock(len);
+  }
+
+  char *block = static_cast<char*>(allocateBlock(nextBlockSize));
+  if(block == nullptr) return nullptr;
+
+  current = block + len;
+  remaining = nextBlockSize - len;
+
+  if(nextBlockSize < kMaxBlockSize) {
+    nextBlockSize *= 2;
+  }
+
+  return block;
+}
+
+void* ReplyArena::allocateBlock(size_t len) {
+  Block *block = static_cast<Block*>(malloc(alignUp(sizeof(Block)) + len));
+  if(block == nullptr) return nullptr;
+
+  block->next = blocks;
+  blocks = block;
+  blockCount++;
+
+  return reinterpret_cast<char*>(block) + alignUp(sizeof(Block));
+}
+
+redisReplyObjectFunctions* ReplyArena::getReplyObjectFunctions() {
+  return &arenaFunctions;
+}
+
+redisReplyObjectFunctions* ReplyArena::getViewReplyObjectFunctions() {
+  return &viewFunctions;
+}
+
+}
@@ -0,0 +1,157 @@
+//------------------------------------------------------------------------------
+// File: ReplyArena.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_REPLY_ARENA_HH
+#define QCLIENT_REPLY_ARENA_HH
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+struct redisReplyObjectFunctions;
+struct redisReader;
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// A receive buffer handed over by the reader, once pinned. Freed when the
+// last reply with string views into it goes away.
+//------------------------------------------------------------------------------
+class ReceiveChunk {
+public:
+  explicit ReceiveChunk(char *sdsbuf) : buf(sdsbuf) {}
+  ~ReceiveChunk();
+
+  ReceiveChunk(const ReceiveChunk& other) = delete;
+  ReceiveChunk& operator=(const ReceiveChunk& other) = delete;
+
+  const char* getBuffer() const {
+    return buf;
+  }
+
+private:
+  char *buf;
+};
+
+//------------------------------------------------------------------------------
+// Keeps track of the reader buffer currently pinned, if any. Install
+// releaseChunk() as the releaseBuffer hook of the reader.
+//------------------------------------------------------------------------------
+struct ReceiveBufferPin {
+  redisReader *reader = nullptr;
+  std::shared_ptr<ReceiveChunk> chunk;
+
+  static void releaseChunk(void *pin, char *buf);
+};
+
+//------------------------------------------------------------------------------
+// Bump allocator for a single reply tree. All nodes, element vectors and
+// string bodies of the tree are carved out of a few large blocks, which are
+// freed all at once when the arena is destroyed - there's no way to free
+// individual allocations.
+//
+// Install on a redisReader by passing getReplyObjectFunctions() to
+// redisReaderCreateWithFunctions, and the arena itself as privdata. The
+// freeObject function of the backend is a no-op: whatever is in the arena
+// lives exactly as long as the arena.
+//------------------------------------------------------------------------------
+class ReplyArena {
+public:
+  //----------------------------------------------------------------------------
+  // Most replies are tiny, and fit entirely into the inline block.
+  //----------------------------------------------------------------------------
+  static constexpr size_t kInlineBlockSize = 256;
+  static constexpr size_t kMaxBlockSize = 1024 * 1024;
+
+  ReplyArena();
+  ~ReplyArena();
+
+  ReplyArena(const ReplyArena& other) = delete;
+  ReplyArena& operator=(const ReplyArena& other) = delete;
+
+  //----------------------------------------------------------------------------
+  // Allocate len bytes, aligned for any redisReply member. Returns nullptr
+  // if out of memory.
+  //----------------------------------------------------------------------------
+  void* allocate(size_t len);
+
+  //----------------------------------------------------------------------------
+  // Number of heap blocks allocated so far, the inline one not included.
+  //----------------------------------------------------------------------------
+  size_t getBlockCount() const {
+    return blockCount;
+  }
+
+  //----------------------------------------------------------------------------
+  // Keep the given chunk alive for as long as this arena.
+  //----------------------------------------------------------------------------
+  void retain(const std::shared_ptr<ReceiveChunk> &chunk) {
+    if(chunks.empty() || chunks.back() != chunk) {
+      chunks.push_back(chunk);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Set to enable string views, see getViewReplyObjectFunctions().
+  //----------------------------------------------------------------------------
+  void setPin(ReceiveBufferPin *p) {
+    pin = p;
+  }
+
+  ReceiveBufferPin* getPin() const {
+    return pin;
+  }
+
+  static redisReplyObjectFunctions* getReplyObjectFunctions();
+
+  //----------------------------------------------------------------------------
+  // Same as above, but strings of at least kMinViewSize bytes aren't copied:
+  // they point straight into the reader buffer, which gets pinned and
+  // retained by the arena. The byte following each view - the '\r' of the
+  // protocol terminator - is overwritten with '\0', so views are still
+  // NULL-terminated.
+  //----------------------------------------------------------------------------
+  static constexpr size_t kMinViewSize = 64;
+  static redisReplyObjectFunctions* getViewReplyObjectFunctions();
+
+private:
+  struct Block {
+    Block *next;
+  };
+
+  void* allocateBlock(size_t len);
+
+  char *current;
+  size_t remaining;
+  size_t nextBlockSize;
+  size_t blockCount = 0;
+  Block *blocks = nullptr;
+  ReceiveBufferPin *pin = nullptr;
+  std::vector<std::shared_ptr<ReceiveChunk>> chunks;
+
+  alignas(std::max_align_t) char inlineBlock[kInlineBlockSize];
+};
+
+}
+
+#endif
@@ -0,0 +1,188 @@
+//------------------------------------------------------------------------------
+// File: ReplyFuture.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "qclient/ReplyFuture.hh"
+#include <climits>
+#include <ctime>
+#include <mutex>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace qclient {
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain uint32_t");
+
+//------------------------------------------------------------------------------
+// Slot state bits
+//------------------------------------------------------------------------------
+static constexpr uint32_t kWaiting = 1u;
+static constexpr uint32_t kReady = 2u;
+
+//------------------------------------------------------------------------------
+// Futex wrappers. Spurious wakeups and EINTR are fine, callers re-check.
+//------------------------------------------------------------------------------
+static void futexWait(std::atomic<uint32_t> *word, uint32_t expected, const struct timespec *timeout) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+}
+
+static void futexWakeAll(std::atomic<uint32_t> *word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+//------------------------------------------------------------------------------
+// Process-wide pool of free slots. Keeps up to kMaxFree around, anything
+// beyond that is given back to the allocator.
+//------------------------------------------------------------------------------
+class FutureSlotPool {
+public:
+  FutureSlot* get() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+
+      if(freeList) {
+        FutureSlot *slot = freeList;
+        freeList = slot->nextFree;
+        freeCount--;
+        return slot;
+      }
+    }
+
+    return new FutureSlot();
+  }
+
+  void put(FutureSlot *slot) {
+    slot->reply.reset();
+    slot->state.store(0, std::memory_order_relaxed);
+
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+
+      if(freeCount < kMaxFree) {
+        slot->nextFree = freeList;
+        freeList = slot;
+        freeCount++;
+        return;
+      }
+    }
+
+    delete slot;
+  }
+
+private:
+  static constexpr size_t kMaxFree = 4096u;
+
+  std::mutex mtx;
+  FutureSlot *freeList = nullptr;
+  size_t freeCount = 0u;
+};
+
+//------------------------------------------------------------------------------
+// Never destroyed: Slots may well be released during static destruction.
+//------------------------------------------------------------------------------
+static FutureSlotPool& slotPool() {
+  static FutureSlotPool *pool = new FutureSlotPool();
+  return *pool;
+}
+
+FutureSlot* FutureSlot::acquire() {
+  FutureSlot *slot = slotPool().get();
+  slot->refs.store(2, std::memory_order_relaxed);
+  return slot;
+}
+
+void FutureSlot::handleResponse(redisReplyPtr &&rep) {
+  reply = std::move(rep);
+
+  if(state.exchange(kReady, std::memory_order_acq_rel) & kWaiting) {
+    futexWakeAll(&state);
+  }
+
+  release();
+}
+
+bool FutureSlot::isReady() const {
+  return state.load(std::memory_order_acquire) & kReady;
+}
+
+//------------------------------------------------------------------------------
+// Announce ourselves through kWaiting before going to sleep, so that the
+// fulfilling side only pays for the wake-up syscall if somebody's waiting.
+//------------------------------------------------------------------------------
+void FutureSlot::wait() {
+  uint32_t current = state.load(std::memory_order_acquire);
+
+  while(!(current & kReady)) {
+    if(!(current & kWaiting)) {
+      if(!state.compare_exchange_weak(current, current | kWaiting, std::memory_order_acq_rel)) {
+        continue;
+      }
+
+      current |= kWaiting;
+    }
+
+    futexWait(&state, current, nullptr);
+    current = state.load(std::memory_order_acquire);
+  }
+}
+
+bool FutureSlot::waitFor(std::chrono::nanoseconds timeout) {
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+  uint32_t current = state.load(std::memory_order_acquire);
+
+  while(!(current & kReady)) {
+    std::chrono::nanoseconds remaining = deadline - std::chrono::steady_clock::now();
+    if(remaining.count() <= 0) {
+      return false;
+    }
+
+    if(!(current & kWaiting)) {
+      if(!state.compare_exchange_weak(current, current | kWaiting, std::memory_order_acq_rel)) {
+        continue;
+      }
+
+      current |= kWaiting;
+    }
+
+    struct timespec ts;
+    ts.tv_sec = remaining.count() / 1000000000;
+    ts.tv_nsec = remaining.count() % 1000000000;
+
+    futexWait(&state, current, &ts);
+    current = state.load(std::memory_order_acquire);
+  }
+
+  return true;
+}
+
+redisReplyPtr FutureSlot::take() {
+  return std::move(reply);
+}
+
+void FutureSlot::release() {
+  if(refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    slotPool().put(this);
+  }
+}
+
+}
@@ -0,0 +1,138 @@
+//------------------------------------------------------------------------------
+// File: RequestBufferAllocator.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "qclient/RequestBufferAllocator.hh"
+#include <atomic>
+#include <cstdlib>
+
+namespace qclient {
+
+namespace {
+
+//------------------------------------------------------------------------------
+// Leaked on purpose: EncodedRequests living in static objects may be
+// destroyed after any allocator we'd tear down at exit.
+//------------------------------------------------------------------------------
+RequestBufferAllocator* builtinAllocator() {
+  static RequestBufferAllocator *allocator = new PooledBufferAllocator();
+  return allocator;
+}
+
+std::atomic<RequestBufferAllocator*> defaultAllocator {nullptr};
+
+}
+
+RequestBufferAllocator* RequestBufferAllocator::getDefault() {
+  RequestBufferAllocator *allocator = defaultAllocator.load(std::memory_order_acquire);
+  if(allocator) return allocator;
+  return builtinAllocator();
+}
+
+void RequestBufferAllocator::setDefault(RequestBufferAllocator *allocator) {
+  defaultAllocator.store(allocator, std::memory_order_release);
+}
+
+char* MallocBufferAllocator::allocate(size_t size) {
+  return (char*) malloc(size);
+}
+
+void MallocBufferAllocator::deallocate(char* buffer, size_t) {
+  free(buffer);
+}
+
+MallocBufferAllocator* MallocBufferAllocator::instance() {
+  static MallocBufferAllocator *allocator = new MallocBufferAllocator();
+  return allocator;
+}
+
+PooledBufferAllocator::PooledBufferAllocator(size_t maxCached)
+: maxCachedBytes(maxCached) {}
+
+PooledBufferAllocator::~PooledBufferAllocator() {
+  for(size_t i = 0; i < kClasses; i++) {
+    for(char* buffer : classes[i].freeList) {
+      free(buffer);
+    }
+  }
+}
+
+int PooledBufferAllocator::getSizeClass(size_t size) {
+  size_t shift = kMinClassShift;
+  while((size_t(1) << shift) < size) {
+    shift++;
+    if(shift > kMaxClassShift) return -1;
+  }
+
+  return shift - kMinClassShift;
+}
+
+char* PooledBufferAllocator::allocate(size_t size) {
+  int cls = getSizeClass(size);
+  if(cls < 0) {
+    return (char*) malloc(size);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(classes[cls].mtx);
+    std::vector<char*> &freeList = classes[cls].freeList;
+
+    if(!freeList.empty()) {
+      char *buffer = freeList.back();
+      freeList.pop_back();
+      return buffer;
+    }
+  }
+
+  return (char*) malloc(size_t(1) << (cls + kMinClassShift));
+}
+
+void PooledBufferAllocator::deallocate(char* buffer, size_t size) {
+  int cls = getSizeClass(size);
+
+  if(cls >= 0) {
+    size_t classSize = size_t(1) << (cls + kMinClassShift);
+
+    std::lock_guard<std::mutex> lock(classes[cls].mtx);
+    std::vector<char*> &freeList = classes[cls].freeList;
+
+    if((freeList.size() + 1) * classSize <= maxCachedBytes) {
+      freeList.push_back(buffer);
+      return;
+    }
+  }
+
+  free(buffer);
+}
+
+size_t PooledBufferAllocator::getCachedBuffers() const {
+  size_t total = 0;
+
+  for(size_t i = 0; i < kClasses; i++) {
+    std::lock_guard<std::mutex> lock(classes[i].mtx);
+    total += classes[i].freeList.size();
+  }
+
+  return total;
+}
+
+}
@@ -0,0 +1,114 @@
+//------------------------------------------------------------------------------
+// File: RequestCursor.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_REQUEST_CURSOR_HH
+#define QCLIENT_REQUEST_CURSOR_HH
+
+#include "qclient/EncodedRequest.hh"
+#include <algorithm>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// Walks over the bytes of an encoded request, across segments.
+//------------------------------------------------------------------------------
+class RequestCursor {
+public:
+  RequestCursor(const EncodedRequest &r) : req(r) {
+    load();
+  }
+
+  bool next(char &c) {
+    while(pos == len) {
+      if(++segment >= req.getSegmentCount()) return false;
+      load();
+    }
+
+    c = data[pos++];
+    return true;
+  }
+
+  bool skip(size_t n) {
+    while(n > 0) {
+      if(pos == len) {
+        if(++segment >= req.getSegmentCount()) return false;
+        load();
+        continue;
+      }
+
+      size_t step = std::min(n, len - pos);
+      pos += step;
+      n -= step;
+    }
+
+    return true;
+  }
+
+  bool read(char *out, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+      if(!next(out[i])) return false;
+    }
+
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Parse "<prefix><integer>\r\n", such as an array or bulk string header.
+  //----------------------------------------------------------------------------
+  bool readHeader(char prefix, size_t &value) {
+    char c;
+    if(!next(c) || c != prefix) return false;
+
+    value = 0;
+    bool digits = false;
+
+    while(next(c)) {
+      if(c == '\r') {
+        return digits && next(c) && c == '\n';
+      }
+
+      if(c < '0' || c > '9') return false;
+      value = value * 10 + (c - '0');
+      digits = true;
+    }
+
+    return false;
+  }
+
+private:
+  void load() {
+    data = req.getSegmentData(segment);
+    len = req.getSegmentLength(segment);
+    pos = 0;
+  }
+
+  const EncodedRequest &req;
+  size_t segment = 0;
+  const char *data = nullptr;
+  size_t len = 0;
+  size_t pos = 0;
+};
+
+}
+
+#endif
@@ -24,13 +24,13 @@
 #ifndef QCLIENT_REQUEST_QUEUE_HH
 #define QCLIENT_REQUEST_QUEUE_HH
 
-#include "qclient/queueing/WaitableQueue.hh"
+#include "qclient/queueing/LockFreeQueue.hh"
 #include "StagedRequest.hh"
 
 namespace qclient {
 
 //------------------------------------------------------------------------------
-// A WaitableQueue which holds pending, un-acknowledged requests, with a twist:
+// A LockFreeQueue which holds pending, un-acknowledged requests, with a twist:
 // At all times, this class holds one extra, hidden request at the front.
 //
 // When you do pop_front(), you're not actually destroying the item which you'd
@@ -65,7 +65,7 @@ namespace qclient {
 
 class RequestQueue {
 public:
-  using QueueType = WaitableQueue<StagedRequest, 5000>;
+  using QueueType = LockFreeQueue<StagedRequest>;
   using Iterator = QueueType::Iterator;
 
   //----------------------------------------------------------------------------
@@ -76,7 +76,8 @@ public:
   }
 
   //----------------------------------------------------------------------------
-  // Reset queue contents - identical interface to WaitableQueue
+  // Reset queue contents - identical interface to LockFreeQueue. Not safe
+  // while there are concurrent producers.
   //----------------------------------------------------------------------------
   void reset() {
     queue.reset();
@@ -84,7 +85,7 @@ public:
   }
 
   //----------------------------------------------------------------------------
-  // Constructs an item inside the queue - identical interface to WaitableQueue
+  // Constructs an item inside the queue - identical interface to LockFreeQueue
   //----------------------------------------------------------------------------
   template<typename... Args>
   void emplace_back(Args&&... args) {
@@ -92,14 +93,23 @@ public:
   }
 
   //----------------------------------------------------------------------------
-  // Pop an item from the front - identical interface to WaitableQueue.
+  // Constructs several items inside the queue at once - identical interface
+  // to LockFreeQueue
+  //----------------------------------------------------------------------------
+  template<typename Constructor>
+  void emplace_back_batch(size_t count, Constructor construct) {
+    queue.emplace_back_batch(count, construct);
+  }
+
+  //----------------------------------------------------------------------------
+  // Pop an item from the front - identical interface to LockFreeQueue.
   //----------------------------------------------------------------------------
   void pop_front() {
     queue.pop_front();
   }
 
   //----------------------------------------------------------------------------
-  // Get iterator to the queue - identical interface to WaitableQueue
+  // Get iterator to the queue - identical interface to LockFreeQueue
   //----------------------------------------------------------------------------
   Iterator begin() {
     auto iter = queue.begin();
@@ -108,12 +118,19 @@ public:
   }
 
   //----------------------------------------------------------------------------
-  // Set blocking mode - identical interface to WaitableQueue
+  // Set blocking mode - identical interface to LockFreeQueue
   //----------------------------------------------------------------------------
   void setBlockingMode(bool value) {
     queue.setBlockingMode(value);
   }
 
+  //----------------------------------------------------------------------------
+  // Set spin iterations - identical interface to LockFreeQueue
+  //----------------------------------------------------------------------------
+  void setSpinIterations(size_t value) {
+    queue.setSpinIterations(value);
+  }
+
   //----------------------------------------------------------------------------
   // If we were to add a new element, what sequence number would it be assigned
   // to?
@@ -24,18 +24,70 @@
 #include "qclient/ResponseBuilder.hh"
 #include "qclient/QClient.hh"
 #include "reader/reader.hh"
+#include "reader/scanner.hh"
+#include "ReplyArena.hh"
 #include <sstream>
+#include <cstring>
+#include <climits>
 
 #define SSTR(message) static_cast<std::ostringstream&>(std::ostringstream().flush() << message).str()
 
 namespace qclient {
 
-ResponseBuilder::ResponseBuilder() {
+ResponseBuilder::ResponseBuilder()
+: pin(new ReceiveBufferPin()), maxUnusedBuffer(REDIS_READER_MAX_BUF),
+  arenaAllocation(true), zeroCopyReplies(false) {
   restart();
 }
 
+ResponseBuilder::~ResponseBuilder() {}
+
 void ResponseBuilder::restart() {
-  reader.reset(redisReaderCreate());
+  arena.reset();
+  streaming = StreamingState();
+
+  if(zeroCopyReplies) {
+    reader.reset(redisReaderCreateWithFunctions(ReplyArena::getViewReplyObjectFunctions()));
+    reader->releaseBuffer = ReceiveBufferPin::releaseChunk;
+    reader->releasePrivdata = pin.get();
+    pin->reader = reader.get();
+    installArena();
+  }
+  else if(arenaAllocation) {
+    reader.reset(redisReaderCreateWithFunctions(ReplyArena::getReplyObjectFunctions()));
+    installArena();
+  }
+  else {
+    reader.reset(redisReaderCreate());
+  }
+
+  reader->maxbuf = maxUnusedBuffer;
+}
+
+void ResponseBuilder::setArenaAllocation(bool enabled) {
+  arenaAllocation = enabled;
+}
+
+void ResponseBuilder::setZeroCopyReplies(bool enabled) {
+  zeroCopyReplies = enabled;
+}
+
+//------------------------------------------------------------------------------
+// Give the reader a fresh arena for the next reply tree. Must only be called
+// between replies, never while one is being parsed.
+//------------------------------------------------------------------------------
+void ResponseBuilder::installArena() {
+  arena = std::make_shared<ReplyArena>();
+  reader->privdata = arena.get();
+
+  if(zeroCopyReplies) {
+    arena->setPin(pin.get());
+  }
+}
+
+void ResponseBuilder::setMaxUnusedBuffer(size_t len) {
+  maxUnusedBuffer = len;
+  reader->maxbuf = len;
 }
 
 void ResponseBuilder::feed(const char* buff, size_t len) {
@@ -48,6 +100,16 @@ void ResponseBuilder::feed(const std::string &str) {
   feed(str.c_str(), str.size());
 }
 
+char* ResponseBuilder::getWritableTail(size_t len) {
+  return redisReaderGetWritableTail(reader.get(), len);
+}
+
+void ResponseBuilder::commitTail(size_t len) {
+  if(len > 0) {
+    redisReaderCommitTail(reader.get(), len);
+  }
+}
+
 void ResponseBuilder::Deleter::operator()(redisReader *reader) {
   redisReaderFree(reader);
 }
@@ -63,7 +125,213 @@ ResponseBuilder::Status ResponseBuilder::pull(redisReplyPtr &out) {
     return Status::kIncomplete;
   }
 
-  out = redisReplyPtr(redisReplyPtr((redisReply*) reply, freeReplyObject));
+  if(arena) {
+    // The reply tree lives inside the arena - share ownership of it.
+    out = redisReplyPtr(arena, (redisReply*) reply);
+    installArena();
+  }
+  else {
+    out = redisReplyPtr((redisReply*) reply, freeReplyObject);
+  }
+
+  return Status::kOk;
+}
+
+namespace {
+
+//------------------------------------------------------------------------------
+// Parse a length line such as "$12\r\n" or "*-1\r\n" - the type byte is not
+// checked. Returns the length of the line including CRLF, zero if it hasn't
+// fully arrived yet, or -1 if it's malformed.
+//------------------------------------------------------------------------------
+constexpr size_t kMaxLengthLine = 32;
+
+//------------------------------------------------------------------------------
+// The reply type for the given type byte, if it's one we stream - zero
+// otherwise.
+//------------------------------------------------------------------------------
+int streamedReplyType(char type) {
+  switch(type) {
+    case '$': return REDIS_REPLY_STRING;
+    case '*': return REDIS_REPLY_ARRAY;
+    case '%': return REDIS_REPLY_MAP;
+    case '~': return REDIS_REPLY_SET;
+  }
+
+  return 0;
+}
+
+int64_t parseLengthLine(char *buf, size_t len, long long &value) {
+  char *cr = respSeekNewline(buf, std::min(len, kMaxLengthLine));
+  if(cr == nullptr) {
+    return (len >= kMaxLengthLine) ? -1 : 0;
+  }
+
+  if(!respParseInteger(buf + 1, cr - buf - 1, &value)) {
+    return -1;
+  }
+
+  return (cr - buf) + 2;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Bulk strings and aggregates are parsed right here, straight out of the
+// reader buffer, consuming bytes as soon as they've been handed to the
+// callback.
+// Anything else is small, and left to the regular reader.
+//------------------------------------------------------------------------------
+ResponseBuilder::Status ResponseBuilder::pullStreaming(QStreamingCallback *cb, redisReplyPtr &out) {
+  redisReader *r = reader.get();
+
+  if(r->err) {
+    return Status::kProtocolError;
+  }
+
+  if(!streaming.active) {
+    if(redisReaderInReply(r)) {
+      // The regular reader is in the middle of a reply, let it finish.
+      return pull(out);
+    }
+
+    streaming.active = true;
+  }
+
+  while(true) {
+    size_t depth = streaming.remaining.size();
+
+    if(streaming.delegated) {
+      redisReplyPtr element;
+      Status status = pull(element);
+      if(status != Status::kOk) return status;
+
+      streaming.delegated = false;
+      cb->handleElement(depth, std::move(element));
+
+      if(finishStreamedElement()) return completeStreaming(out);
+      continue;
+    }
+
+    if(streaming.inString) {
+      size_t available = r->len - r->pos;
+      size_t chunk = std::min(available, streaming.stringTotal - streaming.stringOffset);
+
+      if(chunk > 0) {
+        cb->handleStringChunk(depth, r->buf + r->pos, chunk, streaming.stringOffset, streaming.stringTotal);
+        streaming.stringOffset += chunk;
+        available -= chunk;
+        redisReaderConsume(r, chunk);
+      }
+
+      if(streaming.stringOffset < streaming.stringTotal || available < 2) {
+        return Status::kIncomplete;
+      }
+
+      if(r->buf[r->pos] != '\r' || r->buf[r->pos+1] != '\n') {
+        return Status::kProtocolError;
+      }
+
+      redisReaderConsume(r, 2);
+      streaming.inString = false;
+
+      if(finishStreamedElement()) return completeStreaming(out);
+      continue;
+    }
+
+    if(r->pos == r->len) {
+      return Status::kIncomplete;
+    }
+
+    // A new element begins - is it one we stream?
+    char type = r->buf[r->pos];
+    long long value = -1;
+    int replyType = streamedReplyType(type);
+
+    if(replyType != 0) {
+      int64_t lineLen = parseLengthLine(r->buf + r->pos, r->len - r->pos, value);
+      if(lineLen < 0) return Status::kProtocolError;
+      if(lineLen == 0) return Status::kIncomplete;
+
+      if(replyType == REDIS_REPLY_MAP && value > 0) {
+        if(value > LLONG_MAX / 2) return Status::kProtocolError;
+        value *= 2;
+      }
+
+      if(value >= 0) {
+        redisReaderConsume(r, lineLen);
+      }
+    }
+
+    if(value < 0 || replyType == 0) {
+      if(depth == 0) {
+        // Not worth streaming, return it whole.
+        streaming = StreamingState();
+        return pull(out);
+      }
+
+      streaming.delegated = true;
+      continue;
+    }
+
+    if(depth == 0) {
+      streaming.type = replyType;
+    }
+
+    if(replyType != REDIS_REPLY_STRING) {
+      cb->handleAggregate(depth, replyType, value);
+
+      if(value > 0) {
+        streaming.remaining.push_back(value);
+      }
+      else if(finishStreamedElement()) {
+        return completeStreaming(out);
+      }
+
+      continue;
+    }
+
+    streaming.inString = true;
+    streaming.stringOffset = 0;
+    streaming.stringTotal = value;
+
+    if(value == 0) {
+      cb->handleStringChunk(depth, "", 0, 0, 0);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// An element of the streamed reply is done - returns whether that completes
+// the entire reply.
+//------------------------------------------------------------------------------
+bool ResponseBuilder::finishStreamedElement() {
+  while(!streaming.remaining.empty()) {
+    if(--streaming.remaining.back() > 0) {
+      return false;
+    }
+
+    streaming.remaining.pop_back();
+  }
+
+  return true;
+}
+
+ResponseBuilder::Status ResponseBuilder::completeStreaming(redisReplyPtr &out) {
+  if(streaming.type == REDIS_REPLY_STRING) {
+    out = makeStr("");
+  }
+  else if(streaming.type == REDIS_REPLY_MAP) {
+    out = makeStringArray({}, '%');
+  }
+  else if(streaming.type == REDIS_REPLY_SET) {
+    out = makeStringArray({}, '~');
+  }
+  else {
+    out = makeStringArray({});
+  }
+
+  streaming = StreamingState();
   return Status::kOk;
 }
 
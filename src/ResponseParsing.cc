@@ -131,7 +131,8 @@ HgetallParser::HgetallParser(const redisReply *reply) {
     return;
   }
 
-  if(reply->type != REDIS_REPLY_ARRAY) {
+  // A RESP3 map holds its keys and values interleaved, just like the array.
+  if(reply->type != REDIS_REPLY_ARRAY && reply->type != REDIS_REPLY_MAP) {
     error = SSTR("Unexpected reply type; was expecting ARRAY, received " << qclient::describeRedisReply(reply));
     isOk = false;
     return;
@@ -27,6 +27,8 @@
 #include "qclient/QCallback.hh"
 #include "qclient/EncodedRequest.hh"
 #include <chrono>
+#include <deque>
+#include <vector>
 
 namespace qclient {
 
@@ -36,6 +38,32 @@ public:
     : callback(cb), encodedRequest(std::move(request)), multiSize(multi)
   {}
 
+  //----------------------------------------------------------------------------
+  // A MULTI block: the requests are written out back-to-back, without being
+  // fused into a single buffer. MULTI / EXEC are added here.
+  //----------------------------------------------------------------------------
+  StagedRequest(QCallback *cb, std::deque<EncodedRequest> &&requests, size_t multi)
+    : callback(cb), encodedRequest(EncodedRequest::make("MULTI")), multiSize(multi)
+  {
+    block.reserve(requests.size() + 1);
+    for(auto it = requests.begin(); it != requests.end(); it++) {
+      block.emplace_back(std::move(*it));
+    }
+
+    block.emplace_back(EncodedRequest::make("EXEC"));
+    requests.clear();
+  }
+
+  //----------------------------------------------------------------------------
+  // A request whose reply is to be streamed to the given callback.
+  //----------------------------------------------------------------------------
+  struct StreamReply {};
+
+  StagedRequest(QStreamingCallback *cb, EncodedRequest &&request, StreamReply)
+    : callback(cb), streamingCallback(cb), encodedRequest(std::move(request)),
+      multiSize(0)
+  {}
+
   StagedRequest(const StagedRequest& other) = delete;
   StagedRequest(StagedRequest&& other) = delete;
 
@@ -44,13 +72,35 @@ public:
   }
 
   size_t getLen() const {
-    return encodedRequest.getLen();
+    size_t len = encodedRequest.getLen();
+    for(size_t i = 0; i < block.size(); i++) {
+      len += block[i].getLen();
+    }
+
+    return len;
+  }
+
+  //----------------------------------------------------------------------------
+  // Access the encoded requests to be written, in order - more than one only
+  // for MULTI blocks.
+  //----------------------------------------------------------------------------
+  size_t getEncodedRequestCount() const {
+    return 1u + block.size();
+  }
+
+  const EncodedRequest& getEncodedRequest(size_t i = 0) const {
+    if(i == 0) return encodedRequest;
+    return block[i-1];
   }
 
   QCallback* getCallback() {
     return callback;
   }
 
+  QStreamingCallback* getStreamingCallback() {
+    return streamingCallback;
+  }
+
   void set_value(redisReplyPtr &&reply) {
     if(callback) {
       callback->handleResponse(std::move(reply));
@@ -72,7 +122,9 @@ public:
 
 private:
   QCallback *callback = nullptr;
+  QStreamingCallback *streamingCallback = nullptr;
   EncodedRequest encodedRequest;
+  std::vector<EncodedRequest> block;
   size_t multiSize;
   //! Send request timestamp
   std::chrono::time_point<std::chrono::system_clock> mSendTs;
@@ -0,0 +1,367 @@
+// ----------------------------------------------------------------------
+// File: TypedDecoder.cc
+// Author: Georgios Bitzes - CERN
+// ----------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2018 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+
+#include "qclient/TypedDecoder.hh"
+#include "qclient/ResponseBuilder.hh"
+#include "qclient/QClient.hh"
+#include <sstream>
+
+#define SSTR(message) static_cast<std::ostringstream&>(std::ostringstream().flush() << message).str()
+
+namespace qclient {
+
+namespace {
+
+//------------------------------------------------------------------------------
+// Same prefixes as in ResponseParsing.cc
+//------------------------------------------------------------------------------
+std::string typeMismatch(DecoderShape shape) {
+  switch(shape) {
+    case DecoderShape::kString: {
+      return "Unexpected reply type; was expecting STRING, received ";
+    }
+    case DecoderShape::kInteger: {
+      return "Unexpected reply type; was expecting INTEGER, received ";
+    }
+    case DecoderShape::kStringArray:
+    case DecoderShape::kStringPairs: {
+      return "Unexpected reply type; was expecting ARRAY, received ";
+    }
+  }
+
+  return "";
+}
+
+std::string elementMismatch(size_t index) {
+  return SSTR("Unexpected reply type for element #" << index << ": " <<
+    typeMismatch(DecoderShape::kString));
+}
+
+//------------------------------------------------------------------------------
+// Re-encode a scalar reply, so it can be parsed back when describing the
+// recorded part of a reply.
+//------------------------------------------------------------------------------
+void encodeScalar(std::string &out, const redisReply *reply) {
+  switch(reply->type) {
+    case REDIS_REPLY_INTEGER: {
+      out += SSTR(":" << reply->integer << "\r\n");
+      break;
+    }
+    case REDIS_REPLY_BOOL: {
+      out += reply->integer ? "#t\r\n" : "#f\r\n";
+      break;
+    }
+    case REDIS_REPLY_DOUBLE: {
+      out += ",";
+      out.append(reply->str, reply->len);
+      out += "\r\n";
+      break;
+    }
+    case REDIS_REPLY_BIGNUM: {
+      out += "(";
+      out.append(reply->str, reply->len);
+      out += "\r\n";
+      break;
+    }
+    case REDIS_REPLY_VERB: {
+      out += SSTR("=" << reply->len + 4 << "\r\n" << reply->vtype << ":");
+      out.append(reply->str, reply->len);
+      out += "\r\n";
+      break;
+    }
+    case REDIS_REPLY_STATUS: {
+      out += "+";
+      out.append(reply->str, reply->len);
+      out += "\r\n";
+      break;
+    }
+    case REDIS_REPLY_ERROR: {
+      out += "-";
+      out.append(reply->str, reply->len);
+      out += "\r\n";
+      break;
+    }
+    default: {
+      out += "$-1\r\n";
+    }
+  }
+}
+
+void encodeAggregate(std::string &out, int type, size_t elements) {
+  switch(type) {
+    case REDIS_REPLY_MAP: {
+      out += SSTR("%" << elements / 2 << "\r\n");
+      break;
+    }
+    case REDIS_REPLY_SET: {
+      out += SSTR("~" << elements << "\r\n");
+      break;
+    }
+    case REDIS_REPLY_PUSH: {
+      out += SSTR(">" << elements << "\r\n");
+      break;
+    }
+    default: {
+      out += SSTR("*" << elements << "\r\n");
+    }
+  }
+}
+
+}
+
+TypedDecoderBase::TypedDecoderBase(DecoderShape sh) : shape(sh) {}
+
+TypedDecoderBase::~TypedDecoderBase() {}
+
+//------------------------------------------------------------------------------
+// A new depth-0 event means the reply is being streamed from the start,
+// possibly for a second time, after a reconnection.
+//------------------------------------------------------------------------------
+void TypedDecoderBase::restart() {
+  clearValue();
+  started = true;
+  elementIndex = 0;
+  current.clear();
+  pendingKey.clear();
+
+  failed = false;
+  recording = false;
+  recordingString = false;
+  recordDepth = 0;
+  recorded.clear();
+  error.clear();
+}
+
+void TypedDecoderBase::fail(const std::string &err) {
+  failed = true;
+  error = err;
+}
+
+void TypedDecoderBase::startRecording(const std::string &prefix, size_t depth, bool isString) {
+  fail(prefix);
+  recording = true;
+  recordingString = isString;
+  recordDepth = depth;
+  recorded.clear();
+}
+
+void TypedDecoderBase::finishRecording() {
+  error += describeRedisReply(ResponseBuilder::parseRedisEncodedString(recorded));
+  recording = false;
+  recorded.clear();
+}
+
+//------------------------------------------------------------------------------
+// Returns true if the reply has already failed, and the event should not be
+// decoded. An event at or above the depth of a recorded array marks its end.
+//------------------------------------------------------------------------------
+bool TypedDecoderBase::ignoreEvent(size_t depth) {
+  if(!failed) return false;
+
+  if(recording && !recordingString && depth <= recordDepth) {
+    finishRecording();
+  }
+
+  return true;
+}
+
+void TypedDecoderBase::completeElement(std::string &&str) {
+  if(shape == DecoderShape::kStringPairs && elementIndex % 2 == 0) {
+    pendingKey = std::move(str);
+  }
+  else if(shape == DecoderShape::kStringPairs) {
+    if(!addPair(std::move(pendingKey), std::move(str))) {
+      fail(SSTR("Found duplicate key: '" << pendingKey << "'"));
+      return;
+    }
+  }
+  else {
+    addString(std::move(str));
+  }
+
+  elementIndex++;
+}
+
+void TypedDecoderBase::handleArray(size_t depth, size_t elements) {
+  handleAggregate(depth, REDIS_REPLY_ARRAY, elements);
+}
+
+void TypedDecoderBase::handleAggregate(size_t depth, int type, size_t elements) {
+  if(depth == 0) {
+    restart();
+  }
+
+  if(ignoreEvent(depth)) {
+    if(recording) {
+      encodeAggregate(recorded, type, elements);
+    }
+
+    return;
+  }
+
+  if(depth == 0) {
+    // A set can't hold key-value pairs.
+    if(shape == DecoderShape::kString || shape == DecoderShape::kInteger ||
+       (shape == DecoderShape::kStringPairs && type == REDIS_REPLY_SET)) {
+      startRecording(typeMismatch(shape), depth, false);
+      encodeAggregate(recorded, type, elements);
+      return;
+    }
+
+    if(shape == DecoderShape::kStringPairs && elements % 2 != 0) {
+      fail(SSTR("Unexpected number of elements; expected a multiple of 2, received " << elements));
+      return;
+    }
+
+    reserveValue(shape == DecoderShape::kStringPairs ? elements / 2 : elements);
+    return;
+  }
+
+  // A nested aggregate, where a string was expected.
+  startRecording(elementMismatch(elementIndex), depth, false);
+  encodeAggregate(recorded, type, elements);
+}
+
+void TypedDecoderBase::handleStringChunk(size_t depth, const char *data, size_t len,
+  size_t offset, size_t total) {
+
+  if(depth == 0 && offset == 0) {
+    restart();
+  }
+
+  bool recordingThis = recording && recordingString && depth == recordDepth && offset != 0;
+
+  if(!recordingThis && ignoreEvent(depth)) {
+    if(!recording) return;
+    if(offset == 0) recorded += SSTR("$" << total << "\r\n");
+    recorded.append(data, len);
+    if(offset + len == total) recorded += "\r\n";
+    return;
+  }
+
+  if(recordingThis || (depth == 0 && shape != DecoderShape::kString)) {
+    if(!recordingThis) {
+      startRecording(typeMismatch(shape), depth, true);
+      recorded += SSTR("$" << total << "\r\n");
+    }
+
+    recorded.append(data, len);
+
+    if(offset + len == total) {
+      recorded += "\r\n";
+      finishRecording();
+    }
+
+    return;
+  }
+
+  if(offset == 0) {
+    current.clear();
+    current.reserve(total);
+  }
+
+  current.append(data, len);
+  if(offset + len != total) return;
+
+  if(depth == 0) {
+    addString(std::move(current));
+  }
+  else {
+    completeElement(std::move(current));
+  }
+
+  current.clear();
+}
+
+void TypedDecoderBase::handleElement(size_t depth, redisReplyPtr &&reply) {
+  if(ignoreEvent(depth)) {
+    if(recording) {
+      encodeScalar(recorded, reply.get());
+    }
+
+    return;
+  }
+
+  fail(elementMismatch(elementIndex) + describeRedisReply(reply));
+}
+
+//------------------------------------------------------------------------------
+// Replay a reply which was received whole through the streaming events.
+//------------------------------------------------------------------------------
+void TypedDecoderBase::replay(const redisReplyPtr &root, const redisReply *reply, size_t depth) {
+  if(reply->type == REDIS_REPLY_ARRAY || reply->type == REDIS_REPLY_PUSH ||
+     reply->type == REDIS_REPLY_MAP || reply->type == REDIS_REPLY_SET) {
+    handleAggregate(depth, reply->type, reply->elements);
+
+    for(size_t i = 0; i < reply->elements; i++) {
+      replay(root, reply->element[i], depth + 1);
+    }
+  }
+  else if(reply->type == REDIS_REPLY_STRING) {
+    handleStringChunk(depth, reply->str, reply->len, 0, reply->len);
+  }
+  else {
+    // Aliasing constructor: shares ownership with the root.
+    handleElement(depth, redisReplyPtr(root, const_cast<redisReply*>(reply)));
+  }
+}
+
+void TypedDecoderBase::handleResponse(redisReplyPtr &&reply) {
+  if(!reply) {
+    finish("Received null redisReply");
+    return;
+  }
+
+  if(reply->type == REDIS_REPLY_ARRAY || reply->type == REDIS_REPLY_STRING ||
+     reply->type == REDIS_REPLY_MAP || reply->type == REDIS_REPLY_SET) {
+    // Streamed replies arrive stripped - a whole one needs to be replayed.
+    if(!started) {
+      replay(reply, reply.get(), 0);
+    }
+  }
+  else {
+    restart();
+
+    if(shape == DecoderShape::kInteger && reply->type == REDIS_REPLY_INTEGER) {
+      setInteger(reply->integer);
+    }
+    else {
+      fail(typeMismatch(shape) + describeRedisReply(reply));
+    }
+  }
+
+  if(recording) {
+    finishRecording();
+  }
+
+  std::string err;
+  if(failed) {
+    err = std::move(error);
+  }
+
+  // May delete this.
+  finish(std::move(err));
+}
+
+}
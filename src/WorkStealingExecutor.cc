@@ -0,0 +1,160 @@
+//------------------------------------------------------------------------------
+// File: WorkStealingExecutor.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "qclient/Executor.hh"
+#include "qclient/AssistedThread.hh"
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// The pool the current thread is a worker of, if any, and its index.
+//------------------------------------------------------------------------------
+thread_local WorkStealingExecutor *currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+
+WorkStealingExecutor::WorkStealingExecutor(size_t threadCount) {
+  if(threadCount == 0) {
+    threadCount = 1;
+  }
+
+  for(size_t i = 0; i < threadCount; i++) {
+    workers.emplace_back(new Worker());
+  }
+
+  for(size_t i = 0; i < threadCount; i++) {
+    threads.emplace_back(new AssistedThread(&WorkStealingExecutor::main, this, i));
+  }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+  for(size_t i = 0; i < threads.size(); i++) {
+    threads[i]->stop();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sleepMtx);
+    sleepCv.notify_all();
+  }
+
+  threads.clear();
+}
+
+//------------------------------------------------------------------------------
+// Tasks submitted from one of our own workers stay on that worker's queue,
+// everything else is spread round-robin.
+//------------------------------------------------------------------------------
+void WorkStealingExecutor::execute(std::function<void()> &&task) {
+  size_t id;
+
+  if(currentPool == this) {
+    id = currentWorker;
+  }
+  else {
+    id = nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(workers[id]->mtx);
+    workers[id]->tasks.emplace_back(std::move(task));
+  }
+
+  //----------------------------------------------------------------------------
+  // The counter is bumped only after the push, so a worker may grab the task
+  // first and drive it briefly negative - harmless.
+  //----------------------------------------------------------------------------
+  queuedTasks.fetch_add(1, std::memory_order_seq_cst);
+
+  //----------------------------------------------------------------------------
+  // Only pay for the lock and notification if somebody is asleep.
+  //----------------------------------------------------------------------------
+  if(sleepers.load(std::memory_order_seq_cst) != 0) {
+    std::lock_guard<std::mutex> lock(sleepMtx);
+    sleepCv.notify_one();
+  }
+}
+
+//------------------------------------------------------------------------------
+// Take the oldest task of our own queue. If empty, steal the newest task of
+// somebody else's.
+//------------------------------------------------------------------------------
+bool WorkStealingExecutor::grabTask(size_t id, std::function<void()> &task) {
+  {
+    Worker &own = *workers[id];
+    std::lock_guard<std::mutex> lock(own.mtx);
+
+    if(!own.tasks.empty()) {
+      task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+
+  for(size_t i = 1; i < workers.size(); i++) {
+    Worker &victim = *workers[(id + i) % workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mtx);
+
+    if(!victim.tasks.empty()) {
+      task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void WorkStealingExecutor::main(size_t id, ThreadAssistant &assistant) {
+  currentPool = this;
+  currentWorker = id;
+
+  std::function<void()> task;
+
+  while(true) {
+    if(grabTask(id, task)) {
+      queuedTasks.fetch_sub(1, std::memory_order_seq_cst);
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMtx);
+    sleepers.fetch_add(1, std::memory_order_seq_cst);
+
+    while(queuedTasks.load(std::memory_order_seq_cst) <= 0 && !assistant.terminationRequested()) {
+      sleepCv.wait(lock);
+    }
+
+    sleepers.fetch_sub(1, std::memory_order_seq_cst);
+
+    //--------------------------------------------------------------------------
+    // Only quit once everything has been serviced.
+    //--------------------------------------------------------------------------
+    if(assistant.terminationRequested() && queuedTasks.load(std::memory_order_seq_cst) <= 0) {
+      break;
+    }
+  }
+
+  currentPool = nullptr;
+}
+
+}
@@ -0,0 +1,161 @@
+//------------------------------------------------------------------------------
+// File: WriteBatch.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_WRITE_BATCH_HH
+#define QCLIENT_WRITE_BATCH_HH
+
+#include <sys/uio.h>
+#include <vector>
+#include <cstddef>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// Gathers the buffers of several staged requests, so they can be flushed
+// onto the socket with a single writev(), and keeps track of partial writes
+// across buffer boundaries.
+//
+// The batch only stores pointers and lengths, it never touches the request
+// objects themselves after they've been added. This matters: the reader
+// thread may receive a response and deallocate a request as soon as it has
+// been fully written, even before writev() returns.
+//------------------------------------------------------------------------------
+class WriteBatch {
+public:
+  //----------------------------------------------------------------------------
+  // Constructor - a batch holds at most maxBuffers buffers, and stops
+  // accepting new ones once maxBytes are pending. A single buffer is always
+  // accepted, regardless of its size.
+  //----------------------------------------------------------------------------
+  WriteBatch(size_t maxBuffers, size_t maxBytes)
+  : bufferLimit(maxBuffers == 0 ? 1 : maxBuffers), byteLimit(maxBytes) {
+    iov.reserve(bufferLimit);
+  }
+
+  //----------------------------------------------------------------------------
+  // Append a buffer to the batch.
+  //----------------------------------------------------------------------------
+  void add(const char *buff, size_t len) {
+    if(len == 0) return;
+
+    struct iovec vec;
+    vec.iov_base = const_cast<char*>(buff);
+    vec.iov_len = len;
+    iov.push_back(vec);
+    pendingBytes += len;
+  }
+
+  //----------------------------------------------------------------------------
+  // Is there anything left to write?
+  //----------------------------------------------------------------------------
+  bool empty() const {
+    return front == iov.size();
+  }
+
+  //----------------------------------------------------------------------------
+  // Should we stop gathering more buffers into this batch?
+  //----------------------------------------------------------------------------
+  bool full() const {
+    return (iov.size() - front) >= bufferLimit || pendingBytes >= byteLimit;
+  }
+
+  //----------------------------------------------------------------------------
+  // Pointer to the first pending iovec, to be passed to writev().
+  //----------------------------------------------------------------------------
+  const struct iovec* getIovec() const {
+    return iov.data() + front;
+  }
+
+  //----------------------------------------------------------------------------
+  // Number of pending iovecs.
+  //----------------------------------------------------------------------------
+  int getIovcnt() const {
+    return iov.size() - front;
+  }
+
+  //----------------------------------------------------------------------------
+  // Number of bytes not yet written.
+  //----------------------------------------------------------------------------
+  size_t getPendingBytes() const {
+    return pendingBytes;
+  }
+
+  //----------------------------------------------------------------------------
+  // Account for the given number of bytes having been written. Fully written
+  // buffers are dropped, a partially written one is adjusted so that the next
+  // writev() resumes from where the previous one stopped.
+  //
+  // Returns false if we're told more bytes were written than were pending,
+  // which should never happen.
+  //----------------------------------------------------------------------------
+  bool consume(size_t bytes) {
+    if(bytes > pendingBytes) return false;
+    pendingBytes -= bytes;
+
+    while(bytes > 0) {
+      struct iovec &vec = iov[front];
+
+      if(bytes < vec.iov_len) {
+        vec.iov_base = static_cast<char*>(vec.iov_base) + bytes;
+        vec.iov_len -= bytes;
+        break;
+      }
+
+      bytes -= vec.iov_len;
+      front++;
+    }
+
+    if(empty()) {
+      iov.clear();
+      front = 0;
+    }
+    else if(front >= bufferLimit) {
+      // Don't let already-written entries pile up at the front.
+      iov.erase(iov.begin(), iov.begin() + front);
+      front = 0;
+    }
+
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Drop everything.
+  //----------------------------------------------------------------------------
+  void clear() {
+    iov.clear();
+    front = 0;
+    pendingBytes = 0;
+  }
+
+private:
+  size_t bufferLimit;
+  size_t byteLimit;
+
+  std::vector<struct iovec> iov;
+  size_t front = 0;
+  size_t pendingBytes = 0;
+};
+
+}
+
+#endif
@@ -27,13 +27,17 @@
 #include "qclient/Handshake.hh"
 #include "qclient/Logger.hh"
 #include <poll.h>
+#include <limits.h>
+#include <algorithm>
 
 #define DBG(message) std::cerr << __FILE__ << ":" << __LINE__ << " -- " << #message << " = " << message << std::endl
 
 using namespace qclient;
 
-WriterThread::WriterThread(Logger *log, ConnectionCore &core, EventFD &shutdownFD)
-: logger(log), connectionCore(core), shutdownEventFD(shutdownFD) { }
+WriterThread::WriterThread(Logger *log, ConnectionCore &core, EventFD &shutdownFD,
+  const WriteCoalescingStrategy &coalescing)
+: logger(log), connectionCore(core), shutdownEventFD(shutdownFD),
+  batch(std::min<size_t>(coalescing.getRequestLimit(), IOV_MAX), coalescing.getByteLimit()) { }
 
 WriterThread::~WriterThread() {
   deactivate();
@@ -50,6 +54,19 @@ void WriterThread::deactivate() {
   thread.join();
 }
 
+void WriterThread::addToBatch(StagedRequest *req) {
+  if (connectionCore.hasPerfCb()) {
+    req->setTimestamp();
+  }
+
+  for(size_t r = 0; r < req->getEncodedRequestCount(); r++) {
+    const EncodedRequest &encoded = req->getEncodedRequest(r);
+    for(size_t i = 0; i < encoded.getSegmentCount(); i++) {
+      batch.add(encoded.getSegmentData(i), encoded.getSegmentLength(i));
+    }
+  }
+}
+
 void WriterThread::eventLoop(NetworkStream *networkStream, ThreadAssistant &assistant) {
 
   struct pollfd polls[2];
@@ -58,8 +75,9 @@ void WriterThread::eventLoop(NetworkStream *networkStream, ThreadAssistant &assi
   polls[1].fd = networkStream->getFd();
   polls[1].events = POLLOUT;
 
-  StagedRequest *beingProcessed = nullptr;
-  size_t bytesWritten = 0;
+  // Anything left over belongs to a previous connection - these requests
+  // will be written again from scratch.
+  batch.clear();
   bool canWrite = true;
 
   while(!assistant.terminationRequested() && networkStream->ok()) {
@@ -81,23 +99,22 @@ void WriterThread::eventLoop(NetworkStream *networkStream, ThreadAssistant &assi
 
     // Determine what exactly we should be writing into the socket. getNextToWrite
     // will block until there's something to write, or shutdown has been requested.
-    if(beingProcessed == nullptr) {
-      bytesWritten = 0;
-      beingProcessed = connectionCore.getNextToWrite();
-      if(!beingProcessed) continue;
+    if(batch.empty()) {
+      StagedRequest *next = connectionCore.getNextToWrite();
+      if(!next) continue;
+      addToBatch(next);
+    }
 
-      if (connectionCore.hasPerfCb()) {
-        beingProcessed->setTimestamp();
-      }
+    // Opportunistically pick up anything else which is already staged, so
+    // that all of it goes out with a single syscall. Never block here.
+    while(!batch.full()) {
+      StagedRequest *next = connectionCore.tryGetNextToWrite();
+      if(!next) break;
+      addToBatch(next);
     }
 
     // The socket is writable AND there's staged requests waiting to be written.
-    int bytes;
-
-    bytes = networkStream->send(
-      beingProcessed->getBuffer() + bytesWritten,
-      beingProcessed->getLen() - bytesWritten
-    );
+    int bytes = networkStream->sendv(batch.getIovec(), batch.getIovcnt());
 
     // Determine what happened during sending.
     if(bytes < 0 && errno == EWOULDBLOCK) {
@@ -107,6 +124,11 @@ void WriterThread::eventLoop(NetworkStream *networkStream, ThreadAssistant &assi
       continue;
     }
 
+    if(bytes < 0 && errno == ECANCELED) {
+      // The send was aborted, because shutdown was requested.
+      return;
+    }
+
     if(bytes < 0) {
       // Non-recoverable error, this looks bad. Kill connection.
       QCLIENT_LOG(logger, LogLevel::kError, "Bad return value from send(): "
@@ -119,22 +141,70 @@ void WriterThread::eventLoop(NetworkStream *networkStream, ThreadAssistant &assi
     }
 
     // Seems good, at least some bytes were written. Whoo!
-    bytesWritten += bytes;
-    if(bytesWritten > beingProcessed->getLen()) {
-      QCLIENT_LOG(logger, LogLevel::kFatal, "Wrote more bytes for a request than its length: "
-        << bytesWritten << ", " << beingProcessed->getLen());
+    if(!batch.consume(bytes)) {
+      QCLIENT_LOG(logger, LogLevel::kFatal, "Wrote more bytes than were pending: "
+        << bytes << ", " << batch.getPendingBytes());
       std::abort();
     }
 
-    // Are we done with 'beingProcessed' yet?
-    if(bytesWritten == beingProcessed->getLen()) {
-      // Yep, set to null and process next one.
-      beingProcessed = nullptr;
-    }
-    else {
-      // Fewer bytes were written than the full length of the request, the
+    // Are we done with the current batch yet?
+    if(!batch.empty()) {
+      // Fewer bytes were written than the full length of the batch, the
       // kernel buffers must be full. Poll until the socket is writable.
       canWrite = false;
     }
   }
 }
+
+void WriterThread::clearBatch() {
+  batch.clear();
+}
+
+WriteStatus WriterThread::writeSome(NetworkStream *networkStream, size_t maxBatches) {
+  for(size_t round = 0; round < maxBatches; round++) {
+    if(!networkStream->ok()) {
+      return WriteStatus::kFailed;
+    }
+
+    if(batch.empty()) {
+      StagedRequest *next = connectionCore.pollNextToWrite();
+      if(!next) {
+        if(connectionCore.parkWriter()) return WriteStatus::kParked;
+        continue;
+      }
+
+      addToBatch(next);
+    }
+
+    while(!batch.full()) {
+      StagedRequest *next = connectionCore.tryGetNextToWrite();
+      if(!next) break;
+      addToBatch(next);
+    }
+
+    int bytes = networkStream->sendv(batch.getIovec(), batch.getIovcnt());
+
+    if(bytes < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+      return WriteStatus::kBlocked;
+    }
+
+    if(bytes < 0) {
+      QCLIENT_LOG(logger, LogLevel::kError, "Bad return value from send(): "
+        << bytes << ", errno: " << errno << "," << strerror(errno));
+      networkStream->shutdown();
+      return WriteStatus::kFailed;
+    }
+
+    if(!batch.consume(bytes)) {
+      QCLIENT_LOG(logger, LogLevel::kFatal, "Wrote more bytes than were pending: "
+        << bytes << ", " << batch.getPendingBytes());
+      std::abort();
+    }
+
+    if(!batch.empty()) {
+      return WriteStatus::kBlocked;
+    }
+  }
+
+  return WriteStatus::kYielded;
+}
@@ -30,6 +30,7 @@
 #include "BackpressureApplier.hh"
 #include "CallbackExecutorThread.hh"
 #include "StagedRequest.hh"
+#include "WriteBatch.hh"
 #include "qclient/Options.hh"
 #include "qclient/EncodedRequest.hh"
 #include <deque>
@@ -40,19 +41,43 @@ namespace qclient {
 class ConnectionCore;
 class NetworkStream;
 
+//------------------------------------------------------------------------------
+// Outcome of WriterThread::writeSome.
+//------------------------------------------------------------------------------
+enum class WriteStatus {
+  kParked,    // nothing left to write, see ConnectionCore::parkWriter
+  kBlocked,   // the socket is not writable, wait for POLLOUT
+  kYielded,   // more to write, but we've had our turn
+  kFailed     // the connection is broken, and has been shut down
+};
+
 class WriterThread {
 public:
-  WriterThread(Logger *logger, ConnectionCore &core, EventFD &shutdownFD);
+  WriterThread(Logger *logger, ConnectionCore &core, EventFD &shutdownFD,
+    const WriteCoalescingStrategy &coalescing = WriteCoalescingStrategy::Default());
   ~WriterThread();
 
   void activate(NetworkStream *stream);
   void deactivate();
   void eventLoop(NetworkStream *stream, ThreadAssistant &assistant);
 
+  //----------------------------------------------------------------------------
+  // For when there's no dedicated writer thread, and an external loop polls
+  // the socket instead. Call clearBatch once per connection, before writing.
+  //
+  // Write as much as the socket accepts without blocking, up to maxBatches
+  // batches.
+  //----------------------------------------------------------------------------
+  void clearBatch();
+  WriteStatus writeSome(NetworkStream *stream, size_t maxBatches);
+
 private:
+  void addToBatch(StagedRequest *req);
+
   Logger *logger;
   ConnectionCore &connectionCore;
   EventFD &shutdownEventFD;
+  WriteBatch batch;
   AssistedThread thread;
 };
 
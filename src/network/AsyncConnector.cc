@@ -150,11 +150,17 @@ bool AsyncConnector::blockUntilReady(int shutdownFd, std::chrono::seconds timeou
     //--------------------------------------------------------------------------
     // Timed-out?
     //--------------------------------------------------------------------------
-    if(deadline < std::chrono::steady_clock::now()) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(deadline < now) {
       return false;
     }
 
-    int rpoll = poll(polls, 2, 1);
+    //--------------------------------------------------------------------------
+    // Sleep until the deadline at most, rounded up so as not to wake up
+    // early and spin.
+    //--------------------------------------------------------------------------
+    int remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+    int rpoll = poll(polls, 2, remaining);
     if(rpoll < 0 && errno != EINTR) {
       //------------------------------------------------------------------------
       // Something is wrong, bail out
@@ -171,41 +177,14 @@ bool AsyncConnector::blockUntilReady(int shutdownFd, std::chrono::seconds timeou
 
     if(polls[1].revents != 0) {
       //------------------------------------------------------------------------
-      // An event on our file descriptor.. we could check POLLOUT and POLLERR,
-      // but getsockopt seems more robust, and we can get the errno on failure.
+      // An event on our file descriptor.. Ready, unless ::connect is somehow
+      // still in progress.
       //------------------------------------------------------------------------
-      int valopt = 0;
-      socklen_t optlen = sizeof(int);
-      if(getsockopt(fd.get(), SOL_SOCKET, SO_ERROR, (void*)(&valopt), &optlen) < 0) {
-        //----------------------------------------------------------------------
-        // Not really supposed to happen..
-        //----------------------------------------------------------------------
-        localerrno = errno;
-        error = SSTR("Unable to run getsockopt() after poll(), errno=" << localerrno << strerror(localerrno));
-        finished = true;
-        return true;
-      }
-
-
-      if(valopt == EINTR || valopt == EINPROGRESS) {
-        //----------------------------------------------------------------------
-        // Strange, but ok.. retry.. might never happen.
-        //----------------------------------------------------------------------
-        continue;
-      }
-
-      finished = true;
-
-      if(valopt != 0) {
-        localerrno = valopt;
-        error = SSTR("Unable to connect (" << localerrno << ")" << ":" << strerror(localerrno));
+      if(handleEvent()) {
         return true;
       }
 
-      //------------------------------------------------------------------------
-      // Success, connection is active
-      //------------------------------------------------------------------------
-      return true;
+      continue;
     }
 
     if(polls[0].revents != 0) {
@@ -217,6 +196,56 @@ bool AsyncConnector::blockUntilReady(int shutdownFd, std::chrono::seconds timeou
   }
 }
 
+//------------------------------------------------------------------------------
+// Our file descriptor signalled an event: fetch the outcome of ::connect.
+// Returns false if it's still in progress.
+//------------------------------------------------------------------------------
+bool AsyncConnector::handleEvent() {
+  if(finished || localerrno != 0 || fd.get() < 0) {
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // We could check POLLOUT and POLLERR, but getsockopt seems more robust, and
+  // we can get the errno on failure.
+  //----------------------------------------------------------------------------
+  int valopt = 0;
+  socklen_t optlen = sizeof(int);
+  if(getsockopt(fd.get(), SOL_SOCKET, SO_ERROR, (void*)(&valopt), &optlen) < 0) {
+    //--------------------------------------------------------------------------
+    // Not really supposed to happen..
+    //--------------------------------------------------------------------------
+    localerrno = errno;
+    error = SSTR("Unable to run getsockopt() after poll(), errno=" << localerrno << strerror(localerrno));
+    finished = true;
+    return true;
+  }
+
+  if(valopt == EINTR || valopt == EINPROGRESS) {
+    //--------------------------------------------------------------------------
+    // Strange, but ok.. retry.. might never happen.
+    //--------------------------------------------------------------------------
+    return false;
+  }
+
+  finished = true;
+
+  if(valopt != 0) {
+    localerrno = valopt;
+    error = SSTR("Unable to connect (" << localerrno << ")" << ":" << strerror(localerrno));
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Get file descriptor, without giving up ownership - could be -1 if an
+// error has occurred.
+//------------------------------------------------------------------------------
+int AsyncConnector::getFd() const {
+  return fd.get();
+}
+
 //------------------------------------------------------------------------------
 // Has there been an error yet? Note that, if ::connect is still pending,
 // there might be an error in the future.
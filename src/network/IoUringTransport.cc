@@ -0,0 +1,629 @@
+//------------------------------------------------------------------------------
+// File: IoUringTransport.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "IoUringTransport.hh"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// There's no dependency on liburing - the kernel interface is small enough
+// to drive directly. Multishot recv is the newest thing we rely on.
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define QCLIENT_HAVE_IO_URING 1
+#endif
+
+namespace qclient {
+
+#ifdef QCLIENT_HAVE_IO_URING
+
+namespace {
+
+constexpr unsigned kRingEntries = 8;
+constexpr unsigned kCompletionEntries = 128;
+
+// Must be a power of two.
+constexpr uint16_t kBufferCount = 32;
+constexpr uint32_t kBufferSize = 16 * 1024;
+constexpr uint16_t kBufferGroup = 0;
+
+// Same as TCP_USER_TIMEOUT, as set by AsyncConnector.
+constexpr long long kSendTimeoutSeconds = 30;
+
+enum : uint64_t {
+  kRecvTag = 1,
+  kShutdownTag,
+  kSendTag,
+  kTimeoutTag,
+  kCancelTag
+};
+
+}
+
+//------------------------------------------------------------------------------
+// A bare-bones io_uring instance: Submission and completion queues mapped
+// into our address space, and a way to enter the kernel.
+//------------------------------------------------------------------------------
+class IoUringRing {
+public:
+  static std::unique_ptr<IoUringRing> create(unsigned entries, unsigned cqEntries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = cqEntries;
+
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(fd < 0 && errno == EINVAL) {
+      // COOP_TASKRUN is only an optimization, don't insist on it.
+      memset(&params, 0, sizeof(params));
+      params.flags = IORING_SETUP_CQSIZE;
+      params.cq_entries = cqEntries;
+      fd = syscall(__NR_io_uring_setup, entries, &params);
+    }
+
+    if(fd < 0) {
+      return {};
+    }
+
+    std::unique_ptr<IoUringRing> ring(new IoUringRing(fd));
+
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if((params.features & required) != required || !ring->map(params)) {
+      return {};
+    }
+
+    return ring;
+  }
+
+  ~IoUringRing() {
+    if(sqes != MAP_FAILED) {
+      munmap(sqes, sqesSize);
+    }
+
+    if(ringPtr != MAP_FAILED) {
+      munmap(ringPtr, ringSize);
+    }
+
+    ::close(fd);
+  }
+
+  int getFd() const {
+    return fd;
+  }
+
+  //----------------------------------------------------------------------------
+  // Returns a zeroed SQE, to be submitted with the next enter, or nullptr
+  // if the submission queue is full.
+  //----------------------------------------------------------------------------
+  struct io_uring_sqe* getSqe() {
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if(sqeTail - head >= sqEntries) {
+      return nullptr;
+    }
+
+    unsigned index = sqeTail & sqMask;
+    sqArray[index] = index;
+    sqeTail++;
+
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  //----------------------------------------------------------------------------
+  // Submit everything queued so far, and wait until at least minComplete
+  // completions are available, or timeoutMs passes. Negative timeout means
+  // wait forever. Returns 0, or -errno.
+  //----------------------------------------------------------------------------
+  int enter(unsigned minComplete, int timeoutMs) {
+    __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+    unsigned toSubmit = sqeTail - sqeSubmitted;
+
+    unsigned flags = 0;
+    if(minComplete > 0) {
+      flags |= IORING_ENTER_GETEVENTS;
+    }
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+
+    const void *argp = nullptr;
+    size_t argsz = _NSIG / 8;
+
+    if(minComplete > 0 && timeoutMs >= 0) {
+      ts.tv_sec = timeoutMs / 1000;
+      ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+      arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+      flags |= IORING_ENTER_EXT_ARG;
+      argp = &arg;
+      argsz = sizeof(arg);
+    }
+
+    int ret = syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, argp, argsz);
+    if(ret < 0) {
+      return -errno;
+    }
+
+    sqeSubmitted += ret;
+    return 0;
+  }
+
+  //----------------------------------------------------------------------------
+  // Peek at the next completion, without entering the kernel. Call
+  // advance() once done with it.
+  //----------------------------------------------------------------------------
+  struct io_uring_cqe* peek() {
+    unsigned head = *cqHead;
+    if(head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+      return nullptr;
+    }
+
+    return &cqes[head & cqMask];
+  }
+
+  void advance() {
+    __atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+  }
+
+private:
+  IoUringRing(int fd_) : fd(fd_) {}
+
+  bool map(const struct io_uring_params &params) {
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ringSize = std::max(sqSize, cqSize);
+
+    ringPtr = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(ringPtr == MAP_FAILED) {
+      return false;
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if(sqes == MAP_FAILED) {
+      return false;
+    }
+
+    char *base = static_cast<char*>(ringPtr);
+    sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+
+    cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);
+    return true;
+  }
+
+  int fd;
+
+  void *ringPtr = MAP_FAILED;
+  size_t ringSize = 0;
+  struct io_uring_sqe *sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+  size_t sqesSize = 0;
+
+  unsigned *sqHead = nullptr;
+  unsigned *sqTail = nullptr;
+  unsigned sqMask = 0;
+  unsigned sqEntries = 0;
+  unsigned *sqArray = nullptr;
+  unsigned sqeTail = 0;
+  unsigned sqeSubmitted = 0;
+
+  unsigned *cqHead = nullptr;
+  unsigned *cqTail = nullptr;
+  unsigned cqMask = 0;
+  struct io_uring_cqe *cqes = nullptr;
+};
+
+//------------------------------------------------------------------------------
+// Watch the shutdown fd from within the given ring.
+//------------------------------------------------------------------------------
+static void watchShutdown(IoUringRing &ring, int shutdownFd) {
+  struct io_uring_sqe *sqe = ring.getSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = shutdownFd;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = kShutdownTag;
+}
+
+//------------------------------------------------------------------------------
+// Cancel whichever request carries the given tag.
+//------------------------------------------------------------------------------
+static void cancelRequest(IoUringRing &ring, uint64_t tag) {
+  struct io_uring_sqe *sqe = ring.getSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = tag;
+  sqe->user_data = kCancelTag;
+}
+
+std::unique_ptr<IoUringTransport> IoUringTransport::create(int fd, int shutdownFd) {
+  std::unique_ptr<IoUringTransport> transport(new IoUringTransport(fd, shutdownFd));
+  if(!transport->initialize()) {
+    return {};
+  }
+
+  return transport;
+}
+
+IoUringTransport::IoUringTransport(int fd_, int shutdownFd_)
+: fd(fd_), shutdownFd(shutdownFd_) {}
+
+bool IoUringTransport::initialize() {
+  recvRing = IoUringRing::create(kRingEntries, kCompletionEntries);
+  sendRing = IoUringRing::create(kRingEntries, kCompletionEntries);
+
+  if(!recvRing || !sendRing) {
+    return false;
+  }
+
+  bufferRingSize = kBufferCount * sizeof(struct io_uring_buf);
+  bufferRing = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(bufferRing == MAP_FAILED) {
+    bufferRing = nullptr;
+    return false;
+  }
+
+  buffers = static_cast<char*>(mmap(nullptr, kBufferCount * kBufferSize, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if(buffers == MAP_FAILED) {
+    buffers = nullptr;
+    return false;
+  }
+
+  // Provided buffer rings need 5.19 - same as everything else we use, save
+  // for multishot recv.
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(bufferRing);
+  reg.ring_entries = kBufferCount;
+  reg.bgid = kBufferGroup;
+
+  if(syscall(__NR_io_uring_register, recvRing->getFd(), IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+    return false;
+  }
+
+  for(uint16_t bid = 0; bid < kBufferCount; bid++) {
+    recycleBuffer(bid);
+  }
+
+  // Sends block inside the kernel, not in here - the socket no longer needs
+  // to be non-blocking.
+  int flags = fcntl(fd, F_GETFL);
+  if(flags < 0 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) != 0) {
+    return false;
+  }
+
+  watchShutdown(*recvRing, shutdownFd);
+  watchShutdown(*sendRing, shutdownFd);
+  armRecv();
+  return true;
+}
+
+IoUringTransport::~IoUringTransport() {
+  // The kernel may still write into our buffers until the recv is gone -
+  // make sure of that before unmapping them.
+  if(recvRing && recvArmed) {
+    cancelRequest(*recvRing, kRecvTag);
+
+    while(recvArmed) {
+      int rc = recvRing->enter(1, -1);
+      if(rc < 0 && rc != -EINTR) break;
+      reapRecv();
+    }
+  }
+
+  recvRing.reset();
+  sendRing.reset();
+
+  if(buffers) {
+    munmap(buffers, kBufferCount * kBufferSize);
+  }
+
+  if(bufferRing) {
+    munmap(bufferRing, bufferRingSize);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Hand a receive buffer back to the kernel.
+//------------------------------------------------------------------------------
+void IoUringTransport::recycleBuffer(uint16_t bid) {
+  // Don't go through io_uring_buf_ring::bufs - in C++, the empty struct
+  // it's wrapped in takes up space, and shifts the array.
+  struct io_uring_buf_ring *ring = static_cast<struct io_uring_buf_ring*>(bufferRing);
+  struct io_uring_buf *buf = static_cast<struct io_uring_buf*>(bufferRing) + (bufferRingTail & (kBufferCount - 1));
+
+  buf->addr = reinterpret_cast<uint64_t>(buffers + (size_t) bid * kBufferSize);
+  buf->len = kBufferSize;
+  buf->bid = bid;
+
+  bufferRingTail++;
+  __atomic_store_n(&ring->tail, bufferRingTail, __ATOMIC_RELEASE);
+}
+
+//------------------------------------------------------------------------------
+// Queue up a recv, unless one is already armed. Goes out with the next
+// enter.
+//------------------------------------------------------------------------------
+void IoUringTransport::armRecv() {
+  if(recvArmed || recvDead || chunks.size() >= kBufferCount) {
+    return;
+  }
+
+  struct io_uring_sqe *sqe = recvRing->getSqe();
+  if(!sqe) {
+    return;
+  }
+
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kBufferGroup;
+  sqe->ioprio = multishot ? IORING_RECV_MULTISHOT : 0;
+  sqe->user_data = kRecvTag;
+  recvArmed = true;
+}
+
+//------------------------------------------------------------------------------
+// Collect whatever completions have been posted, without entering the
+// kernel.
+//------------------------------------------------------------------------------
+void IoUringTransport::reapRecv() {
+  struct io_uring_cqe *cqe;
+
+  while((cqe = recvRing->peek()) != nullptr) {
+    uint64_t tag = cqe->user_data;
+    int res = cqe->res;
+    uint32_t flags = cqe->flags;
+    recvRing->advance();
+
+    if(tag == kShutdownTag) {
+      shutdownSeen = true;
+      continue;
+    }
+
+    if(tag != kRecvTag) {
+      continue;
+    }
+
+    if((flags & IORING_CQE_F_MORE) == 0) {
+      recvArmed = false;
+    }
+
+    if(res > 0) {
+      chunks.push_back(Chunk { static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT), 0, static_cast<uint32_t>(res) });
+    }
+    else if(res == 0) {
+      recvDead = true;
+    }
+    else if(res == -ENOBUFS) {
+      // Every buffer is waiting to be consumed - re-armed once some are
+      // recycled.
+    }
+    else if(res == -EINVAL && multishot) {
+      // Kernel too old for multishot recv, re-arm after every completion.
+      multishot = false;
+    }
+    else {
+      recvDead = true;
+      recvError = -res;
+    }
+  }
+}
+
+RecvStatus IoUringTransport::recv(char *buff, int len) {
+  reapRecv();
+
+  int copied = 0;
+  while(copied < len && !chunks.empty()) {
+    Chunk &chunk = chunks.front();
+    uint32_t bytes = std::min<uint32_t>(len - copied, chunk.len);
+
+    memcpy(buff + copied, buffers + (size_t) chunk.bid * kBufferSize + chunk.offset, bytes);
+    copied += bytes;
+    chunk.offset += bytes;
+    chunk.len -= bytes;
+
+    if(chunk.len == 0) {
+      recycleBuffer(chunk.bid);
+      chunks.pop_front();
+    }
+  }
+
+  if(copied > 0) {
+    return RecvStatus(true, 0, copied);
+  }
+
+  if(recvDead) {
+    return RecvStatus(false, recvError, 0);
+  }
+
+  return RecvStatus(true, EAGAIN, 0);
+}
+
+WaitStatus IoUringTransport::waitReadable(int timeoutMs) {
+  reapRecv();
+
+  if(shutdownSeen) return WaitStatus::kShutdown;
+  if(!chunks.empty() || recvDead) return WaitStatus::kReady;
+
+  armRecv();
+
+  int rc = recvRing->enter(1, timeoutMs);
+  if(rc < 0 && rc != -ETIME && rc != -EINTR) {
+    return WaitStatus::kError;
+  }
+
+  reapRecv();
+
+  if(shutdownSeen) return WaitStatus::kShutdown;
+  if(!chunks.empty() || recvDead) return WaitStatus::kReady;
+  return WaitStatus::kTimeout;
+}
+
+LinkStatus IoUringTransport::send(const char *buff, int len) {
+  struct iovec iov;
+  iov.iov_base = const_cast<char*>(buff);
+  iov.iov_len = len;
+  return sendv(&iov, 1);
+}
+
+LinkStatus IoUringTransport::sendv(const struct iovec *iov, int iovcnt) {
+  if(sendShutdownSeen) {
+    errno = ECANCELED;
+    return -1;
+  }
+
+  // Both are copied by the kernel during submission.
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<struct iovec*>(iov);
+  msg.msg_iovlen = std::min(iovcnt, IOV_MAX);
+
+  struct __kernel_timespec ts;
+  ts.tv_sec = kSendTimeoutSeconds;
+  ts.tv_nsec = 0;
+
+  struct io_uring_sqe *sqe = sendRing->getSqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&msg);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = kSendTag;
+
+  sqe = sendRing->getSqe();
+  sqe->opcode = IORING_OP_LINK_TIMEOUT;
+  sqe->addr = reinterpret_cast<uint64_t>(&ts);
+  sqe->len = 1;
+  sqe->user_data = kTimeoutTag;
+
+  bool done = false;
+  int result = 0;
+
+  while(!done) {
+    int rc = sendRing->enter(1, -1);
+    if(rc < 0 && rc != -EINTR && rc != -EAGAIN && rc != -EBUSY) {
+      // Never enter this ring again, the msghdr above is about to go away.
+      sendShutdownSeen = true;
+      errno = -rc;
+      return -1;
+    }
+
+    struct io_uring_cqe *cqe;
+    while((cqe = sendRing->peek()) != nullptr) {
+      uint64_t tag = cqe->user_data;
+      int res = cqe->res;
+      sendRing->advance();
+
+      if(tag == kSendTag) {
+        done = true;
+        result = res;
+      }
+      else if(tag == kShutdownTag) {
+        sendShutdownSeen = true;
+        if(!done) cancelRequest(*sendRing, kSendTag);
+      }
+    }
+  }
+
+  if(result >= 0) {
+    return result;
+  }
+
+  if(sendShutdownSeen) {
+    errno = ECANCELED;
+  }
+  else if(result == -ECANCELED) {
+    // Nobody else cancels sends - the linked timeout must have fired.
+    errno = ETIMEDOUT;
+  }
+  else {
+    errno = -result;
+  }
+
+  return -1;
+}
+
+#else
+
+class IoUringRing {};
+
+std::unique_ptr<IoUringTransport> IoUringTransport::create(int fd, int shutdownFd) {
+  return {};
+}
+
+IoUringTransport::IoUringTransport(int fd_, int shutdownFd_)
+: fd(fd_), shutdownFd(shutdownFd_) {}
+
+IoUringTransport::~IoUringTransport() {}
+
+bool IoUringTransport::initialize() {
+  return false;
+}
+
+void IoUringTransport::reapRecv() {}
+void IoUringTransport::armRecv() {}
+void IoUringTransport::recycleBuffer(uint16_t bid) {}
+
+RecvStatus IoUringTransport::recv(char *buff, int len) {
+  return RecvStatus(false, ENOSYS, 0);
+}
+
+WaitStatus IoUringTransport::waitReadable(int timeoutMs) {
+  return WaitStatus::kError;
+}
+
+LinkStatus IoUringTransport::send(const char *buff, int len) {
+  errno = ENOSYS;
+  return -1;
+}
+
+LinkStatus IoUringTransport::sendv(const struct iovec *iov, int iovcnt) {
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif
+
+}
@@ -0,0 +1,120 @@
+//------------------------------------------------------------------------------
+// File: IoUringTransport.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_IO_URING_TRANSPORT_HH
+#define QCLIENT_IO_URING_TRANSPORT_HH
+
+#include "NetworkStream.hh"
+#include <deque>
+#include <memory>
+#include <sys/uio.h>
+
+namespace qclient {
+
+class IoUringRing;
+
+//------------------------------------------------------------------------------
+// Moves bytes between a connected socket and NetworkStream through io_uring,
+// instead of poll() + recv() / writev().
+//
+// Receiving side, owned by the reader thread: A single multishot recv stays
+// armed on the socket, and the kernel picks buffers out of a ring we've
+// registered up-front. Waiting for data, and reaping everything that arrived
+// in the meantime, costs one io_uring_enter.
+//
+// Sending side, owned by the writer thread: Each batch goes out as a single
+// sendmsg with MSG_WAITALL, linked to a timeout - it either completes in full,
+// or fails the connection. No EWOULDBLOCK, no polling for POLLOUT.
+//
+// Both rings also watch shutdownFd, so neither side can get stuck waiting
+// once shutdown is requested.
+//------------------------------------------------------------------------------
+class IoUringTransport {
+public:
+  //----------------------------------------------------------------------------
+  // Returns nullptr if io_uring can't be used: Not compiled in, disabled by
+  // the kernel, or missing one of the features we need. The caller should
+  // fall back to poll().
+  //----------------------------------------------------------------------------
+  static std::unique_ptr<IoUringTransport> create(int fd, int shutdownFd);
+
+  //----------------------------------------------------------------------------
+  // Destructor - the socket must have been shut down already, so that
+  // nothing is left in flight.
+  //----------------------------------------------------------------------------
+  ~IoUringTransport();
+
+  //----------------------------------------------------------------------------
+  // Receiving side. recv never blocks - it returns whatever has arrived so
+  // far, like recv() on a non-blocking socket.
+  //----------------------------------------------------------------------------
+  RecvStatus recv(char *buff, int len);
+  WaitStatus waitReadable(int timeoutMs);
+
+  //----------------------------------------------------------------------------
+  // Sending side. Blocks until everything has been written, or the
+  // connection fails. Fails with ECANCELED once shutdown is requested.
+  //----------------------------------------------------------------------------
+  LinkStatus send(const char *buff, int len);
+  LinkStatus sendv(const struct iovec *iov, int iovcnt);
+
+private:
+  IoUringTransport(int fd, int shutdownFd);
+  bool initialize();
+
+  void reapRecv();
+  void armRecv();
+  void recycleBuffer(uint16_t bid);
+
+  int fd;
+  int shutdownFd;
+
+  std::unique_ptr<IoUringRing> recvRing;
+  std::unique_ptr<IoUringRing> sendRing;
+
+  //----------------------------------------------------------------------------
+  // Receive buffers, registered with the kernel as a provided buffer ring.
+  //----------------------------------------------------------------------------
+  struct Chunk {
+    uint16_t bid;
+    uint32_t offset;
+    uint32_t len;
+  };
+
+  void *bufferRing = nullptr;
+  size_t bufferRingSize = 0;
+  char *buffers = nullptr;
+  uint16_t bufferRingTail = 0;
+
+  std::deque<Chunk> chunks;
+  bool multishot = true;
+  bool recvArmed = false;
+  bool recvDead = false;
+  int recvError = 0;
+  bool shutdownSeen = false;
+  bool sendShutdownSeen = false;
+};
+
+}
+
+#endif
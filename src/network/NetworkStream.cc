@@ -25,9 +25,13 @@
 #include <sys/socket.h>
 
 #include "NetworkStream.hh"
+#include "IoUringTransport.hh"
 
 #include <iostream>
+#include <poll.h>
 #include <unistd.h>
+#include <limits.h>
+#include <algorithm>
 using namespace qclient;
 
 static RecvStatus recvfn(int socket, char *buffer, int len, int timeout) {
@@ -60,10 +64,18 @@ static LinkStatus sendfn(int socket, const char *buffer, int len, int timeout) {
 //------------------------------------------------------------------------------
 // Create a network stream based on an existing socket fd.
 //------------------------------------------------------------------------------
-NetworkStream::NetworkStream(int fd_, TlsConfig tlsconfig)
-: fd(fd_) {
+NetworkStream::NetworkStream(int fd_, TlsConfig tlsconfig, TransportBackend transport_, int shutdownFd_)
+: fd(fd_), shutdownFd(shutdownFd_) {
 
   isOk = (fd >= 0);
+
+  if(isOk && transport_ == TransportBackend::kIoUring) {
+    uring = IoUringTransport::create(fd, shutdownFd);
+    if(uring) {
+      transport = TransportBackend::kIoUring;
+    }
+  }
+
   initializeTlsFliter(tlsconfig);
 }
 
@@ -79,6 +91,12 @@ void NetworkStream::initializeTlsFliter(const TlsConfig &tlsconfig) {
     RecvFunction recvF = std::bind(recvfn, fd, _1, _2, _3);
     SendFunction sendF = std::bind(sendfn, fd, _1, _2, 0);
 
+    if(uring) {
+      IoUringTransport *transport = uring.get();
+      recvF = [transport](char *buf, int len, int timeout) { return transport->recv(buf, len); };
+      sendF = [transport](const char *buf, int len) { return transport->send(buf, len); };
+    }
+
     tlsfilter.reset(new TlsFilter(tlsconfig, FilterType::CLIENT, recvF, sendF));
   }
 }
@@ -113,21 +131,67 @@ RecvStatus NetworkStream::recv(char *buffer, int len, int timeout) {
     return tlsfilter->recv(buffer, len, 0);
   }
 
+  if(uring) {
+    return uring->recv(buffer, len);
+  }
+
   return recvfn(fd, buffer, len, 0);
 }
 
+WaitStatus NetworkStream::waitReadable(int timeoutMs) {
+  if(uring) {
+    return uring->waitReadable(timeoutMs);
+  }
+
+  struct pollfd polls[2];
+  polls[0].fd = shutdownFd;
+  polls[0].events = POLLIN;
+  polls[0].revents = 0;
+  polls[1].fd = fd;
+  polls[1].events = POLLIN;
+  polls[1].revents = 0;
+
+  int rpoll = poll(polls, 2, timeoutMs);
+  if(rpoll < 0) {
+    return (errno == EINTR) ? WaitStatus::kTimeout : WaitStatus::kError;
+  }
+
+  if(polls[0].revents != 0) return WaitStatus::kShutdown;
+  if(polls[1].revents != 0) return WaitStatus::kReady;
+  return WaitStatus::kTimeout;
+}
+
 LinkStatus NetworkStream::send(const char *buff, int len) {
   if(tlsfilter) {
     return tlsfilter->send(buff, len);
   }
 
+  if(uring) {
+    return uring->send(buff, len);
+  }
+
   return ::send(fd, buff, len, 0);
 }
 
+LinkStatus NetworkStream::sendv(const struct iovec *iov, int iovcnt) {
+  if(tlsfilter) {
+    return tlsfilter->send((const char*) iov[0].iov_base, iov[0].iov_len);
+  }
+
+  if(uring) {
+    return uring->sendv(iov, iovcnt);
+  }
+
+  // A single segmented request may push the batch over the limit - whatever
+  // doesn't fit goes out with the next call.
+  return ::writev(fd, iov, std::min(iovcnt, IOV_MAX));
+}
+
 NetworkStream::~NetworkStream() {
   tlsfilter.reset();
   if(fd > 0) {
     shutdown();
+    uring.reset();
     close();
   }
 }
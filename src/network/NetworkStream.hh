@@ -27,17 +27,35 @@
 #include <string>
 #include <atomic>
 #include <memory>
+#include <sys/uio.h>
 #include "qclient/TlsFilter.hh"
+#include "qclient/Options.hh"
 #include "qclient/network/HostResolver.hh"
 
 namespace qclient {
 
+class IoUringTransport;
+
+//------------------------------------------------------------------------------
+// Outcome of waiting for the stream to become readable.
+//------------------------------------------------------------------------------
+enum class WaitStatus {
+  kReady,
+  kTimeout,
+  kShutdown,
+  kError
+};
+
 class NetworkStream {
 public:
   //----------------------------------------------------------------------------
-  // Create a network stream based on an existing socket fd.
+  // Create a network stream based on an existing socket fd. shutdownFd
+  // becoming readable interrupts any wait.
+  //
+  // Falls back to poll() if the requested transport isn't available.
   //----------------------------------------------------------------------------
-  NetworkStream(int fd, TlsConfig tlsconfig);
+  NetworkStream(int fd, TlsConfig tlsconfig,
+    TransportBackend transport = TransportBackend::kPoll, int shutdownFd = -1);
 
   //----------------------------------------------------------------------------
   // Destructor
@@ -61,10 +79,30 @@ public:
     return fd;
   }
 
+  TransportBackend getTransport() const {
+    return transport;
+  }
+
   void shutdown();
   RecvStatus recv(char *buff, int len, int timeout);
+
+  //----------------------------------------------------------------------------
+  // Wait up to timeoutMs until there's something to receive, or shutdownFd
+  // becomes readable. Negative timeout means wait forever.
+  //----------------------------------------------------------------------------
+  WaitStatus waitReadable(int timeoutMs);
+
   LinkStatus send(const char *buff, int len);
 
+  //----------------------------------------------------------------------------
+  // Gathering send: write as much of the given buffers as possible using a
+  // single writev(). Returns number of bytes written, or -1 on error. At most
+  // IOV_MAX buffers are written per call.
+  //
+  // When TLS is active, only the first buffer is handed over to the filter.
+  //----------------------------------------------------------------------------
+  LinkStatus sendv(const struct iovec *iov, int iovcnt);
+
 private:
   //----------------------------------------------------------------------------
   // Initialize TlsFilter
@@ -80,7 +118,11 @@ private:
   // fd is immutable after construction, safe to access concurrently.
   int fd = -1;
 
+  int shutdownFd = -1;
+  TransportBackend transport = TransportBackend::kPoll;
+
   bool fdShutdown = false;
+  std::unique_ptr<IoUringTransport> uring;
   std::unique_ptr<TlsFilter> tlsfilter;
   std::atomic<bool> isOk;
 
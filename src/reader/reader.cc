@@ -55,9 +55,17 @@
 
 #include "reader.hh"
 #include "sds.hh"
+#include "scanner.hh"
 
 #include "qclient/Reply.hh"
 
+using qclient::respSeekNewline;
+using qclient::respParseInteger;
+
+/* Task type for a RESP3 blob error ('!'): read like a bulk string, but turns
+ * into a REDIS_REPLY_ERROR. Never seen outside of the reader. */
+#define REDIS_READER_BLOB_ERROR 100
+
 /* Create a reply object */
 static redisReply *createReplyObject(int type) {
     redisReply *r = (redisReply*) calloc(1,sizeof(*r));
@@ -79,9 +87,14 @@ void freeReplyObject(void *reply) {
 
     switch(r->type) {
     case REDIS_REPLY_INTEGER:
+    case REDIS_REPLY_NIL:
+    case REDIS_REPLY_BOOL:
         break; /* Nothing to free */
     case REDIS_REPLY_ARRAY:
     case REDIS_REPLY_PUSH:
+    case REDIS_REPLY_MAP:
+    case REDIS_REPLY_SET:
+    case REDIS_REPLY_ATTR:
         if (r->element != NULL) {
             for (j = 0; j < r->elements; j++)
                 freeReplyObject(r->element[j]);
@@ -91,22 +104,92 @@ void freeReplyObject(void *reply) {
     case REDIS_REPLY_ERROR:
     case REDIS_REPLY_STATUS:
     case REDIS_REPLY_STRING:
+    case REDIS_REPLY_DOUBLE:
+    case REDIS_REPLY_BIGNUM:
+    case REDIS_REPLY_VERB:
         free(r->str);
         break;
     }
     free(r);
 }
 
+/* Can a reply of this type hold other replies? */
+static int isAggregateType(int type) {
+    return type == REDIS_REPLY_ARRAY || type == REDIS_REPLY_PUSH ||
+           type == REDIS_REPLY_MAP || type == REDIS_REPLY_SET ||
+           type == REDIS_REPLY_ATTR;
+}
+
+/* Free the buffer, or hand it over if pinned. */
+static void disposeBuffer(redisReader *r) {
+    if (r->pinned) {
+        r->releaseBuffer(r->releasePrivdata, r->buf);
+        r->pinned = 0;
+    } else {
+        sdsfree(r->buf);
+    }
+}
+
+/* Make sure there's room for at least addlen more bytes at the end of the
+ * buffer. A pinned buffer is never touched - the unconsumed bytes are copied
+ * into a new one instead. Returns REDIS_ERR when out of memory. */
+static int makeRoom(redisReader *r, size_t addlen) {
+    sds newbuf;
+
+    if (r->pinned) {
+        if (sdsavail(r->buf) >= addlen)
+            return REDIS_OK;
+
+        newbuf = sdsnewlen(r->buf+r->pos, r->len-r->pos);
+        if (newbuf == NULL)
+            return REDIS_ERR;
+
+        disposeBuffer(r);
+        r->buf = newbuf;
+        r->pos = 0;
+        r->len = sdslen(r->buf);
+    }
+
+    newbuf = sdsMakeRoomFor(r->buf, addlen);
+    if (newbuf == NULL)
+        return REDIS_ERR;
+
+    r->buf = newbuf;
+    return REDIS_OK;
+}
+
+/* Discard part of the buffer when we've consumed at least 1k, and at least
+ * as much as is left, to avoid doing unnecessary calls to memmove() in sds.c:
+ * with many small replies pipelined in a large buffer, moving what's left
+ * after each one of them adds up quickly. A pinned buffer must stay put,
+ * it's replaced once it runs out of room instead. */
+static void compactBuffer(redisReader *r) {
+    if (r->pos >= 1024 && r->pos >= r->len - r->pos && !r->pinned) {
+        sdsrange(r->buf,r->pos,-1);
+        r->pos = 0;
+        r->len = sdslen(r->buf);
+    }
+}
+
 static void __redisReaderSetError(redisReader *r, int type, const char *str) {
     size_t len;
+    int i;
 
     if (r->reply != NULL && r->fn && r->fn->freeObject) {
         r->fn->freeObject(r->reply);
         r->reply = NULL;
     }
 
+    /* Attributes being read aren't attached to the reply. */
+    for (i = 0; i <= r->ridx && r->fn && r->fn->freeObject; i++) {
+        if (r->rstack[i].type == REDIS_REPLY_ATTR && r->rstack[i].obj != NULL) {
+            r->fn->freeObject(r->rstack[i].obj);
+            r->rstack[i].obj = NULL;
+        }
+    }
+
     /* Clear input buffer on errors. */
-    sdsfree(r->buf);
+    disposeBuffer(r);
     r->buf = NULL;
     r->pos = r->len = 0;
 
@@ -168,114 +251,12 @@ static char *readBytes(redisReader *r, unsigned int bytes) {
     return NULL;
 }
 
-/* Find pointer to \r\n. */
-static char *seekNewline(char *s, size_t len) {
-    int pos = 0;
-    int _len = len-1;
-
-    /* Position should be < len-1 because the character at "pos" should be
-     * followed by a \n. Note that strchr cannot be used because it doesn't
-     * allow to search a limited length and the buffer that is being searched
-     * might not have a trailing NULL character. */
-    while (pos < _len) {
-        while(pos < _len && s[pos] != '\r') pos++;
-        if (pos==_len) {
-            /* Not found. */
-            return NULL;
-        } else {
-            if (s[pos+1] == '\n') {
-                /* Found. */
-                return s+pos;
-            } else {
-                /* Continue searching. */
-                pos++;
-            }
-        }
-    }
-    return NULL;
-}
-
-/* Convert a string into a long long. Returns REDIS_OK if the string could be
- * parsed into a (non-overflowing) long long, REDIS_ERR otherwise. The value
- * will be set to the parsed value when appropriate.
- *
- * Note that this function demands that the string strictly represents
- * a long long: no spaces or other characters before or after the string
- * representing the number are accepted, nor zeroes at the start if not
- * for the string "0" representing the zero number.
- *
- * Because of its strictness, it is safe to use this function to check if
- * you can convert a string into a long long, and obtain back the string
- * from the number without any loss in the string representation. */
-static int string2ll(const char *s, size_t slen, long long *value) {
-    const char *p = s;
-    size_t plen = 0;
-    int negative = 0;
-    unsigned long long v;
-
-    if (plen == slen)
-        return REDIS_ERR;
-
-    /* Special case: first and only digit is 0. */
-    if (slen == 1 && p[0] == '0') {
-        if (value != NULL) *value = 0;
-        return REDIS_OK;
-    }
-
-    if (p[0] == '-') {
-        negative = 1;
-        p++; plen++;
-
-        /* Abort on only a negative sign. */
-        if (plen == slen)
-            return REDIS_ERR;
-    }
-
-    /* First digit should be 1-9, otherwise the string should just be 0. */
-    if (p[0] >= '1' && p[0] <= '9') {
-        v = p[0]-'0';
-        p++; plen++;
-    } else if (p[0] == '0' && slen == 1) {
-        *value = 0;
-        return REDIS_OK;
-    } else {
-        return REDIS_ERR;
-    }
-
-    while (plen < slen && p[0] >= '0' && p[0] <= '9') {
-        if (v > (ULLONG_MAX / 10)) /* Overflow. */
-            return REDIS_ERR;
-        v *= 10;
-
-        if (v > (ULLONG_MAX - (p[0]-'0'))) /* Overflow. */
-            return REDIS_ERR;
-        v += p[0]-'0';
-
-        p++; plen++;
-    }
-
-    /* Return if not all bytes were used. */
-    if (plen < slen)
-        return REDIS_ERR;
-
-    if (negative) {
-        if (v > ((unsigned long long)(-(LLONG_MIN+1))+1)) /* Overflow. */
-            return REDIS_ERR;
-        if (value != NULL) *value = -v;
-    } else {
-        if (v > LLONG_MAX) /* Overflow. */
-            return REDIS_ERR;
-        if (value != NULL) *value = v;
-    }
-    return REDIS_OK;
-}
-
 static char *readLine(redisReader *r, int *_len) {
     char *p, *s;
     int len;
 
     p = r->buf+r->pos;
-    s = seekNewline(p,(r->len-r->pos));
+    s = respSeekNewline(p,(r->len-r->pos));
     if (s != NULL) {
         len = s-(r->buf+r->pos);
         r->pos += len+2; /* skip \r\n */
@@ -285,9 +266,28 @@ static char *readLine(redisReader *r, int *_len) {
     return NULL;
 }
 
+/* An attribute annotates the item which follows it. We have no use for the
+ * annotations: drop the attribute once complete, and read the item into the
+ * same slot instead. */
+static void discardAttribute(redisReader *r) {
+    redisReadTask *cur = &(r->rstack[r->ridx]);
+
+    if (cur->obj != NULL && r->fn && r->fn->freeObject)
+        r->fn->freeObject(cur->obj);
+
+    cur->type = -1;
+    cur->elements = -1;
+    cur->obj = NULL;
+}
+
 static void moveToNextTask(redisReader *r) {
     redisReadTask *cur, *prv;
     while (r->ridx >= 0) {
+        if (r->rstack[r->ridx].type == REDIS_REPLY_ATTR) {
+            discardAttribute(r);
+            return;
+        }
+
         /* Return a.s.a.p. when the stack is now empty. */
         if (r->ridx == 0) {
             r->ridx--;
@@ -296,7 +296,7 @@ static void moveToNextTask(redisReader *r) {
 
         cur = &(r->rstack[r->ridx]);
         prv = &(r->rstack[r->ridx-1]);
-        assert(prv->type == REDIS_REPLY_ARRAY || prv->type == REDIS_REPLY_PUSH);
+        assert(isAggregateType(prv->type));
         if (cur->idx == prv->elements-1) {
             r->ridx--;
         } else {
@@ -320,7 +320,7 @@ static int processLineItem(redisReader *r) {
         if (cur->type == REDIS_REPLY_INTEGER) {
             if (r->fn && r->fn->createInteger) {
                 long long v;
-                if (string2ll(p, len, &v) == REDIS_ERR) {
+                if (!respParseInteger(p, len, &v)) {
                     __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
                             "Bad integer value");
                     return REDIS_ERR;
@@ -329,6 +329,75 @@ static int processLineItem(redisReader *r) {
             } else {
                 obj = (void*)REDIS_REPLY_INTEGER;
             }
+        } else if (cur->type == REDIS_REPLY_DOUBLE) {
+            char buf[326], *eptr;
+            double d;
+
+            if ((size_t)len >= sizeof(buf)) {
+                __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
+                        "Double value is too large");
+                return REDIS_ERR;
+            }
+
+            /* strtod() also accepts "inf", "-inf" and "nan", as RESP3
+             * expects, but needs a terminated string. */
+            memcpy(buf,p,len);
+            buf[len] = '\0';
+            d = strtod(buf,&eptr);
+
+            if (len == 0 || eptr != buf+len || isspace((unsigned char) buf[0])) {
+                __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
+                        "Bad double value");
+                return REDIS_ERR;
+            }
+
+            if (r->fn && r->fn->createDouble)
+                obj = r->fn->createDouble(cur,d,p,len);
+            else
+                obj = (void*)REDIS_REPLY_DOUBLE;
+        } else if (cur->type == REDIS_REPLY_NIL) {
+            if (len != 0) {
+                __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
+                        "Bad nil value");
+                return REDIS_ERR;
+            }
+
+            if (r->fn && r->fn->createNil)
+                obj = r->fn->createNil(cur);
+            else
+                obj = (void*)REDIS_REPLY_NIL;
+        } else if (cur->type == REDIS_REPLY_BOOL) {
+            if (len != 1 || (p[0] != 't' && p[0] != 'f')) {
+                __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
+                        "Bad bool value");
+                return REDIS_ERR;
+            }
+
+            if (r->fn && r->fn->createBool)
+                obj = r->fn->createBool(cur,p[0] == 't');
+            else
+                obj = (void*)REDIS_REPLY_BOOL;
+        } else if (cur->type == REDIS_REPLY_BIGNUM) {
+            int i = (len > 0 && p[0] == '-') ? 1 : 0;
+
+            if (i == len) {
+                __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
+                        "Bad big number value");
+                return REDIS_ERR;
+            }
+
+            for (; i < len; i++) {
+                if (!isdigit((unsigned char) p[i])) {
+                    __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
+                            "Bad big number value");
+                    return REDIS_ERR;
+                }
+            }
+
+            if (r->fn && r->fn->createString)
+                obj = r->fn->createString(cur,p,len);
+            else
+                obj = (void*)REDIS_REPLY_BIGNUM;
         } else {
             /* Type will be error or status. */
             if (r->fn && r->fn->createString)
@@ -360,12 +429,12 @@ static int processBulkItem(redisReader *r) {
     int success = 0;
 
     p = r->buf+r->pos;
-    s = seekNewline(p,r->len-r->pos);
+    s = respSeekNewline(p,r->len-r->pos);
     if (s != NULL) {
         p = r->buf+r->pos;
         bytelen = s-(r->buf+r->pos)+2; /* include \r\n */
 
-        if (string2ll(p, bytelen - 2, &len) == REDIS_ERR) {
+        if (!respParseInteger(p, bytelen - 2, &len)) {
             __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
                     "Bad bulk string length");
             return REDIS_ERR;
@@ -388,10 +457,23 @@ static int processBulkItem(redisReader *r) {
             /* Only continue when the buffer contains the entire bulk item. */
             bytelen += len+2; /* include \r\n */
             if (r->pos+bytelen <= r->len) {
+                /* A verbatim string starts with its three-letter type. */
+                if (cur->type == REDIS_REPLY_VERB && (len < 4 || s[2+3] != ':')) {
+                    __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
+                            "Verbatim string 4 bytes of content type are "
+                            "missing or incorrectly encoded.");
+                    return REDIS_ERR;
+                }
+
+                /* A blob error is just an error, as far as anyone else is
+                 * concerned. */
+                if (cur->type == REDIS_READER_BLOB_ERROR)
+                    cur->type = REDIS_REPLY_ERROR;
+
                 if (r->fn && r->fn->createString)
                     obj = r->fn->createString(cur,s+2,len);
                 else
-                    obj = (void*)REDIS_REPLY_STRING;
+                    obj = (void*)(size_t)(cur->type);
                 success = 1;
             }
         }
@@ -430,20 +512,27 @@ static int processMultiBulkItem(redisReader *r, int type) {
     }
 
     if ((p = readLine(r,&len)) != NULL) {
-        if (string2ll(p, len, &elements) == REDIS_ERR) {
+        if (!respParseInteger(p, len, &elements)) {
             __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
                     "Bad multi-bulk length");
             return REDIS_ERR;
         }
 
-        root = (r->ridx == 0);
+        /* An attribute isn't part of the reply: keep it off the root. */
+        root = (r->ridx == 0 && type != REDIS_REPLY_ATTR);
 
-        if (elements < -1 || (LLONG_MAX > SIZE_MAX && elements > SIZE_MAX)) {
+        if (elements < -1 || (LLONG_MAX > SIZE_MAX && elements > SIZE_MAX) ||
+            (elements > 0 && (type == REDIS_REPLY_MAP || type == REDIS_REPLY_ATTR) &&
+             elements > (long long)(SIZE_MAX / 2))) {
             __redisReaderSetError(r,REDIS_ERR_PROTOCOL,
                     "Multi-bulk length out of range");
             return REDIS_ERR;
         }
 
+        /* Maps and attributes hold keys and values interleaved. */
+        if (elements > 0 && (type == REDIS_REPLY_MAP || type == REDIS_REPLY_ATTR))
+            elements *= 2;
+
         if (elements == -1) {
             if (r->fn && r->fn->createNil)
                 obj = r->fn->createNil(cur);
@@ -468,9 +557,9 @@ static int processMultiBulkItem(redisReader *r, int type) {
             }
 
             /* Modify task stack when there are more than 0 elements. */
+            cur->obj = obj;
             if (elements > 0) {
                 cur->elements = elements;
-                cur->obj = obj;
                 r->ridx++;
                 r->rstack[r->ridx].type = -1;
                 r->rstack[r->ridx].elements = -1;
@@ -517,6 +606,33 @@ static int processItem(redisReader *r) {
             case '>':
                 cur->type = REDIS_REPLY_PUSH;
                 break;
+            case ',':
+                cur->type = REDIS_REPLY_DOUBLE;
+                break;
+            case '_':
+                cur->type = REDIS_REPLY_NIL;
+                break;
+            case '#':
+                cur->type = REDIS_REPLY_BOOL;
+                break;
+            case '(':
+                cur->type = REDIS_REPLY_BIGNUM;
+                break;
+            case '!':
+                cur->type = REDIS_READER_BLOB_ERROR;
+                break;
+            case '=':
+                cur->type = REDIS_REPLY_VERB;
+                break;
+            case '%':
+                cur->type = REDIS_REPLY_MAP;
+                break;
+            case '~':
+                cur->type = REDIS_REPLY_SET;
+                break;
+            case '|':
+                cur->type = REDIS_REPLY_ATTR;
+                break;
             default:
                 __redisReaderSetErrorProtocolByte(r,*p);
                 return REDIS_ERR;
@@ -532,11 +648,20 @@ static int processItem(redisReader *r) {
     case REDIS_REPLY_ERROR:
     case REDIS_REPLY_STATUS:
     case REDIS_REPLY_INTEGER:
+    case REDIS_REPLY_DOUBLE:
+    case REDIS_REPLY_NIL:
+    case REDIS_REPLY_BOOL:
+    case REDIS_REPLY_BIGNUM:
         return processLineItem(r);
     case REDIS_REPLY_STRING:
+    case REDIS_REPLY_VERB:
+    case REDIS_READER_BLOB_ERROR:
         return processBulkItem(r);
     case REDIS_REPLY_ARRAY:
     case REDIS_REPLY_PUSH:
+    case REDIS_REPLY_MAP:
+    case REDIS_REPLY_SET:
+    case REDIS_REPLY_ATTR:
         return processMultiBulkItem(r, cur->type);
     default:
         assert(NULL);
@@ -568,7 +693,8 @@ void redisReaderFree(redisReader *r) {
         return;
     if (r->reply != NULL && r->fn && r->fn->freeObject)
         r->fn->freeObject(r->reply);
-    sdsfree(r->buf);
+    if (r->buf != NULL)
+        disposeBuffer(r);
     free(r);
 }
 
@@ -582,7 +708,7 @@ int redisReaderFeed(redisReader *r, const char *buf, size_t len) {
     /* Copy the provided buffer. */
     if (buf != NULL && len >= 1) {
         /* Destroy internal buffer when it is empty and is quite large. */
-        if (r->len == 0 && r->maxbuf != 0 && sdsavail(r->buf) > r->maxbuf) {
+        if (!r->pinned && r->len == 0 && r->maxbuf != 0 && sdsavail(r->buf) > r->maxbuf) {
             sdsfree(r->buf);
             r->buf = sdsempty();
             r->pos = 0;
@@ -591,19 +717,75 @@ int redisReaderFeed(redisReader *r, const char *buf, size_t len) {
             assert(r->buf != NULL);
         }
 
-        newbuf = sdscatlen(r->buf,buf,len);
-        if (newbuf == NULL) {
+        if (makeRoom(r, len) != REDIS_OK) {
             __redisReaderSetErrorOOM(r);
             return REDIS_ERR;
         }
 
-        r->buf = newbuf;
+        newbuf = sdscatlen(r->buf,buf,len);
+        assert(newbuf == r->buf);
         r->len = sdslen(r->buf);
     }
 
     return REDIS_OK;
 }
 
+char *redisReaderGetWritableTail(redisReader *r, size_t minlen) {
+    /* Return early when this reader is in an erroneous state. */
+    if (r->err)
+        return NULL;
+
+    /* Destroy internal buffer when it is empty and much larger than what's
+     * being asked for. sdsMakeRoomFor() may allocate up to twice minlen, that
+     * much is never discarded. */
+    if (!r->pinned && r->len == 0 && r->maxbuf != 0 && sdsavail(r->buf) > r->maxbuf &&
+        sdsavail(r->buf) > 2 * minlen) {
+        sdsfree(r->buf);
+        r->buf = sdsempty();
+        r->pos = 0;
+
+        /* r->buf should not be NULL since we just free'd a larger one. */
+        assert(r->buf != NULL);
+    }
+
+    if (makeRoom(r, minlen) != REDIS_OK) {
+        __redisReaderSetErrorOOM(r);
+        return NULL;
+    }
+
+    return r->buf + sdslen(r->buf);
+}
+
+int redisReaderCommitTail(redisReader *r, size_t len) {
+    /* Return early when this reader is in an erroneous state. */
+    if (r->err)
+        return REDIS_ERR;
+
+    assert(sdsavail(r->buf) >= len);
+    sdsIncrLen(r->buf, len);
+    r->len = sdslen(r->buf);
+    return REDIS_OK;
+}
+
+int redisReaderInReply(redisReader *r) {
+    /* A task stack may be left set up, with nothing read into it yet. */
+    return r->ridx > 0 || (r->ridx == 0 && r->rstack[0].type >= 0);
+}
+
+int redisReaderConsume(redisReader *r, size_t len) {
+    /* Return early when this reader is in an erroneous state. */
+    if (r->err)
+        return REDIS_ERR;
+
+    /* Never in the middle of a reply built by redisReaderGetReply. */
+    assert(!redisReaderInReply(r));
+    assert(r->pos + len <= r->len);
+
+    r->pos += len;
+    compactBuffer(r);
+    return REDIS_OK;
+}
+
 int redisReaderGetReply(redisReader *r, void **reply) {
     /* Default target pointer to NULL. */
     if (reply != NULL)
@@ -637,13 +819,7 @@ int redisReaderGetReply(redisReader *r, void **reply) {
     if (r->err)
         return REDIS_ERR;
 
-    /* Discard part of the buffer when we've consumed at least 1k, to avoid
-     * doing unnecessary calls to memmove() in sds.c. */
-    if (r->pos >= 1024) {
-        sdsrange(r->buf,r->pos,-1);
-        r->pos = 0;
-        r->len = sdslen(r->buf);
-    }
+    compactBuffer(r);
 
     /* Emit a reply when there is one. */
     if (r->ridx == -1) {
@@ -657,8 +833,18 @@ int redisReaderGetReply(redisReader *r, void **reply) {
     return REDIS_OK;
 }
 
+static void attachToParent(const redisReadTask *task, redisReply *r) {
+    redisReply *parent;
+
+    if (task->parent) {
+        parent = (redisReply*) task->parent->obj;
+        assert(isAggregateType(parent->type));
+        parent->element[task->idx] = r;
+    }
+}
+
 static void *createStringObject(const redisReadTask *task, char *str, size_t len) {
-    redisReply *r, *parent;
+    redisReply *r;
     char *buf;
 
     r = createReplyObject(task->type);
@@ -673,7 +859,17 @@ static void *createStringObject(const redisReadTask *task, char *str, size_t len
 
     assert(task->type == REDIS_REPLY_ERROR  ||
            task->type == REDIS_REPLY_STATUS ||
-           task->type == REDIS_REPLY_STRING);
+           task->type == REDIS_REPLY_STRING ||
+           task->type == REDIS_REPLY_BIGNUM ||
+           task->type == REDIS_REPLY_VERB);
+
+    /* Split the type off a verbatim string. */
+    if (task->type == REDIS_REPLY_VERB) {
+        memcpy(r->vtype,str,3);
+        r->vtype[3] = '\0';
+        str += 4;
+        len -= 4;
+    }
 
     /* Copy string value */
     memcpy(buf,str,len);
@@ -681,16 +877,12 @@ static void *createStringObject(const redisReadTask *task, char *str, size_t len
     r->str = buf;
     r->len = len;
 
-    if (task->parent) {
-        parent = (redisReply*) task->parent->obj;
-        assert(parent->type == REDIS_REPLY_ARRAY || parent->type == REDIS_REPLY_PUSH);
-        parent->element[task->idx] = r;
-    }
+    attachToParent(task,r);
     return r;
 }
 
 static void *createArrayObject(const redisReadTask *task, size_t elements, int type) {
-    redisReply *r, *parent;
+    redisReply *r;
 
     r = createReplyObject(type);
     if (r == NULL)
@@ -706,16 +898,14 @@ static void *createArrayObject(const redisReadTask *task, size_t elements, int t
 
     r->elements = elements;
 
-    if (task->parent) {
-        parent = (redisReply*) task->parent->obj;
-        assert(parent->type == REDIS_REPLY_ARRAY);
-        parent->element[task->idx] = r;
-    }
+    /* An attribute is only referenced by its task, until dropped. */
+    if (type != REDIS_REPLY_ATTR)
+        attachToParent(task,r);
     return r;
 }
 
 static void *createIntegerObject(const redisReadTask *task, long long value) {
-    redisReply *r, *parent;
+    redisReply *r;
 
     r = createReplyObject(REDIS_REPLY_INTEGER);
     if (r == NULL)
@@ -723,26 +913,54 @@ static void *createIntegerObject(const redisReadTask *task, long long value) {
 
     r->integer = value;
 
-    if (task->parent) {
-        parent = (redisReply*) task->parent->obj;
-        assert(parent->type == REDIS_REPLY_ARRAY || parent->type == REDIS_REPLY_PUSH);
-        parent->element[task->idx] = r;
+    attachToParent(task,r);
+    return r;
+}
+
+static void *createDoubleObject(const redisReadTask *task, double value, char *str, size_t len) {
+    redisReply *r;
+
+    r = createReplyObject(REDIS_REPLY_DOUBLE);
+    if (r == NULL)
+        return NULL;
+
+    /* Keep the textual representation around, too. */
+    r->str = (char*) malloc(len+1);
+    if (r->str == NULL) {
+        freeReplyObject(r);
+        return NULL;
     }
+
+    memcpy(r->str,str,len);
+    r->str[len] = '\0';
+    r->len = len;
+    r->dval = value;
+
+    attachToParent(task,r);
     return r;
 }
 
 static void *createNilObject(const redisReadTask *task) {
-    redisReply *r, *parent;
+    redisReply *r;
 
     r = createReplyObject(REDIS_REPLY_NIL);
     if (r == NULL)
         return NULL;
 
-    if (task->parent) {
-        parent = (redisReply*) task->parent->obj;
-        assert(parent->type == REDIS_REPLY_ARRAY || parent->type == REDIS_REPLY_PUSH);
-        parent->element[task->idx] = r;
-    }
+    attachToParent(task,r);
+    return r;
+}
+
+static void *createBoolObject(const redisReadTask *task, int value) {
+    redisReply *r;
+
+    r = createReplyObject(REDIS_REPLY_BOOL);
+    if (r == NULL)
+        return NULL;
+
+    r->integer = value != 0;
+
+    attachToParent(task,r);
     return r;
 }
 
@@ -754,7 +972,9 @@ static redisReplyObjectFunctions defaultFunctions = {
     createStringObject,
     createArrayObject,
     createIntegerObject,
+    createDoubleObject,
     createNilObject,
+    createBoolObject,
     freeReplyObject
 };
 
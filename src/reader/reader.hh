@@ -74,7 +74,9 @@ typedef struct redisReplyObjectFunctions {
     void *(*createString)(const redisReadTask*, char*, size_t);
     void *(*createArray)(const redisReadTask*, size_t, int);
     void *(*createInteger)(const redisReadTask*, long long);
+    void *(*createDouble)(const redisReadTask*, double, char*, size_t);
     void *(*createNil)(const redisReadTask*);
+    void *(*createBool)(const redisReadTask*, int);
     void (*freeObject)(void*);
 } redisReplyObjectFunctions;
 
@@ -93,6 +95,14 @@ typedef struct redisReader {
 
     redisReplyObjectFunctions *fn;
     void *privdata;
+
+    /* Set while replies may point straight into buf: it must then not be
+     * freed, reallocated or compacted in place. When a different buffer is
+     * needed, the unconsumed bytes are copied into a fresh one, and ownership
+     * of the old one is handed over to releaseBuffer. */
+    int pinned;
+    void (*releaseBuffer)(void *releasePrivdata, char *buf);
+    void *releasePrivdata;
 } redisReader;
 
 /* Public API for the protocol parser. */
@@ -101,6 +111,20 @@ void redisReaderFree(redisReader *r);
 redisReader *redisReaderCreate(void);
 int redisReaderFeed(redisReader *r, const char *buf, size_t len);
 int redisReaderGetReply(redisReader *r, void **reply);
+
+/* Zero-copy alternative to redisReaderFeed: get writable space of at least
+ * minlen bytes at the end of the buffer, write into it, then commit the
+ * number of bytes actually written. Returns NULL on error. */
+char *redisReaderGetWritableTail(redisReader *r, size_t minlen);
+int redisReaderCommitTail(redisReader *r, size_t len);
+
+/* For callers which parse the buffer themselves, between replies: the
+ * unconsumed bytes start at buf+pos, and end at buf+len. Mark the first len
+ * of them as consumed. */
+int redisReaderConsume(redisReader *r, size_t len);
+
+/* Is redisReaderGetReply in the middle of a reply? */
+int redisReaderInReply(redisReader *r);
 void freeReplyObject(void *reply);
 
 #define redisReaderSetPrivdata(_r, _p) (int)(((redisReader*)(_r))->privdata = (_p))
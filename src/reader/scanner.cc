@@ -0,0 +1,315 @@
+//------------------------------------------------------------------------------
+// File: scanner.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "reader/scanner.hh"
+#include <cstring>
+#include <cstdint>
+#include <climits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define QCLIENT_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace qclient {
+
+namespace {
+
+using SeekNewlineFunction = char* (*)(char*, size_t);
+using ParseDigitsFunction = bool (*)(const char*, size_t, unsigned long long*);
+
+//------------------------------------------------------------------------------
+// Portable versions
+//------------------------------------------------------------------------------
+char* seekNewlineScalar(char *s, size_t len) {
+  if(len < 2) return nullptr;
+
+  // The '\r' must be followed by at least one more byte.
+  char *end = s + len - 1;
+
+  while(s < end) {
+    char *cr = static_cast<char*>(memchr(s, '\r', end - s));
+    if(cr == nullptr) return nullptr;
+    if(cr[1] == '\n') return cr;
+    s = cr + 1;
+  }
+
+  return nullptr;
+}
+
+//------------------------------------------------------------------------------
+// Up to 18 digits, which can never overflow. The first digit has already
+// been checked to be non-zero.
+//------------------------------------------------------------------------------
+bool parseDigitsScalar(const char *s, size_t len, unsigned long long *out) {
+  unsigned long long v = 0;
+
+  for(size_t i = 0; i < len; i++) {
+    unsigned int digit = static_cast<unsigned char>(s[i]) - '0';
+    if(digit > 9) return false;
+    v = (v * 10) + digit;
+  }
+
+  *out = v;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// 19 digits or more - check for overflow at every step.
+//------------------------------------------------------------------------------
+bool parseDigitsChecked(const char *s, size_t len, unsigned long long *out) {
+  unsigned long long v = 0;
+
+  for(size_t i = 0; i < len; i++) {
+    unsigned int digit = static_cast<unsigned char>(s[i]) - '0';
+    if(digit > 9) return false;
+    if(v > (ULLONG_MAX / 10)) return false;
+    v *= 10;
+    if(v > (ULLONG_MAX - digit)) return false;
+    v += digit;
+  }
+
+  *out = v;
+  return true;
+}
+
+#ifdef QCLIENT_SCANNER_X86
+//------------------------------------------------------------------------------
+// SSE2: Compare 16 bytes at a time against '\r', and the same 16 bytes
+// shifted by one against '\n'.
+//------------------------------------------------------------------------------
+__attribute__((target("sse2")))
+char* seekNewlineSSE2(char *s, size_t len) {
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  size_t pos = 0;
+
+  while(pos + 17 <= len) {
+    __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + pos));
+    __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + pos + 1));
+
+    unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(first, cr)) &
+                        _mm_movemask_epi8(_mm_cmpeq_epi8(second, lf));
+
+    if(mask != 0) {
+      return s + pos + __builtin_ctz(mask);
+    }
+
+    pos += 16;
+  }
+
+  for(; pos + 1 < len; pos++) {
+    if(s[pos] == '\r' && s[pos+1] == '\n') return s + pos;
+  }
+
+  return nullptr;
+}
+
+//------------------------------------------------------------------------------
+// AVX2: Same as above, 32 bytes at a time.
+//------------------------------------------------------------------------------
+__attribute__((target("avx2")))
+char* seekNewlineAVX2(char *s, size_t len) {
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  size_t pos = 0;
+
+  while(pos + 33 <= len) {
+    __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos));
+    __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos + 1));
+
+    unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(first, cr))) &
+                        static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(second, lf)));
+
+    if(mask != 0) {
+      return s + pos + __builtin_ctz(mask);
+    }
+
+    pos += 32;
+  }
+
+  return seekNewlineSSE2(s + pos, len - pos);
+}
+
+//------------------------------------------------------------------------------
+// SSSE3: Validate and combine up to 16 digits at once, pairwise - two digits
+// into one 16-bit lane, two of those into one 32-bit lane, and so on. Any
+// AVX2 CPU supports this.
+//------------------------------------------------------------------------------
+__attribute__((target("ssse3")))
+bool parseDigitsSSSE3(const char *s, size_t len, unsigned long long *out) {
+  if(len < 9 || len > 16) {
+    return parseDigitsScalar(s, len, out);
+  }
+
+  // Right-align the digits, pad with leading zeroes.
+  char padded[16];
+  memset(padded, '0', 16 - len);
+  memcpy(padded + 16 - len, s, len);
+
+  __m128i digits = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(padded)),
+                                _mm_set1_epi8('0'));
+
+  // Anything other than a digit ends up above 9, when seen as unsigned.
+  __m128i nine = _mm_set1_epi8(9);
+  if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(digits, nine), digits)) != 0xFFFF) {
+    return false;
+  }
+
+  __m128i pairs = _mm_maddubs_epi16(digits, _mm_set_epi8(1, 10, 1, 10, 1, 10, 1, 10,
+                                                         1, 10, 1, 10, 1, 10, 1, 10));
+  __m128i quads = _mm_madd_epi16(pairs, _mm_set_epi16(1, 100, 1, 100, 1, 100, 1, 100));
+  __m128i packed = _mm_packs_epi32(quads, quads);
+  __m128i octets = _mm_madd_epi16(packed, _mm_set_epi16(1, 10000, 1, 10000, 1, 10000, 1, 10000));
+
+  uint64_t high = static_cast<uint32_t>(_mm_cvtsi128_si32(octets));
+  uint64_t low = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(octets, 4)));
+
+  *out = (high * 100000000ull) + low;
+  return true;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Currently active implementations. Constant-initialized to the portable
+// ones, so they're usable even before the upgrade below has run.
+//------------------------------------------------------------------------------
+ScanLevel activeLevel = ScanLevel::kScalar;
+SeekNewlineFunction activeSeekNewline = seekNewlineScalar;
+ParseDigitsFunction activeParseDigits = parseDigitsScalar;
+
+struct ScanLevelInitializer {
+  ScanLevelInitializer() {
+    setScanLevel(detectScanLevel());
+  }
+} scanLevelInitializer;
+
+}
+
+ScanLevel detectScanLevel() {
+#ifdef QCLIENT_SCANNER_X86
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("ssse3")) {
+    return ScanLevel::kAVX2;
+  }
+
+  if(__builtin_cpu_supports("sse2")) {
+    return ScanLevel::kSSE2;
+  }
+#endif
+
+  return ScanLevel::kScalar;
+}
+
+ScanLevel setScanLevel(ScanLevel level) {
+  ScanLevel supported = detectScanLevel();
+  if(static_cast<int>(level) > static_cast<int>(supported)) {
+    level = supported;
+  }
+
+  activeLevel = level;
+  activeSeekNewline = seekNewlineScalar;
+  activeParseDigits = parseDigitsScalar;
+
+#ifdef QCLIENT_SCANNER_X86
+  if(level == ScanLevel::kSSE2) {
+    activeSeekNewline = seekNewlineSSE2;
+  }
+  else if(level == ScanLevel::kAVX2) {
+    activeSeekNewline = seekNewlineAVX2;
+    activeParseDigits = parseDigitsSSSE3;
+  }
+#endif
+
+  return level;
+}
+
+ScanLevel getScanLevel() {
+  return activeLevel;
+}
+
+const char* scanLevelToString(ScanLevel level) {
+  switch(level) {
+    case ScanLevel::kScalar: {
+      return "scalar";
+    }
+    case ScanLevel::kSSE2: {
+      return "sse2";
+    }
+    case ScanLevel::kAVX2: {
+      return "avx2";
+    }
+  }
+
+  return "unknown";
+}
+
+char* respSeekNewline(char *s, size_t len) {
+  return activeSeekNewline(s, len);
+}
+
+bool respParseInteger(const char *s, size_t len, long long *value) {
+  if(len == 0) return false;
+
+  bool negative = false;
+  if(s[0] == '-') {
+    negative = true;
+    s++;
+    len--;
+
+    if(len == 0) return false;
+  }
+
+  // No leading zeroes - "0" is the only number which may start with one.
+  if(s[0] < '1' || s[0] > '9') {
+    if(s[0] == '0' && len == 1 && !negative) {
+      *value = 0;
+      return true;
+    }
+
+    return false;
+  }
+
+  unsigned long long v;
+
+  if(len <= 18) {
+    if(!activeParseDigits(s, len, &v)) return false;
+  }
+  else {
+    if(!parseDigitsChecked(s, len, &v)) return false;
+  }
+
+  if(negative) {
+    if(v > (static_cast<unsigned long long>(-(LLONG_MIN+1)) + 1)) return false;
+    *value = static_cast<long long>(0ull - v);
+  }
+  else {
+    if(v > LLONG_MAX) return false;
+    *value = static_cast<long long>(v);
+  }
+
+  return true;
+}
+
+}
@@ -0,0 +1,73 @@
+//------------------------------------------------------------------------------
+// File: scanner.hh
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef QCLIENT_READER_SCANNER_HH
+#define QCLIENT_READER_SCANNER_HH
+
+#include <cstddef>
+
+namespace qclient {
+
+//------------------------------------------------------------------------------
+// The hot loops of the RESP reader: finding the CRLF which terminates a line,
+// and parsing the integer it contains. Vectorized code paths are picked at
+// runtime, based on what the CPU supports - there's always a portable
+// fallback.
+//------------------------------------------------------------------------------
+enum class ScanLevel {
+  kScalar,
+  kSSE2,
+  kAVX2
+};
+
+//------------------------------------------------------------------------------
+// The best level supported by this CPU.
+//------------------------------------------------------------------------------
+ScanLevel detectScanLevel();
+
+//------------------------------------------------------------------------------
+// Force a particular level - meant for tests and benchmarks. Levels not
+// supported by this CPU are downgraded to the best one which is. Returns the
+// level actually in use. Not thread-safe with respect to concurrent parsing.
+//------------------------------------------------------------------------------
+ScanLevel setScanLevel(ScanLevel level);
+ScanLevel getScanLevel();
+
+const char* scanLevelToString(ScanLevel level);
+
+//------------------------------------------------------------------------------
+// Find the first "\r\n" within the given range, return a pointer to its '\r',
+// or nullptr if there's none.
+//------------------------------------------------------------------------------
+char* respSeekNewline(char *s, size_t len);
+
+//------------------------------------------------------------------------------
+// Parse the given range into a long long, strictly: an optional minus sign,
+// then digits, without leading zeroes, and no overflow. Returns false if the
+// range is anything else.
+//------------------------------------------------------------------------------
+bool respParseInteger(const char *s, size_t len, long long *value);
+
+}
+
+#endif
@@ -62,7 +62,8 @@ void SharedManager::publish(const std::string &channel, const std::string &paylo
     //--------------------------------------------------------------------------
     // Real mode
     //--------------------------------------------------------------------------
-    qcl->exec("PUBLISH", channel, payload);
+    static const PreparedCommand publishCmd({"PUBLISH"}, 2);
+    qcl->exec(publishCmd, channel, payload);
   }
   else {
     //--------------------------------------------------------------------------
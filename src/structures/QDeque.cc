@@ -42,7 +42,7 @@ QDeque::~QDeque() {}
 // Query deque size
 //------------------------------------------------------------------------------
 qclient::Status QDeque::size(size_t &out) {
-  IntegerParser parser(mQcl.exec("deque-len", mKey).get());
+  IntegerParser parser(mQcl.pooledExec("deque-len", mKey).get());
   if(!parser.ok()) {
     return qclient::Status(EINVAL, parser.err());
   }
@@ -55,7 +55,7 @@ qclient::Status QDeque::size(size_t &out) {
 // Add item to the back of the queue
 //------------------------------------------------------------------------------
 qclient::Status QDeque::push_back(const std::string &contents) {
-  IntegerParser parser(mQcl.exec("deque-push-back", mKey, contents).get());
+  IntegerParser parser(mQcl.pooledExec("deque-push-back", mKey, contents).get());
   if(!parser.ok()) {
     return qclient::Status(EINVAL, parser.err());
   }
@@ -68,7 +68,7 @@ qclient::Status QDeque::push_back(const std::string &contents) {
 // returned - not an error.
 //------------------------------------------------------------------------------
 qclient::Status QDeque::pop_front(std::string &out) {
-  StringParser parser(mQcl.exec("deque-pop-front", mKey).get());
+  StringParser parser(mQcl.pooledExec("deque-pop-front", mKey).get());
   if(!parser.ok()) {
     return qclient::Status(EINVAL, parser.err());
   }
@@ -81,7 +81,7 @@ qclient::Status QDeque::pop_front(std::string &out) {
 // Clear all items in the queue
 //------------------------------------------------------------------------------
 qclient::Status QDeque::clear() {
-  IntegerParser parser(mQcl.exec("deque-clear", mKey).get());
+  IntegerParser parser(mQcl.pooledExec("deque-clear", mKey).get());
   if(!parser.ok()) {
     return qclient::Status(EINVAL, parser.err());
   }
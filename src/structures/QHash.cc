@@ -51,7 +51,7 @@ std::string
 QHash::hget(const std::string& field)
 {
   std::string resp{""};
-  redisReplyPtr reply = mClient->exec("HGET", mKey, field).get();
+  redisReplyPtr reply = mClient->pooledExec("HGET", mKey, field).get();
 
   if ((reply == nullptr) || ((reply->type != REDIS_REPLY_STRING) &&
                              (reply->type != REDIS_REPLY_NIL))) {
@@ -72,7 +72,7 @@ QHash::hget(const std::string& field)
 bool
 QHash::hdel(const std::string& field)
 {
-  redisReplyPtr reply = mClient->exec("HDEL", mKey, field).get();
+  redisReplyPtr reply = mClient->pooledExec("HDEL", mKey, field).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
     throw std::runtime_error("[FATAL] Error hdel key: " + mKey + " field: "
@@ -97,21 +97,15 @@ QHash::hdel_async(const std::string& field, AsyncHandler* ah)
 std::vector<std::string>
 QHash::hgetall()
 {
-  redisReplyPtr reply = mClient->exec("HGETALL", mKey).get();
+  TypedResponse<std::vector<std::string>> resp = mClient->execute<std::vector<std::string>>(
+    EncodedRequest::make("HGETALL", mKey)).get();
 
-  if ((reply == nullptr) || (reply->type != REDIS_REPLY_ARRAY)) {
+  if (!resp.ok()) {
     throw std::runtime_error("[FATAL] Error hgetall key: " + mKey +
                              ": Unexpected/null reply");
   }
 
-  std::vector<std::string> resp;
-  resp.reserve(reply->elements);
-
-  for (size_t i = 0; i < reply->elements; ++i) {
-    resp.emplace_back(reply->element[i]->str, reply->element[i]->len);
-  }
-
-  return resp;
+  return std::move(resp.value());
 }
 
 //------------------------------------------------------------------------------
@@ -120,7 +114,7 @@ QHash::hgetall()
 bool
 QHash::hexists(const std::string& field)
 {
-  redisReplyPtr reply = mClient->exec("HEXISTS", mKey, field).get();
+  redisReplyPtr reply = mClient->pooledExec("HEXISTS", mKey, field).get();
 
   if (reply->type != REDIS_REPLY_INTEGER) {
     throw std::runtime_error("[FATAL] Error hexists key: " + mKey + " field: "
@@ -136,7 +130,7 @@ QHash::hexists(const std::string& field)
 long long int
 QHash::hlen()
 {
-  redisReplyPtr reply = mClient->exec("HLEN", mKey).get();
+  redisReplyPtr reply = mClient->pooledExec("HLEN", mKey).get();
 
   if (reply->type != REDIS_REPLY_INTEGER) {
     throw std::runtime_error("[FATAL] Error hlen key: " + mKey +
@@ -161,7 +155,7 @@ QHash::hlen_async(AsyncHandler* ah)
 std::vector<std::string>
 QHash::hkeys()
 {
-  redisReplyPtr reply = mClient->exec("HKEYS", mKey).get();
+  redisReplyPtr reply = mClient->pooledExec("HKEYS", mKey).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_ARRAY)) {
     throw std::runtime_error("[FATAL] Error hkeys key: " + mKey +
@@ -184,7 +178,7 @@ QHash::hkeys()
 std::vector<std::string>
 QHash::hvals()
 {
-  redisReplyPtr reply = mClient->exec("HVALS", mKey).get();
+  redisReplyPtr reply = mClient->pooledExec("HVALS", mKey).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_ARRAY)) {
     throw std::runtime_error("[FATAL] Error hvals key: " + mKey +
@@ -207,7 +201,7 @@ QHash::hvals()
 std::pair<std::string, std::map<std::string, std::string> >
 QHash::hscan(const std::string& cursor, long long count)
 {
-  redisReplyPtr reply = mClient->exec("HSCAN", mKey, cursor, "COUNT",
+  redisReplyPtr reply = mClient->pooledExec("HSCAN", mKey, cursor, "COUNT",
                                       std::to_string(count)).get();
 
   if (reply == nullptr) {
@@ -242,7 +236,7 @@ bool QHash::hmset(std::list<std::string> lst_elem)
 {
   (void) lst_elem.push_front(mKey);
   (void) lst_elem.push_front("HMSET");
-  redisReplyPtr reply =  mClient->execute(lst_elem).get();
+  redisReplyPtr reply =  mClient->pooledExecute(EncodedRequest(lst_elem)).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_STATUS)) {
     throw std::runtime_error("[FATAL] Error hmset key: " + mKey +
@@ -66,7 +66,7 @@ void QLocalityHash::Iterator::fillFromBackend() {
   while(mError.empty() && mResults.empty() && !mReachedEnd) {
     mReqs++;
 
-    redisReplyPtr reply = mQcl->exec("LHSCAN", mKey, mCursor, "COUNT", std::to_string(mCount)).get();
+    redisReplyPtr reply = mQcl->pooledExec("LHSCAN", mKey, mCursor, "COUNT", std::to_string(mCount)).get();
 
     if(!reply) {
       mError = "unable to contact backend - network error";
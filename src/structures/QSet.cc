@@ -51,7 +51,7 @@ long long int QSet::sadd(std::list<std::string> lst_elem)
 {
   (void) lst_elem.push_front(mKey);
   (void) lst_elem.push_front("SADD");
-  redisReplyPtr reply = mClient->execute(lst_elem).get();
+  redisReplyPtr reply = mClient->pooledExecute(EncodedRequest(lst_elem)).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
     throw std::runtime_error("[FATAL] Error sadd key: " + mKey +
@@ -68,7 +68,7 @@ long long int QSet::srem(std::list<std::string> lst_elem)
 {
   (void) lst_elem.push_front(mKey);
   (void) lst_elem.push_front("SREM");
-  redisReplyPtr reply = mClient->execute(lst_elem).get();
+  redisReplyPtr reply = mClient->pooledExecute(EncodedRequest(lst_elem)).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
     throw std::runtime_error("[FATAL] Error srem key: " + mKey +
@@ -83,7 +83,7 @@ long long int QSet::srem(std::list<std::string> lst_elem)
 //------------------------------------------------------------------------------
 long long int QSet::scard()
 {
-  redisReplyPtr reply = mClient->exec("SCARD", mKey).get();
+  redisReplyPtr reply = mClient->pooledExec("SCARD", mKey).get();
 
   if ((reply == nullptr) || (reply->type != REDIS_REPLY_INTEGER)) {
     throw std::runtime_error("[FATAL] Error scard key: " + mKey +
@@ -98,20 +98,15 @@ long long int QSet::scard()
 //------------------------------------------------------------------------------
 std::set<std::string> QSet::smembers()
 {
-  redisReplyPtr reply = mClient->exec("SMEMBERS", mKey).get();
+  TypedResponse<std::set<std::string>> resp = mClient->execute<std::set<std::string>>(
+    EncodedRequest::make("SMEMBERS", mKey)).get();
 
-  if ((reply == nullptr) || (reply->type != REDIS_REPLY_ARRAY)) {
+  if (!resp.ok()) {
     throw std::runtime_error("[FATAL] Error smembers key: " + mKey +
                              " : Unexpected/null reply");
   }
 
-  std::set<std::string> ret;
-
-  for (size_t i = 0; i < reply->elements; ++i) {
-    ret.emplace(reply->element[i]->str, reply->element[i]->len);
-  }
-
-  return ret;
+  return std::move(resp.value());
 }
 
 //------------------------------------------------------------------------------
@@ -120,7 +115,7 @@ std::set<std::string> QSet::smembers()
 std::pair< std::string, std::vector<std::string> >
 QSet::sscan(const std::string &cursor, long long count)
 {
-  redisReplyPtr reply = mClient->exec("SSCAN", mKey, cursor, "COUNT", std::to_string(count)).get();
+  redisReplyPtr reply = mClient->pooledExec("SSCAN", mKey, cursor, "COUNT", std::to_string(count)).get();
 
   if (reply == nullptr) {
     throw std::runtime_error("[FATAL] Error sscan key: " + mKey +
@@ -91,6 +91,16 @@ inline void assert_reply(std::future<redisReplyPtr> &&fut, T&& check) {
   assert_reply(fut.get(), check);
 }
 
+template<typename T>
+inline void assert_reply(ReplyFuture &fut, T&& check) {
+  assert_reply(fut.get(), check);
+}
+
+template<typename T>
+inline void assert_reply(ReplyFuture &&fut, T&& check) {
+  assert_reply(fut.get(), check);
+}
+
 }
 
 #endif
@@ -0,0 +1,130 @@
+// ----------------------------------------------------------------------
+// File: coroutines.cc
+// Author: Georgios Bitzes - CERN
+// ----------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "qclient/Task.hh"
+
+#if QCLIENT_HAVE_COROUTINES == 1
+
+#include "qclient/ResponseBuilder.hh"
+#include "ConnectionCore.hh"
+#include "ReplyMacros.hh"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+
+using namespace qclient;
+
+//------------------------------------------------------------------------------
+// Stages straight into a ConnectionCore, no networking involved.
+//------------------------------------------------------------------------------
+class CoreClient {
+public:
+  CoreClient(ConnectionCore &c) : core(c) {}
+
+  void executeUnordered(QCallback *callback, EncodedRequest &&req) {
+    core.stage(callback, std::move(req));
+  }
+
+  RequestAwaiter<CoreClient> coExec(const std::string &cmd, const std::string &arg) {
+    return RequestAwaiter<CoreClient>(*this, EncodedRequest::make(cmd, arg));
+  }
+
+  std::vector<std::thread::id> threads;
+
+private:
+  ConnectionCore &core;
+};
+
+static Task<long long> getInteger(CoreClient &client, const std::string &key) {
+  redisReplyPtr reply = co_await client.coExec("GET", key);
+  client.threads.emplace_back(std::this_thread::get_id());
+
+  if(!reply) {
+    throw std::runtime_error("request discarded");
+  }
+
+  co_return reply->integer;
+}
+
+static Task<long long> sumOfTwo(CoreClient &client) {
+  long long first = co_await getInteger(client, "first");
+  long long second = co_await getInteger(client, "second");
+  co_return first + second;
+}
+
+TEST(Coroutines, InlineResumption) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true,
+                      nullptr, true, nullptr, true);
+  CoreClient client(core);
+
+  std::future<long long> fut = spawn(sumOfTwo(client));
+  ASSERT_EQ(fut.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+
+  // Resumes right away, and issues the second request
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(3)));
+  ASSERT_EQ(fut.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(4)));
+  ASSERT_EQ(fut.get(), 7);
+
+  ASSERT_EQ(client.threads.size(), 2u);
+  ASSERT_EQ(client.threads[0], std::this_thread::get_id());
+  ASSERT_EQ(client.threads[1], std::this_thread::get_id());
+}
+
+TEST(Coroutines, CallbackThreadResumption) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  CoreClient client(core);
+
+  std::future<long long> fut = spawn(getInteger(client, "key"));
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(5)));
+  ASSERT_EQ(fut.get(), 5);
+
+  ASSERT_EQ(client.threads.size(), 1u);
+  ASSERT_NE(client.threads[0], std::this_thread::get_id());
+}
+
+static Task<void> discarded(CoreClient &client, bool &reached) {
+  try {
+    co_await getInteger(client, "key");
+  }
+  catch(const std::runtime_error &exc) {
+    reached = true;
+    throw;
+  }
+}
+
+TEST(Coroutines, Exceptions) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true,
+                      nullptr, true, nullptr, true);
+  CoreClient client(core);
+
+  bool reached = false;
+  std::future<void> fut = spawn(discarded(client, reached));
+  ASSERT_EQ(core.clearAllPending(), 0u);
+
+  ASSERT_TRUE(reached);
+  ASSERT_THROW(fut.get(), std::runtime_error);
+}
+
+#endif
@@ -0,0 +1,182 @@
+// ----------------------------------------------------------------------
+// File: event-loop.cc
+// Author: Georgios Bitzes - CERN
+// ----------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "qclient/EventLoopGroup.hh"
+#include "qclient/EventFD.hh"
+#include "EventLoop.hh"
+#include "ConnectionCore.hh"
+#include <gtest/gtest.h>
+#include <sys/epoll.h>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+
+using namespace qclient;
+
+namespace {
+
+class RecordingHandler : public EventHandler {
+public:
+  RecordingHandler(int i, std::vector<int> &rec) : id(i), record(rec) {}
+
+  virtual void handleEvents(int fd, uint32_t events) override {
+    if(events & EPOLLIN) readable++;
+  }
+
+  virtual void handleTimer() override {
+    record.push_back(id);
+  }
+
+  int id;
+  std::vector<int> &record;
+  std::atomic<int> readable {0};
+};
+
+}
+
+TEST(EventLoop, TasksRunInOrder) {
+  EventLoop loop;
+  std::vector<int> seen;
+
+  std::thread producer([&]() {
+    for(int i = 0; i < 10000; i++) {
+      loop.post([&seen, i]() { seen.push_back(i); });
+    }
+  });
+
+  producer.join();
+
+  bool onLoop = false;
+  loop.runSync([&]() { onLoop = loop.inLoopThread(); });
+  ASSERT_TRUE(onLoop);
+  ASSERT_FALSE(loop.inLoopThread());
+
+  ASSERT_EQ(seen.size(), 10000u);
+  for(int i = 0; i < 10000; i++) {
+    ASSERT_EQ(seen[i], i);
+  }
+}
+
+TEST(EventLoop, Timers) {
+  EventLoop loop;
+  std::vector<int> fired;
+
+  RecordingHandler first(1, fired), second(2, fired), third(3, fired);
+  auto now = EventLoop::Clock::now();
+
+  loop.runSync([&]() {
+    loop.setTimer(&third, now + std::chrono::milliseconds(30));
+    loop.setTimer(&first, now + std::chrono::milliseconds(10));
+    loop.setTimer(&second, now + std::chrono::milliseconds(5));
+
+    // Setting it again replaces the previous deadline
+    loop.setTimer(&second, now + std::chrono::milliseconds(20));
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(25));
+  loop.runSync([&]() { loop.cancelTimer(&third); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  std::vector<int> result;
+  loop.runSync([&]() { result = fired; });
+  ASSERT_EQ(result, std::vector<int>({1, 2}));
+  ASSERT_GE(EventLoop::Clock::now() - now, std::chrono::milliseconds(20));
+}
+
+TEST(EventLoop, WatchAndUnwatch) {
+  EventLoop loop;
+  EventFD efd;
+  std::vector<int> unused;
+  RecordingHandler handler(1, unused);
+
+  loop.runSync([&]() { loop.watch(efd.getFD(), EPOLLIN, &handler); });
+  efd.notify();
+
+  for(size_t i = 0; i < 1000 && handler.readable == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  ASSERT_GT(handler.readable, 0);
+
+  // Level-triggered - keeps firing until unwatched
+  loop.runSync([&]() { loop.unwatch(efd.getFD()); });
+  int readable = handler.readable;
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_EQ(handler.readable, readable);
+
+  // Doesn't spin while there's nothing to do
+  uint64_t iterations = loop.getIterations();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ASSERT_EQ(loop.getIterations(), iterations);
+}
+
+TEST(EventLoopGroup, RoundRobin) {
+  EventLoopGroup group(3);
+  ASSERT_EQ(group.getThreadCount(), 3u);
+
+  EventLoop *first = group.pick();
+  EventLoop *second = group.pick();
+  EventLoop *third = group.pick();
+
+  ASSERT_NE(first, second);
+  ASSERT_NE(second, third);
+  ASSERT_NE(first, third);
+  ASSERT_EQ(group.pick(), first);
+}
+
+TEST(ConnectionCore, WriteNotifier) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), false,
+                      nullptr, true, nullptr, true);
+
+  std::atomic<int> notified {0};
+  core.setWriteNotifier([&]() { notified++; });
+
+  // Not parked yet, producers don't bother
+  std::future<redisReplyPtr> fut1 = core.stage(EncodedRequest::make("PING", "1"));
+  ASSERT_EQ(notified, 0);
+
+  // Can't park while there's something to write
+  ASSERT_FALSE(core.parkWriter());
+  ASSERT_NE(core.pollNextToWrite(), nullptr);
+  ASSERT_EQ(core.pollNextToWrite(), nullptr);
+
+  // Parked - the first request to arrive notifies, and only the first
+  ASSERT_TRUE(core.parkWriter());
+  std::future<redisReplyPtr> fut2 = core.stage(EncodedRequest::make("PING", "2"));
+  std::future<redisReplyPtr> fut3 = core.stage(EncodedRequest::make("PING", "3"));
+  ASSERT_EQ(notified, 1);
+
+  ASSERT_NE(core.pollNextToWrite(), nullptr);
+  ASSERT_NE(core.pollNextToWrite(), nullptr);
+  ASSERT_EQ(core.pollNextToWrite(), nullptr);
+  ASSERT_TRUE(core.parkWriter());
+
+  std::vector<EncodedRequest> batch;
+  batch.emplace_back(EncodedRequest::make("PING", "4"));
+  batch.emplace_back(EncodedRequest::make("PING", "5"));
+  std::future<std::vector<redisReplyPtr>> fut4 = core.stageBatch(std::move(batch));
+  ASSERT_EQ(notified, 2);
+
+  ASSERT_EQ(core.clearAllPending(), 0u);
+}
@@ -0,0 +1,266 @@
+// ----------------------------------------------------------------------
+// File: executor.cc
+// Author: Georgios Bitzes - CERN
+// ----------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "qclient/Executor.hh"
+#include "qclient/ResponseBuilder.hh"
+#include "CallbackDispatcher.hh"
+#include "ConnectionCore.hh"
+#include "ReplyMacros.hh"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <thread>
+
+using namespace qclient;
+
+TEST(WorkStealingExecutor, RunsEverything) {
+  std::atomic<int64_t> counter {0};
+
+  {
+    WorkStealingExecutor executor(4);
+    ASSERT_EQ(executor.getThreadCount(), 4u);
+
+    std::vector<std::thread> producers;
+    for(size_t i = 0; i < 3; i++) {
+      producers.emplace_back([&]() {
+        for(size_t j = 0; j < 10000; j++) {
+          executor.execute([&]() {
+            counter++;
+
+            // Tasks submitted from within the pool, too
+            if(counter % 100 == 0) {
+              executor.execute([&]() { counter += 1000000; });
+            }
+          });
+        }
+      });
+    }
+
+    for(auto &producer : producers) {
+      producer.join();
+    }
+
+    // Destructor runs whatever's still pending
+  }
+
+  ASSERT_EQ(counter % 1000000, 30000);
+  ASSERT_GE(counter / 1000000, 1);
+}
+
+TEST(WorkStealingExecutor, StealsFromBlockedWorker) {
+  WorkStealingExecutor executor(2);
+
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  executor.execute([released]() { released.wait(); });
+
+  // Half of these land behind the blocked task
+  std::atomic<int64_t> counter {0};
+  for(size_t i = 0; i < 100; i++) {
+    executor.execute([&]() { counter++; });
+  }
+
+  for(size_t i = 0; i < 500 && counter != 100; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  ASSERT_EQ(counter, 100);
+  release.set_value();
+}
+
+//------------------------------------------------------------------------------
+// Records the order of replies, and whether it was ever invoked concurrently
+// with any other Recorder.
+//------------------------------------------------------------------------------
+static std::atomic<int64_t> activeRecorders {0};
+
+class Recorder : public QCallback {
+public:
+  Recorder(std::vector<int64_t> *global, std::mutex *globalMtx, size_t delayUs = 0)
+  : globalOrder(global), globalMtx(globalMtx), delay(delayUs) {}
+
+  virtual void handleResponse(redisReplyPtr &&reply) override {
+    if(activeRecorders.fetch_add(1) != 0) {
+      overlapped = true;
+    }
+
+    if(delay != 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(delay));
+    }
+
+    order.emplace_back(reply->integer);
+
+    if(globalOrder) {
+      std::lock_guard<std::mutex> lock(*globalMtx);
+      globalOrder->emplace_back(reply->integer);
+    }
+
+    activeRecorders--;
+    received++;
+  }
+
+  std::vector<int64_t> order;
+  std::atomic<bool> overlapped {false};
+  std::atomic<size_t> received {0};
+
+private:
+  std::vector<int64_t> *globalOrder;
+  std::mutex *globalMtx;
+  size_t delay;
+};
+
+TEST(CallbackDispatcher, StrictFifo) {
+  std::vector<int64_t> global;
+  std::mutex mtx;
+  std::vector<std::unique_ptr<Recorder>> recorders;
+  for(size_t i = 0; i < 3; i++) {
+    recorders.emplace_back(new Recorder(&global, &mtx));
+  }
+
+  {
+    CallbackDispatcher dispatcher(std::make_shared<WorkStealingExecutor>(4), CallbackOrdering::kStrictFifo);
+    for(int64_t i = 0; i < 10000; i++) {
+      dispatcher.stage(recorders[i % 3].get(), ResponseBuilder::makeInt(i));
+    }
+  }
+
+  ASSERT_EQ(global.size(), 10000u);
+  for(int64_t i = 0; i < 10000; i++) {
+    ASSERT_EQ(global[i], i);
+  }
+
+  for(size_t i = 0; i < 3; i++) {
+    ASSERT_FALSE(recorders[i]->overlapped);
+  }
+}
+
+TEST(CallbackDispatcher, PerCallback) {
+  std::vector<std::unique_ptr<Recorder>> recorders;
+  for(size_t i = 0; i < 8; i++) {
+    recorders.emplace_back(new Recorder(nullptr, nullptr));
+  }
+
+  {
+    CallbackDispatcher dispatcher(std::make_shared<WorkStealingExecutor>(4), CallbackOrdering::kPerCallback);
+    for(int64_t i = 0; i < 16000; i++) {
+      dispatcher.stage(recorders[i % 8].get(), ResponseBuilder::makeInt(i));
+    }
+  }
+
+  for(size_t i = 0; i < 8; i++) {
+    ASSERT_EQ(recorders[i]->order.size(), 2000u);
+
+    for(size_t j = 0; j < 2000; j++) {
+      ASSERT_EQ(recorders[i]->order[j], (int64_t) (j*8 + i));
+    }
+  }
+}
+
+TEST(ConnectionCore, CallbackExecutor) {
+  std::shared_ptr<Executor> executor = std::make_shared<WorkStealingExecutor>(4);
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true,
+                      nullptr, true, nullptr, false, executor, CallbackOrdering::kPerCallback);
+
+  Recorder recorder(nullptr, nullptr);
+  std::vector<std::future<redisReplyPtr>> futures;
+
+  for(int64_t i = 0; i < 100; i++) {
+    futures.emplace_back(core.stage(EncodedRequest::make("ping", std::to_string(i))));
+    core.stage(&recorder, EncodedRequest::make("ping", std::to_string(i)));
+  }
+
+  for(int64_t i = 0; i < 200; i++) {
+    ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(i)));
+  }
+
+  for(int64_t i = 0; i < 100; i++) {
+    ASSERT_REPLY(futures[i], i*2);
+  }
+
+  for(size_t i = 0; i < 500 && recorder.received != 100; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  ASSERT_EQ(recorder.order.size(), 100u);
+  for(int64_t i = 0; i < 100; i++) {
+    ASSERT_EQ(recorder.order[i], i*2 + 1);
+  }
+}
+
+//------------------------------------------------------------------------------
+// A slow callback, with replies for a fast one interleaved: How long until
+// all the fast ones have been delivered?
+//------------------------------------------------------------------------------
+static std::chrono::milliseconds measureSlowCallback(std::shared_ptr<Executor> executor,
+  CallbackOrdering ordering) {
+
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true,
+                      nullptr, true, nullptr, false, executor, ordering);
+
+  Recorder slow(nullptr, nullptr, 2000);
+  Recorder fast(nullptr, nullptr);
+
+  for(size_t i = 0; i < 1000; i++) {
+    if(i % 20 == 0) {
+      core.stage(&slow, EncodedRequest::make("slow"));
+    }
+
+    core.stage(&fast, EncodedRequest::make("fast"));
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < 1050; i++) {
+    EXPECT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(i)));
+  }
+
+  while(fast.received != 1000) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+  while(slow.received != 50) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+}
+
+TEST(CallbackDispatcher, SlowCallbackBenchmark) {
+  std::shared_ptr<Executor> executor = std::make_shared<WorkStealingExecutor>(4);
+
+  std::chrono::milliseconds dedicated = measureSlowCallback({}, CallbackOrdering::kStrictFifo);
+  std::chrono::milliseconds strict = measureSlowCallback(executor, CallbackOrdering::kStrictFifo);
+  std::chrono::milliseconds perCallback = measureSlowCallback(executor, CallbackOrdering::kPerCallback);
+
+  std::cout << "Fast callbacks delayed by a slow one - dedicated thread: " << dedicated.count()
+            << " ms, pool with strict FIFO: " << strict.count()
+            << " ms, pool with per-callback ordering: " << perCallback.count() << " ms" << std::endl;
+
+  // 50 slow callbacks of 2ms each hold up the last fast one, unless they're
+  // allowed to run in parallel.
+  ASSERT_GE(dedicated.count(), 90);
+  ASSERT_GE(strict.count(), 90);
+  ASSERT_LT(perCallback.count(), 90);
+}
@@ -0,0 +1,132 @@
+//------------------------------------------------------------------------------
+// File: follower-reads.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <gtest/gtest.h>
+#include "test-config.hh"
+#include "qclient/QClient.hh"
+#include "qclient/QClientPool.hh"
+
+using namespace qclient;
+#define SSTR(message) static_cast<std::ostringstream&>(std::ostringstream().flush() << message).str()
+
+static Options followerOptions() {
+  Options opts;
+  opts.tlsconfig = testconfig.tlsconfig;
+  return std::move(opts.withFollowerReads());
+}
+
+static std::string getString(std::future<redisReplyPtr> &&fut) {
+  redisReplyPtr reply = fut.get();
+  if(!reply) return "(null)";
+  if(reply->type == REDIS_REPLY_NIL) return "(nil)";
+  return std::string(reply->str, reply->len);
+}
+
+//------------------------------------------------------------------------------
+// Satisfies a promise - one per request.
+//------------------------------------------------------------------------------
+class PromiseReply : public QCallback {
+public:
+  virtual void handleResponse(redisReplyPtr &&reply) override {
+    promise.set_value(std::move(reply));
+  }
+
+  std::promise<redisReplyPtr> promise;
+};
+
+//------------------------------------------------------------------------------
+// The test server is listed twice: Once as the leader, once as a follower
+// serving reads. Every path a read can take sees the writes before it.
+//------------------------------------------------------------------------------
+TEST(FollowerReads, ReadsSeeWrites) {
+  Members members;
+  members.push_back(testconfig.host, testconfig.port);
+  members.push_back(testconfig.host, testconfig.port);
+
+  QClient qcl(members, followerOptions());
+  const std::string key = "qclient_test:follower_reads";
+  ASSERT_TRUE(qcl.exec("DEL", key).get() != nullptr);
+
+  for(size_t i = 1; i <= 100; i++) {
+    redisReplyPtr reply = qcl.exec("INCR", key).get();
+    ASSERT_TRUE(reply != nullptr);
+    ASSERT_EQ(reply->integer, (long long) i);
+
+    ASSERT_EQ(getString(qcl.exec("GET", key)), SSTR(i));
+  }
+
+  // Pinned to the leader
+  EncodedRequest pinned = EncodedRequest::make("GET", key);
+  pinned.requireLeader();
+  ASSERT_EQ(getString(qcl.execute(std::move(pinned))), "100");
+
+  // Shared, ordered callbacks stay on the leader; dedicated ones are routed
+  PromiseReply ordered, unordered;
+  qcl.execute(&ordered, EncodedRequest::make("GET", key));
+  qcl.executeUnordered(&unordered, EncodedRequest::make("GET", key));
+  ASSERT_EQ(getString(ordered.promise.get_future()), "100");
+  ASSERT_EQ(getString(unordered.promise.get_future()), "100");
+
+  ASSERT_TRUE(qcl.exec("DEL", key).get() != nullptr);
+  ASSERT_EQ(getString(qcl.exec("GET", key)), "(nil)");
+}
+
+//------------------------------------------------------------------------------
+// A follower nobody listens on: Reads fall back to the leader.
+//------------------------------------------------------------------------------
+TEST(FollowerReads, UnreachableFollower) {
+  Members members;
+  members.push_back(testconfig.host, testconfig.port);
+  members.push_back("127.0.0.1", 1);
+
+  QClient qcl(members, followerOptions());
+  const std::string key = "qclient_test:follower_reads_unreachable";
+  ASSERT_TRUE(qcl.exec("DEL", key).get() != nullptr);
+  ASSERT_TRUE(qcl.exec("INCR", key).get() != nullptr);
+
+  for(size_t i = 0; i < 100; i++) {
+    ASSERT_EQ(getString(qcl.exec("GET", key)), "1");
+  }
+
+  ASSERT_TRUE(qcl.exec("DEL", key).get() != nullptr);
+}
+
+//------------------------------------------------------------------------------
+// Pooled connections route reads the same way.
+//------------------------------------------------------------------------------
+TEST(FollowerReads, Pool) {
+  Members members;
+  members.push_back(testconfig.host, testconfig.port);
+  members.push_back(testconfig.host, testconfig.port);
+
+  QClientPool pool(members, 4, followerOptions());
+  const std::string key = "qclient_test:follower_reads_pool";
+  ASSERT_TRUE(pool.exec("DEL", key).get() != nullptr);
+
+  for(size_t i = 1; i <= 100; i++) {
+    ASSERT_TRUE(pool.exec("INCR", key).get() != nullptr);
+    ASSERT_EQ(getString(pool.exec("GET", key)), SSTR(i));
+  }
+
+  ASSERT_TRUE(pool.exec("DEL", key).get() != nullptr);
+}
@@ -27,6 +27,10 @@
 #include <set>
 #include <list>
 #include <algorithm>
+#include <fstream>
+#include <thread>
+#include <sys/resource.h>
+#include <dirent.h>
 
 using namespace qclient;
 #define SSTR(message) static_cast<std::ostringstream&>(std::ostringstream().flush() << message).str()
@@ -46,6 +50,23 @@ TEST(Ping, one)
   ASSERT_EQ(strcmp(reply->str, "hello there"), 0);
 }
 
+//------------------------------------------------------------------------------
+// Ping with a large payload, which is referenced by the request instead of
+// being copied into it
+//------------------------------------------------------------------------------
+TEST(Ping, ZeroCopyPayload)
+{
+  QClient cl{testconfig.host, testconfig.port, {} };
+
+  RequestPayload payload = std::make_shared<const std::string>(8 * 1024 * 1024, 'q');
+  std::future<redisReplyPtr> fut = cl.execute(EncodedRequest::makeZeroCopy("PING", payload));
+
+  redisReplyPtr reply = fut.get();
+  ASSERT_TRUE(reply != nullptr);
+  ASSERT_EQ(reply->type, REDIS_REPLY_STRING);
+  ASSERT_EQ(std::string(reply->str, reply->len), *payload);
+}
+
 TEST(Ping, Benchmark) {
   std::vector<std::future<redisReplyPtr>> responses;
 
@@ -71,3 +92,324 @@ TEST(Ping, Benchmark) {
   std::cout << "Took " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
   << " ms for " << kRequests << " pings (" << ((double) kRequests / (double) microsec)*1000 << " kHz)" << std::endl;
 }
+
+//------------------------------------------------------------------------------
+// Number of write-type syscalls issued by this process so far, as reported by
+// the kernel. The writer thread uses writev(), which is accounted for here.
+//------------------------------------------------------------------------------
+static int64_t countWriteSyscalls() {
+  std::ifstream in("/proc/self/io");
+  std::string key;
+  int64_t value;
+
+  while(in >> key >> value) {
+    if(key == "syscw:") return value;
+  }
+
+  return -1;
+}
+
+static void pipelinedPings(Options &&opts, const std::string &name) {
+  // Sends through io_uring aren't accounted for in /proc/self/io.
+  bool countSyscalls = (opts.transport == TransportBackend::kPoll);
+  QClient cl{testconfig.host, testconfig.port, std::move(opts) };
+  ASSERT_TRUE(cl.exec("PING", "warmup").get() != nullptr);
+
+  constexpr size_t kRequests = 200000;
+  std::vector<std::future<redisReplyPtr>> responses;
+  responses.reserve(kRequests);
+
+  int64_t syscallsBefore = countWriteSyscalls();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for(size_t i = 0; i < kRequests; i++) {
+    responses.push_back(cl.exec("PING", SSTR("ping #" << i)));
+  }
+
+  for(size_t i = 0; i < kRequests; i++) {
+    redisReplyPtr reply = responses[i].get();
+    ASSERT_TRUE(reply != nullptr);
+    ASSERT_EQ(std::string(reply->str, reply->len), SSTR("ping #" << i));
+  }
+
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  int64_t syscallsAfter = countWriteSyscalls();
+  int64_t microsec = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+  std::cout << name << ": " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+  << " ms for " << kRequests << " pings (" << ((double) kRequests / (double) microsec)*1000 << " kHz)";
+
+  if(countSyscalls && syscallsBefore >= 0) {
+    std::cout << ", " << (double) (syscallsAfter - syscallsBefore) / (double) kRequests << " write syscalls per request";
+  }
+
+  std::cout << std::endl;
+}
+
+TEST(Ping, BenchmarkWriteCoalescing) {
+  pipelinedPings(std::move(Options().withWriteCoalescingStrategy(WriteCoalescingStrategy::Disabled())),
+    "Without write coalescing");
+  pipelinedPings(std::move(Options().withWriteCoalescingStrategy(WriteCoalescingStrategy::Default())),
+    "With write coalescing");
+}
+
+//------------------------------------------------------------------------------
+// Number of threads in this process, as reported by the kernel.
+//------------------------------------------------------------------------------
+static int64_t countThreads() {
+  std::ifstream in("/proc/self/status");
+  std::string line;
+
+  while(std::getline(in, line)) {
+    if(line.compare(0, 8, "Threads:") == 0) {
+      return std::stoll(line.substr(8));
+    }
+  }
+
+  return -1;
+}
+
+//------------------------------------------------------------------------------
+// CPU time consumed by this process so far, user plus system.
+//------------------------------------------------------------------------------
+static std::chrono::microseconds cpuTime() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+TEST(Ping, EventLoopGroup) {
+  std::shared_ptr<EventLoopGroup> group = std::make_shared<EventLoopGroup>(2);
+  std::vector<std::unique_ptr<QClient>> clients;
+
+  for(size_t i = 0; i < 10; i++) {
+    Options opts;
+    opts.withEventLoopGroup(group);
+    clients.emplace_back(new QClient(testconfig.host, testconfig.port, std::move(opts)));
+  }
+
+  constexpr size_t kRequests = 10000;
+  std::vector<std::vector<std::future<redisReplyPtr>>> responses(clients.size());
+
+  for(size_t i = 0; i < kRequests; i++) {
+    for(size_t c = 0; c < clients.size(); c++) {
+      responses[c].push_back(clients[c]->exec("PING", SSTR("client #" << c << ", ping #" << i)));
+    }
+  }
+
+  for(size_t c = 0; c < clients.size(); c++) {
+    for(size_t i = 0; i < kRequests; i++) {
+      redisReplyPtr reply = responses[c][i].get();
+      ASSERT_TRUE(reply != nullptr);
+      ASSERT_EQ(std::string(reply->str, reply->len), SSTR("client #" << c << ", ping #" << i));
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// A client whose hostname is slow to resolve, or never does, mustn't hold up
+// the connected ones pinned to the same loop thread.
+//------------------------------------------------------------------------------
+TEST(Ping, EventLoopGroupUnresolvableHost) {
+  std::shared_ptr<EventLoopGroup> group = std::make_shared<EventLoopGroup>(1);
+
+  Options opts;
+  opts.withEventLoopGroup(group);
+  QClient qcl(testconfig.host, testconfig.port, std::move(opts));
+  ASSERT_TRUE(qcl.exec("PING", "warmup").get() != nullptr);
+
+  Options unresolvableOpts;
+  unresolvableOpts.withEventLoopGroup(group);
+  QClient unresolvable("qclient-test-unresolvable.invalid", testconfig.port, std::move(unresolvableOpts));
+
+  for(size_t i = 0; i < 100; i++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    redisReplyPtr reply = qcl.exec("PING", SSTR("ping #" << i)).get();
+
+    ASSERT_TRUE(reply != nullptr);
+    ASSERT_EQ(std::string(reply->str, reply->len), SSTR("ping #" << i));
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+  }
+}
+
+static void manyClients(bool shared, const std::string &name) {
+  constexpr size_t kClients = 500;
+  int64_t threadsBefore = countThreads();
+
+  std::shared_ptr<EventLoopGroup> group;
+  std::shared_ptr<Executor> executor;
+
+  if(shared) {
+    group = std::make_shared<EventLoopGroup>(2);
+    executor = std::make_shared<WorkStealingExecutor>(2);
+  }
+
+  std::vector<std::unique_ptr<QClient>> clients;
+  for(size_t i = 0; i < kClients; i++) {
+    Options opts;
+    if(group) opts.withEventLoopGroup(group);
+    if(executor) opts.withCallbackExecutor(executor);
+    clients.emplace_back(new QClient(testconfig.host, testconfig.port, std::move(opts)));
+  }
+
+  for(size_t i = 0; i < kClients; i++) {
+    ASSERT_TRUE(clients[i]->exec("PING", "warmup").get() != nullptr);
+  }
+
+  int64_t threads = countThreads() - threadsBefore;
+
+  // Idle for a while
+  std::chrono::microseconds idleStart = cpuTime();
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  std::chrono::microseconds idleCpu = cpuTime() - idleStart;
+
+  // A few requests on each
+  std::chrono::microseconds busyStart = cpuTime();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for(size_t round = 0; round < 20; round++) {
+    std::vector<std::future<redisReplyPtr>> responses;
+    for(size_t i = 0; i < kClients; i++) {
+      responses.push_back(clients[i]->exec("PING", "hi"));
+    }
+
+    for(size_t i = 0; i < kClients; i++) {
+      ASSERT_TRUE(responses[i].get() != nullptr);
+    }
+  }
+
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  std::chrono::microseconds busyCpu = cpuTime() - busyStart;
+
+  std::cout << name << ": " << threads << " threads for " << kClients << " clients, "
+  << idleCpu.count() / 2000 << " ms CPU per second while idle, "
+  << busyCpu.count() / 1000 << " ms CPU for " << 20 * kClients << " pings over "
+  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+}
+
+TEST(Ping, BenchmarkManyClients) {
+  manyClients(false, "Dedicated threads");
+  manyClients(true, "EventLoopGroup(2) + WorkStealingExecutor(2)");
+}
+
+static void syncPings(Options &&opts, const std::string &name) {
+  int64_t threadsBefore = countThreads();
+  QClient cl{testconfig.host, testconfig.port, std::move(opts) };
+  ASSERT_TRUE(cl.exec("PING", "warmup").get() != nullptr);
+  int64_t threads = countThreads() - threadsBefore;
+
+  constexpr size_t kRequests = 20000;
+  std::chrono::microseconds cpuStart = cpuTime();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for(size_t i = 0; i < kRequests; i++) {
+    redisReplyPtr reply = cl.exec("PING", SSTR("ping #" << i)).get();
+    ASSERT_TRUE(reply != nullptr);
+    ASSERT_EQ(std::string(reply->str, reply->len), SSTR("ping #" << i));
+  }
+
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  std::chrono::microseconds cpu = cpuTime() - cpuStart;
+
+  std::cout << name << ": " << threads << " threads, "
+  << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / kRequests
+  << " us per synchronous ping, " << cpu.count() / kRequests << " us CPU" << std::endl;
+}
+
+TEST(Ping, BenchmarkSingleThreadedConnection) {
+  syncPings(Options(), "Reader and writer threads");
+  syncPings(std::move(Options().withSingleThreadedConnection()), "Single-threaded connection");
+  syncPings(std::move(Options().withSingleThreadedConnection().withInlineCallbacks()),
+    "Single-threaded connection, inline callbacks");
+}
+
+//------------------------------------------------------------------------------
+// Number of times any thread in this process has been scheduled off a CPU,
+// voluntarily or not, as reported by the kernel.
+//------------------------------------------------------------------------------
+static int64_t countContextSwitches() {
+  int64_t total = 0;
+
+  DIR *dir = opendir("/proc/self/task");
+  if(!dir) return -1;
+
+  while(struct dirent *entry = readdir(dir)) {
+    if(entry->d_name[0] == '.') continue;
+
+    std::ifstream in(SSTR("/proc/self/task/" << entry->d_name << "/status"));
+    std::string line;
+
+    while(std::getline(in, line)) {
+      size_t colon = line.find(':');
+      if(colon == std::string::npos) continue;
+
+      std::string key = line.substr(0, colon);
+      if(key == "voluntary_ctxt_switches" || key == "nonvoluntary_ctxt_switches") {
+        total += std::stoll(line.substr(colon + 1));
+      }
+    }
+  }
+
+  closedir(dir);
+  return total;
+}
+
+static void idleWakeups(Options &&opts, const std::string &name) {
+  QClient cl{testconfig.host, testconfig.port, std::move(opts) };
+  ASSERT_TRUE(cl.exec("PING", "warmup").get() != nullptr);
+
+  // Let everything settle down first.
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  int64_t before = countContextSwitches();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  int64_t wakeups = countContextSwitches() - before;
+
+  std::cout << name << ": " << wakeups << " wakeups during one idle second" << std::endl;
+
+  // Sleeping itself takes one.
+  ASSERT_LE(wakeups, 3);
+  ASSERT_TRUE(cl.exec("PING", "still alive").get() != nullptr);
+}
+
+TEST(Ping, IdleWakeups) {
+  idleWakeups(Options(), "Reader and writer threads");
+  idleWakeups(std::move(Options().withIoUringTransport()), "io_uring transport");
+  idleWakeups(std::move(Options().withSingleThreadedConnection()), "Single-threaded connection");
+}
+
+TEST(Ping, IoUringTransport) {
+  QClient cl{testconfig.host, testconfig.port, std::move(Options().withIoUringTransport()) };
+
+  // Large enough to span several receive buffers, and to run out of them
+  // while replies are waiting to be consumed.
+  std::string payload(1024 * 1024, 'x');
+  for(size_t i = 0; i < payload.size(); i += 7) {
+    payload[i] = 'a' + (i % 26);
+  }
+
+  std::vector<std::future<redisReplyPtr>> responses;
+  for(size_t i = 0; i < 8; i++) {
+    responses.push_back(cl.exec("PING", payload));
+    responses.push_back(cl.exec("PING", SSTR("ping #" << i)));
+  }
+
+  for(size_t i = 0; i < 8; i++) {
+    redisReplyPtr reply = responses[2*i].get();
+    ASSERT_TRUE(reply != nullptr);
+    ASSERT_EQ(std::string(reply->str, reply->len), payload);
+
+    reply = responses[2*i + 1].get();
+    ASSERT_TRUE(reply != nullptr);
+    ASSERT_EQ(std::string(reply->str, reply->len), SSTR("ping #" << i));
+  }
+}
+
+TEST(Ping, BenchmarkIoUringTransport) {
+  syncPings(Options(), "poll() transport");
+  syncPings(std::move(Options().withIoUringTransport()), "io_uring transport");
+  pipelinedPings(Options(), "poll() transport");
+  pipelinedPings(std::move(Options().withIoUringTransport()), "io_uring transport");
+}
@@ -0,0 +1,220 @@
+//------------------------------------------------------------------------------
+// File: pool.cc
+// Author: Georgios Bitzes - CERN
+//------------------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include <gtest/gtest.h>
+#include "test-config.hh"
+#include "qclient/QClientPool.hh"
+#include <mutex>
+#include <thread>
+
+using namespace qclient;
+#define SSTR(message) static_cast<std::ostringstream&>(std::ostringstream().flush() << message).str()
+
+static Options poolOptions() {
+  Options opts;
+  opts.tlsconfig = testconfig.tlsconfig;
+  return opts;
+}
+
+static void clearKeys(QClientPool &pool, size_t keys) {
+  for(size_t i = 0; i < keys; i++) {
+    ASSERT_TRUE(pool.exec("DEL", SSTR("qclient_test:pool_" << i)).get() != nullptr);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Every routing policy delivers every reply
+//------------------------------------------------------------------------------
+TEST(QClientPool, Routing) {
+  for(PoolRouting routing : {PoolRouting::kRoundRobin, PoolRouting::kLeastOutstanding, PoolRouting::kKeyHash}) {
+    QClientPool pool(testconfig.host, testconfig.port, 4, poolOptions(), routing);
+    ASSERT_EQ(pool.size(), 4u);
+    ASSERT_TRUE(pool.checkConnection(std::chrono::seconds(5)).ok());
+
+    std::vector<std::future<redisReplyPtr>> futs;
+    for(size_t i = 0; i < 1000; i++) {
+      futs.emplace_back(pool.exec("PING", SSTR("ping-" << i)));
+    }
+
+    for(size_t i = 0; i < futs.size(); i++) {
+      redisReplyPtr reply = futs[i].get();
+      ASSERT_TRUE(reply != nullptr);
+      ASSERT_EQ(std::string(reply->str, reply->len), SSTR("ping-" << i));
+    }
+
+    ASSERT_EQ(pool.pooledExec("PING", "pooled").get()->type, REDIS_REPLY_STRING);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Requests on the same key execute in order, even when pipelined over many
+// connections
+//------------------------------------------------------------------------------
+TEST(QClientPool, KeyHashOrdering) {
+  QClientPool pool(testconfig.host, testconfig.port, 4, poolOptions(), PoolRouting::kKeyHash);
+  clearKeys(pool, 16);
+
+  std::vector<std::future<redisReplyPtr>> futs;
+  for(size_t i = 0; i < 4000; i++) {
+    futs.emplace_back(pool.exec("INCR", SSTR("qclient_test:pool_" << i % 16)));
+  }
+
+  for(size_t i = 0; i < futs.size(); i++) {
+    redisReplyPtr reply = futs[i].get();
+    ASSERT_TRUE(reply != nullptr);
+    ASSERT_EQ(reply->type, REDIS_REPLY_INTEGER);
+    ASSERT_EQ(reply->integer, (long long) (i / 16 + 1));
+  }
+
+  clearKeys(pool, 16);
+}
+
+//------------------------------------------------------------------------------
+// A batch spanning several connections still gets its replies in order
+//------------------------------------------------------------------------------
+class OrderedReplies : public QCallback {
+public:
+  virtual void handleResponse(redisReplyPtr &&reply) override {
+    std::lock_guard<std::mutex> lock(mtx);
+    replies.emplace_back(std::move(reply));
+    if(replies.size() == expected) {
+      promise.set_value();
+    }
+  }
+
+  size_t expected = 0;
+  std::promise<void> promise;
+  std::mutex mtx;
+  std::vector<redisReplyPtr> replies;
+};
+
+TEST(QClientPool, KeyHashBatch) {
+  QClientPool pool(testconfig.host, testconfig.port, 4, poolOptions(), PoolRouting::kKeyHash);
+  clearKeys(pool, 16);
+
+  std::vector<EncodedRequest> batch;
+  for(size_t i = 0; i < 64; i++) {
+    batch.emplace_back(EncodedRequest::make("INCR", SSTR("qclient_test:pool_" << i % 16)));
+  }
+
+  std::vector<redisReplyPtr> replies = pool.executeBatch(std::move(batch)).get();
+  ASSERT_EQ(replies.size(), 64u);
+
+  for(size_t i = 0; i < replies.size(); i++) {
+    ASSERT_TRUE(replies[i] != nullptr);
+    ASSERT_EQ(replies[i]->integer, (long long) (i / 16 + 1));
+  }
+
+  OrderedReplies cb;
+  cb.expected = 64;
+
+  batch.clear();
+  for(size_t i = 0; i < 64; i++) {
+    batch.emplace_back(EncodedRequest::make("INCR", SSTR("qclient_test:pool_" << i % 16)));
+  }
+
+  pool.executeBatch(&cb, std::move(batch));
+  cb.promise.get_future().get();
+
+  for(size_t i = 0; i < cb.replies.size(); i++) {
+    ASSERT_TRUE(cb.replies[i] != nullptr);
+    ASSERT_EQ(cb.replies[i]->integer, (long long) (i / 16 + 5));
+  }
+
+  clearKeys(pool, 16);
+}
+
+//------------------------------------------------------------------------------
+// A callback shared by many requests, without any locking of its own:
+// Expects its replies in order, one at a time.
+//------------------------------------------------------------------------------
+class SharedCallback : public QCallback {
+public:
+  virtual void handleResponse(redisReplyPtr &&reply) override {
+    if(inside.exchange(true)) {
+      overlapped = true;
+    }
+
+    replies.emplace_back(std::move(reply));
+    std::this_thread::sleep_for(std::chrono::microseconds(10));
+    inside = false;
+
+    if(replies.size() == expected) {
+      promise.set_value();
+    }
+  }
+
+  size_t expected = 0;
+  std::atomic<bool> inside {false};
+  std::atomic<bool> overlapped {false};
+  std::promise<void> promise;
+  std::vector<redisReplyPtr> replies;
+};
+
+TEST(QClientPool, SharedCallback) {
+  for(PoolRouting routing : {PoolRouting::kRoundRobin, PoolRouting::kLeastOutstanding}) {
+    QClientPool pool(testconfig.host, testconfig.port, 4, poolOptions(), routing);
+
+    SharedCallback cb;
+    cb.expected = 1000;
+
+    for(size_t i = 0; i < cb.expected; i++) {
+      pool.execCB(&cb, "PING", SSTR("ping-" << i));
+    }
+
+    cb.promise.get_future().get();
+    ASSERT_FALSE(cb.overlapped);
+
+    for(size_t i = 0; i < cb.replies.size(); i++) {
+      ASSERT_TRUE(cb.replies[i] != nullptr);
+      ASSERT_EQ(std::string(cb.replies[i]->str, cb.replies[i]->len), SSTR("ping-" << i));
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// MULTI blocks stay on a single connection
+//------------------------------------------------------------------------------
+TEST(QClientPool, Multi) {
+  QClientPool pool(testconfig.host, testconfig.port, 4, poolOptions());
+  clearKeys(pool, 1);
+
+  std::vector<std::future<redisReplyPtr>> futs;
+  for(size_t i = 0; i < 100; i++) {
+    std::deque<EncodedRequest> block;
+    block.emplace_back(EncodedRequest::make("INCR", "qclient_test:pool_0"));
+    block.emplace_back(EncodedRequest::make("PING", SSTR("multi-" << i)));
+    futs.emplace_back(pool.execute(std::move(block)));
+  }
+
+  for(size_t i = 0; i < futs.size(); i++) {
+    redisReplyPtr reply = futs[i].get();
+    ASSERT_TRUE(reply != nullptr);
+    ASSERT_EQ(reply->type, REDIS_REPLY_ARRAY);
+    ASSERT_EQ(reply->elements, 2u);
+    ASSERT_EQ(reply->element[0]->type, REDIS_REPLY_INTEGER);
+    ASSERT_EQ(std::string(reply->element[1]->str, reply->element[1]->len), SSTR("multi-" << i));
+  }
+
+  clearKeys(pool, 1);
+}
@@ -24,6 +24,7 @@
 #include "EndpointDecider.hh"
 #include "qclient/GlobalInterceptor.hh"
 #include "qclient/EncodedRequest.hh"
+#include "qclient/PreparedCommand.hh"
 #include "qclient/ResponseBuilder.hh"
 #include "qclient/MultiBuilder.hh"
 #include "qclient/Handshake.hh"
@@ -31,7 +32,11 @@
 #include "qclient/pubsub/MessageQueue.hh"
 #include "qclient/Status.hh"
 #include "qclient/QuarkDBVersion.hh"
+#include "qclient/QClientPool.hh"
+#include "qclient/CommandClassification.hh"
+#include "qclient/Semaphore.hh"
 #include "ConnectionCore.hh"
+#include "WriteBatch.hh"
 #include "ReplyMacros.hh"
 
 #include "gtest/gtest.h"
@@ -86,6 +91,346 @@ TEST(EncodedRequest, FusedEncodedRequest) {
   ASSERT_EQ("*2\r\n$4\r\nping\r\n$3\r\n124\r\n*2\r\n$4\r\nping\r\n$4\r\n4321\r\n*3\r\n$3\r\nset\r\n$3\r\nabc\r\n$4\r\n1234\r\n", std::string(fused.getBuffer(), fused.getLen()));
 }
 
+class CountingAllocator : public RequestBufferAllocator {
+public:
+  char* allocate(size_t size) override {
+    allocations++;
+    return MallocBufferAllocator::instance()->allocate(size);
+  }
+
+  void deallocate(char* buffer, size_t size) override {
+    deallocations++;
+    MallocBufferAllocator::instance()->deallocate(buffer, size);
+  }
+
+  size_t allocations = 0;
+  size_t deallocations = 0;
+};
+
+TEST(EncodedRequest, InlineStorage) {
+  CountingAllocator allocator;
+  RequestBufferAllocator::setDefault(&allocator);
+
+  {
+    EncodedRequest small = EncodedRequest::make("set", "abc", "1234");
+    ASSERT_TRUE(small.isInline());
+
+    // Moving an inline request copies the contents over
+    EncodedRequest moved(std::move(small));
+    ASSERT_TRUE(moved.isInline());
+    ASSERT_EQ("*3\r\n$3\r\nset\r\n$3\r\nabc\r\n$4\r\n1234\r\n", std::string(moved.getBuffer(), moved.getLen()));
+    ASSERT_EQ(small.getBuffer(), nullptr);
+    ASSERT_EQ(small.getLen(), 0u);
+
+    std::string payload(EncodedRequest::kInlineCapacity, 'a');
+    EncodedRequest large = EncodedRequest::make("set", "abc", payload);
+    ASSERT_FALSE(large.isInline());
+    ASSERT_EQ(allocator.allocations, 1u);
+
+    // Moving a heap request transfers the buffer
+    const char *buff = large.getBuffer();
+    moved = std::move(large);
+    ASSERT_FALSE(moved.isInline());
+    ASSERT_EQ(moved.getBuffer(), buff);
+    ASSERT_EQ("*3\r\n$3\r\nset\r\n$3\r\nabc\r\n$128\r\n" + payload + "\r\n", std::string(moved.getBuffer(), moved.getLen()));
+    ASSERT_EQ(allocator.deallocations, 0u);
+  }
+
+  ASSERT_EQ(allocator.allocations, 1u);
+  ASSERT_EQ(allocator.deallocations, 1u);
+  RequestBufferAllocator::setDefault(nullptr);
+}
+
+TEST(EncodedRequest, PooledBufferAllocator) {
+  PooledBufferAllocator pool(4096);
+
+  char *buff1 = pool.allocate(300);
+  char *buff2 = pool.allocate(400);
+  ASSERT_EQ(pool.getCachedBuffers(), 0u);
+
+  pool.deallocate(buff1, 300);
+  ASSERT_EQ(pool.getCachedBuffers(), 1u);
+
+  // Same size class, the buffer is recycled
+  ASSERT_EQ(pool.allocate(500), buff1);
+  ASSERT_EQ(pool.getCachedBuffers(), 0u);
+
+  pool.deallocate(buff1, 500);
+  pool.deallocate(buff2, 400);
+  ASSERT_EQ(pool.getCachedBuffers(), 2u);
+
+  // Size class is larger than the cache limit - not pooled
+  pool.deallocate(pool.allocate(8000), 8000);
+  ASSERT_EQ(pool.getCachedBuffers(), 2u);
+
+  // Too large for any size class
+  pool.deallocate(pool.allocate(4 * 1024 * 1024), 4 * 1024 * 1024);
+  ASSERT_EQ(pool.getCachedBuffers(), 2u);
+}
+
+TEST(EncodedRequest, ZeroCopy) {
+  RequestPayload small = std::make_shared<const std::string>("small");
+  RequestPayload large = std::make_shared<const std::string>(EncodedRequest::kZeroCopyThreshold, 'x');
+
+  // Small payloads are copied anyway
+  EncodedRequest copied = EncodedRequest::makeZeroCopy("set", "abc", small);
+  ASSERT_TRUE(copied.isContiguous());
+  ASSERT_EQ(copied.getSegmentCount(), 1u);
+  ASSERT_EQ(copied, EncodedRequest::make("set", "abc", "small"));
+  ASSERT_EQ(small.use_count(), 1);
+
+  {
+    EncodedRequest req = EncodedRequest::makeZeroCopy("hset", "key", large, "field");
+    ASSERT_FALSE(req.isContiguous());
+    ASSERT_EQ(req.getSegmentCount(), 3u);
+    ASSERT_EQ(req.getSegmentData(1), large->data());
+    ASSERT_EQ(req.getSegmentLength(1), large->size());
+    ASSERT_EQ(std::string(req.getSegmentData(0), req.getSegmentLength(0)), "*4\r\n$4\r\nhset\r\n$3\r\nkey\r\n$4096\r\n");
+    ASSERT_EQ(std::string(req.getSegmentData(2), req.getSegmentLength(2)), "\r\n$5\r\nfield\r\n");
+    ASSERT_EQ(req, EncodedRequest::make("hset", "key", *large, "field"));
+    ASSERT_EQ(large.use_count(), 2);
+
+    // Moving keeps the segments intact, even though the headers are inline
+    EncodedRequest moved(std::move(req));
+    ASSERT_EQ(moved.getSegmentData(1), large->data());
+    ASSERT_EQ(moved, EncodedRequest::make("hset", "key", *large, "field"));
+
+    // Fusing references the payload, instead of copying it
+    std::deque<EncodedRequest> block;
+    block.emplace_back(EncodedRequest::make("ping", "1"));
+    block.emplace_back(std::move(moved));
+    block.emplace_back(EncodedRequest::makeZeroCopy("set", large, large));
+
+    EncodedRequest fused = EncodedRequest::fuseIntoBlock(block);
+    block.clear();
+    ASSERT_EQ(large.use_count(), 2);
+    ASSERT_EQ(fused.getSegmentCount(), 7u);
+    ASSERT_EQ(fused.getSegmentData(1), large->data());
+    ASSERT_EQ(fused.getSegmentData(3), large->data());
+    ASSERT_EQ(fused.getSegmentData(5), large->data());
+    ASSERT_EQ(fused.toString(), EncodedRequest::make("ping", "1").toString() +
+      EncodedRequest::make("hset", "key", *large, "field").toString() +
+      EncodedRequest::make("set", *large, *large).toString());
+  }
+
+  ASSERT_EQ(large.use_count(), 1);
+}
+
+TEST(QClientPool, HashKey) {
+  uint64_t hash1, hash2;
+
+  ASSERT_TRUE(QClientPool::hashKey(EncodedRequest::make("get", "abc"), hash1));
+  ASSERT_TRUE(QClientPool::hashKey(EncodedRequest::make("hset", "abc", "f", "v"), hash2));
+  ASSERT_EQ(hash1, hash2);
+
+  ASSERT_TRUE(QClientPool::hashKey(EncodedRequest::make("get", "abd"), hash2));
+  ASSERT_NE(hash1, hash2);
+
+  ASSERT_TRUE(QClientPool::hashKey(EncodedRequest::make("get", ""), hash1));
+  ASSERT_FALSE(QClientPool::hashKey(EncodedRequest::make("ping"), hash1));
+
+  // Key referenced by the request, spread over several segments
+  RequestPayload large = std::make_shared<const std::string>(EncodedRequest::kZeroCopyThreshold, 'x');
+  EncodedRequest req = EncodedRequest::makeZeroCopy("set", large, "value");
+  ASSERT_EQ(req.getSegmentCount(), 3u);
+
+  ASSERT_TRUE(QClientPool::hashKey(req, hash1));
+  ASSERT_TRUE(QClientPool::hashKey(EncodedRequest::make("get", *large), hash2));
+  ASSERT_EQ(hash1, hash2);
+
+  // Garbage in, no key out
+  ASSERT_FALSE(QClientPool::hashKey(EncodedRequest(strdup("+OK\r\n"), 5), hash1));
+  ASSERT_FALSE(QClientPool::hashKey(EncodedRequest(strdup("*2\r\n$3\r\nget\r\n$9\r\nabc"), 21), hash1));
+}
+
+TEST(Options, Clone) {
+  Options opts;
+  opts.withTransparentRedirects().withQueueSpinning(7);
+  opts.chainHandshake(std::unique_ptr<Handshake>(new AuthHandshake("pw")));
+  opts.logger = std::make_shared<StandardErrorLogger>();
+
+  Options copy = opts.clone();
+  ASSERT_TRUE(copy.transparentRedirects);
+  ASSERT_EQ(copy.queueSpinIterations, 7u);
+  ASSERT_EQ(copy.logger, opts.logger);
+  ASSERT_TRUE(copy.handshake != nullptr);
+  ASSERT_NE(copy.handshake.get(), opts.handshake.get());
+  ASSERT_EQ(copy.handshake->provideHandshake(), opts.handshake->provideHandshake());
+
+  ASSERT_TRUE(Options().clone().handshake == nullptr);
+  ASSERT_EQ(copy.readRouting, ReadRouting::kLeaderOnly);
+
+  opts.withFollowerReads();
+  ASSERT_EQ(opts.clone().readRouting, ReadRouting::kFollowers);
+}
+
+TEST(CommandClassification, Lookup) {
+  ASSERT_EQ(classifyCommand("GET"), CommandType::kRead);
+  ASSERT_EQ(classifyCommand("get"), CommandType::kRead);
+  ASSERT_EQ(classifyCommand("hGetAll"), CommandType::kRead);
+  ASSERT_EQ(classifyCommand("deque-len"), CommandType::kRead);
+  ASSERT_EQ(classifyCommand("APPEND"), CommandType::kWrite);
+  ASSERT_EQ(classifyCommand("zscore"), CommandType::kRead);
+  ASSERT_EQ(classifyCommand("set"), CommandType::kWrite);
+  ASSERT_EQ(classifyCommand("hincrbymulti"), CommandType::kWrite);
+
+  ASSERT_EQ(classifyCommand(""), CommandType::kUnknown);
+  ASSERT_EQ(classifyCommand("ge"), CommandType::kUnknown);
+  ASSERT_EQ(classifyCommand("gets"), CommandType::kUnknown);
+  ASSERT_EQ(classifyCommand("flushall"), CommandType::kUnknown);
+  ASSERT_EQ(classifyCommand("ZZZ"), CommandType::kUnknown);
+
+  for(const CommandClassification &entry : kCommandTable) {
+    ASSERT_EQ(classifyCommand(entry.name), entry.type);
+  }
+}
+
+TEST(EncodedRequest, RequireLeader) {
+  EncodedRequest req = EncodedRequest::make("get", "abc");
+  ASSERT_FALSE(req.requiresLeader());
+
+  req.requireLeader();
+  ASSERT_TRUE(req.requiresLeader());
+
+  EncodedRequest moved(std::move(req));
+  ASSERT_TRUE(moved.requiresLeader());
+  ASSERT_FALSE(req.requiresLeader());
+
+  req = std::move(moved);
+  ASSERT_TRUE(req.requiresLeader());
+  ASSERT_FALSE(moved.requiresLeader());
+}
+
+TEST(Handshake, ActivateStaleReads) {
+  ActivateStaleReadsHandshake strict;
+  ASSERT_EQ(strict.provideHandshake(), std::vector<std::string> {"ACTIVATE-STALE-READS"});
+  ASSERT_EQ(strict.validateResponse(ResponseBuilder::makeStatus("OK")), Handshake::Status::VALID_COMPLETE);
+  ASSERT_EQ(strict.validateResponse(ResponseBuilder::makeErr("ERR unknown command")), Handshake::Status::INVALID);
+
+  ActivateStaleReadsHandshake lenient(true);
+  ASSERT_EQ(lenient.validateResponse(ResponseBuilder::makeErr("ERR unknown command")), Handshake::Status::VALID_COMPLETE);
+  ASSERT_EQ(lenient.clone()->validateResponse(ResponseBuilder::makeInt(1)), Handshake::Status::VALID_COMPLETE);
+}
+
+TEST(PreparedCommand, BasicSanity) {
+  PreparedCommand hset({"HSET"}, 3);
+  ASSERT_EQ(hset.getFixedArgs(), 1u);
+  ASSERT_EQ(hset.getVariableArgs(), 3u);
+
+  std::string field = "f1";
+  ASSERT_EQ(hset.encode("key", field, std::string(200, 'v')),
+    EncodedRequest::make("HSET", "key", field, std::string(200, 'v')));
+
+  // Unexpected number of arguments: slower, but still correct
+  ASSERT_EQ(hset.encode("key", "f1", "v1", "f2", "v2"),
+    EncodedRequest::make("HSET", "key", "f1", "v1", "f2", "v2"));
+
+  PreparedCommand ping({"PING"}, 0);
+  ASSERT_EQ(ping.encode(), EncodedRequest::make("PING"));
+
+  PreparedCommand publish({"PUBLISH", "channel"}, 1);
+  ASSERT_EQ(publish.encode("payload"), EncodedRequest::make("PUBLISH", "channel", "payload"));
+}
+
+TEST(PreparedCommand, EncodingBenchmark) {
+  const size_t kRequests = 1000000;
+  const std::string key = "some-hash", field = "some-field", value = "some-value";
+  PreparedCommand hset({"HSET"}, 3);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  size_t totalMake = 0;
+  for(size_t i = 0; i < kRequests; i++) {
+    totalMake += EncodedRequest::make("HSET", key, field, value).getLen();
+  }
+
+  std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+  size_t totalPrepared = 0;
+  for(size_t i = 0; i < kRequests; i++) {
+    totalPrepared += hset.encode(key, field, value).getLen();
+  }
+
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  ASSERT_EQ(totalMake, totalPrepared);
+
+  std::cout << "EncodedRequest::make: " << std::chrono::duration_cast<std::chrono::nanoseconds>(middle - start).count() / kRequests
+            << " ns/request, PreparedCommand::encode: " << std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle).count() / kRequests
+            << " ns/request" << std::endl;
+}
+
+TEST(WriteBatch, PartialWrites) {
+  EncodedRequest req1 = EncodedRequest::make("ping", "123");
+  EncodedRequest req2 = EncodedRequest::make("set", "abc", "1234");
+  EncodedRequest req3 = EncodedRequest::make("get", "abc");
+
+  WriteBatch batch(16, 1024);
+  ASSERT_TRUE(batch.empty());
+
+  batch.add(req1.getBuffer(), req1.getLen());
+  batch.add(req2.getBuffer(), req2.getLen());
+  batch.add(req3.getBuffer(), req3.getLen());
+  ASSERT_FALSE(batch.full());
+  ASSERT_EQ(batch.getIovcnt(), 3);
+  ASSERT_EQ(batch.getPendingBytes(), req1.getLen() + req2.getLen() + req3.getLen());
+
+  std::string expected = std::string(req1.getBuffer(), req1.getLen()) +
+    std::string(req2.getBuffer(), req2.getLen()) + std::string(req3.getBuffer(), req3.getLen());
+
+  // Simulate a socket which accepts 5 bytes at a time
+  std::string written;
+  while(!batch.empty()) {
+    size_t remaining = 5;
+    const struct iovec *iov = batch.getIovec();
+
+    for(int i = 0; i < batch.getIovcnt() && remaining > 0; i++) {
+      size_t len = std::min(remaining, iov[i].iov_len);
+      written.append((const char*) iov[i].iov_base, len);
+      remaining -= len;
+    }
+
+    ASSERT_TRUE(batch.consume(5 - remaining));
+  }
+
+  ASSERT_EQ(written, expected);
+  ASSERT_EQ(batch.getPendingBytes(), 0u);
+  ASSERT_FALSE(batch.consume(1));
+}
+
+TEST(WriteBatch, Limits) {
+  EncodedRequest req = EncodedRequest::make("ping", "123");
+
+  WriteBatch batch(2, 1024);
+  batch.add(req.getBuffer(), req.getLen());
+  ASSERT_FALSE(batch.full());
+  batch.add(req.getBuffer(), req.getLen());
+  ASSERT_TRUE(batch.full());
+
+  ASSERT_TRUE(batch.consume(req.getLen()));
+  ASSERT_FALSE(batch.full());
+  ASSERT_EQ(batch.getIovcnt(), 1);
+
+  WriteBatch small(16, 10);
+  small.add(req.getBuffer(), req.getLen());
+  ASSERT_TRUE(small.full());
+}
+
+TEST(ConnectionCore, TryGetNextToWrite) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  ASSERT_EQ(core.tryGetNextToWrite(), nullptr);
+
+  std::future<redisReplyPtr> fut1 = core.stage(EncodedRequest::make("ping", "1"));
+  std::future<redisReplyPtr> fut2 = core.stage(EncodedRequest::make("ping", "2"));
+
+  StagedRequest *req1 = core.tryGetNextToWrite();
+  ASSERT_NE(req1, nullptr);
+  ASSERT_EQ(std::string(req1->getBuffer(), req1->getLen()), "*2\r\n$4\r\nping\r\n$1\r\n1\r\n");
+
+  StagedRequest *req2 = core.tryGetNextToWrite();
+  ASSERT_NE(req2, nullptr);
+  ASSERT_EQ(std::string(req2->getBuffer(), req2->getLen()), "*2\r\n$4\r\nping\r\n$1\r\n2\r\n");
+
+  ASSERT_EQ(core.tryGetNextToWrite(), nullptr);
+}
+
 TEST(ResponseBuilder, BasicSanity) {
   ResponseBuilder builder;
 
@@ -253,6 +598,308 @@ TEST(ConnectionCore, IgnoredResponsesWithReconnect) {
   ASSERT_REPLY(fut1, 3);
 }
 
+TEST(ConnectionCore, StageMulti) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+
+  std::deque<EncodedRequest> block;
+  block.emplace_back(EncodedRequest::make("set", "abc", "1"));
+  block.emplace_back(EncodedRequest::make("get", "abc"));
+  std::future<redisReplyPtr> fut1 = core.stageMulti(std::move(block));
+
+  // Each request is written separately, with nothing fused
+  StagedRequest *req = core.tryGetNextToWrite();
+  ASSERT_NE(req, nullptr);
+  ASSERT_EQ(req->getEncodedRequestCount(), 4u);
+  ASSERT_EQ(req->getEncodedRequest(0), EncodedRequest::make("MULTI"));
+  ASSERT_EQ(req->getEncodedRequest(1), EncodedRequest::make("set", "abc", "1"));
+  ASSERT_EQ(req->getEncodedRequest(2), EncodedRequest::make("get", "abc"));
+  ASSERT_EQ(req->getEncodedRequest(3), EncodedRequest::make("EXEC"));
+  ASSERT_EQ(req->getMultiSize(), 3u);
+  ASSERT_EQ(req->getLen(), EncodedRequest::make("MULTI").getLen() +
+    EncodedRequest::make("set", "abc", "1").getLen() +
+    EncodedRequest::make("get", "abc").getLen() + EncodedRequest::make("EXEC").getLen());
+
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeStatus("OK")));
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeStatus("QUEUED")));
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeStatus("QUEUED")));
+  ASSERT_EQ(fut1.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(7)));
+  ASSERT_REPLY(fut1, 7);
+}
+
+class ReplyCollector : public QCallback {
+public:
+  virtual void handleResponse(redisReplyPtr &&reply) override {
+    std::lock_guard<std::mutex> lock(mtx);
+    replies.emplace_back(std::move(reply));
+    cv.notify_all();
+  }
+
+  std::vector<redisReplyPtr> waitFor(size_t count) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait_for(lock, std::chrono::seconds(5), [&]() { return replies.size() >= count; });
+    return replies;
+  }
+
+private:
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<redisReplyPtr> replies;
+};
+
+static StagedRequest* waitForNextToWrite(ConnectionCore &core) {
+  StagedRequest *req = nullptr;
+  for(size_t attempt = 0; attempt < 500 && !(req = core.tryGetNextToWrite()); attempt++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  return req;
+}
+
+TEST(ConnectionCore, StageBatch) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::RateLimitPendingRequests(2), true);
+  ReplyCollector collector;
+
+  core.stage(&collector, EncodedRequest::make("ping", "1"));
+  ASSERT_NE(core.tryGetNextToWrite(), nullptr);
+
+  std::vector<EncodedRequest> batch;
+  batch.emplace_back(EncodedRequest::make("ping", "2"));
+  batch.emplace_back(EncodedRequest::make("ping", "3"));
+  batch.emplace_back(EncodedRequest::make("ping", "4"));
+
+  // The batch is larger than the backpressure limit, stageBatch has to block
+  // until earlier requests are acknowledged.
+  std::future<std::vector<redisReplyPtr>> futBatch = std::async(std::launch::async, [&]() {
+    return core.stageBatch(std::move(batch)).get();
+  });
+
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(1)));
+  ASSERT_REPLY(collector.waitFor(1)[0], 1);
+
+  for(int i = 2; i <= 4; i++) {
+    StagedRequest *req = waitForNextToWrite(core);
+    ASSERT_NE(req, nullptr);
+
+    EncodedRequest expected = EncodedRequest::make("ping", std::to_string(i));
+    ASSERT_EQ(std::string(req->getBuffer(), req->getLen()), std::string(expected.getBuffer(), expected.getLen()));
+    ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(i)));
+  }
+
+  std::vector<redisReplyPtr> replies = futBatch.get();
+  ASSERT_EQ(replies.size(), 3u);
+  ASSERT_REPLY(replies[0], 2);
+  ASSERT_REPLY(replies[1], 3);
+  ASSERT_REPLY(replies[2], 4);
+
+  ASSERT_TRUE(core.stageBatch(std::vector<EncodedRequest>()).get().empty());
+}
+
+TEST(ConnectionCore, StageBatchWithCallback) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  ReplyCollector collector;
+
+  std::vector<EncodedRequest> batch;
+  for(size_t i = 0; i < 100; i++) {
+    batch.emplace_back(EncodedRequest::make("ping", std::to_string(i)));
+  }
+
+  core.stageBatch(&collector, std::move(batch));
+
+  for(size_t i = 0; i < 100; i++) {
+    ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(i)));
+  }
+
+  std::vector<redisReplyPtr> replies = collector.waitFor(100);
+  ASSERT_EQ(replies.size(), 100u);
+
+  for(size_t i = 0; i < 100; i++) {
+    ASSERT_REPLY(replies[i], i);
+  }
+}
+
+TEST(ConnectionCore, ConcurrentBatchesAtLimit) {
+  // Every batch needs the entire backpressure limit - none may hold on to
+  // part of it while waiting for the rest.
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::RateLimitPendingRequests(100), true);
+
+  std::vector<std::future<std::vector<redisReplyPtr>>> futs;
+  for(size_t t = 0; t < 4; t++) {
+    futs.emplace_back(std::async(std::launch::async, [&core]() {
+      std::vector<EncodedRequest> batch;
+      for(size_t i = 0; i < 100; i++) {
+        batch.emplace_back(EncodedRequest::make("ping", std::to_string(i)));
+      }
+
+      return core.stageBatch(std::move(batch)).get();
+    }));
+  }
+
+  for(size_t i = 0; i < 400; i++) {
+    ASSERT_NE(waitForNextToWrite(core), nullptr);
+    ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(i % 100)));
+  }
+
+  for(size_t t = 0; t < futs.size(); t++) {
+    std::vector<redisReplyPtr> replies = futs[t].get();
+    ASSERT_EQ(replies.size(), 100u);
+
+    for(size_t i = 0; i < replies.size(); i++) {
+      ASSERT_REPLY(replies[i], i);
+    }
+  }
+}
+
+TEST(Semaphore, BulkDown) {
+  Semaphore sem(4);
+  sem.down(3);
+
+  // Only one slot left: The bulk reservation takes nothing until it can
+  // take everything.
+  std::future<void> bulk = std::async(std::launch::async, [&sem]() { sem.down(3); });
+  ASSERT_EQ(bulk.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+  ASSERT_EQ(sem.getValue(), 1);
+
+  // A single reservation queues up behind it.
+  std::future<void> single = std::async(std::launch::async, [&sem]() { sem.down(); });
+  ASSERT_EQ(single.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+
+  sem.up(2);
+  bulk.get();
+  ASSERT_EQ(single.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+
+  sem.up();
+  single.get();
+  ASSERT_EQ(sem.getValue(), 0);
+}
+
+class ChainingCallback : public QCallback {
+public:
+  ChainingCallback(ConnectionCore &c) : core(c) {}
+
+  virtual void handleResponse(redisReplyPtr &&reply) override {
+    threads.emplace_back(std::this_thread::get_id());
+    replies.emplace_back(std::move(reply));
+
+    // Staging from within an inline callback must not deadlock.
+    if(replies.size() == 1) {
+      followUp = core.stage(EncodedRequest::make("ping", "follow-up"));
+    }
+  }
+
+  ConnectionCore &core;
+  std::vector<std::thread::id> threads;
+  std::vector<redisReplyPtr> replies;
+  std::future<redisReplyPtr> followUp;
+};
+
+TEST(ConnectionCore, InlineCallbacks) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::RateLimitPendingRequests(1),
+                      true, nullptr, true, nullptr, true);
+  ChainingCallback callback(core);
+
+  core.stage(&callback, EncodedRequest::make("ping", "1"));
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(1)));
+
+  // Ran synchronously, on this very thread
+  ASSERT_EQ(callback.replies.size(), 1u);
+  ASSERT_REPLY(callback.replies[0], 1);
+  ASSERT_EQ(callback.threads[0], std::this_thread::get_id());
+
+  ASSERT_TRUE(callback.followUp.valid());
+  ASSERT_EQ(callback.followUp.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(2)));
+  ASSERT_REPLY(callback.followUp, 2);
+
+  // Discarded requests get nullptr, and may stage more requests too
+  core.stage(&callback, EncodedRequest::make("ping", "3"));
+  callback.replies.clear();
+  ASSERT_EQ(core.clearAllPending(), 0u);
+  ASSERT_EQ(callback.replies.size(), 1u);
+  ASSERT_EQ(callback.replies[0], nullptr);
+
+  ASSERT_EQ(callback.followUp.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+  ASSERT_EQ(core.clearAllPending(), 0u);
+  ASSERT_EQ(callback.followUp.get(), nullptr);
+}
+
+TEST(ConnectionCore, PooledFutures) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+
+  ReplyFuture fut1 = core.pooledStage(EncodedRequest::make("ping", "1"));
+  ReplyFuture fut2 = core.pooledStage(EncodedRequest::make("ping", "2"));
+  ReplyFuture fut3 = core.pooledStage(EncodedRequest::make("ping", "3"));
+  ASSERT_TRUE(fut1.valid());
+  ASSERT_EQ(fut1.wait_for(std::chrono::milliseconds(1)), std::future_status::timeout);
+
+  // Blocks until the reply arrives
+  std::thread waiter([&]() {
+    ASSERT_REPLY(fut1, 1);
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(1)));
+  waiter.join();
+  ASSERT_FALSE(fut1.valid());
+
+  // Nobody waits for the second one - its slot goes back once fulfilled
+  fut2 = ReplyFuture();
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(2)));
+
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeInt(3)));
+  ASSERT_EQ(fut3.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  ASSERT_TRUE(fut3.ready());
+  ASSERT_REPLY(fut3, 3);
+
+  // Slots are recycled, and discarded requests get nullptr
+  for(size_t i = 0; i < 10; i++) {
+    ReplyFuture fut = core.pooledStage(EncodedRequest::make("ping", "4"));
+    ASSERT_EQ(core.clearAllPending(), 0u);
+    ASSERT_EQ(fut.get(), nullptr);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Synchronous round-trips through a ConnectionCore, against a "server" thread
+// which replies to each request as soon as it's staged.
+//------------------------------------------------------------------------------
+template<typename Issue>
+static std::chrono::microseconds measureRoundTrips(size_t count, Issue issue) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+
+  std::thread server([&]() {
+    for(size_t i = 0; i < count; i++) {
+      if(!core.getNextToWrite()) return;
+      core.consumeResponse(ResponseBuilder::makeInt(i));
+    }
+  });
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < count; i++) {
+    redisReplyPtr reply = issue(core);
+    EXPECT_EQ(reply->integer, (long long) i);
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+  server.join();
+  return std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+}
+
+TEST(ConnectionCore, PooledFutureBenchmark) {
+  const size_t kCount = 20000;
+
+  std::chrono::microseconds stdFuture = measureRoundTrips(kCount, [](ConnectionCore &core) {
+    return core.stage(EncodedRequest::make("ping")).get();
+  });
+
+  std::chrono::microseconds pooled = measureRoundTrips(kCount, [](ConnectionCore &core) {
+    return core.pooledStage(EncodedRequest::make("ping")).get();
+  });
+
+  std::cout << "Synchronous round-trip - std::future: " << stdFuture.count() / (double) kCount
+            << " us, ReplyFuture: " << pooled.count() / (double) kCount << " us" << std::endl;
+}
+
 TEST(ConnectionCore, Unavailable) {
   ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
 
@@ -292,6 +939,32 @@ TEST(ConnectionCore, BadHandshakeResponse) {
   core.reconnection();
 }
 
+TEST(ConnectionCore, Hello3Handshake) {
+  Hello3Handshake handshake;
+  ConnectionCore core(nullptr, &handshake,
+    BackpressureStrategy::Default(), false);
+
+  ASSERT_FALSE(core.consumeResponse(ResponseBuilder::makeErr("ERR unknown command 'HELLO'")));
+  core.reconnection();
+
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::parseRedisEncodedString(
+    "%2\r\n$6\r\nserver\r\n$5\r\nredis\r\n$5\r\nproto\r\n:3\r\n")));
+
+  std::future<redisReplyPtr> fut = core.stage(EncodedRequest::make("hgetall", "key"));
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::parseRedisEncodedString(
+    "%1\r\n$1\r\na\r\n$1\r\nb\r\n")));
+
+  redisReplyPtr reply = fut.get();
+  ASSERT_EQ(reply->type, REDIS_REPLY_MAP);
+  ASSERT_EQ(reply->elements, 2u);
+
+  // Failure is tolerated, if asked to
+  Hello3Handshake tolerant(true);
+  ConnectionCore core2(nullptr, &tolerant,
+    BackpressureStrategy::Default(), false);
+  ASSERT_TRUE(core2.consumeResponse(ResponseBuilder::makeErr("ERR unknown command 'HELLO'")));
+}
+
 TEST(ConnectionCore, PubSubModeWithHandshakeNoRetries) {
   PingHandshake handshake("hi there");
 
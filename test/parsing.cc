@@ -23,7 +23,10 @@
 
 #include "qclient/ResponseParsing.hh"
 #include "qclient/ResponseBuilder.hh"
+#include "qclient/TypedDecoder.hh"
 #include <gtest/gtest.h>
+#include <chrono>
+#include <sstream>
 
 using namespace qclient;
 
@@ -132,6 +135,16 @@ TEST(ResponseParsing, HgetallDuplicate) {
   ASSERT_EQ(parser.err(), "Found duplicate key: '1'");
 }
 
+TEST(ResponseParsing, HgetallMap) {
+  HgetallParser parser(ResponseBuilder::parseRedisEncodedString("%2\r\n$1\r\n1\r\n$1\r\n2\r\n$1\r\n3\r\n$1\r\n4\r\n"));
+  ASSERT_TRUE(parser.ok());
+
+  std::map<std::string, std::string> val = parser.value();
+  ASSERT_EQ(val.size(), 2u);
+  ASSERT_EQ(val["1"], "2");
+  ASSERT_EQ(val["3"], "4");
+}
+
 TEST(ResponseParsing, Hgetall) {
   std::vector<std::string> vec = { "1", "2", "3", "4" };
 
@@ -144,3 +157,236 @@ TEST(ResponseParsing, Hgetall) {
   ASSERT_EQ(val["1"], "2");
   ASSERT_EQ(val["3"], "4");
 }
+
+namespace {
+
+//------------------------------------------------------------------------------
+// Decode the given redis-encoded reply into T - streamed, fed chunkSize bytes
+// at a time.
+//------------------------------------------------------------------------------
+template<typename T>
+TypedResponse<T> decodeStreamed(const std::string &encoded, size_t chunkSize) {
+  TypedDecoder<T> *decoder = new TypedDecoder<T>();
+  std::future<TypedResponse<T>> fut = decoder->getFuture();
+
+  ResponseBuilder builder;
+  redisReplyPtr reply;
+
+  for(size_t pos = 0; pos < encoded.size(); pos += chunkSize) {
+    builder.feed(encoded.c_str() + pos, std::min(chunkSize, encoded.size() - pos));
+
+    if(builder.pullStreaming(decoder, reply) == ResponseBuilder::Status::kOk) {
+      decoder->handleResponse(std::move(reply));
+      EXPECT_GE(pos + chunkSize, encoded.size());
+    }
+  }
+
+  return fut.get();
+}
+
+//------------------------------------------------------------------------------
+// Same, but from a fully built tree.
+//------------------------------------------------------------------------------
+template<typename T>
+TypedResponse<T> decodeWhole(const std::string &encoded) {
+  TypedDecoder<T> *decoder = new TypedDecoder<T>();
+  std::future<TypedResponse<T>> fut = decoder->getFuture();
+  decoder->handleResponse(ResponseBuilder::parseRedisEncodedString(encoded));
+  return fut.get();
+}
+
+//------------------------------------------------------------------------------
+// Both ways of decoding must agree on the outcome, for every chunk size.
+//------------------------------------------------------------------------------
+template<typename T>
+TypedResponse<T> decode(const std::string &encoded) {
+  TypedResponse<T> whole = decodeWhole<T>(encoded);
+
+  for(size_t chunkSize : {1u, 2u, 3u, 7u, 4096u}) {
+    TypedResponse<T> streamed = decodeStreamed<T>(encoded, chunkSize);
+    EXPECT_EQ(streamed.ok(), whole.ok());
+    EXPECT_EQ(streamed.err(), whole.err());
+    EXPECT_EQ(streamed.value(), whole.value());
+  }
+
+  return whole;
+}
+
+}
+
+TEST(TypedDecoder, String) {
+  TypedResponse<std::string> resp = decode<std::string>("$7\r\nturtles\r\n");
+  ASSERT_TRUE(resp.ok());
+  ASSERT_TRUE(resp.err().empty());
+  ASSERT_EQ(resp.value(), "turtles");
+
+  resp = decode<std::string>("$0\r\n\r\n");
+  ASSERT_TRUE(resp.ok());
+  ASSERT_EQ(resp.value(), "");
+}
+
+TEST(TypedDecoder, Integer) {
+  TypedResponse<int64_t> resp = decode<int64_t>(":-1337\r\n");
+  ASSERT_TRUE(resp.ok());
+  ASSERT_EQ(resp.value(), -1337);
+}
+
+TEST(TypedDecoder, Containers) {
+  std::string encoded = "*4\r\n$1\r\n1\r\n$1\r\n2\r\n$1\r\n3\r\n$1\r\n2\r\n";
+
+  TypedResponse<std::vector<std::string>> vec = decode<std::vector<std::string>>(encoded);
+  ASSERT_TRUE(vec.ok());
+  ASSERT_EQ(vec.value(), std::vector<std::string>({"1", "2", "3", "2"}));
+
+  TypedResponse<std::set<std::string>> set = decode<std::set<std::string>>(encoded);
+  ASSERT_TRUE(set.ok());
+  ASSERT_EQ(set.value(), std::set<std::string>({"1", "2", "3"}));
+
+  TypedResponse<std::unordered_map<std::string, std::string>> map =
+    decode<std::unordered_map<std::string, std::string>>(encoded);
+  ASSERT_TRUE(map.ok());
+  ASSERT_EQ(map.value().size(), 2u);
+  ASSERT_EQ(map.value()["1"], "2");
+  ASSERT_EQ(map.value()["3"], "2");
+
+  ASSERT_TRUE(decode<std::vector<std::string>>("*0\r\n").value().empty());
+  ASSERT_TRUE((decode<std::map<std::string, std::string>>("*0\r\n").ok()));
+}
+
+TEST(TypedDecoder, Resp3Aggregates) {
+  std::string map = "%2\r\n$1\r\na\r\n$1\r\nb\r\n$1\r\nc\r\n$1\r\nd\r\n";
+
+  HgetallParser parser(ResponseBuilder::parseRedisEncodedString(map));
+  ASSERT_TRUE(parser.ok());
+
+  TypedResponse<std::map<std::string, std::string>> resp =
+    decode<std::map<std::string, std::string>>(map);
+  ASSERT_TRUE(resp.ok());
+  ASSERT_EQ(resp.value(), parser.value());
+
+  TypedResponse<std::vector<std::string>> vec = decode<std::vector<std::string>>(map);
+  ASSERT_EQ(vec.value(), std::vector<std::string>({"a", "b", "c", "d"}));
+
+  TypedResponse<std::unordered_set<std::string>> set =
+    decode<std::unordered_set<std::string>>("~2\r\n$1\r\nx\r\n$1\r\ny\r\n");
+  ASSERT_TRUE(set.ok());
+  ASSERT_EQ(set.value(), std::unordered_set<std::string>({"x", "y"}));
+
+  // Errors are described with the original types
+  std::string nested = "%1\r\n$1\r\na\r\n~1\r\n,2.5\r\n";
+  TypedResponse<std::map<std::string, std::string>> err =
+    decode<std::map<std::string, std::string>>(nested);
+  ASSERT_FALSE(err.ok());
+  ASSERT_EQ(err.err(), HgetallParser(ResponseBuilder::parseRedisEncodedString(nested)).err());
+  ASSERT_EQ(err.err(), "Unexpected reply type for element #1: Unexpected reply type; was expecting STRING, received 1) (double) 2.5\n");
+
+  TypedResponse<std::string> str = decode<std::string>(nested);
+  ASSERT_EQ(str.err(), StringParser(ResponseBuilder::parseRedisEncodedString(nested)).err());
+}
+
+TEST(TypedDecoder, NullReply) {
+  TypedDecoder<std::string> *decoder = new TypedDecoder<std::string>();
+  std::future<TypedResponse<std::string>> fut = decoder->getFuture();
+  decoder->handleResponse(redisReplyPtr());
+
+  TypedResponse<std::string> resp = fut.get();
+  ASSERT_FALSE(resp.ok());
+  ASSERT_EQ(resp.err(), StringParser(nullptr).err());
+}
+
+TEST(TypedDecoder, ErrorsMatchParsers) {
+  std::vector<std::string> replies = {
+    ":13\r\n",
+    "+OK\r\n",
+    "-ERR something\r\n",
+    "$-1\r\n",
+    "$7\r\nturtles\r\n",
+    "*0\r\n",
+    "*3\r\n$1\r\n1\r\n$1\r\n2\r\n$1\r\n3\r\n",
+    "*2\r\n$1\r\na\r\n+3\r\n",
+    "*2\r\n:5\r\n$1\r\nb\r\n",
+    "*4\r\n$1\r\na\r\n$1\r\nb\r\n$1\r\nc\r\n*2\r\n$1\r\nx\r\n*1\r\n:3\r\n",
+    "*4\r\n$1\r\na\r\n*2\r\n$2\r\nxy\r\n$-1\r\n$1\r\nc\r\n$1\r\nd\r\n",
+    "*4\r\n$1\r\n1\r\n$1\r\n2\r\n$1\r\n1\r\n$1\r\n4\r\n",
+    "*2\r\n*1\r\n$3\r\nabc\r\n$1\r\nd\r\n",
+    "%1\r\n$1\r\na\r\n$1\r\nb\r\n",
+    "%1\r\n$1\r\na\r\n#t\r\n",
+    "*2\r\n=7\r\ntxt:abc\r\n(123\r\n",
+    "~1\r\n%1\r\n_\r\n$1\r\nx\r\n",
+    ",1.25\r\n",
+  };
+
+  for(const std::string &encoded : replies) {
+    redisReplyPtr reply = ResponseBuilder::parseRedisEncodedString(encoded);
+
+    StringParser stringParser(reply);
+    TypedResponse<std::string> str = decode<std::string>(encoded);
+    ASSERT_EQ(str.ok(), stringParser.ok()) << encoded;
+    ASSERT_EQ(str.err(), stringParser.err()) << encoded;
+
+    IntegerParser integerParser(reply);
+    TypedResponse<long long> integer = decode<long long>(encoded);
+    ASSERT_EQ(integer.ok(), integerParser.ok()) << encoded;
+    ASSERT_EQ(integer.err(), integerParser.err()) << encoded;
+
+    HgetallParser hgetallParser(reply);
+    TypedResponse<std::map<std::string, std::string>> map =
+      decode<std::map<std::string, std::string>>(encoded);
+    ASSERT_EQ(map.ok(), hgetallParser.ok()) << encoded;
+    ASSERT_EQ(map.err(), hgetallParser.err()) << encoded;
+
+    if(map.ok()) {
+      ASSERT_EQ(map.value(), hgetallParser.value());
+    }
+  }
+}
+
+TEST(TypedDecoder, Benchmark) {
+  const size_t kElements = 200000;
+
+  std::ostringstream ss;
+  ss << "*" << kElements * 2 << "\r\n";
+  for(size_t i = 0; i < kElements; i++) {
+    std::string field = "f" + std::to_string(i * 7919);
+    std::string value = "/eos/user/file-" + std::to_string(i);
+    ss << "$" << field.size() << "\r\n" << field << "\r\n";
+    ss << "$" << value.size() << "\r\n" << value << "\r\n";
+  }
+
+  std::string encoded = ss.str();
+
+  // Build the tree, then parse it
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  {
+    ResponseBuilder builder;
+    builder.feed(encoded);
+
+    redisReplyPtr reply;
+    ASSERT_EQ(builder.pull(reply), ResponseBuilder::Status::kOk);
+
+    HgetallParser parser(reply);
+    ASSERT_TRUE(parser.ok());
+    ASSERT_EQ(parser.value().size(), kElements);
+  }
+  std::chrono::steady_clock::time_point mid = std::chrono::steady_clock::now();
+
+  // Decode directly
+  {
+    TypedDecoder<std::map<std::string, std::string>> *decoder =
+      new TypedDecoder<std::map<std::string, std::string>>();
+    auto fut = decoder->getFuture();
+
+    ResponseBuilder builder;
+    builder.feed(encoded);
+
+    redisReplyPtr reply;
+    ASSERT_EQ(builder.pullStreaming(decoder, reply), ResponseBuilder::Status::kOk);
+    decoder->handleResponse(std::move(reply));
+    ASSERT_EQ(fut.get().value().size(), kElements);
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+  std::cout << "tree + HgetallParser: " << std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count()
+    << " us, TypedDecoder: " << std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count()
+    << " us" << std::endl;
+}
@@ -27,6 +27,12 @@
 #include "qclient/queueing/RingBuffer.hh"
 #include "qclient/queueing/LastNSet.hh"
 #include "qclient/queueing/LastNMap.hh"
+#include "qclient/queueing/WaitableQueue.hh"
+#include "qclient/queueing/LockFreeQueue.hh"
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <iostream>
 
 using namespace qclient;
 
@@ -105,6 +111,305 @@ TYPED_TEST(Thread_Safe_Queue, BasicSanity) {
   ASSERT_TRUE(this->queue.empty());
 }
 
+TYPED_TEST(Thread_Safe_Queue, EmplaceBatch) {
+  ASSERT_EQ(-1, this->queue.emplace_back_batch(0, [](Coord *mem, size_t i) {
+    new (mem) Coord(i, i);
+  }));
+
+  ASSERT_EQ(0, this->queue.emplace_back(-1, -1));
+  ASSERT_EQ(50, this->queue.emplace_back_batch(50, [](Coord *mem, size_t i) {
+    new (mem) Coord(i, i*2);
+  }));
+  ASSERT_EQ(this->queue.getNextSequenceNumber(), 51);
+  ASSERT_EQ(this->queue.size(), 51u);
+
+  auto it = this->queue.begin();
+  ASSERT_EQ(it.item().x, -1);
+  it.next();
+  this->queue.pop_front();
+
+  for(int i = 0; i < 50; i++) {
+    ASSERT_EQ(it.item().x, i);
+    ASSERT_EQ(it.item().y, i*2);
+    it.next();
+    ASSERT_EQ(i+1, this->queue.pop_front());
+  }
+
+  ASSERT_TRUE(this->queue.empty());
+}
+
+TYPED_TEST(Thread_Safe_Queue, PopBatch) {
+  for(int i = 0; i < 100; i++) {
+    ASSERT_EQ(i, this->queue.emplace_back(i, i*3));
+  }
+
+  auto it = this->queue.begin();
+  for(int i = 0; i < 40; i++) {
+    ASSERT_EQ(it.item().x, i);
+    it.next();
+  }
+
+  this->queue.pop_front_batch(40);
+  ASSERT_EQ(this->queue.size(), 60u);
+  ASSERT_EQ(this->queue.front().x, 40);
+
+  this->queue.pop_front_batch(0);
+  ASSERT_EQ(this->queue.size(), 60u);
+
+  for(int i = 40; i < 100; i++) {
+    ASSERT_EQ(it.item().y, i*3);
+    it.next();
+  }
+
+  this->queue.pop_front_batch(60);
+  ASSERT_TRUE(this->queue.empty());
+  ASSERT_EQ(100, this->queue.emplace_back(-1, -1));
+  ASSERT_EQ(100, this->queue.pop_front());
+}
+
+TEST(LockFreeQueue, BasicSanity) {
+  LockFreeQueue<Coord> queue;
+  ASSERT_EQ(queue.size(), 0u);
+  ASSERT_EQ(queue.getNextSequenceNumber(), 0);
+
+  auto it = queue.begin();
+  ASSERT_EQ(it.seq(), 0);
+  ASSERT_FALSE(it.itemHasArrived());
+
+  // The iterator sits past the end, and picks up the item once it arrives
+  queue.emplace_back(1, 2);
+  ASSERT_TRUE(it.itemHasArrived());
+  ASSERT_EQ(it.item().x, 1);
+  ASSERT_EQ(it.item().y, 2);
+  ASSERT_EQ(queue.front().x, 1);
+  it.next();
+  ASSERT_EQ(it.seq(), 1);
+  ASSERT_FALSE(it.itemHasArrived());
+
+  queue.emplace_back_batch(50, [](Coord *mem, size_t i) {
+    new (mem) Coord(i, i*2);
+  });
+
+  ASSERT_EQ(queue.size(), 51u);
+  ASSERT_EQ(queue.getNextSequenceNumber(), 51);
+  queue.pop_front();
+
+  for(int i = 0; i < 50; i++) {
+    ASSERT_TRUE(it.itemHasArrived());
+    ASSERT_EQ(it.item().x, i);
+    ASSERT_EQ(it.item().y, i*2);
+    ASSERT_EQ(it.seq(), i+1);
+    it.next();
+    queue.pop_front();
+  }
+
+  ASSERT_EQ(queue.size(), 0u);
+  ASSERT_FALSE(it.itemHasArrived());
+
+  // A fresh iterator starts at the front
+  queue.emplace_back(7, 7);
+  auto it2 = queue.begin();
+  ASSERT_EQ(it2.seq(), 51);
+  ASSERT_EQ(it2.item().x, 7);
+
+  queue.reset();
+  ASSERT_EQ(queue.size(), 0u);
+  ASSERT_EQ(queue.begin().seq(), 0);
+}
+
+TEST(LockFreeQueue, BlockingMode) {
+  LockFreeQueue<Coord> queue;
+  auto it = queue.begin();
+
+  std::thread producer([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.emplace_back(3, 4);
+  });
+
+  Coord *item = it.getItemBlockOrNull();
+  ASSERT_NE(item, nullptr);
+  ASSERT_EQ(item->x, 3);
+  it.next();
+  producer.join();
+
+  std::thread stopper([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.setBlockingMode(false);
+  });
+
+  ASSERT_EQ(it.getItemBlockOrNull(), nullptr);
+  stopper.join();
+}
+
+static Coord* spinForItem(LockFreeQueue<Coord>::Iterator &it) {
+  while(!it.itemHasArrived()) {
+    std::this_thread::yield();
+  }
+
+  return &it.item();
+}
+
+TEST(LockFreeQueue, NodeRecycling) {
+  // Items alternate between two queues, so nodes recycled by one get reused
+  // by the other. Every round has a fresh producer thread, which leaves its
+  // spare nodes behind on exit.
+  LockFreeQueue<Coord> queue1, queue2;
+  auto it1 = queue1.begin();
+  auto it2 = queue2.begin();
+
+  for(int round = 0; round < 5; round++) {
+    std::thread producer([&queue1, &queue2, round]() {
+      for(int i = 0; i < 10000; i++) {
+        while(queue1.size() + queue2.size() > 300) {
+          std::this_thread::yield();
+        }
+
+        queue1.emplace_back(round, i);
+        queue2.emplace_back_batch(2, [&](Coord *mem, size_t j) {
+          new (mem) Coord(round, 2*i + j);
+        });
+      }
+    });
+
+    for(int i = 0; i < 10000; i++) {
+      Coord *item = spinForItem(it1);
+      ASSERT_EQ(item->x, round);
+      ASSERT_EQ(item->y, i);
+      it1.next();
+      queue1.pop_front();
+
+      for(int j = 0; j < 2; j++) {
+        item = spinForItem(it2);
+        ASSERT_EQ(item->x, round);
+        ASSERT_EQ(item->y, 2*i + j);
+        it2.next();
+        queue2.pop_front();
+      }
+    }
+
+    producer.join();
+  }
+
+  ASSERT_EQ(queue1.size(), 0u);
+  ASSERT_EQ(queue2.size(), 0u);
+  ASSERT_EQ(queue1.getNextSequenceNumber(), 50000);
+  ASSERT_EQ(queue2.getNextSequenceNumber(), 100000);
+}
+
+TEST(WaitableQueue, MultipleProducers) {
+  WaitableQueue<Coord, 7> queue;
+  queue.setSpinIterations(100);
+  auto it = queue.begin();
+
+  std::vector<std::thread> producers;
+  for(int p = 0; p < 4; p++) {
+    producers.emplace_back([&queue, p]() {
+      for(int i = 0; i < 1000; i++) {
+        queue.emplace_back(p, i);
+      }
+    });
+  }
+
+  std::vector<int> lastSeen(4, -1);
+  for(size_t i = 0; i < 4000; i++) {
+    Coord *item = it.getItemBlockOrNull();
+    ASSERT_NE(item, nullptr);
+    ASSERT_EQ(lastSeen[item->x] + 1, item->y);
+    lastSeen[item->x] = item->y;
+    it.next();
+    queue.pop_front();
+  }
+
+  for(auto &producer : producers) {
+    producer.join();
+  }
+
+  ASSERT_EQ(queue.size(), 0u);
+
+  std::thread stopper([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.setBlockingMode(false);
+  });
+
+  ASSERT_EQ(it.getItemBlockOrNull(), nullptr);
+  stopper.join();
+}
+
+//------------------------------------------------------------------------------
+// Push items from the given number of producers, consume from a single
+// thread blocking whenever the queue is empty - returns items per second.
+// If maxPending is set, producers wait while the queue holds more items than
+// that, like they would under backpressure.
+//------------------------------------------------------------------------------
+template<typename Queue>
+double measureQueueThroughput(Queue &queue, size_t producers, size_t itemsPerProducer,
+  size_t maxPending = 0) {
+  std::vector<std::thread> threads;
+  auto it = queue.begin();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for(size_t p = 0; p < producers; p++) {
+    threads.emplace_back([&queue, p, itemsPerProducer, maxPending]() {
+      for(size_t i = 0; i < itemsPerProducer; i++) {
+        while(maxPending != 0 && queue.size() > maxPending) {
+          std::this_thread::yield();
+        }
+
+        queue.emplace_back(p, i);
+      }
+    });
+  }
+
+  std::vector<int> lastSeen(producers, -1);
+  size_t total = producers * itemsPerProducer;
+
+  for(size_t i = 0; i < total; i++) {
+    Coord *item = it.getItemBlockOrNull();
+    EXPECT_NE(item, nullptr);
+
+    // Items from the same producer arrive in order
+    EXPECT_EQ(lastSeen[item->x] + 1, item->y);
+    lastSeen[item->x] = item->y;
+
+    it.next();
+    queue.pop_front();
+  }
+
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+  for(size_t p = 0; p < producers; p++) {
+    threads[p].join();
+  }
+
+  return total / std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+}
+
+TEST(LockFreeQueue, ContentionBenchmark) {
+  const size_t totalItems = 256 * 1024;
+
+  for(size_t producers = 1; producers <= 64; producers *= 2) {
+    WaitableQueue<Coord, 5000> waitable;
+    double waitableRate = measureQueueThroughput(waitable, producers, totalItems / producers);
+
+    LockFreeQueue<Coord> lockFree;
+    double lockFreeRate = measureQueueThroughput(lockFree, producers, totalItems / producers);
+
+    LockFreeQueue<Coord> spinning;
+    spinning.setSpinIterations(1000);
+    double spinningRate = measureQueueThroughput(spinning, producers, totalItems / producers);
+
+    // With a bounded backlog, popped nodes get recycled
+    LockFreeQueue<Coord> bounded;
+    double boundedRate = measureQueueThroughput(bounded, producers, totalItems / producers, 1024);
+
+    std::cout << "Producers: " << producers << ", WaitableQueue: " << (size_t) waitableRate
+              << " items/sec, LockFreeQueue: " << (size_t) lockFreeRate << " items/sec"
+              << ", LockFreeQueue with spinning: " << (size_t) spinningRate << " items/sec"
+              << ", LockFreeQueue with at most 1024 pending: " << (size_t) boundedRate << " items/sec" << std::endl;
+  }
+}
+
 class Accumulator {
 public:
 
@@ -0,0 +1,378 @@
+// ----------------------------------------------------------------------
+// File: read-router.cc
+// Author: Georgios Bitzes - CERN
+// ----------------------------------------------------------------------
+
+/************************************************************************
+ * qclient - A simple redis C++ client with support for redirects       *
+ * Copyright (C) 2016 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#include "ReadRouter.hh"
+#include "ConnectionCore.hh"
+#include "StagedRequest.hh"
+#include "qclient/ResponseBuilder.hh"
+#include "ReplyMacros.hh"
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace qclient;
+
+//------------------------------------------------------------------------------
+// A follower on a local port, answering each command as the given script
+// says. Serves one connection at a time, on a thread of its own.
+//------------------------------------------------------------------------------
+class ScriptedServer {
+public:
+  struct Action {
+    std::string reply;
+    bool hangUp = false;
+  };
+
+  using Script = std::function<Action(const std::vector<std::string>&)>;
+
+  ScriptedServer(Script scr) : script(scr) {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+
+    struct sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    socklen_t len = sizeof(addr);
+    EXPECT_EQ(bind(listenFd, (struct sockaddr*) &addr, sizeof(addr)), 0);
+    EXPECT_EQ(listen(listenFd, 16), 0);
+    EXPECT_EQ(getsockname(listenFd, (struct sockaddr*) &addr, &len), 0);
+    port = ntohs(addr.sin_port);
+
+    thread = std::thread(&ScriptedServer::main, this);
+  }
+
+  ~ScriptedServer() {
+    stopping = true;
+    thread.join();
+    hangUp();
+    close(listenFd);
+  }
+
+  int getPort() const {
+    return port;
+  }
+
+  std::vector<std::string> getCommands() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return commands;
+  }
+
+private:
+  void hangUp() {
+    if(connFd >= 0) {
+      close(connFd);
+      connFd = -1;
+    }
+
+    builder.restart();
+  }
+
+  void main() {
+    while(!stopping) {
+      struct pollfd fds[2];
+      fds[0].fd = listenFd;
+      fds[0].events = POLLIN;
+      fds[1].fd = connFd;
+      fds[1].events = POLLIN;
+
+      if(poll(fds, connFd >= 0 ? 2 : 1, 10) <= 0) {
+        continue;
+      }
+
+      if(fds[0].revents & POLLIN) {
+        hangUp();
+        connFd = accept(listenFd, nullptr, nullptr);
+        continue;
+      }
+
+      char buffer[1024];
+      ssize_t bytes = recv(connFd, buffer, sizeof(buffer), 0);
+
+      if(bytes <= 0) {
+        hangUp();
+        continue;
+      }
+
+      builder.feed(buffer, bytes);
+
+      redisReplyPtr request;
+      while(connFd >= 0 && builder.pull(request) == ResponseBuilder::Status::kOk) {
+        std::vector<std::string> args;
+        for(size_t i = 0; i < request->elements; i++) {
+          args.emplace_back(request->element[i]->str, request->element[i]->len);
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          commands.emplace_back(args[0]);
+        }
+
+        Action action = script(args);
+        send(connFd, action.reply.c_str(), action.reply.size(), MSG_NOSIGNAL);
+
+        if(action.hangUp) {
+          hangUp();
+        }
+      }
+    }
+  }
+
+  Script script;
+  int listenFd = -1;
+  int connFd = -1;
+  int port = 0;
+  ResponseBuilder builder;
+  std::atomic<bool> stopping {false};
+  std::thread thread;
+
+  std::mutex mtx;
+  std::vector<std::string> commands;
+};
+
+//------------------------------------------------------------------------------
+// Accepts the stale reads handshake, answers reads with the given action.
+//------------------------------------------------------------------------------
+static ScriptedServer::Script follower(ScriptedServer::Action onRead) {
+  return [onRead](const std::vector<std::string> &args) {
+    if(args[0] == "ACTIVATE-STALE-READS") {
+      return ScriptedServer::Action { "+OK\r\n" };
+    }
+
+    return onRead;
+  };
+}
+
+//------------------------------------------------------------------------------
+// Wait for something to be staged on the leader core.
+//------------------------------------------------------------------------------
+static StagedRequest* waitForLeader(ConnectionCore &core) {
+  for(size_t i = 0; i < 1000; i++) {
+    StagedRequest *req = core.tryGetNextToWrite();
+    if(req) return req;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  return nullptr;
+}
+
+static std::string describeStaged(StagedRequest *req) {
+  return std::string(req->getBuffer(), req->getLen());
+}
+
+//------------------------------------------------------------------------------
+// Streams out whatever it receives, remembering what it saw.
+//------------------------------------------------------------------------------
+class RecordingStreamer : public QStreamingCallback {
+public:
+  virtual void handleArray(size_t depth, size_t elements) override {
+    events++;
+  }
+
+  virtual void handleStringChunk(size_t depth, const char *data, size_t len,
+    size_t offset, size_t total) override {
+    events++;
+  }
+
+  virtual void handleElement(size_t depth, redisReplyPtr &&reply) override {
+    events++;
+  }
+
+  virtual void handleResponse(redisReplyPtr &&reply) override {
+    promise.set_value(std::move(reply));
+  }
+
+  std::atomic<size_t> events {0};
+  std::promise<redisReplyPtr> promise;
+};
+
+TEST(ReadRouter, Eligible) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  ReadRouter router(core, Members("127.0.0.1", 1), Options());
+
+  ASSERT_TRUE(router.eligible(EncodedRequest::make("GET", "a")));
+  ASSERT_TRUE(router.eligible(EncodedRequest::make("hgetall", "a")));
+  ASSERT_FALSE(router.eligible(EncodedRequest::make("SET", "a", "b")));
+  ASSERT_FALSE(router.eligible(EncodedRequest::make("NOT-A-COMMAND", "a")));
+
+  EncodedRequest pinned = EncodedRequest::make("GET", "a");
+  pinned.requireLeader();
+  ASSERT_FALSE(router.eligible(pinned));
+
+  // Longer than any command name we know of
+  ASSERT_FALSE(router.eligible(EncodedRequest::make(std::string(33, 'G'), "a")));
+  ASSERT_FALSE(router.eligible(EncodedRequest::make(std::string(4096, 'G'), "a")));
+}
+
+TEST(ReadRouter, FailedOnFollower) {
+  ASSERT_TRUE(ReadRouter::failedOnFollower(nullptr));
+  ASSERT_TRUE(ReadRouter::failedOnFollower(ResponseBuilder::makeErr("MOVED 0 127.0.0.1:7777")));
+  ASSERT_TRUE(ReadRouter::failedOnFollower(ResponseBuilder::makeErr("ERR unavailable")));
+  ASSERT_TRUE(ReadRouter::failedOnFollower(ResponseBuilder::makeErr("UNAVAILABLE no leader")));
+
+  ASSERT_FALSE(ReadRouter::failedOnFollower(ResponseBuilder::makeErr("ERR wrong type")));
+  ASSERT_FALSE(ReadRouter::failedOnFollower(ResponseBuilder::makeErr("MOVE")));
+  ASSERT_FALSE(ReadRouter::failedOnFollower(ResponseBuilder::makeStr("MOVED 0 127.0.0.1:7777")));
+  ASSERT_FALSE(ReadRouter::failedOnFollower(ResponseBuilder::makeInt(3)));
+}
+
+TEST(ReadRouter, PickFollower) {
+  Members members;
+  members.push_back("127.0.0.1", 1);
+  members.push_back("127.0.0.1", 2);
+  members.push_back("127.0.0.1", 3);
+
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  ReadRouter router(core, members, Options());
+
+  // No leader yet - everyone takes their turn
+  std::set<size_t> picked;
+  for(size_t i = 0; i < 3; i++) {
+    picked.insert(router.pickFollower());
+  }
+  ASSERT_EQ(picked, std::set<size_t>({0, 1, 2}));
+
+  router.setLeader(Endpoint("127.0.0.1", 2));
+  picked.clear();
+
+  for(size_t i = 0; i < 6; i++) {
+    picked.insert(router.pickFollower());
+  }
+  ASSERT_EQ(picked, std::set<size_t>({0, 2}));
+
+  ASSERT_TRUE(router.fallbackToLeader(0));
+  for(size_t i = 0; i < 6; i++) {
+    ASSERT_EQ(router.pickFollower(), 2u);
+  }
+
+  ASSERT_TRUE(router.fallbackToLeader(2));
+  ASSERT_EQ(router.pickFollower(), ReadRouter::kNone);
+
+  // Leader moved to an endpoint outside of members
+  router.setLeader(Endpoint("127.0.0.1", 4));
+  ASSERT_EQ(router.pickFollower(), 1u);
+}
+
+TEST(ReadRouter, ServedByFollower) {
+  ScriptedServer server(follower({"$8\r\nfollower\r\n"}));
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  ReadRouter router(core, Members("127.0.0.1", server.getPort()), Options());
+
+  std::future<redisReplyPtr> fut = router.route(EncodedRequest::make("GET", "a"));
+  ASSERT_EQ(fut.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  ASSERT_REPLY(fut.get(), "follower");
+  ASSERT_EQ(core.tryGetNextToWrite(), nullptr);
+}
+
+TEST(ReadRouter, FallbackToLeaderOnMoved) {
+  ScriptedServer server(follower({"-MOVED 0 127.0.0.1:7777\r\n"}));
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  ReadRouter router(core, Members("127.0.0.1", server.getPort()), Options());
+
+  std::future<redisReplyPtr> fut = router.route(EncodedRequest::make("GET", "a"));
+
+  StagedRequest *req = waitForLeader(core);
+  ASSERT_NE(req, nullptr);
+  ASSERT_EQ(describeStaged(req), "*2\r\n$3\r\nGET\r\n$1\r\na\r\n");
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeStr("leader")));
+  ASSERT_REPLY(fut.get(), "leader");
+
+  // The follower is now avoided: straight to the leader
+  ASSERT_EQ(router.pickFollower(), ReadRouter::kNone);
+  fut = router.route(EncodedRequest::make("GET", "b"));
+  ASSERT_EQ(describeStaged(waitForLeader(core)), "*2\r\n$3\r\nGET\r\n$1\r\nb\r\n");
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeStr("leader")));
+  ASSERT_REPLY(fut.get(), "leader");
+}
+
+TEST(ReadRouter, FallbackToLeaderOnDeadFollower) {
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  ReadRouter router(core, Members("127.0.0.1", 1), Options());
+
+  std::future<redisReplyPtr> fut = router.route(EncodedRequest::make("GET", "a"));
+
+  StagedRequest *req = waitForLeader(core);
+  ASSERT_NE(req, nullptr);
+  ASSERT_TRUE(core.consumeResponse(ResponseBuilder::makeStr("leader")));
+  ASSERT_REPLY(fut.get(), "leader");
+}
+
+TEST(ReadRouter, NullptrOnShutdown) {
+  ScriptedServer server(follower({""}));
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  std::unique_ptr<ReadRouter> router(new ReadRouter(core, Members("127.0.0.1", server.getPort()), Options()));
+
+  std::future<redisReplyPtr> fut = router->route(EncodedRequest::make("GET", "a"));
+
+  // Wait until the follower holds on to it, then go away
+  for(size_t i = 0; i < 1000 && server.getCommands().size() < 2; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(server.getCommands(), std::vector<std::string>({"ACTIVATE-STALE-READS", "GET"}));
+
+  router.reset();
+  ASSERT_EQ(fut.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  ASSERT_EQ(fut.get(), nullptr);
+  ASSERT_EQ(core.tryGetNextToWrite(), nullptr);
+}
+
+TEST(ReadRouter, StreamedReadNotRetriedOnceForwarded) {
+  ScriptedServer server(follower({"*2\r\n$3\r\nabc\r\n", true}));
+  RecordingStreamer streamer;
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  ReadRouter router(core, Members("127.0.0.1", server.getPort()), Options());
+
+  std::future<redisReplyPtr> fut = streamer.promise.get_future();
+  router.routeStreaming(&streamer, EncodedRequest::make("LRANGE", "a", "0", "-1"));
+
+  // Half of the array made it through: Retrying on the leader would
+  // deliver it twice.
+  ASSERT_EQ(fut.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  ASSERT_EQ(fut.get(), nullptr);
+  ASSERT_EQ(streamer.events, 2u);
+  ASSERT_EQ(core.tryGetNextToWrite(), nullptr);
+  ASSERT_EQ(router.pickFollower(), ReadRouter::kNone);
+}
+
+TEST(ReadRouter, StreamedReadRetriedIfNothingForwarded) {
+  ScriptedServer server(follower({"-MOVED 0 127.0.0.1:7777\r\n"}));
+  RecordingStreamer streamer;
+  ConnectionCore core(nullptr, nullptr, BackpressureStrategy::Default(), true);
+  ReadRouter router(core, Members("127.0.0.1", server.getPort()), Options());
+
+  router.routeStreaming(&streamer, EncodedRequest::make("LRANGE", "a", "0", "-1"));
+
+  StagedRequest *req = waitForLeader(core);
+  ASSERT_NE(req, nullptr);
+  ASSERT_EQ(req->getStreamingCallback(), &streamer);
+  ASSERT_EQ(streamer.events, 0u);
+}
@@ -24,6 +24,12 @@
 #include <gtest/gtest.h>
 #include "qclient/ResponseBuilder.hh"
 #include "qclient/QClient.hh"
+#include "qclient/SSTR.hh"
+#include "reader/scanner.hh"
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <cmath>
 
 using namespace qclient;
 
@@ -42,3 +48,764 @@ TEST(ResponseBuilder, PushReplies) {
   );
 
 }
+
+TEST(ResponseBuilder, WritableTail) {
+  ResponseBuilder builder;
+  builder.setMaxUnusedBuffer(0);
+
+  std::string part1 = "*2\r\n$4\r\nab";
+  std::string part2 = "cd\r\n$3\r\naaa\r\n:5\r\n";
+
+  char *tail = builder.getWritableTail(4096);
+  ASSERT_NE(tail, nullptr);
+  memcpy(tail, part1.data(), part1.size());
+  builder.commitTail(part1.size());
+
+  redisReplyPtr reply;
+  ASSERT_EQ(builder.pull(reply), ResponseBuilder::Status::kIncomplete);
+
+  tail = builder.getWritableTail(part2.size());
+  ASSERT_NE(tail, nullptr);
+  memcpy(tail, part2.data(), part2.size());
+  builder.commitTail(part2.size());
+
+  ASSERT_EQ(builder.pull(reply), ResponseBuilder::Status::kOk);
+  ASSERT_EQ(describeRedisReply(reply),
+    "1) \"abcd\"\n"
+    "2) \"aaa\"\n"
+  );
+
+  ASSERT_EQ(builder.pull(reply), ResponseBuilder::Status::kOk);
+  ASSERT_EQ(reply->type, REDIS_REPLY_INTEGER);
+  ASSERT_EQ(reply->integer, 5);
+
+  ASSERT_EQ(builder.pull(reply), ResponseBuilder::Status::kIncomplete);
+}
+
+TEST(ReceiveBufferStrategy, AdaptiveReadSize) {
+  ReceiveBufferStrategy strategy = ReceiveBufferStrategy::WithLimits(1024, 8192, 0);
+
+  // Full reads grow the read size, up to the maximum
+  ASSERT_EQ(strategy.nextReadSize(1024, 1024), 2048u);
+  ASSERT_EQ(strategy.nextReadSize(4096, 4096), 8192u);
+  ASSERT_EQ(strategy.nextReadSize(8192, 8192), 8192u);
+
+  // Partial reads keep it as-is, mostly empty ones shrink it
+  ASSERT_EQ(strategy.nextReadSize(8192, 5000), 8192u);
+  ASSERT_EQ(strategy.nextReadSize(8192, 10), 4096u);
+  ASSERT_EQ(strategy.nextReadSize(1024, 10), 1024u);
+
+  ASSERT_EQ(ReceiveBufferStrategy::WithLimits(0, 0, 0).getMaxReadSize(), 1u);
+}
+
+TEST(ResponseBuilder, ArenaAllocation) {
+  std::string encoded = "*4\r\n$4\r\nabcd\r\n*2\r\n:7\r\n$-1\r\n+OK\r\n$5000\r\n" + std::string(5000, 'z') + "\r\n";
+
+  ResponseBuilder arenaBuilder;
+  ResponseBuilder mallocBuilder;
+  mallocBuilder.setArenaAllocation(false);
+  mallocBuilder.restart();
+
+  redisReplyPtr arenaReply, mallocReply;
+  for(size_t i = 0; i < encoded.size(); i++) {
+    arenaBuilder.feed(encoded.c_str() + i, 1);
+    mallocBuilder.feed(encoded.c_str() + i, 1);
+  }
+
+  ASSERT_EQ(arenaBuilder.pull(arenaReply), ResponseBuilder::Status::kOk);
+  ASSERT_EQ(mallocBuilder.pull(mallocReply), ResponseBuilder::Status::kOk);
+  ASSERT_EQ(describeRedisReply(arenaReply), describeRedisReply(mallocReply));
+
+  // The reply must survive the builder
+  arenaBuilder.restart();
+  ASSERT_EQ(arenaReply->elements, 4u);
+  ASSERT_EQ(arenaReply->element[1]->element[0]->integer, 7);
+  ASSERT_EQ(arenaReply->element[1]->element[1]->type, REDIS_REPLY_NIL);
+  ASSERT_EQ(std::string(arenaReply->element[3]->str, arenaReply->element[3]->len), std::string(5000, 'z'));
+  ASSERT_EQ(arenaReply->element[3]->str[5000], '\0');
+
+  // Replies are independent of each other
+  arenaBuilder.feed(":1\r\n:2\r\n");
+  redisReplyPtr reply1, reply2;
+  ASSERT_EQ(arenaBuilder.pull(reply1), ResponseBuilder::Status::kOk);
+  ASSERT_EQ(arenaBuilder.pull(reply2), ResponseBuilder::Status::kOk);
+  reply1.reset();
+  ASSERT_EQ(reply2->integer, 2);
+}
+
+TEST(ResponseBuilder, ArenaBenchmark) {
+  const size_t kElements = 100000;
+
+  std::ostringstream ss;
+  ss << "*" << kElements * 2 << "\r\n";
+  for(size_t i = 0; i < kElements; i++) {
+    std::string field = "field-" + std::to_string(i);
+    ss << "$" << field.size() << "\r\n" << field << "\r\n$5\r\nvalue\r\n";
+  }
+
+  std::string encoded = ss.str();
+
+  for(bool arena : {false, true}) {
+    ResponseBuilder builder;
+    builder.setArenaAllocation(arena);
+    builder.restart();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    builder.feed(encoded);
+
+    redisReplyPtr reply;
+    ASSERT_EQ(builder.pull(reply), ResponseBuilder::Status::kOk);
+    ASSERT_EQ(reply->elements, kElements * 2);
+
+    std::chrono::steady_clock::time_point parsed = std::chrono::steady_clock::now();
+    reply.reset();
+    std::chrono::steady_clock::time_point freed = std::chrono::steady_clock::now();
+
+    std::cout << (arena ? "Arena" : "Malloc") << " allocation, " << kElements * 2 << " elements: parse "
+              << std::chrono::duration_cast<std::chrono::microseconds>(parsed - start).count() << " us, free "
+              << std::chrono::duration_cast<std::chrono::microseconds>(freed - parsed).count() << " us" << std::endl;
+  }
+}
+
+TEST(ResponseBuilder, ZeroCopyReplies) {
+  ResponseBuilder builder;
+  builder.setZeroCopyReplies(true);
+  builder.restart();
+
+  std::string big(1000, 'b');
+  builder.feed("$1000\r\n" + big + "\r\n+OK\r\n");
+
+  redisReplyPtr reply1, reply2;
+  ASSERT_EQ(builder.pull(reply1), ResponseBuilder::Status::kOk);
+  ASSERT_EQ(builder.pull(reply2), ResponseBuilder::Status::kOk);
+  ASSERT_EQ(std::string(reply1->str, reply1->len), big);
+  ASSERT_EQ(reply1->str[reply1->len], '\0');
+  ASSERT_EQ(std::string(reply2->str, reply2->len), "OK");
+
+  // Lots more data arrives, forcing the reader to move on to new buffers -
+  // the old reply must not be affected.
+  for(size_t i = 0; i < 100; i++) {
+    builder.feed("$1000\r\n" + std::string(1000, 'a' + (i % 26)) + "\r\n");
+    redisReplyPtr other;
+    ASSERT_EQ(builder.pull(other), ResponseBuilder::Status::kOk);
+    ASSERT_EQ(std::string(other->str, other->len), std::string(1000, 'a' + (i % 26)));
+  }
+
+  ASSERT_EQ(std::string(reply1->str, reply1->len), big);
+
+  // ... and outlive the builder.
+  builder.restart();
+  ASSERT_EQ(std::string(reply1->str, reply1->len), big);
+}
+
+TEST(ResponseBuilder, ZeroCopyRepliesWithPartialReads) {
+  std::string encoded;
+  std::vector<std::string> expected;
+
+  for(size_t i = 0; i < 500; i++) {
+    std::string contents = std::to_string(i) + "-" + std::string((i * 37) % 3000, 'a' + (i % 26));
+    expected.push_back(contents);
+
+    if(i % 3 == 0) {
+      encoded += "*2\r\n$" + std::to_string(contents.size()) + "\r\n" + contents + "\r\n:" + std::to_string(i) + "\r\n";
+    }
+    else {
+      encoded += "$" + std::to_string(contents.size()) + "\r\n" + contents + "\r\n";
+    }
+  }
+
+  for(size_t chunkSize : {1u, 7u, 100u, 4096u}) {
+    ResponseBuilder builder;
+    builder.setZeroCopyReplies(true);
+    builder.setMaxUnusedBuffer(1024);
+    builder.restart();
+
+    std::vector<redisReplyPtr> replies;
+
+    // Alternate between both ways of receiving bytes
+    for(size_t pos = 0; pos < encoded.size(); pos += chunkSize) {
+      size_t len = std::min(chunkSize, encoded.size() - pos);
+
+      if((pos / chunkSize) % 2 == 0) {
+        builder.feed(encoded.c_str() + pos, len);
+      }
+      else {
+        char *tail = builder.getWritableTail(len);
+        ASSERT_NE(tail, nullptr);
+        memcpy(tail, encoded.c_str() + pos, len);
+        builder.commitTail(len);
+      }
+
+      redisReplyPtr reply;
+      while(builder.pull(reply) == ResponseBuilder::Status::kOk) {
+        replies.push_back(reply);
+      }
+    }
+
+    builder.restart();
+    ASSERT_EQ(replies.size(), expected.size());
+
+    for(size_t i = 0; i < replies.size(); i++) {
+      const redisReply *str = (i % 3 == 0) ? replies[i]->element[0] : replies[i].get();
+      ASSERT_EQ(std::string(str->str, str->len), expected[i]);
+      ASSERT_EQ(str->str[str->len], '\0');
+
+      if(i % 3 == 0) {
+        ASSERT_EQ(replies[i]->element[1]->integer, (long long) i);
+      }
+    }
+  }
+}
+
+namespace {
+
+//------------------------------------------------------------------------------
+// Records streaming events as text, string chunks are merged back together.
+//------------------------------------------------------------------------------
+class StreamRecorder : public QStreamingCallback {
+public:
+  virtual void handleResponse(redisReplyPtr &&reply) override {}
+
+  virtual void handleArray(size_t depth, size_t elements) override {
+    events.push_back(SSTR(depth << ": array " << elements));
+  }
+
+  virtual void handleStringChunk(size_t depth, const char *data, size_t len,
+    size_t offset, size_t total) override {
+
+    if(offset == 0) {
+      current.clear();
+    }
+
+    ASSERT_EQ(offset, current.size());
+    current.append(data, len);
+    chunks++;
+
+    if(offset + len == total) {
+      events.push_back(SSTR(depth << ": \"" << current << "\""));
+    }
+  }
+
+  virtual void handleElement(size_t depth, redisReplyPtr &&reply) override {
+    events.push_back(SSTR(depth << ": " << describeRedisReply(reply)));
+  }
+
+  std::vector<std::string> events;
+  std::string current;
+  size_t chunks = 0;
+};
+
+}
+
+TEST(ResponseBuilder, StreamingReplies) {
+  std::string encoded = "*4\r\n$3\r\nabc\r\n*3\r\n:7\r\n$0\r\n\r\n$-1\r\n*0\r\n+OK\r\n"
+    "$11\r\nhello world\r\n"
+    "-ERR something\r\n"
+    "*-1\r\n"
+    ":9\r\n";
+
+  std::vector<std::string> expected = {
+    "0: array 4",
+    "1: \"abc\"",
+    "1: array 3",
+    "2: (integer) 7",
+    "2: \"\"",
+    "2: (nil)",
+    "1: array 0",
+    "1: OK",
+    "0: \"hello world\"",
+  };
+
+  for(size_t chunkSize : {1u, 3u, 1000u}) {
+    ResponseBuilder builder;
+    StreamRecorder recorder;
+    std::vector<redisReplyPtr> replies;
+
+    for(size_t pos = 0; pos < encoded.size(); pos += chunkSize) {
+      builder.feed(encoded.c_str() + pos, std::min(chunkSize, encoded.size() - pos));
+
+      redisReplyPtr reply;
+      while(builder.pullStreaming(&recorder, reply) == ResponseBuilder::Status::kOk) {
+        replies.push_back(reply);
+      }
+    }
+
+    ASSERT_EQ(recorder.events, expected);
+    ASSERT_EQ(replies.size(), 5u);
+
+    // Streamed replies come back stripped
+    ASSERT_EQ(replies[0]->type, REDIS_REPLY_ARRAY);
+    ASSERT_EQ(replies[0]->elements, 0u);
+    ASSERT_EQ(replies[1]->type, REDIS_REPLY_STRING);
+    ASSERT_EQ(replies[1]->len, 0u);
+
+    // Anything else comes back whole
+    ASSERT_EQ(replies[2]->type, REDIS_REPLY_ERROR);
+    ASSERT_EQ(replies[3]->type, REDIS_REPLY_NIL);
+    ASSERT_EQ(replies[4]->integer, 9);
+  }
+}
+
+TEST(ResponseBuilder, StreamingHugeString) {
+  const size_t kLength = 8 * 1024 * 1024;
+  const size_t kChunkSize = 64 * 1024;
+
+  std::string contents;
+  contents.reserve(kLength);
+  for(size_t i = 0; contents.size() < kLength; i++) {
+    contents += std::to_string(i);
+  }
+  contents.resize(kLength);
+
+  std::string encoded = "$" + std::to_string(kLength) + "\r\n" + contents + "\r\n$3\r\nabc\r\n";
+
+  ResponseBuilder builder;
+  builder.setMaxUnusedBuffer(kChunkSize * 4);
+  StreamRecorder recorder;
+  std::vector<redisReplyPtr> replies;
+
+  for(size_t pos = 0; pos < encoded.size(); pos += kChunkSize) {
+    size_t len = std::min(kChunkSize, encoded.size() - pos);
+
+    char *tail = builder.getWritableTail(len);
+    ASSERT_NE(tail, nullptr);
+    memcpy(tail, encoded.c_str() + pos, len);
+    builder.commitTail(len);
+
+    redisReplyPtr reply;
+    while(builder.pull(reply) == ResponseBuilder::Status::kOk) {
+      replies.push_back(reply);
+    }
+  }
+
+  ASSERT_EQ(replies.size(), 2u);
+  ASSERT_EQ(replies[0]->len, kLength);
+
+  // Now once more, streamed. The string is handed out as it arrives.
+  replies.clear();
+
+  for(size_t pos = 0; pos < encoded.size(); pos += kChunkSize) {
+    size_t len = std::min(kChunkSize, encoded.size() - pos);
+
+    char *tail = builder.getWritableTail(len);
+    ASSERT_NE(tail, nullptr);
+    memcpy(tail, encoded.c_str() + pos, len);
+    builder.commitTail(len);
+
+    redisReplyPtr reply;
+    while(builder.pullStreaming(&recorder, reply) == ResponseBuilder::Status::kOk) {
+      replies.push_back(reply);
+    }
+  }
+
+  ASSERT_EQ(replies.size(), 2u);
+  ASSERT_EQ(recorder.events.size(), 2u);
+  ASSERT_EQ(recorder.events[0], "0: \"" + contents + "\"");
+  ASSERT_EQ(recorder.events[1], "0: \"abc\"");
+  ASSERT_GE(recorder.chunks, kLength / kChunkSize);
+}
+
+TEST(ResponseBuilder, StreamingProtocolError) {
+  ResponseBuilder builder;
+  StreamRecorder recorder;
+  redisReplyPtr reply;
+
+  builder.feed("*2\r\n$3\r\nabcXY");
+  ASSERT_EQ(builder.pullStreaming(&recorder, reply), ResponseBuilder::Status::kProtocolError);
+
+  builder.restart();
+  builder.feed("$12a\r\n");
+  ASSERT_EQ(builder.pullStreaming(&recorder, reply), ResponseBuilder::Status::kProtocolError);
+}
+
+namespace {
+
+//------------------------------------------------------------------------------
+// Parse all replies in the given string, fed chunkSize bytes at a time.
+//------------------------------------------------------------------------------
+std::vector<redisReplyPtr> parseAll(const std::string &encoded, size_t chunkSize,
+  bool arena, bool zeroCopy) {
+
+  ResponseBuilder builder;
+  builder.setArenaAllocation(arena);
+  builder.setZeroCopyReplies(zeroCopy);
+  builder.restart();
+
+  std::vector<redisReplyPtr> replies;
+
+  for(size_t pos = 0; pos < encoded.size(); pos += chunkSize) {
+    builder.feed(encoded.c_str() + pos, std::min(chunkSize, encoded.size() - pos));
+
+    redisReplyPtr reply;
+    ResponseBuilder::Status status;
+    while((status = builder.pull(reply)) == ResponseBuilder::Status::kOk) {
+      replies.push_back(reply);
+    }
+
+    EXPECT_EQ(status, ResponseBuilder::Status::kIncomplete);
+  }
+
+  return replies;
+}
+
+}
+
+TEST(ResponseBuilder, Resp3Types) {
+  std::string verbatim(100, 'v');
+
+  std::string encoded =
+    ",3.14\r\n"
+    ",-inf\r\n"
+    "#t\r\n"
+    "#f\r\n"
+    "_\r\n"
+    "(3492890328409238509324850943850943825024385\r\n"
+    "=15\r\ntxt:Some string\r\n"
+    "=104\r\nmkd:" + verbatim + "\r\n"
+    "!21\r\nSYNTAX invalid syntax\r\n"
+    "%2\r\n$5\r\nfield\r\n:1\r\n$3\r\nset\r\n~2\r\n$1\r\na\r\n#t\r\n"
+    "~0\r\n"
+    "*3\r\n%0\r\n,1e10\r\n>2\r\n$3\r\nfoo\r\n_\r\n";
+
+  for(size_t chunkSize : {1u, 5u, 4096u}) {
+    for(int mode = 0; mode < 3; mode++) {
+      std::vector<redisReplyPtr> replies = parseAll(encoded, chunkSize, mode != 0, mode == 2);
+      ASSERT_EQ(replies.size(), 12u);
+
+      ASSERT_EQ(replies[0]->type, REDIS_REPLY_DOUBLE);
+      ASSERT_EQ(replies[0]->dval, 3.14);
+      ASSERT_EQ(std::string(replies[0]->str, replies[0]->len), "3.14");
+      ASSERT_EQ(describeRedisReply(replies[0]), "(double) 3.14");
+
+      ASSERT_EQ(replies[1]->type, REDIS_REPLY_DOUBLE);
+      ASSERT_TRUE(std::isinf(replies[1]->dval));
+      ASSERT_LT(replies[1]->dval, 0);
+
+      ASSERT_EQ(replies[2]->type, REDIS_REPLY_BOOL);
+      ASSERT_EQ(replies[2]->integer, 1);
+      ASSERT_EQ(describeRedisReply(replies[2]), "(true)");
+      ASSERT_EQ(replies[3]->type, REDIS_REPLY_BOOL);
+      ASSERT_EQ(replies[3]->integer, 0);
+
+      ASSERT_EQ(replies[4]->type, REDIS_REPLY_NIL);
+
+      ASSERT_EQ(replies[5]->type, REDIS_REPLY_BIGNUM);
+      ASSERT_EQ(describeRedisReply(replies[5]), "(big number) 3492890328409238509324850943850943825024385");
+
+      ASSERT_EQ(replies[6]->type, REDIS_REPLY_VERB);
+      ASSERT_EQ(std::string(replies[6]->vtype), "txt");
+      ASSERT_EQ(std::string(replies[6]->str, replies[6]->len), "Some string");
+
+      ASSERT_EQ(replies[7]->type, REDIS_REPLY_VERB);
+      ASSERT_EQ(std::string(replies[7]->vtype), "mkd");
+      ASSERT_EQ(std::string(replies[7]->str, replies[7]->len), verbatim);
+
+      ASSERT_EQ(replies[8]->type, REDIS_REPLY_ERROR);
+      ASSERT_EQ(std::string(replies[8]->str, replies[8]->len), "SYNTAX invalid syntax");
+
+      ASSERT_EQ(replies[9]->type, REDIS_REPLY_MAP);
+      ASSERT_EQ(replies[9]->elements, 4u);
+      ASSERT_EQ(replies[9]->element[3]->type, REDIS_REPLY_SET);
+      ASSERT_EQ(describeRedisReply(replies[9]),
+        "1# \"field\" => (integer) 1\n"
+        "2# \"set\" => 1) \"a\"\n"
+        "            2) (true)\n");
+
+      ASSERT_EQ(replies[10]->type, REDIS_REPLY_SET);
+      ASSERT_EQ(replies[10]->elements, 0u);
+
+      ASSERT_EQ(replies[11]->type, REDIS_REPLY_ARRAY);
+      ASSERT_EQ(replies[11]->element[0]->type, REDIS_REPLY_MAP);
+      ASSERT_EQ(replies[11]->element[1]->dval, 1e10);
+      ASSERT_EQ(replies[11]->element[2]->type, REDIS_REPLY_PUSH);
+      ASSERT_EQ(replies[11]->element[2]->element[1]->type, REDIS_REPLY_NIL);
+    }
+  }
+}
+
+TEST(ResponseBuilder, Resp3Attributes) {
+  // Attributes are dropped, wherever they are - only what follows is kept.
+  std::string encoded =
+    "|1\r\n+key-popularity\r\n%2\r\n$1\r\na\r\n,0.19\r\n$1\r\nb\r\n,0.05\r\n"
+    "*2\r\n:2039123\r\n:9543892\r\n"
+    "*3\r\n:1\r\n|1\r\n+ttl\r\n:3600\r\n$3\r\nabc\r\n|0\r\n:3\r\n"
+    "|1\r\n$1\r\nx\r\n|1\r\n$1\r\ny\r\n:1\r\n:2\r\n+OK\r\n";
+
+  for(size_t chunkSize : {1u, 7u, 4096u}) {
+    for(int mode = 0; mode < 3; mode++) {
+      std::vector<redisReplyPtr> replies = parseAll(encoded, chunkSize, mode != 0, mode == 2);
+      ASSERT_EQ(replies.size(), 3u);
+
+      ASSERT_EQ(describeRedisReply(replies[0]), "1) (integer) 2039123\n2) (integer) 9543892\n");
+      ASSERT_EQ(describeRedisReply(replies[1]), "1) (integer) 1\n2) \"abc\"\n3) (integer) 3\n");
+      ASSERT_EQ(describeRedisReply(replies[2]), "OK");
+    }
+  }
+}
+
+TEST(ResponseBuilder, Resp3ProtocolErrors) {
+  for(const char *encoded : {",abc\r\n", ",\r\n", ", 1\r\n", "#x\r\n", "#tt\r\n",
+      "_x\r\n", "(12a\r\n", "(-\r\n", "=3\r\nabc\r\n", "=5\r\ntxt-a\r\n",
+      "*2\r\n|1\r\n:1\r\n#q\r\n"}) {
+
+    ResponseBuilder builder;
+    builder.feed(encoded);
+
+    redisReplyPtr reply;
+    ASSERT_EQ(builder.pull(reply), ResponseBuilder::Status::kProtocolError) << encoded;
+  }
+}
+
+TEST(ResponseBuilder, StreamingResp3Aggregates) {
+  std::string encoded = "%2\r\n$1\r\na\r\n~2\r\n:1\r\n$1\r\nb\r\n$1\r\nc\r\n,1.5\r\n"
+    "~1\r\n$1\r\nd\r\n"
+    ">2\r\n$7\r\nmessage\r\n$1\r\ne\r\n";
+
+  std::vector<std::string> expected = {
+    "0: array 4",
+    "1: \"a\"",
+    "1: array 2",
+    "2: (integer) 1",
+    "2: \"b\"",
+    "1: \"c\"",
+    "1: (double) 1.5",
+    "0: array 1",
+    "1: \"d\"",
+  };
+
+  for(size_t chunkSize : {1u, 3u, 1000u}) {
+    ResponseBuilder builder;
+    StreamRecorder recorder;
+    std::vector<redisReplyPtr> replies;
+
+    for(size_t pos = 0; pos < encoded.size(); pos += chunkSize) {
+      builder.feed(encoded.c_str() + pos, std::min(chunkSize, encoded.size() - pos));
+
+      redisReplyPtr reply;
+      while(builder.pullStreaming(&recorder, reply) == ResponseBuilder::Status::kOk) {
+        replies.push_back(reply);
+      }
+    }
+
+    ASSERT_EQ(recorder.events, expected);
+    ASSERT_EQ(replies.size(), 3u);
+
+    // Stripped, but of the right type
+    ASSERT_EQ(replies[0]->type, REDIS_REPLY_MAP);
+    ASSERT_EQ(replies[0]->elements, 0u);
+    ASSERT_EQ(replies[1]->type, REDIS_REPLY_SET);
+    ASSERT_EQ(replies[1]->elements, 0u);
+
+    // Never streamed
+    ASSERT_EQ(replies[2]->type, REDIS_REPLY_PUSH);
+    ASSERT_EQ(replies[2]->elements, 2u);
+  }
+}
+
+namespace {
+
+char* naiveSeekNewline(char *s, size_t len) {
+  for(size_t i = 0; i + 1 < len; i++) {
+    if(s[i] == '\r' && s[i+1] == '\n') return s + i;
+  }
+
+  return nullptr;
+}
+
+//------------------------------------------------------------------------------
+// Walk over a RESP stream using nothing but the scanner - skip over bulk
+// string contents, parse all lengths and integers. Returns number of items.
+//------------------------------------------------------------------------------
+size_t scanOnly(char *buf, size_t len) {
+  size_t pos = 0;
+  size_t items = 0;
+
+  while(pos < len) {
+    char *cr = respSeekNewline(buf + pos, len - pos);
+    if(cr == nullptr) return 0;
+
+    char type = buf[pos];
+    long long value = -1;
+
+    if(type == '$' || type == '*' || type == ':') {
+      if(!respParseInteger(buf + pos + 1, cr - buf - pos - 1, &value)) return 0;
+    }
+
+    pos = (cr - buf) + 2;
+    if(type == '$' && value >= 0) {
+      pos += value + 2;
+    }
+
+    items++;
+  }
+
+  return items;
+}
+
+std::vector<ScanLevel> supportedScanLevels() {
+  std::vector<ScanLevel> levels;
+  for(ScanLevel level : {ScanLevel::kScalar, ScanLevel::kSSE2, ScanLevel::kAVX2}) {
+    if(static_cast<int>(level) <= static_cast<int>(detectScanLevel())) {
+      levels.push_back(level);
+    }
+  }
+
+  return levels;
+}
+
+}
+
+TEST(RespScanner, SeekNewline) {
+  std::mt19937 rng(42);
+  const char alphabet[] = { 'a', '\r', '\n', 'b' };
+
+  for(ScanLevel level : supportedScanLevels()) {
+    ASSERT_EQ(setScanLevel(level), level);
+
+    for(size_t iteration = 0; iteration < 20000; iteration++) {
+      std::string str(rng() % 100, 'x');
+      size_t specials = rng() % 4;
+
+      for(size_t i = 0; i < specials && !str.empty(); i++) {
+        str[rng() % str.size()] = alphabet[rng() % 4];
+      }
+
+      char *data = (char*) str.data();
+      ASSERT_EQ(respSeekNewline(data, str.size()), naiveSeekNewline(data, str.size()))
+        << scanLevelToString(level) << " " << str;
+    }
+  }
+
+  setScanLevel(detectScanLevel());
+}
+
+TEST(RespScanner, ParseInteger) {
+  std::vector<std::pair<std::string, bool>> cases = {
+    {"0", true}, {"-0", false}, {"01", false}, {"-", false}, {"", false},
+    {"1", true}, {"-1", true}, {"12a", false}, {"+5", false}, {" 5", false},
+    {"123456789", true}, {"1234567890123456", true}, {"12345678901234567", true},
+    {"123456789012345678", true}, {"1234567890123456789", true},
+    {"9223372036854775807", true}, {"-9223372036854775808", true},
+    {"9223372036854775808", false}, {"-9223372036854775809", false},
+    {"99999999999999999999", false}, {"12345678:0123456", false},
+    {"1234567/0123456", false}, {"-1234567890123456", true}
+  };
+
+  std::mt19937_64 rng(42);
+  for(size_t i = 0; i < 10000; i++) {
+    std::string num = std::to_string(rng() >> (1 + rng() % 63));
+    cases.emplace_back(num, true);
+
+    num[rng() % num.size()] = "x:/ "[rng() % 4];
+    cases.emplace_back(num, false);
+  }
+
+  for(ScanLevel level : supportedScanLevels()) {
+    ASSERT_EQ(setScanLevel(level), level);
+
+    for(auto &testcase : cases) {
+      const std::string &str = testcase.first;
+      long long value = 0;
+
+      ASSERT_EQ(respParseInteger(str.data(), str.size(), &value), testcase.second) << scanLevelToString(level) << " " << str;
+
+      if(testcase.second) {
+        ASSERT_EQ(std::to_string(value), str) << scanLevelToString(level);
+      }
+    }
+  }
+
+  setScanLevel(detectScanLevel());
+}
+
+TEST(RespScanner, ThroughputBenchmark) {
+  const size_t kElements = 200000;
+  std::vector<std::pair<std::string, std::string>> corpora;
+
+  {
+    // SMEMBERS: many short members
+    std::ostringstream ss;
+    ss << "*" << kElements << "\r\n";
+    for(size_t i = 0; i < kElements; i++) {
+      std::string member = "member-" + std::to_string(i);
+      ss << "$" << member.size() << "\r\n" << member << "\r\n";
+    }
+    corpora.emplace_back("smembers", ss.str());
+  }
+
+  {
+    // LHSCAN page: cursor, then field / value pairs
+    std::ostringstream ss;
+    ss << "*2\r\n$14\r\nnext:cursor-42\r\n*" << kElements * 2 << "\r\n";
+    for(size_t i = 0; i < kElements; i++) {
+      std::string field = "f" + std::to_string(i * 7919);
+      std::string value = "/eos/user/file-" + std::to_string(i);
+      ss << "$" << field.size() << "\r\n" << field << "\r\n";
+      ss << "$" << value.size() << "\r\n" << value << "\r\n";
+    }
+    corpora.emplace_back("lhscan", ss.str());
+  }
+
+  {
+    // Pipelined integer replies, such as inode numbers or timestamps
+    std::ostringstream ss;
+    for(size_t i = 0; i < kElements; i++) {
+      ss << ":" << 1600000000000000ull + i * 104729 << "\r\n";
+    }
+    corpora.emplace_back("integers", ss.str());
+  }
+
+  {
+    // Pipelined status replies
+    std::ostringstream ss;
+    for(size_t i = 0; i < kElements; i++) {
+      ss << "+OK\r\n";
+    }
+    corpora.emplace_back("status", ss.str());
+  }
+
+  const size_t kRounds = 5;
+
+  for(auto &corpus : corpora) {
+    for(ScanLevel level : supportedScanLevels()) {
+      ASSERT_EQ(setScanLevel(level), level);
+
+      // The scanner alone
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      for(size_t round = 0; round < kRounds; round++) {
+        ASSERT_GT(scanOnly((char*) corpus.second.data(), corpus.second.size()), 0u);
+      }
+
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      double scanThroughput = (corpus.second.size() * kRounds) / seconds / (1024 * 1024 * 1024);
+
+      // Full parsing, including building the reply trees
+      std::chrono::nanoseconds elapsed(0);
+
+      for(size_t round = 0; round < kRounds; round++) {
+        ResponseBuilder builder;
+        builder.feed(corpus.second);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        redisReplyPtr reply;
+        size_t replies = 0;
+        while(builder.pull(reply) == ResponseBuilder::Status::kOk) {
+          replies++;
+        }
+
+        elapsed += std::chrono::steady_clock::now() - start;
+        ASSERT_GT(replies, 0u);
+      }
+
+      seconds = std::chrono::duration<double>(elapsed).count();
+      double parseThroughput = (corpus.second.size() * kRounds) / seconds / (1024 * 1024 * 1024);
+
+      std::cout << corpus.first << ", " << scanLevelToString(level) << ": scan "
+                << scanThroughput << " GB/s, full parse " << parseThroughput << " GB/s" << std::endl;
+    }
+  }
+
+  setScanLevel(detectScanLevel());
+}